@@ -5,6 +5,8 @@ set -e
 
 CC=${CC:-clang}
 CFLAGS="-std=c11 -Wall -Wextra -Werror -Wpedantic -Wshadow -Wformat=2 -Wnull-dereference -Wdouble-promotion -Wconversion -Wsign-conversion -Wstrict-prototypes -Wmissing-prototypes -Wvla -Wno-unused-parameter -Wno-unused-function -g -O0 -DDEBUG"
+BENCH_CFLAGS="${CFLAGS/-g -O0 -DDEBUG/-O2 -DNDEBUG}"
+LDFLAGS="-lm -lpthread"
 
 mkdir -p build
 
@@ -13,9 +15,13 @@ show_usage() {
     echo ""
     echo "Commands:"
     echo "  all           Build all tools (default)"
-    echo "  test          Build and run tests"
+    echo "  test [bin]    Build and run tests"
     echo "  debug         Build fft_debug tool"
     echo "  export        Build fft_export_images tool"
+    echo "  bench [bin]   Build and run benchmarks, writes build/bench.json"
+    echo "  gendisc [bin] Build fft_gen_disc and write a synthetic disc image"
+    echo "  replay        Build fft_replay tool"
+    echo "  cook [bin]    Build fft_cook and write build/fft.pack"
     echo "  clean         Clean build directory"
     echo ""
     echo "Environment variables:"
@@ -25,15 +31,25 @@ show_usage() {
 compile_tool() {
     local tool_name=$1
     local source_file=$2
-    $CC $CFLAGS -o "build/$tool_name" "$source_file" -I.
+    $CC $CFLAGS -o "build/$tool_name" "$source_file" -I. $LDFLAGS
     echo "Built: build/$tool_name"
 }
 
 case "${1:-all}" in
     "test")
         echo "Building and running tests..."
-        $CC $CFLAGS -o build/test test.c -I.
-        build/test
+        $CC $CFLAGS -o build/test test.c -I. $LDFLAGS
+        # Disc tests run on a synthetic disc when the real one isn't available.
+        BIN=${2:-../heretic/fft.bin}
+        if [ ! -f "$BIN" ]; then
+            compile_tool "fft_gen_disc" "tools/fft_gen_disc.c"
+            BIN=build/fft_synthetic.bin
+            build/fft_gen_disc "$BIN"
+        fi
+        build/test "$BIN"
+        # Again with the trace zones compiled out.
+        $CC $CFLAGS -DFFT_TEST_NO_TRACE -o build/test_no_trace test.c -I. $LDFLAGS
+        build/test_no_trace "$BIN"
         ;;
     
     "debug")
@@ -44,9 +60,39 @@ case "${1:-all}" in
         compile_tool "fft_export_images" "tools/fft_export_images.c"
         ;;
     
+    "bench")
+        $CC $BENCH_CFLAGS -o build/fft_bench tools/fft_bench.c -I. $LDFLAGS
+        echo "Built: build/fft_bench"
+        # Fall back to a synthetic disc when the real one isn't available.
+        BIN=${2:-../heretic/fft.bin}
+        if [ ! -f "$BIN" ]; then
+            compile_tool "fft_gen_disc" "tools/fft_gen_disc.c"
+            BIN=build/fft_synthetic.bin
+            build/fft_gen_disc "$BIN"
+        fi
+        build/fft_bench "$BIN" | tee build/bench.json
+        ;;
+    
+    "replay")
+        compile_tool "fft_replay" "tools/fft_replay.c"
+        ;;
+    
+    "cook")
+        compile_tool "fft_cook" "tools/fft_cook.c"
+        build/fft_cook "${2:-../heretic/fft.bin}" "${3:-build/fft.pack}"
+        ;;
+    
+    "gendisc")
+        compile_tool "fft_gen_disc" "tools/fft_gen_disc.c"
+        build/fft_gen_disc "${2:-build/fft_synthetic.bin}"
+        ;;
+    
     "all")
         compile_tool "fft_debug" "tools/fft_debug.c"
         compile_tool "fft_export_images" "tools/fft_export_images.c"
+        compile_tool "fft_gen_disc" "tools/fft_gen_disc.c"
+        compile_tool "fft_replay" "tools/fft_replay.c"
+        compile_tool "fft_cook" "tools/fft_cook.c"
         ;;
     
     "clean")
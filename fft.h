@@ -59,7 +59,7 @@ USAGE
         }
         ```
 WARNINGS
-    - This lib is not thread-safe
+    - A context (see fft_ctx_t) should only be used by one thread at a time
     - This lib uses ASSERTs in many places instead of returning errors
 
     Both of these will probably be addressed in the future. This library was
@@ -140,12 +140,125 @@ These functions are the main entrypoints for reading any data. Pass in the path
 to your PSX FFT BIN file to fft_init() at your program start and call
 fft_shutdown() at the end of your program to clean up resources.
 
+All state (the open BIN file, memory tracking and the prefetch cache) lives in a
+context. fft_init() sets up the default context. More contexts can be created
+with fft_ctx_create(), each with its own BIN file, to run independent workloads
+in one process.
+
+Every function uses the calling thread's current context. A thread uses the
+default context until fft_ctx_make_current() is called. Memory must be freed
+while any context is current; it is always returned to the context it was
+allocated from. Everything allocated from a context must be freed before
+fft_ctx_destroy(), which asserts that none is left.
+
+Example:
+    ```c
+    fft_ctx_t* ctx = fft_ctx_create("other.bin");
+    fft_ctx_make_current(ctx);
+    fft_map_data_t* map_data = fft_map_data_read(49);
+    fft_map_data_destroy(map_data);
+    fft_ctx_make_current(NULL); // Back to the default context
+    fft_ctx_destroy(ctx);
+    ```
+
 ================================================================================
 */
 
+typedef struct fft_ctx_t fft_ctx_t;
+
 void fft_init(const char* filename);
 void fft_shutdown(void);
 
+fft_ctx_t* fft_ctx_create(const char* filename);
+void fft_ctx_destroy(fft_ctx_t* ctx);
+void fft_ctx_make_current(fft_ctx_t* ctx);
+fft_ctx_t* fft_ctx_get_current(void);
+
+/*
+================================================================================
+Thread Pool
+================================================================================
+
+A small work-stealing thread pool for batch jobs. Each worker has its own task
+deque. Workers run their newest task first and steal the oldest task from other
+workers when they run out. Threads waiting on a pool help run tasks instead of
+sleeping.
+
+Batch functions take an fft_executor_t, so callers can share one pool, plug in
+their own scheduler, or pass NULL to run serially on the calling thread.
+
+Tasks run with the context that was current when they were submitted.
+
+Example:
+    ```c
+    fft_pool_t* pool = fft_pool_create(0); // One worker per CPU
+    fft_executor_t executor = fft_pool_executor(pool);
+    fft_instruction_table_t table = fft_instruction_table_read(&executor);
+    fft_instruction_table_destroy(&table);
+    fft_pool_destroy(pool);
+    ```
+
+================================================================================
+*/
+
+// Runs items [begin, end) of a parallel-for.
+typedef void (*fft_range_fn)(void* arg, uint32_t begin, uint32_t end);
+typedef void (*fft_task_fn)(void* arg);
+
+// fft_executor_t runs fn over [0, count) in chunks of at most grain items and
+// returns when all of them are done.
+typedef struct {
+    void (*parallel_for)(void* userdata, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg);
+    void* userdata;
+} fft_executor_t;
+
+// Runs a parallel-for on the executor, or serially if executor is NULL.
+void fft_executor_parallel_for(const fft_executor_t* executor, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg);
+
+typedef struct fft_pool_t fft_pool_t;
+
+fft_pool_t* fft_pool_create(uint32_t worker_count);
+void fft_pool_destroy(fft_pool_t* pool);
+uint32_t fft_pool_worker_count(const fft_pool_t* pool);
+
+void fft_pool_submit(fft_pool_t* pool, fft_task_fn fn, void* arg);
+void fft_pool_wait(fft_pool_t* pool);
+void fft_pool_parallel_for(fft_pool_t* pool, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg);
+fft_executor_t fft_pool_executor(fft_pool_t* pool);
+
+/*
+================================================================================
+Tracing
+================================================================================
+
+Define FFT_TRACE in the translation unit with FFT_IMPLEMENTATION to record when
+the disc reads and decoders start and end. Each thread records into its own
+ring buffer without locking. Once a buffer is full the oldest zones are
+overwritten.
+
+fft_trace_write() exports what has been recorded as Chrome trace JSON, which can
+be opened in chrome://tracing or https://ui.perfetto.dev. Call it, and
+fft_trace_reset(), while no library calls are running on other threads.
+
+Without FFT_TRACE the zones compile to nothing and fft_trace_write() returns
+false.
+
+Example:
+    ```c
+    #define FFT_TRACE
+    #define FFT_IMPLEMENTATION
+    #include "fft.h"
+
+    fft_map_data_t* map_data = fft_map_data_read(49);
+    fft_trace_write("map_49.json");
+    ```
+
+================================================================================
+*/
+
+bool fft_trace_write(const char* path);
+void fft_trace_reset(void);
+
 /*
 ================================================================================
 Fixed Point Types
@@ -629,6 +742,56 @@ typedef enum {
         F_FILE_COUNT // Automatically represents the count of files
 } fft_io_entry_e;
 
+/*
+================================================================================
+IO Statistics
+================================================================================
+
+The current context counts its disc activity, both in total and per file, so
+you can see what a workload reads without attaching strace. Reads are
+attributed to the file whose sectors contain them. Reads outside every indexed
+file (e.g. non-GNS map resources) are counted under files[F_FILE_COUNT].
+
+Seeks and syscalls count the stdio calls made, which is an upper bound on the
+actual system calls since stdio may buffer. time_ns is the wall time spent in
+them, not including time waiting for the IO lock. The cache counters are for
+the prefetcher's scenario bundle cache.
+
+Example:
+    ```c
+    #include <inttypes.h>
+
+    fft_io_stats_reset();
+    fft_map_data_t* map_data = fft_map_data_read(49);
+
+    fft_io_stats_t stats;
+    fft_io_stats_snapshot(&stats);
+    printf("%" PRIu64 " reads of TEST.EVT\n", stats.files[F_EVENT__TEST_EVT].reads);
+    ```
+
+================================================================================
+*/
+
+typedef struct {
+    uint64_t opens;    // Whole file reads with fft_io_open().
+    uint64_t reads;    // Read requests, each one or more contiguous sectors.
+    uint64_t sectors;  // Sectors read from the disc.
+    uint64_t bytes;    // Bytes returned to the caller.
+    uint64_t seeks;    // fseek() calls.
+    uint64_t syscalls; // fseek() and fread() calls.
+    uint64_t time_ns;  // Time spent seeking and reading.
+} fft_io_counters_t;
+
+typedef struct {
+    fft_io_counters_t total;
+    fft_io_counters_t files[F_FILE_COUNT + 1]; // Last entry is unindexed sectors.
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+} fft_io_stats_t;
+
+void fft_io_stats_snapshot(fft_io_stats_t* out_stats);
+void fft_io_stats_reset(void);
+
 /*
 ================================================================================
 Map state
@@ -961,6 +1124,14 @@ extern const fft_image_desc_t image_desc_list[FFT_IMAGE_DESC_COUNT];
 
 static fft_image_desc_t image_get_desc(fft_io_entry_e entry);
 
+// Decoded RGBA8 sizes in bytes of one image and of all of its palettes.
+static size_t fft_image_measure(fft_image_desc_t desc);
+static size_t fft_image_palette_measure(fft_image_desc_t desc);
+
+// Decodes one palettized image into fft_image_measure(desc) bytes of caller
+// storage, such as a mapped GPU buffer.
+static void fft_image_read_4bpp_palettized_into(fft_span_t* span, fft_image_desc_t desc, uint8_t pal_index, uint8_t* out_pixels);
+
 /*
 ================================================================================
 Mesh Header
@@ -981,9 +1152,8 @@ enum {
     FFT_MESH_HEADER_SIZE = 196, // Total size of mesh header in bytes
 };
 
-// These constants document the binary file offsets for each field in the mesh
-// header. They are kept for reference but are not used by the reading code,
-// which reads the header sequentially as a complete 196-byte structure.
+// These constants are the binary file offsets for each field in the mesh
+// header. The header layout table is built from them.
 enum {
     FFT_MESH_PTR_GEOMETRY = 0x40,
     FFT_MESH_PTR_CLUT_COLOR = 0x44,
@@ -1187,6 +1357,7 @@ typedef struct {
 } fft_geometry_t;
 
 static fft_geometry_t fft_geometry_read(fft_span_t* span);
+static void fft_geometry_read_into(fft_span_t* span, fft_geometry_t* out);
 
 /*
 ================================================================================
@@ -1251,6 +1422,7 @@ enum {
     FFT_TERRAIN_MAX_Y = 2, // Elevation
 
     FFT_TERRAIN_MAX_TILES = 256,
+    FFT_TERRAIN_TILE_SIZE = 8, // Size of a tile in bytes
     FFT_TERRAIN_TILE_WIDTH = 28,
     FFT_TERRAIN_TILE_DEPTH = 28,
     FFT_TERRAIN_TILE_HEIGHT = 12,
@@ -1356,6 +1528,7 @@ typedef struct {
 } fft_terrain_t;
 
 static fft_terrain_t fft_terrain_read(fft_span_t* span);
+static void fft_terrain_read_into(fft_span_t* span, fft_terrain_t* out);
 static const char* fft_terrain_surface_str(fft_terrain_surface_e value);
 static const char* fft_terrain_slope_str(fft_terrain_slope_e value);
 static const char* fft_terrain_shading_str(uint8_t value);
@@ -1409,7 +1582,16 @@ typedef struct {
 
 } fft_mesh_t;
 
+// fft_mesh_read() returns the mesh by value, which is large. Use
+// fft_mesh_read_into() to decode straight into storage the caller owns, such
+// as a heap allocated map or bundle, without a temporary on the stack.
 fft_mesh_t fft_mesh_read(fft_span_t* span);
+void fft_mesh_read_into(fft_span_t* span, fft_mesh_t* out);
+
+// Returns the mesh meta (which chunks are present, polygon and light counts)
+// without decoding the geometry, so vertex buffers can be sized up front. The
+// span is not advanced.
+fft_record_meta_t fft_mesh_measure(const fft_span_t* span);
 
 /*
 ================================================================================
@@ -1475,8 +1657,81 @@ enum {
 void fft_map_data_destroy(fft_map_data_t* map);
 fft_map_data_t* fft_map_data_read(int map_id);
 
+// Returns the bytes on the disc of the resources one map state uses: the primary
+// mesh, the state's alt mesh and its texture. Only the GNS records are read. This
+// sizes reads, not decoded output: use fft_mesh_measure() for mesh sizes, and a
+// texture always decodes to FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT RGBA8 pixels.
+uint32_t fft_map_state_disc_size(int map_id, fft_state_t state);
+
+// Reads every valid map. With an executor, maps are loaded in parallel. Without
+// one (NULL), a reader thread streams resources from the disc while the calling
+// thread decodes them. Entries for invalid maps are set to NULL.
+void fft_map_data_read_all(const fft_executor_t* executor, fft_map_data_t* out_maps[FFT_MAP_DESC_LIST_COUNT]);
+
+// Reads the texture of every state of every valid map and passes each one to
+// visit. Textures are only valid during the call. Reading overlaps decoding
+// like fft_map_data_read_all().
+typedef void (*fft_texture_visit_fn)(void* userdata, uint8_t map_id, const fft_texture_t* texture);
+void fft_map_texture_read_each(fft_texture_visit_fn visit, void* userdata);
+
 extern const fft_map_desc_t fft_map_list[FFT_MAP_DESC_LIST_COUNT];
 
+/*
+================================================================================
+Incremental Map Loading
+================================================================================
+
+fft_map_data_read() loads a whole map at once, which can take long enough to
+drop frames when called from a render loop. The map loader does the same work in
+small steps so it can be spread over several frames:
+
+  1. Read and parse the GNS records
+  2. Read one record's resource from the disc
+  3. Decode that resource (mesh geometry, texture, etc.)
+
+Steps 2 and 3 repeat for each record. fft_map_loader_update() runs steps until
+the time budget is used up, always running at least one step so the load makes
+progress.
+
+Example:
+    ```c
+    fft_map_loader_t loader;
+    fft_map_loader_begin(&loader, map_id);
+
+    // Each frame
+    if (fft_map_loader_update(&loader, 2000)) { // 2ms
+        fft_map_data_t* map_data = fft_map_loader_finish(&loader);
+    }
+    ```
+
+================================================================================
+*/
+
+typedef enum {
+    FFT_MAP_LOADER_STAGE_GNS,
+    FFT_MAP_LOADER_STAGE_READ,
+    FFT_MAP_LOADER_STAGE_DECODE,
+    FFT_MAP_LOADER_STAGE_DONE,
+} fft_map_loader_stage_e;
+
+typedef struct {
+    int map_id;
+    fft_map_loader_stage_e stage;
+    uint8_t record_index;
+    fft_span_t file; // Resource read but not decoded yet
+    fft_map_data_t* map_data;
+} fft_map_loader_t;
+
+void fft_map_loader_begin(fft_map_loader_t* loader, int map_id);
+bool fft_map_loader_step(fft_map_loader_t* loader);
+bool fft_map_loader_update(fft_map_loader_t* loader, uint32_t budget_us);
+
+// Returns the loaded map. The loader must be done. The caller owns the map.
+fft_map_data_t* fft_map_loader_finish(fft_map_loader_t* loader);
+
+// Stops a load in progress and frees everything it loaded so far.
+void fft_map_loader_cancel(fft_map_loader_t* loader);
+
 /*
 ================================================================================
 Scenarios
@@ -1552,6 +1807,197 @@ typedef struct {
 
 fft_scenario_t fft_scenario_get_scenario(uint32_t);
 
+// fft_scenario_table_t holds every scenario row decoded in a single pass over
+// ATTACK.OUT, along with secondary indexes for common lookups.
+//
+// Only rows referenced by a usable event (see fft_event_desc_list) are
+// validated and indexed. The rest are decoded as-is and marked not usable.
+//
+// Each index holds the scenario ids of the usable rows sorted by key, then by
+// id. Use fft_scenario_table_find() to get the ids matching a key.
+typedef enum {
+    FFT_SCENARIO_KEY_MAP_ID,
+    FFT_SCENARIO_KEY_EVENT_ID,
+    FFT_SCENARIO_KEY_ENTD_ID,
+    FFT_SCENARIO_KEY_NEXT_EVENT_ID,
+    FFT_SCENARIO_KEY_COUNT,
+} fft_scenario_key_e;
+
+typedef struct {
+    fft_scenario_t scenarios[FFT_SCENARIO_COUNT];
+    bool usable[FFT_SCENARIO_COUNT];
+    uint16_t usable_count;
+
+    uint16_t index_keys[FFT_SCENARIO_KEY_COUNT][FFT_SCENARIO_COUNT];
+    uint16_t index_ids[FFT_SCENARIO_KEY_COUNT][FFT_SCENARIO_COUNT];
+} fft_scenario_table_t;
+
+fft_scenario_table_t fft_scenario_table_read(void);
+
+// Returns the number of usable scenarios whose key equals value. out_ids points
+// at their ids, in ascending order, inside the table.
+uint16_t fft_scenario_table_find(const fft_scenario_table_t* table, fft_scenario_key_e key, uint16_t value, const uint16_t** out_ids);
+
+/*
+================================================================================
+Story Graph
+================================================================================
+
+The story graph links scenarios through their next_event_id. A scenario with a
+next step of FFT_NEXTSTEP_EVENT has an edge to every usable scenario whose
+event_id is the next_event_id. Other next steps (world map, reset) end a chain.
+
+Nodes are scenario ids. Adjacency is stored in compressed sparse row form. The
+successors of scenario N are edges[edge_offsets[N]..edge_offsets[N + 1]].
+
+Reachability, topological order and depth are computed once when the graph is
+built. Depth is the longest chain of scenarios leading to a node, so scenarios
+with the same depth happen at the same point in the story.
+
+Scenarios that are part of, or reachable from, a cycle cannot be ordered. They
+are left out of topo_order and have a depth of FFT_STORY_DEPTH_NONE. Only the
+scenarios on a cycle are reachable from themselves.
+
+Example:
+    ```c
+    static fft_scenario_table_t table;
+    static fft_story_graph_t graph;
+    table = fft_scenario_table_read();
+    graph = fft_story_graph_build(&table);
+
+    uint16_t path[FFT_SCENARIO_COUNT];
+    uint16_t length = fft_story_graph_shortest_path(&graph, from, to, path);
+    ```
+
+================================================================================
+*/
+
+enum {
+    FFT_STORY_EDGE_MAX = FFT_SCENARIO_COUNT * 4,
+    FFT_STORY_REACH_WORDS = (FFT_SCENARIO_COUNT + 31) / 32,
+    FFT_STORY_DEPTH_NONE = 0xFFFF,
+};
+
+typedef struct {
+    uint16_t edge_offsets[FFT_SCENARIO_COUNT + 1];
+    uint16_t edges[FFT_STORY_EDGE_MAX];
+    uint16_t edge_count;
+
+    // Bitset per scenario of every scenario reachable from it.
+    uint32_t reachable[FFT_SCENARIO_COUNT][FFT_STORY_REACH_WORDS];
+
+    uint16_t topo_order[FFT_SCENARIO_COUNT];
+    uint16_t topo_count;
+    uint16_t depth[FFT_SCENARIO_COUNT];
+} fft_story_graph_t;
+
+fft_story_graph_t fft_story_graph_build(const fft_scenario_table_t* table);
+uint16_t fft_story_graph_successors(const fft_story_graph_t* graph, uint16_t scenario_id, const uint16_t** out_ids);
+bool fft_story_graph_is_reachable(const fft_story_graph_t* graph, uint16_t from, uint16_t to);
+
+// Writes the scenario ids of the shortest path, including from and to, to
+// out_path and returns its length. Returns 0 if to is not reachable from from.
+uint16_t fft_story_graph_shortest_path(const fft_story_graph_t* graph, uint16_t from, uint16_t to, uint16_t out_path[FFT_SCENARIO_COUNT]);
+
+/*
+================================================================================
+ENTD
+================================================================================
+
+ENTD files hold the unit placements for battles. A scenario's entd_id selects
+one entry. There are four files of 128 entries each, BATTLE/ENTD1.ENT holding
+entries 0x000-0x07F, ENTD2.ENT 0x080-0x0FF and so on.
+
+Each entry is 640 bytes: 16 unit records of 40 bytes. Slots with a sprite set
+of 0 are empty. Decoding keeps only the fields below and drops empty slots.
+
++--------+------+-----------------------------------------------------+
+| Offset | Size | Description                                         |
++--------+------+-----------------------------------------------------+
+| 0x00   |    1 | sprite_set                                          |
+| 0x01   |    1 | flags (male, female, monster, join, formation, ...) |
+| 0x02   |    1 | name                                                |
+| 0x03   |    1 | level                                               |
+| 0x04   |    2 | birthday month, day                                 |
+| 0x06   |    1 | brave                                               |
+| 0x07   |    1 | faith                                               |
+| 0x08   |    2 | prerequisite job, job level                         |
+| 0x0A   |    1 | job                                                 |
+| 0x0B   |    1 | secondary skillset                                  |
+| 0x0C   |    2 | reaction                                            |
+| 0x0E   |    2 | support                                             |
+| 0x10   |    2 | movement                                            |
+| 0x12   |    5 | head, body, accessory, right hand, left hand        |
+| 0x17   |    1 | palette                                             |
+| 0x18   |    1 | presence, team (bits 4-5), control (bit 3)          |
+| 0x19   |    1 | x                                                   |
+| 0x1A   |    1 | y                                                   |
+| 0x1B   |    1 | facing (bits 0-1), upper level (bit 7)              |
+| 0x1C   |   12 | AI, trophy and targeting data (not decoded)         |
++--------+------+-----------------------------------------------------+
+
+Reference: https://ffhacktics.com/wiki/ENTD
+
+================================================================================
+*/
+
+enum {
+    FFT_ENTD_FILE_COUNT = 4,
+    FFT_ENTD_PER_FILE = 128,
+    FFT_ENTD_COUNT = FFT_ENTD_FILE_COUNT * FFT_ENTD_PER_FILE,
+    FFT_ENTD_UNIT_MAX = 16,
+    FFT_ENTD_UNIT_SIZE = 40,
+    FFT_ENTD_SIZE = FFT_ENTD_UNIT_MAX * FFT_ENTD_UNIT_SIZE,
+};
+
+typedef struct {
+    uint16_t reaction;
+    uint16_t support;
+    uint16_t movement;
+    uint8_t sprite_set;
+    uint8_t flags;
+    uint8_t name;
+    uint8_t level;
+    uint8_t brave;
+    uint8_t faith;
+    uint8_t job;
+    uint8_t secondary;
+    uint8_t head;
+    uint8_t body;
+    uint8_t accessory;
+    uint8_t right_hand;
+    uint8_t left_hand;
+    uint8_t palette;
+    uint8_t team;
+    uint8_t x;
+    uint8_t y;
+    uint8_t facing;
+    bool upper_level;
+    bool controllable;
+    uint8_t slot; // Position of the unit in the entry (0-15)
+} fft_entd_unit_t;
+
+typedef struct {
+    fft_entd_unit_t units[FFT_ENTD_UNIT_MAX];
+    uint8_t unit_count;
+} fft_entd_t;
+
+// fft_entd_table_t holds the units of every ENTD entry back to back. The units
+// of entry N are units[unit_offsets[N]..unit_offsets[N + 1]].
+typedef struct {
+    uint16_t unit_offsets[FFT_ENTD_COUNT + 1];
+    fft_entd_unit_t* units;
+    uint32_t unit_count;
+} fft_entd_table_t;
+
+fft_io_entry_e fft_entd_file(uint16_t entd_id);
+uint8_t fft_entd_decode(const uint8_t* data, fft_entd_unit_t out_units[FFT_ENTD_UNIT_MAX]);
+fft_entd_t fft_entd_get_entd(uint16_t entd_id);
+
+fft_entd_table_t fft_entd_table_read(void);
+void fft_entd_table_destroy(fft_entd_table_t* table);
+uint8_t fft_entd_table_units(const fft_entd_table_t* table, uint16_t entd_id, const fft_entd_unit_t** out_units);
+
 /*
 ================================================================================
 Event Opcodes
@@ -1773,6 +2219,76 @@ typedef struct {
 
 uint16_t fft_instructions_read(fft_span_t*, fft_instruction_t*);
 
+/*
+================================================================================
+Packed Event Instructions
+================================================================================
+
+fft_instruction_t expands every parameter into a tagged fft_param_t, so each
+instruction takes the space of 14 parameters even though most opcodes only have
+a few single byte parameters. Packed instructions leave the parameters in place
+in the code section and only record where each instruction starts, its opcode
+and its parameter layout. Parameters are decoded on demand.
+
++--------+------+------------------------------------------------+
+| Name   | Size | Description                                    |
++--------+------+------------------------------------------------+
+| offset |    2 | Offset of the opcode byte in the code section  |
+| opcode |    1 | fft_opcode_e                                   |
+| layout |    1 | Index into fft_param_layout_list               |
++--------+------+------------------------------------------------+
+
+The parameter layouts are generated from FFT_OPCODE_LIST. Layout 0 is reserved
+for opcodes we don't know about, which have no parameters.
+
+The code section must outlive the packed instructions since the parameters are
+read from it directly.
+
+Example:
+    ```c
+    fft_packed_instruction_t packed[FFT_INSTRUCTION_MAX];
+    uint16_t count = fft_instructions_pack(&code_span, packed);
+    for (uint16_t i = 0; i < count; i++) {
+        if (packed[i].opcode == FFT_OPCODE_CHANGEMAPBETA) {
+            uint16_t map_id = fft_packed_param(code_span.data, packed[i], 0);
+        }
+    }
+    ```
+
+================================================================================
+*/
+
+// Dense index for each opcode in FFT_OPCODE_LIST. Opcode values are sparse so
+// this lets the layout fit in a single byte.
+typedef enum {
+    FFT_PARAM_LAYOUT_NONE = 0,
+#define X(code, value, name, params, param_count) FFT_PARAM_LAYOUT_##code,
+    FFT_OPCODE_LIST
+#undef X
+        FFT_PARAM_LAYOUT_COUNT
+} fft_param_layout_e;
+
+typedef struct {
+    uint8_t param_sizes[FFT_OPCODE_PARAM_MAX];
+    uint8_t param_count;
+} fft_param_layout_t;
+
+extern const fft_param_layout_t fft_param_layout_list[FFT_PARAM_LAYOUT_COUNT];
+
+typedef struct {
+    uint16_t offset;
+    uint8_t opcode;
+    uint8_t layout;
+} fft_packed_instruction_t;
+
+uint16_t fft_instructions_pack(fft_span_t*, fft_packed_instruction_t*);
+// Returns the number of instructions fft_instructions_read() and
+// fft_instructions_pack() would produce. The span is not advanced.
+uint16_t fft_instructions_measure(const fft_span_t*);
+uint8_t fft_packed_param_count(fft_packed_instruction_t instruction);
+uint16_t fft_packed_param(const uint8_t* code, fft_packed_instruction_t instruction, uint8_t index);
+fft_instruction_t fft_packed_unpack(const uint8_t* code, fft_packed_instruction_t instruction);
+
 /*
 ================================================================================
 Font
@@ -1812,6 +2328,9 @@ enum {
 };
 
 size_t fft_text_read(fft_span_t*, char*);
+// Returns the length fft_text_read() would write, not counting the terminator.
+// The span is not advanced.
+size_t fft_text_measure(const fft_span_t*);
 size_t fft_text_count(const char*);
 size_t fft_text_by_index(const char* string, int index, char* buffer);
 
@@ -1868,1733 +2387,6391 @@ typedef struct {
     const char* name;
 } fft_event_desc_t;
 
-extern fft_event_desc_t event_desc_list[];
+extern fft_event_desc_t fft_event_desc_list[FFT_EVENT_COUNT];
 
 fft_event_t fft_event_get_event(uint32_t);
 
-static_assert(FFT_EVENT_COUNT == FFT_SCENARIO_COUNT, "Event/battle count mismatch");
+// Output sizes of an event, measured from its raw FFT_EVENT_SIZE bytes without
+// decoding it. Lets callers size their own message and instruction buffers
+// instead of using fft_event_t. valid is false for the invalid event marker.
+typedef struct {
+    size_t messages_len; // Not counting the terminator
+    uint16_t instruction_count;
+    bool valid;
+} fft_event_measure_t;
 
-#ifdef __cplusplus
-}
-#endif
+fft_event_measure_t fft_event_measure(const uint8_t* event_data);
 
-#endif // FFT_H
+// Reads every valid event and passes it to visit. Events are only valid during
+// the call. A reader thread streams TEST.EVT from the disc while the calling
+// thread decodes, so only a few chunks of the file are in memory at once.
+typedef void (*fft_event_visit_fn)(void* userdata, uint16_t event_id, const fft_event_t* event);
+void fft_event_read_each(fft_event_visit_fn visit, void* userdata);
+
+static_assert(FFT_EVENT_COUNT == FFT_SCENARIO_COUNT, "Event/battle count mismatch");
 
 /*
 ================================================================================
-                                 IMPLEMENTATION
+Event Interpreter
+================================================================================
 
-                                 IMPLEMENTATION
+The interpreter plays an event script headlessly. It doesn't render anything, it
+only tracks the parts of the scene that are useful for tooling: unit positions,
+the camera, messages shown, waits and branches. Time is measured in frames and
+only advances with FFT_OPCODE_WAIT.
+
+Each opcode is dispatched through a handler table indexed by the opcode byte.
+fft_vm_init() installs the default handlers, which can be replaced per opcode.
+A replacement handler can call fft_vm_default() to keep the default behavior.
+
+Conditions in the game depend on story and battle variables that we don't
+model. The default handlers keep the variables touched by the arithmetic
+opcodes and the comparison opcodes compare the last two arithmetic results.
+
+Parameter meanings are from https://ffhacktics.com/wiki/Event_Instructions
+
+Example:
+    ```c
+    fft_event_t event = fft_event_get_event(id);
+    fft_vm_t vm;
+    fft_vm_init_event(&vm, &event);
+    fft_vm_run(&vm);
+
+    char buffer[FFT_TEXT_MAX_LEN];
+    for (uint16_t i = 0; i < vm.message_count; i++) {
+        fft_text_by_index(event.messages, vm.messages[i].message_id, buffer);
+        printf("%u: %s\n", vm.messages[i].frame, buffer);
+    }
+    ```
 
-                                 IMPLEMENTATION
 ================================================================================
 */
 
-#ifdef FFT_IMPLEMENTATION
+enum {
+    FFT_VM_UNIT_MAX = 256,      // Unit ids are a single byte
+    FFT_VM_VARIABLE_MAX = 1024, // Variables outside of this range read as 0
+    FFT_VM_MESSAGE_MAX = 256,
+    FFT_VM_STEP_MAX = 65536,    // Guards against scripts that loop forever
+    FFT_VM_HANDLER_COUNT = 256,
+};
 
-#include <math.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+    uint8_t elevation;
+    uint8_t facing;
+    bool visible;
+} fft_vm_unit_t;
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint16_t angle;
+    uint16_t map_rotation;
+    uint16_t camera_rotation;
+    uint16_t zoom;
+} fft_vm_camera_t;
+
+typedef struct {
+    uint16_t message_id; // 1-based index for fft_text_by_index()
+    uint8_t unit_id;
+    uint32_t frame;
+} fft_vm_message_t;
+
+typedef struct fft_vm_t fft_vm_t;
+
+typedef void (*fft_vm_handler_fn)(fft_vm_t* vm, fft_packed_instruction_t instruction);
+
+struct fft_vm_t {
+    // Program
+    const uint8_t* code;
+    fft_packed_instruction_t instructions[FFT_INSTRUCTION_MAX];
+    uint16_t instruction_count;
+    uint16_t pc; // Index of the next instruction
+    uint32_t steps;
+    bool halted;
+    bool step_limit_reached;
+
+    // Scene state
+    uint32_t frame;
+    fft_vm_camera_t camera;
+    fft_vm_unit_t units[FFT_VM_UNIT_MAX];
+    uint16_t variables[FFT_VM_VARIABLE_MAX];
+    uint16_t results[2]; // Last two arithmetic results, used by comparisons
+    bool condition;
+
+    fft_vm_message_t messages[FFT_VM_MESSAGE_MAX];
+    uint16_t message_count;
+
+    fft_vm_handler_fn handlers[FFT_VM_HANDLER_COUNT];
+    void* userdata;
+};
+
+void fft_vm_init(fft_vm_t* vm, fft_span_t* code);
+void fft_vm_init_event(fft_vm_t* vm, const fft_event_t* event);
+bool fft_vm_step(fft_vm_t* vm);
+void fft_vm_run(fft_vm_t* vm);
+void fft_vm_default(fft_vm_t* vm, fft_packed_instruction_t instruction);
+uint16_t fft_vm_param(const fft_vm_t* vm, fft_packed_instruction_t instruction, uint8_t index);
 
 /*
 ================================================================================
-Global State
+Instruction Table
 ================================================================================
-*/
 
-// WARNING: This is not thread-safe and should be used in a single-threaded context.
-static struct {
-    struct {
-        FILE* file; // The main file handle for the FFT binary.
-    } io;
+The instruction table decodes the instructions of every event in TEST.EVT into
+columns. Each row is one instruction. Whole-game questions, like "all
+ChangeMapBeta parameters across all events", become scans over a few
+contiguous arrays instead of re-decoding every event.
 
-    struct {
-        size_t usage_peak;
-        size_t usage_total;
-        size_t usage_current;
-        size_t allocations_total;
-        size_t allocations_current;
-    } mem;
-} _fft_state;
++------------+----------+-------------------------------------------------+
+| Column     | Type     | Description                                     |
++------------+----------+-------------------------------------------------+
+| event_id   | uint16_t | Event the instruction belongs to                |
+| index      | uint16_t | Position of the instruction within the event    |
+| opcode     | uint8_t  | fft_opcode_e                                    |
+| params[N]  | uint16_t | Nth parameter, 0 if the opcode has fewer params |
++------------+----------+-------------------------------------------------+
+
+Events with the invalid event marker are skipped.
+
+Example:
+    ```c
+    fft_instruction_table_t table = fft_instruction_table_read(NULL);
+    uint32_t* rows = FFT_MEM_ALLOC(table.row_count * sizeof(uint32_t));
+    uint32_t count = fft_instruction_table_filter(&table, FFT_OPCODE_CHANGEMAPBETA, rows);
+    for (uint32_t i = 0; i < count; i++) {
+        printf("%d: %d\n", table.event_id[rows[i]], table.params[0][rows[i]]);
+    }
+    FFT_MEM_FREE(rows);
+    fft_instruction_table_destroy(&table);
+    ```
+
+================================================================================
+*/
+
+typedef struct {
+    uint32_t row_count;
+    uint16_t* event_id;
+    uint16_t* index;
+    uint8_t* opcode;
+    uint16_t* params[FFT_OPCODE_PARAM_MAX];
+} fft_instruction_table_t;
+
+// Events are decoded in parallel on executor, or serially if it is NULL.
+fft_instruction_table_t fft_instruction_table_read(const fft_executor_t* executor);
+void fft_instruction_table_destroy(fft_instruction_table_t* table);
+void fft_instruction_table_histogram(const fft_instruction_table_t* table, uint32_t out_counts[256]);
+uint32_t fft_instruction_table_filter(const fft_instruction_table_t* table, fft_opcode_e opcode, uint32_t* out_rows);
 
 /*
 ================================================================================
-Utilities
+Scenario Bundle
 ================================================================================
-*/
 
-// You can define these to change the memory allocation functions used by the library.
-//
-// #define FFT_MEM_ALLOC(size) malloc(size)
-// #define FFT_MEM_ALLOC_TAG(size, tag) malloc(size)
-// #define FFT_MEM_FREE(ptr) free(ptr)
-#ifndef FFT_MEM_ALLOC
-#    define FFT_MEM_ALLOC(size)          fft_mem_alloc(size, __FILE__, __LINE__, NULL);
-#    define FFT_MEM_ALLOC_TAG(size, tag) fft_mem_alloc(size, __FILE__, __LINE__, tag);
-#    define FFT_MEM_FREE(ptr)            fft_mem_free(ptr)
-#endif
+A scenario bundle is everything needed to open a battle: the scenario row, the
+map state it plays in, that state's texture and mesh, the event and the raw
+ENTD entry.
 
-// Macros for min/max operations.
-#define FFT_MAX(a, b) ((a) > (b) ? (a) : (b))
-#define FFT_MIN(a, b) ((a) < (b) ? (a) : (b))
+Loading reads only the bytes it needs. The scenario row and the map's GNS
+records come first because they say where everything else is. The texture,
+meshes, event and ENTD entry are then read in a single batch sorted by sector.
 
-// Bytes to kilobytes and megabytes.
-#define FFT_BYTES_TO_KB(x) ((double)(x) / 1024.0)
-#define FFT_BYTES_TO_MB(x) ((double)(x) / (1024.0 * 1024.0))
+The map state comes from the scenario's time and weather with the default
+layout. Scenario weather values with the high bits set (see fft_weather_e) use
+the low bits only. If the map has no texture for that state, the default state
+texture is used.
 
-// Usage:
-//   assert(condition, "Simple message");
-//   assert(condition, "Formatted message: %d, %s", value1, value2);
-#define FFT_ASSERT(cond, ...)                                   \
-    do {                                                        \
-        if (!(cond)) {                                          \
-            fprintf(stderr, "Assertion failed: " __VA_ARGS__);  \
-            fprintf(stderr, " at %s:%d\n", __FILE__, __LINE__); \
-            exit(EXIT_FAILURE);                                 \
-        }                                                       \
-    } while (0)
-
-// Print a byte as binary for debugging.
-// Example output: "label: 0b10101010"
-static void print_byte(const char* label, uint8_t byte) {
-    printf("%s: 0b", label);
-    for (int i = 7; i >= 0; i--) {
-        printf("%d", (byte >> i) & 1);
-    }
-    printf("\n");
-}
+Example:
+    ```c
+    fft_scenario_bundle_t* bundle = fft_scenario_bundle_load(scenario_id);
+    render(&bundle->primary_mesh, &bundle->texture);
+    fft_scenario_bundle_destroy(bundle);
+    ```
 
-/*
-================================================================================
-Fixed-Point Implementation
 ================================================================================
 */
 
-float fft_fixed16_to_f32(fft_fixed16_t value) {
-    return (float)value / FFT_FIXED16_ONE;
-}
+typedef struct {
+    fft_scenario_t scenario;
+    fft_state_t state;
+
+    fft_record_t records[FFT_RECORD_MAX];
+    uint8_t record_count;
+
+    fft_mesh_t primary_mesh;
+    fft_mesh_t state_mesh; // Alt mesh for the state, if has_state_mesh
+    bool has_state_mesh;
+    fft_texture_t texture;
+
+    fft_event_t event;
+    uint8_t entd[FFT_ENTD_SIZE];
+} fft_scenario_bundle_t;
+
+fft_scenario_bundle_t* fft_scenario_bundle_load(uint16_t scenario_id);
+void fft_scenario_bundle_destroy(fft_scenario_bundle_t* bundle);
 
 /*
 ================================================================================
-Span Implementation
+Prefetcher
+================================================================================
+
+The prefetcher loads scenario bundles on a background thread before they are
+needed. Call fft_prefetch_hint() with the scenario being viewed, and the
+scenarios that can follow it (next_step FFT_NEXTSTEP_EVENT with a matching
+event_id) are loaded into a small cache. fft_prefetch_take() then returns the
+cached bundle, waits for it if it is still loading, or loads it directly if it
+was never requested.
+
+The cache holds FFT_PREFETCH_SLOT_DEFAULT bundles. Use fft_prefetch_start_slots()
+to pick another size, up to FFT_PREFETCH_SLOT_MAX.
+
+The scenario table must outlive the prefetcher. Call fft_prefetch_stop() before
+fft_shutdown() so cached bundles are freed.
+
+Example:
+    ```c
+    fft_prefetch_start(&table);
+    fft_scenario_bundle_t* bundle = fft_prefetch_take(scenario_id);
+    fft_prefetch_hint(scenario_id);
+    view(bundle); // Successors load while this runs
+    fft_scenario_bundle_destroy(bundle);
+    fft_prefetch_stop();
+    ```
+
 ================================================================================
 */
 
 enum {
-    // This is the size of a map texture, which is the largest file size we read.
-    FFT_SPAN_MAX_BYTES = 131072,
+    FFT_PREFETCH_SLOT_DEFAULT = 4,
+    FFT_PREFETCH_SLOT_MAX = 32,
+    FFT_PREFETCH_QUEUE_MAX = 8,
 };
 
-static void fft_span_read_bytes(fft_span_t* f, size_t size, uint8_t* out_bytes) {
-    FFT_ASSERT(size <= FFT_SPAN_MAX_BYTES, "Too many bytes requested.");
-    memcpy(out_bytes, &f->data[f->offset], size);
-    f->offset += size;
-    return;
-}
-
-static void fft_span_set_offset(fft_span_t* f, size_t offset) {
-    FFT_ASSERT(offset <= f->size, "Seek out of bounds.");
-    f->offset = offset;
-}
-
-// FN_SPAN_READ is a macro that generates a read function for a specific type. It
-// reads the value, returns it and increments the offset.
-#define FFT_FN_SPAN_READ(name, type)                                                  \
-    static type fft_span_read_##name(fft_span_t* span) {                              \
-        FFT_ASSERT(span->offset + sizeof(type) <= span->size, "Out of bounds read."); \
-        type value;                                                                   \
-        memcpy(&value, &span->data[span->offset], sizeof(type));                      \
-        span->offset += sizeof(type);                                                 \
-        return value;                                                                 \
-    }
+void fft_prefetch_start(const fft_scenario_table_t* table);
+void fft_prefetch_start_slots(const fft_scenario_table_t* table, uint32_t slot_count);
+void fft_prefetch_stop(void);
+void fft_prefetch_hint(uint16_t scenario_id);
 
-FFT_FN_SPAN_READ(u8, uint8_t)
-FFT_FN_SPAN_READ(u16, uint16_t)
-FFT_FN_SPAN_READ(u32, uint32_t)
-FFT_FN_SPAN_READ(i8, int8_t)
-FFT_FN_SPAN_READ(i16, int16_t)
-FFT_FN_SPAN_READ(i32, int32_t)
+// The caller owns the returned bundle.
+fft_scenario_bundle_t* fft_prefetch_take(uint16_t scenario_id);
 
 /*
 ================================================================================
-Memory Implementation
+Access Log
 ================================================================================
-*/
 
-typedef struct fft_mem_alloc_header_t {
-    size_t size;
-    int32_t line;
-    const char* file;
-    const char* tag;
-    struct fft_mem_alloc_header_t* next;
-} fft_mem_alloc_header_t;
+The access log records the high-level requests a session makes (maps, events,
+scenarios, bundles and prefetches) with the time since recording started. The
+log can be replayed with tools/fft_replay.c to tune cache sizes and prefetching
+against real traffic instead of synthetic loops.
 
-static fft_mem_alloc_header_t* allocations_head = NULL;
+Only the calls made by the application are recorded, not the ones the library
+makes internally (e.g. the prefetcher loading bundles in the background).
+Recording is per context.
 
-static void fft_mem_init(void) {
-    _fft_state.mem.usage_peak = 0;
-    _fft_state.mem.usage_total = 0;
-    _fft_state.mem.usage_current = 0;
-    _fft_state.mem.allocations_total = 0;
-    _fft_state.mem.allocations_current = 0;
-}
+The log is a header followed by fft_access_record_t's in the byte order of the
+machine that recorded it.
 
-static void fft_mem_shutdown(void) {
-    if (_fft_state.mem.allocations_current != 0) {
-        printf("Memory leak detected: %zu allocations remaining\n", _fft_state.mem.allocations_current);
-        fft_mem_alloc_header_t* current = allocations_head;
-        while (current) {
-            printf("Leaked %zu bytes allocated from %s:%d\n", current->size, current->file, current->line);
-            if (current->tag != NULL) {
-                printf("\tTag: %s\n", current->tag);
-            }
-            current = current->next;
-        }
-    }
+Example:
+    ```c
+    fft_access_log_start("session.fftlog");
+    run_viewer();
+    fft_access_log_stop();
 
-    if (_fft_state.mem.usage_current != 0) {
-        printf("Memory leak detected: %zu bytes remaining\n", _fft_state.mem.usage_current);
-        printf("Memory usage peak: %0.2fMB\n", FFT_BYTES_TO_MB(_fft_state.mem.usage_peak));
-        printf("Memory usage total: %0.2fMB\n", FFT_BYTES_TO_MB(_fft_state.mem.usage_total));
-        printf("Memory allocations: %zu\n", _fft_state.mem.allocations_total);
+    fft_access_log_t log = fft_access_log_read("session.fftlog");
+    for (uint32_t i = 0; i < log.count; i++) {
+        printf("%s %u\n", fft_access_kind_str(log.records[i].kind), log.records[i].id);
     }
-}
+    fft_access_log_destroy(&log);
+    ```
 
-static void* fft_mem_alloc(size_t size, const char* file, int32_t line, const char* tag) {
-    fft_mem_alloc_header_t* header = calloc(1, sizeof(fft_mem_alloc_header_t) + size);
-    FFT_ASSERT(header != NULL, "Failed to allocate memory");
+================================================================================
+*/
 
-    header->size = size;
-    header->file = file;
-    header->line = line;
-    header->tag = tag;
+typedef enum {
+    FFT_ACCESS_MAP_READ,      // fft_map_data_read(), id is the map id
+    FFT_ACCESS_MAP_READ_ALL,  // fft_map_data_read_all()
+    FFT_ACCESS_MAP_TEXTURES,  // fft_map_texture_read_each()
+    FFT_ACCESS_MAP_LOADER,    // fft_map_loader_begin(), id is the map id
+    FFT_ACCESS_SCENARIO,      // fft_scenario_get_scenario(), id is the scenario id
+    FFT_ACCESS_EVENT,         // fft_event_get_event(), id is the event id
+    FFT_ACCESS_EVENT_EACH,    // fft_event_read_each()
+    FFT_ACCESS_ENTD,          // fft_entd_get_entd(), id is the entd id
+    FFT_ACCESS_BUNDLE,        // fft_scenario_bundle_load(), id is the scenario id
+    FFT_ACCESS_PREFETCH_HINT, // fft_prefetch_hint(), id is the scenario id
+    FFT_ACCESS_PREFETCH_TAKE, // fft_prefetch_take(), id is the scenario id
+    FFT_ACCESS_KIND_COUNT,
+} fft_access_kind_e;
 
-    header->next = allocations_head;
-    allocations_head = header;
+typedef struct {
+    uint64_t time_ns; // Since fft_access_log_start()
+    uint32_t id;
+    uint16_t kind; // fft_access_kind_e
+    uint16_t reserved;
+} fft_access_record_t;
 
-    _fft_state.mem.usage_current += size;
-    _fft_state.mem.usage_peak = FFT_MAX(_fft_state.mem.usage_peak, _fft_state.mem.usage_current);
-    _fft_state.mem.usage_total += size;
-    _fft_state.mem.allocations_total++;
-    _fft_state.mem.allocations_current++;
+typedef struct {
+    fft_access_record_t* records;
+    uint32_t count;
+} fft_access_log_t;
 
-    return (void*)(header + 1);
-}
+// Starts recording to path, replacing it. Returns false if it can't be opened.
+bool fft_access_log_start(const char* path);
+void fft_access_log_stop(void);
 
-static void fft_mem_free(void* ptr) {
-    if (ptr == NULL) {
-        return;
-    }
+// Returns an empty log if path can't be read or isn't an access log.
+fft_access_log_t fft_access_log_read(const char* path);
+void fft_access_log_destroy(fft_access_log_t* log);
 
-    fft_mem_alloc_header_t* header = ((fft_mem_alloc_header_t*)ptr) - 1;
+const char* fft_access_kind_str(fft_access_kind_e value);
 
-    // Remove from the linked list
-    fft_mem_alloc_header_t** current = &allocations_head;
-    while (*current) {
-        if (*current == header) {
-            *current = header->next;
-            break;
-        }
-        current = &((*current)->next);
-    }
+/*
+================================================================================
+Cooked Pack
+================================================================================
 
-    _fft_state.mem.allocations_current--;
-    _fft_state.mem.usage_current -= header->size;
+A pack is a file of data that has already been decoded from the disc: the
+scenario table, map records, meshes and textures, events and images. It is
+cooked once with tools/fft_cook.c and then memory mapped, so loading is a page
+fault instead of a decode, and the pages are shared by every process mapping
+the same pack. Reading a pack doesn't need fft_init().
+
+The file is a header, the entries, and a table of fft_pack_entry_t at the end
+sorted by kind, id and index. Each entry starts on a FFT_PACK_ALIGN boundary and
+is one of the structs below, followed by the arrays its offsets point at.
+Offsets are from the start of the entry.
+
+The structs are stored in the layout and byte order of the machine that cooked
+the pack. fft_pack_open() rejects a pack with a different version or struct
+layout, in which case it has to be cooked again.
+
+  - Meshes store only the polygons they use, not FFT_MESH_MAX_POLYGONS.
+  - Textures and images store one palette index per pixel, ready to upload as a
+    single channel texture. Image palettes are RGBA8, map textures use the
+    mesh clut.
+  - Events store their exact size messages and packed instructions.
+  - The scenario table is stored whole, so fft_scenario_table_find() works on
+    it in place.
 
-    free(header);
-}
+Example:
+    ```c
+    fft_pack_t pack;
+    if (fft_pack_open("fft.pack", &pack)) {
+        const fft_pack_mesh_t* mesh = fft_pack_mesh(&pack, map_id, 0);
+        render(fft_pack_mesh_polygons(mesh), mesh->meta.polygon_count);
+        fft_pack_close(&pack);
+    }
+    ```
 
-/*
-================================================================================
-IO/Filesystem Implementation
 ================================================================================
 */
 
 enum {
-    FFT_IO_SECTOR_SIZE = 2048,
-    FFT_IO_SECTOR_SIZE_RAW = 2352,
-    FFT_IO_SECTOR_HEADER_SIZE = 24,
+    FFT_PACK_VERSION = 1,
+    FFT_PACK_ALIGN = 64, // Alignment of every entry
 };
 
+typedef enum {
+    FFT_PACK_SCENARIOS, // fft_scenario_table_t
+    FFT_PACK_MAP,       // fft_pack_map_t, id is the map id
+    FFT_PACK_MESH,      // fft_pack_mesh_t, id is the map id, index is the mesh
+    FFT_PACK_TEXTURE,   // fft_pack_texture_t, id is the map id, index is the texture
+    FFT_PACK_EVENT,     // fft_pack_event_t, id is the event id
+    FFT_PACK_IMAGE,     // fft_pack_image_t, id is the index in image_desc_list
+    FFT_PACK_KIND_COUNT,
+} fft_pack_kind_e;
+
 typedef struct {
-    uint32_t sector;
-    uint32_t size;
-    char* name;
-} fft_io_desc_t;
+    uint16_t kind; // fft_pack_kind_e
+    uint16_t id;
+    uint16_t index;
+    uint16_t reserved;
+    uint64_t offset;
+    uint64_t size;
+} fft_pack_entry_t;
 
-// This is a list of description for all files in the filesystem.
-//
-// Result:
-//   const file_desc_t file_list[F_FILE_COUNT] = {
-//     [F_BATTLE_BIN] =      { .sector = 1000,  .size = 1397096, .name = "BATTLE.BIN"},
-//     [F_EVENT__TEST_EVT] = { .sector = 3707,  .size = 4096000, .name = "EVENT/TEST.EVT"},
-//     [F_MAP__MAP001_GNS] = { .sector = 11304, .size = 2388,    .name = "MAP/MAP000.GNS"},
-//     ...
-//   }
-const fft_io_desc_t fft_io_file_list[F_FILE_COUNT] = {
-#define X(oname, osector, osize, opath) [oname] = { .sector = osector, .size = osize, .name = opath },
-    FFT_IO_INDEX
-#undef X
-};
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t layout; // Hash of the struct sizes of the build that cooked it
+    uint32_t entry_count;
+    uint64_t entry_offset;
+} fft_pack_header_t;
+
+// The map's records and how many mesh and texture entries it has.
+typedef struct {
+    fft_record_t records[FFT_RECORD_MAX];
+    uint8_t record_count;
+    uint8_t mesh_count;
+    uint8_t texture_count;
+} fft_pack_map_t;
 
-static void fft_io_init(const char* filename) {
-    _fft_state.io.file = fopen(filename, "rb");
-    FFT_ASSERT(_fft_state.io.file != NULL, "Failed to open fft.bin");
-}
+// A mesh without its polygon array, followed by meta.polygon_count polygons.
+typedef struct {
+    fft_recordtype_e type; // Primary, alt or override
+    fft_state_t state;
+    fft_mesh_header_t header;
+    fft_clut_t clut;
+    fft_lighting_t lighting;
+    fft_terrain_t terrain;
+    fft_record_meta_t meta;
+    uint32_t polygons_offset;
+} fft_pack_mesh_t;
 
-static void fft_io_shutdown(void) {
-    fclose(_fft_state.io.file);
-}
+// FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT palette indices.
+typedef struct {
+    fft_state_t state;
+    uint32_t pixels_offset;
+} fft_pack_texture_t;
 
-static fft_io_desc_t fft_io_get_file_desc(uint32_t sector_start) {
-    for (size_t i = 0; i < F_FILE_COUNT; i++) {
-        if (fft_io_file_list[i].sector == sector_start) {
-            return fft_io_file_list[i];
-        }
-    }
-    return (fft_io_desc_t) { .sector = 0, .size = 0, .name = NULL };
-}
+// data is the raw event, and the packed instruction offsets are into its code
+// section (data + 4). messages is messages_len chars and a terminator.
+typedef struct {
+    uint8_t data[FFT_EVENT_SIZE];
+    uint32_t messages_len;
+    uint32_t message_count;
+    uint32_t instruction_count;
+    uint32_t messages_offset;
+    uint32_t instructions_offset;
+} fft_pack_event_t;
+
+// repeat images of width * height palette indices, and pal_count palettes of
+// FFT_IMAGE_PAL_COL_COUNT RGBA8 colors.
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t repeat;
+    uint32_t pal_count;
+    uint32_t pixels_offset;
+    uint32_t palettes_offset;
+} fft_pack_image_t;
 
-static fft_span_t fft_io_read(uint32_t sector_start, uint32_t size) {
-    uint32_t offset = 0;
-    uint32_t occupied_sectors = (uint32_t)ceil(size / (double)FFT_IO_SECTOR_SIZE);
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    const fft_pack_entry_t* entries;
+    uint32_t entry_count;
+} fft_pack_t;
+
+// Maps the pack at path. Returns false if it can't be mapped, isn't a pack,
+// was cooked by a build with a different version or struct layout, or has an
+// entry whose arrays don't fit inside it.
+bool fft_pack_open(const char* path, fft_pack_t* out);
+void fft_pack_close(fft_pack_t* pack);
+
+// Returns the entry or NULL if the pack doesn't have it. out_size is optional.
+const void* fft_pack_find(const fft_pack_t* pack, fft_pack_kind_e kind, uint16_t id, uint16_t index, uint64_t* out_size);
+
+const fft_scenario_table_t* fft_pack_scenarios(const fft_pack_t* pack);
+const fft_pack_map_t* fft_pack_map(const fft_pack_t* pack, uint8_t map_id);
+const fft_pack_mesh_t* fft_pack_mesh(const fft_pack_t* pack, uint8_t map_id, uint8_t index);
+const fft_pack_texture_t* fft_pack_texture(const fft_pack_t* pack, uint8_t map_id, uint8_t index);
+const fft_pack_event_t* fft_pack_event(const fft_pack_t* pack, uint16_t event_id);
+const fft_pack_image_t* fft_pack_image(const fft_pack_t* pack, uint32_t desc_index);
+
+const fft_polygon_t* fft_pack_mesh_polygons(const fft_pack_mesh_t* mesh);
+const uint8_t* fft_pack_texture_pixels(const fft_pack_texture_t* texture);
+const char* fft_pack_event_messages(const fft_pack_event_t* event);
+const fft_packed_instruction_t* fft_pack_event_instructions(const fft_pack_event_t* event);
+const uint8_t* fft_pack_image_pixels(const fft_pack_image_t* image, uint32_t repeat_index);
+const uint8_t* fft_pack_image_palette(const fft_pack_image_t* image, uint32_t pal_index);
+
+// Copies a packed mesh back into a full fft_mesh_t for code that expects one.
+void fft_pack_mesh_expand(const fft_pack_mesh_t* mesh, fft_mesh_t* out);
+
+// The writer appends entries to a new pack. fft_pack_writer_begin() returns
+// NULL if path can't be created. fft_pack_writer_end() writes the entry table,
+// frees the writer and returns false if any write failed. The add functions
+// other than fft_pack_writer_add() cook their entry from decoded data.
+typedef struct fft_pack_writer_t fft_pack_writer_t;
+
+fft_pack_writer_t* fft_pack_writer_begin(const char* path);
+bool fft_pack_writer_end(fft_pack_writer_t* writer);
+void fft_pack_writer_add(fft_pack_writer_t* writer, fft_pack_kind_e kind, uint16_t id, uint16_t index, const void* data, size_t size);
+void fft_pack_writer_add_scenarios(fft_pack_writer_t* writer, const fft_scenario_table_t* table);
+void fft_pack_writer_add_mesh(fft_pack_writer_t* writer, uint8_t map_id, uint8_t index, fft_recordtype_e type, const fft_mesh_t* mesh);
+void fft_pack_writer_add_map(fft_pack_writer_t* writer, uint8_t map_id, const fft_map_data_t* map_data);
+void fft_pack_writer_add_event(fft_pack_writer_t* writer, uint16_t event_id, const fft_event_t* event);
+void fft_pack_writer_add_image(fft_pack_writer_t* writer, uint32_t desc_index);
 
-    // Try to get the file descriptor to tag the allocation with a filename.
-    fft_io_desc_t desc = fft_io_get_file_desc(sector_start);
-    uint8_t* bytes = NULL;
-    if (desc.sector == 0 && desc.size == 0 && desc.name == NULL) {
-        bytes = FFT_MEM_ALLOC(size);
-    } else {
-        bytes = FFT_MEM_ALLOC_TAG(size, desc.name);
-    }
+/*
+================================================================================
+Shared Cache
+================================================================================
 
-    for (uint32_t i = 0; i < occupied_sectors; i++) {
-        int32_t seek_to = (int32_t)((sector_start + i) * FFT_IO_SECTOR_SIZE_RAW) + FFT_IO_SECTOR_HEADER_SIZE;
-        int32_t sn = fseek(_fft_state.io.file, seek_to, SEEK_SET);
-        FFT_ASSERT(sn == 0, "Failed to seek to sector");
+A shared cache lets a pool of worker processes decode each map and event once
+between them instead of once each. It is a named POSIX shared memory object
+holding the same entries as a cooked pack (see "Cooked Pack") and an index of
+them. The first process to ask for an entry decodes it and publishes it, and
+every other process reads it in place, so the decoded data is resident once
+however many workers there are.
+
+Entries are returned from a read-only mapping and stay valid until
+fft_shared_cache_close(). Nothing is moved or evicted, so once the cache is
+full the accessors return NULL and the caller has to decode on its own.
+
+The first process to open a name creates it with the given capacity, later
+ones use the size it was created with. The object outlives the processes until
+fft_shared_cache_unlink() removes it.
+
+The index is FFT_SHARED_CACHE_SLOT_COUNT slots claimed with compare and
+exchange, and entries are carved out of the cache with an atomic bump
+allocator, so there are no locks for a crashed worker to leave held. Waits on
+other processes give up after FFT_SHARED_CACHE_WAIT_MS: fft_shared_cache_open()
+returns NULL if the creator never finishes setting up the cache, and the
+accessors return NULL for an entry whose publisher never finishes. An entry
+left unfinished by a crashed worker stays that way, so the cache should be
+unlinked and created again after a crash.
 
-        uint8_t sector[FFT_IO_SECTOR_SIZE];
-        size_t rn = fread(sector, sizeof(uint8_t), FFT_IO_SECTOR_SIZE, _fft_state.io.file);
-        FFT_ASSERT(rn == FFT_IO_SECTOR_SIZE, "Failed to read correct number of bytes from sector");
+Example:
+    ```c
+    // In every worker
+    fft_shared_cache_t* cache = fft_shared_cache_open("/fft-cache", 256 * 1024 * 1024);
+    const fft_pack_mesh_t* mesh = fft_shared_cache_mesh(cache, map_id, 0);
+    render(fft_pack_mesh_polygons(mesh), mesh->meta.polygon_count);
+    fft_shared_cache_close(cache);
+    ```
 
-        size_t remaining_size = size - (size_t)offset;
-        size_t bytes_to_copy = (remaining_size < FFT_IO_SECTOR_SIZE) ? remaining_size : FFT_IO_SECTOR_SIZE;
+================================================================================
+*/
 
-        memcpy(bytes + offset, sector, bytes_to_copy);
-        offset += bytes_to_copy;
-    }
+enum {
+    FFT_SHARED_CACHE_VERSION = 1,
+    FFT_SHARED_CACHE_SLOT_COUNT = 8192, // Entries the index holds, a power of two
+    FFT_SHARED_CACHE_WAIT_MS = 30000,   // Longest wait on another process
+};
 
-    return (fft_span_t) {
-        .data = bytes,
-        .size = size,
-    };
-}
+typedef struct fft_shared_cache_t fft_shared_cache_t;
 
-static fft_span_t fft_io_open(fft_io_entry_e file) {
-    fft_io_desc_t desc = fft_io_file_list[file];
-    return fft_io_read(desc.sector, desc.size);
-}
+// Cooks the entry for a key into writer. Only called in the process that
+// publishes the key. Other entries it adds are published with it unless
+// another process already has them.
+typedef void (*fft_shared_cache_cook_fn)(void* userdata, fft_pack_writer_t* writer);
 
-static void fft_io_close(fft_span_t span) {
-    FFT_MEM_FREE((void*)span.data);
-    return;
-}
+// Opens the cache called name, a shm_open() name starting with a slash, and
+// creates it with capacity bytes for entries if it doesn't exist. Returns NULL
+// if it can't be opened or was created by a build with a different version or
+// struct layout.
+fft_shared_cache_t* fft_shared_cache_open(const char* name, size_t capacity);
+void fft_shared_cache_close(fft_shared_cache_t* cache);
+bool fft_shared_cache_unlink(const char* name);
+
+// Bytes of the cache used by entries so far, by every process.
+uint64_t fft_shared_cache_used(const fft_shared_cache_t* cache);
+
+// Returns the entry, calling cook to publish it if no process has yet. Returns
+// NULL if cook didn't add it or the cache is full. out_size is optional.
+const void* fft_shared_cache_get(fft_shared_cache_t* cache, fft_pack_kind_e kind, uint16_t id, uint16_t index,
+    fft_shared_cache_cook_fn cook, void* userdata, uint64_t* out_size);
+
+// These decode from the disc when publishing, which needs fft_init(). A map is
+// published with its meshes and textures. Events return NULL for invalid events.
+const fft_pack_map_t* fft_shared_cache_map(fft_shared_cache_t* cache, uint8_t map_id);
+const fft_pack_mesh_t* fft_shared_cache_mesh(fft_shared_cache_t* cache, uint8_t map_id, uint8_t index);
+const fft_pack_texture_t* fft_shared_cache_texture(fft_shared_cache_t* cache, uint8_t map_id, uint8_t index);
+const fft_pack_event_t* fft_shared_cache_event(fft_shared_cache_t* cache, uint16_t event_id);
 
 /*
 ================================================================================
-Map state Implementation
+Resident Maps
+================================================================================
+
+Keeps every map's decoded resources in memory, with the ones that are rarely
+used kept compressed. This is for applications that want all maps resident
+without the footprint of a fft_map_data_t per map.
+
+Resources are stored as cooked pack entries (see "Cooked Pack"), which already
+drop unused polygons and store textures as one palette index per pixel. With
+FFT_RESIDENT_COMPRESS_COLD, meshes and textures for states other than the
+default one are also compressed with fft_lz_compress(). With
+FFT_RESIDENT_COMPRESS_ALL every mesh and texture is.
+
+A compressed entry is decompressed when it is read, into one of hot_count
+buffers that are reused least recently used first. A pointer to a compressed
+entry stays valid until hot_count other compressed entries have been read, so
+reading a mesh and its texture needs a hot_count of at least 2. Pointers to
+uncompressed entries stay valid until fft_resident_destroy().
+
+Like a context, a resident store should only be used by one thread at a time.
+
+The codec is a byte oriented LZ77 with a 64KB window, in the spirit of LZ4. It
+trades ratio for decompression speed, and does well on palettized textures and
+the zero padding in mesh data.
+
+Example:
+    ```c
+    fft_resident_t* resident = fft_resident_create(FFT_RESIDENT_COMPRESS_COLD, 4);
+    fft_resident_add_all_maps(resident);
+
+    const fft_pack_mesh_t* mesh = fft_resident_mesh(resident, map_id, 0);
+    render(fft_pack_mesh_polygons(mesh), mesh->meta.polygon_count);
+    fft_resident_destroy(resident);
+    ```
+
 ================================================================================
 */
 
-static fft_state_t fft_default_state = (fft_state_t) {
-    .time = FFT_TIME_DAY,
-    .weather = FFT_WEATHER_NONE,
-    .layout = FFT_LAYOUT_DEFAULT,
-};
+// Largest compressed size of size bytes.
+size_t fft_lz_bound(size_t size);
 
-const char* fft_layout_str(fft_layout_e value) {
-    switch (value) {
-    case FFT_LAYOUT_DEFAULT:
-        return "Default";
-    case FFT_LAYOUT_ALTERNATE_A:
-        return "Alternate A";
-    case FFT_LAYOUT_ALTERNATE_B:
-        return "Alternate B";
-    case FFT_LAYOUT_ALTERNATE_C:
-        return "Alternate C";
-    case FFT_LAYOUT_ALTERNATE_D:
-        return "Alternate D";
-    case FFT_LAYOUT_ALTERNATE_E:
-        return "Alternate E";
-    default:
-        return "Unknown";
-    }
+// Compresses src into dst, which must hold fft_lz_bound(size) bytes. Returns
+// the compressed size.
+size_t fft_lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_capacity);
+
+// Decompresses src into dst. Returns false if src is malformed or doesn't
+// decompress to exactly dst_size bytes.
+bool fft_lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+typedef enum {
+    FFT_RESIDENT_COMPRESS_COLD, // Meshes and textures for states other than the default
+    FFT_RESIDENT_COMPRESS_ALL,  // Every mesh and texture
+} fft_resident_policy_e;
+
+typedef struct {
+    uint64_t raw_bytes;    // Cooked size of every entry
+    uint64_t stored_bytes; // Size in memory, compressed or not, not counting hot buffers
+    uint32_t entry_count;
+    uint32_t compressed_count;
+    uint64_t hot_hits; // Compressed entries read while still in a hot buffer
+    uint64_t decompressions;
+} fft_resident_stats_t;
+
+typedef struct fft_resident_t fft_resident_t;
+
+fft_resident_t* fft_resident_create(fft_resident_policy_e policy, uint32_t hot_count);
+void fft_resident_destroy(fft_resident_t* resident);
+
+// Cooks a map's records, meshes and textures into the store. A map can only be
+// added once. fft_resident_add_all_maps() reads every valid map one at a time,
+// so only one fft_map_data_t is alive at once.
+void fft_resident_add_map(fft_resident_t* resident, uint8_t map_id, const fft_map_data_t* map_data);
+void fft_resident_add_all_maps(fft_resident_t* resident);
+
+// Returns the entry, decompressing it if needed, or NULL if the store doesn't
+// have it. out_size is optional.
+const void* fft_resident_get(fft_resident_t* resident, fft_pack_kind_e kind, uint16_t id, uint16_t index, uint64_t* out_size);
+
+const fft_pack_map_t* fft_resident_map(fft_resident_t* resident, uint8_t map_id);
+const fft_pack_mesh_t* fft_resident_mesh(fft_resident_t* resident, uint8_t map_id, uint8_t index);
+const fft_pack_texture_t* fft_resident_texture(fft_resident_t* resident, uint8_t map_id, uint8_t index);
+
+fft_resident_stats_t fft_resident_stats(const fft_resident_t* resident);
+
+#ifdef __cplusplus
 }
+#endif
 
-static void validate_layout(fft_layout_e value) {
-    switch (value) {
-    case FFT_LAYOUT_DEFAULT:
-    case FFT_LAYOUT_ALTERNATE_A:
-    case FFT_LAYOUT_ALTERNATE_B:
-    case FFT_LAYOUT_ALTERNATE_C:
-    case FFT_LAYOUT_ALTERNATE_D:
-    case FFT_LAYOUT_ALTERNATE_E:
-        return;
-    default:
-        FFT_ASSERT(false, "Invalid layout value: %d", value);
-    }
+#endif // FFT_H
+
+/*
+================================================================================
+                                 IMPLEMENTATION
+
+                                 IMPLEMENTATION
+
+                                 IMPLEMENTATION
+================================================================================
+*/
+
+#ifdef FFT_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+================================================================================
+Context
+================================================================================
+*/
+
+struct fft_mem_alloc_header_t;
+struct fft_prefetch_t;
+
+// WARNING: Only IO and memory tracking are guarded by locks, so the prefetcher
+// can load in the background. Everything else in a context should be used from
+// one thread at a time.
+struct fft_ctx_t {
+    struct {
+        FILE* file; // The main file handle for the FFT binary.
+        fft_io_stats_t stats;
+        FILE* access_log; // Set while recording, see fft_access_log_start().
+        uint64_t access_log_start_ns;
+        pthread_mutex_t lock;
+    } io;
+
+    struct {
+        size_t usage_peak;
+        size_t usage_total;
+        size_t usage_current;
+        size_t allocations_total;
+        size_t allocations_current;
+        struct fft_mem_alloc_header_t* allocations_head;
+        pthread_mutex_t lock;
+    } mem;
+
+    struct fft_prefetch_t* prefetch; // Set while the prefetcher is running.
+};
+
+static fft_ctx_t _fft_ctx_default = {
+    .io = { .lock = PTHREAD_MUTEX_INITIALIZER },
+    .mem = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static _Thread_local fft_ctx_t* _fft_ctx_current = NULL;
+
+static fft_ctx_t* fft_ctx(void) {
+    return _fft_ctx_current != NULL ? _fft_ctx_current : &_fft_ctx_default;
 }
 
-const char* fft_time_str(fft_time_e value) {
-    switch (value) {
-    case FFT_TIME_DAY:
-        return "Day";
-    case FFT_TIME_NIGHT:
-        return "Night";
-    default:
-        return "Unknown";
+/*
+================================================================================
+Utilities
+================================================================================
+*/
+
+// You can define these to change the memory allocation functions used by the library.
+//
+// #define FFT_MEM_ALLOC(size) malloc(size)
+// #define FFT_MEM_ALLOC_TAG(size, tag) malloc(size)
+// #define FFT_MEM_FREE(ptr) free(ptr)
+#ifndef FFT_MEM_ALLOC
+#    define FFT_MEM_ALLOC(size)          fft_mem_alloc(size, __FILE__, __LINE__, NULL);
+#    define FFT_MEM_ALLOC_TAG(size, tag) fft_mem_alloc(size, __FILE__, __LINE__, tag);
+#    define FFT_MEM_FREE(ptr)            fft_mem_free(ptr)
+#endif
+
+// Macros for min/max operations.
+#define FFT_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define FFT_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Bytes to kilobytes and megabytes.
+#define FFT_BYTES_TO_KB(x) ((double)(x) / 1024.0)
+#define FFT_BYTES_TO_MB(x) ((double)(x) / (1024.0 * 1024.0))
+
+// Usage:
+//   assert(condition, "Simple message");
+//   assert(condition, "Formatted message: %d, %s", value1, value2);
+#define FFT_ASSERT(cond, ...)                                   \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "Assertion failed: " __VA_ARGS__);  \
+            fprintf(stderr, " at %s:%d\n", __FILE__, __LINE__); \
+            exit(EXIT_FAILURE);                                 \
+        }                                                       \
+    } while (0)
+
+// Current time in nanoseconds, for measuring durations.
+static uint64_t fft_time_now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+
+// Print a byte as binary for debugging.
+// Example output: "label: 0b10101010"
+static void print_byte(const char* label, uint8_t byte) {
+    printf("%s: 0b", label);
+    for (int i = 7; i >= 0; i--) {
+        printf("%d", (byte >> i) & 1);
     }
+    printf("\n");
 }
 
-static void validate_time(fft_time_e value) {
-    switch (value) {
-    case FFT_TIME_DAY:
-    case FFT_TIME_NIGHT:
-        return;
-    default:
-        FFT_ASSERT(false, "Invalid time value: %d", value);
+/*
+================================================================================
+Tracing Implementation
+================================================================================
+*/
+
+#ifdef FFT_TRACE
+
+enum {
+    FFT_TRACE_EVENT_MAX = 16384, // Per thread, must be a power of two
+};
+
+typedef struct {
+    const char* name;
+    uint64_t time_ns;
+    char phase; // 'B' for begin, 'E' for end
+} fft_trace_event_t;
+
+// Only the owning thread writes to a buffer. Buffers are never freed, so a
+// thread's zones can still be exported after it exits.
+typedef struct fft_trace_buffer_t {
+    fft_trace_event_t events[FFT_TRACE_EVENT_MAX];
+    atomic_uint_fast64_t count; // Total recorded, the ring holds the last FFT_TRACE_EVENT_MAX
+    uint32_t thread_id;
+    struct fft_trace_buffer_t* next;
+} fft_trace_buffer_t;
+
+static _Atomic(fft_trace_buffer_t*) _fft_trace_buffers = NULL;
+static atomic_uint _fft_trace_thread_count = 0;
+static _Thread_local fft_trace_buffer_t* _fft_trace_buffer = NULL;
+
+static fft_trace_buffer_t* fft_trace_buffer(void) {
+    if (_fft_trace_buffer == NULL) {
+        fft_trace_buffer_t* buffer = calloc(1, sizeof(fft_trace_buffer_t));
+        FFT_ASSERT(buffer != NULL, "Failed to allocate trace buffer");
+        buffer->thread_id = atomic_fetch_add(&_fft_trace_thread_count, 1) + 1;
+
+        // Push onto the list of all buffers.
+        fft_trace_buffer_t* head = atomic_load(&_fft_trace_buffers);
+        do {
+            buffer->next = head;
+        } while (!atomic_compare_exchange_weak(&_fft_trace_buffers, &head, buffer));
+
+        _fft_trace_buffer = buffer;
     }
+    return _fft_trace_buffer;
 }
 
-const char* fft_weather_str(fft_weather_e value) {
-    switch (value) {
-    case FFT_WEATHER_NONE:
-        return "None";
-    case FFT_WEATHER_NONE_ALT:
-        return "NoneAlt";
-    case FFT_WEATHER_NORMAL:
-        return "Normal";
-    case FFT_WEATHER_STRONG:
-        return "Strong";
-    case FFT_WEATHER_VERY_STRONG:
-        return "VeryStrong";
-    default:
-        return "Unknown";
+static void fft_trace_record(const char* name, char phase) {
+    fft_trace_buffer_t* buffer = fft_trace_buffer();
+    uint64_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+    buffer->events[count & (FFT_TRACE_EVENT_MAX - 1)] = (fft_trace_event_t) {
+        .name = name,
+        .time_ns = fft_time_now_ns(),
+        .phase = phase,
+    };
+    atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+#    define FFT_TRACE_BEGIN(name) fft_trace_record(name, 'B')
+#    define FFT_TRACE_END(name)   fft_trace_record(name, 'E')
+
+bool fft_trace_write(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
     }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    bool first = true;
+    for (fft_trace_buffer_t* buffer = atomic_load(&_fft_trace_buffers); buffer != NULL; buffer = buffer->next) {
+        uint64_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+        uint64_t start = count > FFT_TRACE_EVENT_MAX ? count - FFT_TRACE_EVENT_MAX : 0;
+        for (uint64_t i = start; i < count; i++) {
+            const fft_trace_event_t* event = &buffer->events[i & (FFT_TRACE_EVENT_MAX - 1)];
+            fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                first ? "" : ",", event->name, event->phase, (double)event->time_ns / 1000.0, buffer->thread_id);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
 }
 
-static void validate_weather(fft_weather_e value) {
-    switch (value) {
-    case FFT_WEATHER_NONE:
-    case FFT_WEATHER_NONE_ALT:
-    case FFT_WEATHER_NORMAL:
-    case FFT_WEATHER_STRONG:
-    case FFT_WEATHER_VERY_STRONG:
-    case FFT_WEATHER_UNKNOWN_0x10: // Allow this until we understand it
-    case FFT_WEATHER_UNKNOWN_0x20: // Allow this until we understand it
-        return;
-    default:
-        FFT_ASSERT(false, "Invalid weather value: %d", value);
+void fft_trace_reset(void) {
+    for (fft_trace_buffer_t* buffer = atomic_load(&_fft_trace_buffers); buffer != NULL; buffer = buffer->next) {
+        atomic_store(&buffer->count, 0);
     }
 }
 
-bool fft_state_is_equal(fft_state_t a, fft_state_t b) {
-    return a.time == b.time && a.weather == b.weather && a.layout == b.layout;
+#else
+
+#    define FFT_TRACE_BEGIN(name) ((void)0)
+#    define FFT_TRACE_END(name)   ((void)0)
+
+bool fft_trace_write(const char* path) {
+    (void)path;
+    return false;
 }
 
-bool fft_state_is_default(fft_state_t map_state) {
-    return fft_state_is_equal(fft_default_state, map_state);
+void fft_trace_reset(void) {
 }
 
+#endif
+
 /*
 ================================================================================
-GNS/Records Implementation
+Fixed-Point Implementation
 ================================================================================
 */
 
-const char* fft_record_unknown_str(fft_record_unknown_e value) {
-    switch (value) {
-    case FFT_RECORD_UNKNOWN_0x22:
-        return "0x22";
-    case FFT_RECORD_UNKNOWN_0x30:
-        return "0x30";
-    case FFT_RECORD_UNKNOWN_0x70:
-        return "0x70";
-    default:
-        return "Unknown";
+float fft_fixed16_to_f32(fft_fixed16_t value) {
+    return (float)value / FFT_FIXED16_ONE;
+}
+
+// Reference version of fft_fixed16_to_f32_array(). The fast version has to
+// match it bit for bit.
+static void fft_fixed16_to_f32_array_ref(const fft_fixed16_t* values, size_t count, float* out_values) {
+    for (size_t i = 0; i < count; i++) {
+        out_values[i] = fft_fixed16_to_f32(values[i]);
     }
 }
 
-static void validate_gns_unknown(fft_record_unknown_e value) {
-    switch (value) {
-    case FFT_RECORD_UNKNOWN_0x22:
-    case FFT_RECORD_UNKNOWN_0x30:
-    case FFT_RECORD_UNKNOWN_0x70:
-        return;
-    default:
-        FFT_ASSERT(false, "Invalid Record unknown value: %d", value);
+// Batch version of fft_fixed16_to_f32(). Nothing in the library converts
+// arrays yet, it is kept here so the tests and bench can check the kernel.
+static void fft_fixed16_to_f32_array(const fft_fixed16_t* values, size_t count, float* out_values) {
+    // 1.0 is a power of two, so multiplying by its reciprocal is exact and
+    // gives the same result as the division.
+    const float scale = 1.0f / FFT_FIXED16_ONE;
+    for (size_t i = 0; i < count; i++) {
+        out_values[i] = (float)values[i] * scale;
+    }
+}
+
+/*
+================================================================================
+Span Implementation
+================================================================================
+*/
+
+enum {
+    // This is the size of a map texture, which is the largest file size we read.
+    FFT_SPAN_MAX_BYTES = 131072,
+};
+
+static void fft_span_read_bytes(fft_span_t* f, size_t size, uint8_t* out_bytes) {
+    FFT_ASSERT(size <= FFT_SPAN_MAX_BYTES, "Too many bytes requested.");
+    FFT_ASSERT(size <= f->size - f->offset, "Out of bounds read.");
+    memcpy(out_bytes, &f->data[f->offset], size);
+    f->offset += size;
+    return;
+}
+
+static void fft_span_set_offset(fft_span_t* f, size_t offset) {
+    FFT_ASSERT(offset <= f->size, "Seek out of bounds.");
+    f->offset = offset;
+}
+
+// FN_SPAN_READ is a macro that generates a read function for a specific type. It
+// reads the value, returns it and increments the offset.
+#define FFT_FN_SPAN_READ(name, type)                                                  \
+    static type fft_span_read_##name(fft_span_t* span) {                              \
+        FFT_ASSERT(span->offset + sizeof(type) <= span->size, "Out of bounds read."); \
+        type value;                                                                   \
+        memcpy(&value, &span->data[span->offset], sizeof(type));                      \
+        span->offset += sizeof(type);                                                 \
+        return value;                                                                 \
+    }
+
+FFT_FN_SPAN_READ(u8, uint8_t)
+FFT_FN_SPAN_READ(u16, uint16_t)
+FFT_FN_SPAN_READ(u32, uint32_t)
+FFT_FN_SPAN_READ(i8, int8_t)
+FFT_FN_SPAN_READ(i16, int16_t)
+FFT_FN_SPAN_READ(i32, int32_t)
+
+// FN_SPAN_READ_ARRAY is a macro that generates a bulk read function for a
+// specific type. It reads count values into out_values with a single bounds
+// check and copy, and increments the offset. Use these in decode loops instead
+// of reading one value at a time. Like the single reads, values are copied in
+// host byte order, which is little-endian on every supported target.
+#define FFT_FN_SPAN_READ_ARRAY(name, type)                                                       \
+    static void fft_span_read_##name##_array(fft_span_t* span, size_t count, type* out_values) { \
+        FFT_ASSERT(count <= (span->size - span->offset) / sizeof(type), "Out of bounds read.");  \
+        memcpy(out_values, &span->data[span->offset], count * sizeof(type));                     \
+        span->offset += count * sizeof(type);                                                    \
+    }
+
+FFT_FN_SPAN_READ_ARRAY(u8, uint8_t)
+FFT_FN_SPAN_READ_ARRAY(u16, uint16_t)
+FFT_FN_SPAN_READ_ARRAY(u32, uint32_t)
+FFT_FN_SPAN_READ_ARRAY(i8, int8_t)
+FFT_FN_SPAN_READ_ARRAY(i16, int16_t)
+FFT_FN_SPAN_READ_ARRAY(i32, int32_t)
+
+// Fixed size structs on the disc are described by layout tables, the same way
+// FFT_IO_INDEX describes the files. A table is a macro that takes three macros
+// and lists each field of the struct with one of them:
+//
+//   F(field, type, wire, offset)                 // Load a value
+//   B(field, type, wire, offset, shift, width)   // Load a value and extract bits
+//   A(field, type, wire, offset, count)          // Load an array of values
+//
+// field is the destination in the decoded struct (e.g. state.time), type is its
+// type, wire is how it is stored (u8, u16, u32, i8, i16 or i32) and offset is
+// the byte offset in the struct.
+//
+// FFT_FN_LAYOUT_DECODE() generates the decoders for a table:
+//   fft_<name>_decode(bytes, out):              Decode one struct from bytes.
+//   fft_<name>_decode_array(bytes, count, out): Decode count consecutive structs.
+//   fft_<name>_read(span, out):                 Decode one struct from a span.
+//
+// Every field is checked to be inside the struct at compile time, and reads
+// from a span are bounds checked once per struct. Loads are at fixed offsets
+// without branches, so validation of the values is left to the caller.
+enum {
+    FFT_LAYOUT_WIRE_SIZE_u8 = 1,
+    FFT_LAYOUT_WIRE_SIZE_u16 = 2,
+    FFT_LAYOUT_WIRE_SIZE_u32 = 4,
+    FFT_LAYOUT_WIRE_SIZE_i8 = 1,
+    FFT_LAYOUT_WIRE_SIZE_i16 = 2,
+    FFT_LAYOUT_WIRE_SIZE_i32 = 4,
+};
+
+#define FFT_FN_LAYOUT_LOAD(name, type)                         \
+    static type fft_layout_load_##name(const uint8_t* bytes) { \
+        type value;                                            \
+        memcpy(&value, bytes, sizeof(type));                   \
+        return value;                                          \
+    }
+
+FFT_FN_LAYOUT_LOAD(u8, uint8_t)
+FFT_FN_LAYOUT_LOAD(u16, uint16_t)
+FFT_FN_LAYOUT_LOAD(u32, uint32_t)
+FFT_FN_LAYOUT_LOAD(i8, int8_t)
+FFT_FN_LAYOUT_LOAD(i16, int16_t)
+FFT_FN_LAYOUT_LOAD(i32, int32_t)
+
+#define FFT_LAYOUT_CHECK_FIELD(field, type, wire, offset) \
+    static_assert((offset) + FFT_LAYOUT_WIRE_SIZE_##wire <= FFT_LAYOUT_SIZE, "Layout field out of bounds: " #field);
+#define FFT_LAYOUT_CHECK_BITS(field, type, wire, offset, shift, width)                                               \
+    static_assert((offset) + FFT_LAYOUT_WIRE_SIZE_##wire <= FFT_LAYOUT_SIZE, "Layout field out of bounds: " #field); \
+    static_assert((shift) + (width) <= FFT_LAYOUT_WIRE_SIZE_##wire * 8, "Layout bits out of range: " #field);
+#define FFT_LAYOUT_CHECK_ARRAY(field, type, wire, offset, count) \
+    static_assert((offset) + (FFT_LAYOUT_WIRE_SIZE_##wire * (count)) <= FFT_LAYOUT_SIZE, "Layout field out of bounds: " #field);
+
+#define FFT_LAYOUT_LOAD_FIELD(field, type, wire, offset) \
+    out->field = (type)fft_layout_load_##wire(&bytes[offset]);
+#define FFT_LAYOUT_LOAD_BITS(field, type, wire, offset, shift, width) \
+    out->field = (type)(((uint32_t)fft_layout_load_##wire(&bytes[offset]) >> (shift)) & ((1u << (width)) - 1u));
+#define FFT_LAYOUT_LOAD_ARRAY(field, type, wire, offset, count)                                             \
+    for (size_t i = 0; i < (count); i++) {                                                                  \
+        out->field[i] = (type)fft_layout_load_##wire(&bytes[(offset) + (i * FFT_LAYOUT_WIRE_SIZE_##wire)]); \
+    }
+
+#define FFT_FN_LAYOUT_DECODE(name, struct_type, struct_size, layout)                              \
+    static void fft_##name##_decode(const uint8_t* bytes, struct_type* out) {                     \
+        enum { FFT_LAYOUT_SIZE = (struct_size) };                                                 \
+        layout(FFT_LAYOUT_CHECK_FIELD, FFT_LAYOUT_CHECK_BITS, FFT_LAYOUT_CHECK_ARRAY)             \
+        layout(FFT_LAYOUT_LOAD_FIELD, FFT_LAYOUT_LOAD_BITS, FFT_LAYOUT_LOAD_ARRAY)                \
+    }                                                                                             \
+    static void fft_##name##_decode_array(const uint8_t* bytes, size_t count, struct_type* out) { \
+        for (size_t n = 0; n < count; n++) {                                                      \
+            fft_##name##_decode(&bytes[n * (struct_size)], &out[n]);                              \
+        }                                                                                         \
+    }                                                                                             \
+    static void fft_##name##_read(fft_span_t* span, struct_type* out) {                           \
+        FFT_ASSERT((struct_size) <= span->size - span->offset, "Out of bounds read.");            \
+        fft_##name##_decode(&span->data[span->offset], out);                                      \
+        span->offset += (struct_size);                                                            \
+    }
+
+/*
+================================================================================
+Memory Implementation
+================================================================================
+*/
+
+typedef struct fft_mem_alloc_header_t {
+    size_t size;
+    int32_t line;
+    const char* file;
+    const char* tag;
+    fft_ctx_t* ctx; // Context the allocation is tracked in.
+    struct fft_mem_alloc_header_t* next;
+} fft_mem_alloc_header_t;
+
+static void fft_mem_init(fft_ctx_t* ctx) {
+    ctx->mem.usage_peak = 0;
+    ctx->mem.usage_total = 0;
+    ctx->mem.usage_current = 0;
+    ctx->mem.allocations_total = 0;
+    ctx->mem.allocations_current = 0;
+}
+
+static void fft_mem_shutdown(fft_ctx_t* ctx) {
+    if (ctx->mem.allocations_current != 0) {
+        printf("Memory leak detected: %zu allocations remaining\n", ctx->mem.allocations_current);
+        fft_mem_alloc_header_t* current = ctx->mem.allocations_head;
+        while (current) {
+            printf("Leaked %zu bytes allocated from %s:%d\n", current->size, current->file, current->line);
+            if (current->tag != NULL) {
+                printf("\tTag: %s\n", current->tag);
+            }
+            current = current->next;
+        }
+    }
+
+    if (ctx->mem.usage_current != 0) {
+        printf("Memory leak detected: %zu bytes remaining\n", ctx->mem.usage_current);
+        printf("Memory usage peak: %0.2fMB\n", FFT_BYTES_TO_MB(ctx->mem.usage_peak));
+        printf("Memory usage total: %0.2fMB\n", FFT_BYTES_TO_MB(ctx->mem.usage_total));
+        printf("Memory allocations: %zu\n", ctx->mem.allocations_total);
+    }
+}
+
+static void* fft_mem_alloc(size_t size, const char* file, int32_t line, const char* tag) {
+    fft_mem_alloc_header_t* header = calloc(1, sizeof(fft_mem_alloc_header_t) + size);
+    FFT_ASSERT(header != NULL, "Failed to allocate memory");
+
+    header->size = size;
+    header->file = file;
+    header->line = line;
+    header->tag = tag;
+
+    fft_ctx_t* ctx = fft_ctx();
+    header->ctx = ctx;
+
+    pthread_mutex_lock(&ctx->mem.lock);
+    header->next = ctx->mem.allocations_head;
+    ctx->mem.allocations_head = header;
+
+    ctx->mem.usage_current += size;
+    ctx->mem.usage_peak = FFT_MAX(ctx->mem.usage_peak, ctx->mem.usage_current);
+    ctx->mem.usage_total += size;
+    ctx->mem.allocations_total++;
+    ctx->mem.allocations_current++;
+    pthread_mutex_unlock(&ctx->mem.lock);
+
+    return (void*)(header + 1);
+}
+
+static void fft_mem_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    fft_mem_alloc_header_t* header = ((fft_mem_alloc_header_t*)ptr) - 1;
+
+    fft_ctx_t* ctx = header->ctx;
+    pthread_mutex_lock(&ctx->mem.lock);
+
+    // Remove from the linked list
+    fft_mem_alloc_header_t** current = &ctx->mem.allocations_head;
+    while (*current) {
+        if (*current == header) {
+            *current = header->next;
+            break;
+        }
+        current = &((*current)->next);
+    }
+
+    ctx->mem.allocations_current--;
+    ctx->mem.usage_current -= header->size;
+
+    pthread_mutex_unlock(&ctx->mem.lock);
+
+    free(header);
+}
+
+/*
+================================================================================
+IO/Filesystem Implementation
+================================================================================
+*/
+
+enum {
+    FFT_IO_SECTOR_SIZE = 2048,
+    FFT_IO_SECTOR_SIZE_RAW = 2352,
+    FFT_IO_SECTOR_HEADER_SIZE = 24,
+};
+
+typedef struct {
+    uint32_t sector;
+    uint32_t size;
+    char* name;
+} fft_io_desc_t;
+
+// This is a list of description for all files in the filesystem.
+//
+// Result:
+//   const file_desc_t file_list[F_FILE_COUNT] = {
+//     [F_BATTLE_BIN] =      { .sector = 1000,  .size = 1397096, .name = "BATTLE.BIN"},
+//     [F_EVENT__TEST_EVT] = { .sector = 3707,  .size = 4096000, .name = "EVENT/TEST.EVT"},
+//     [F_MAP__MAP001_GNS] = { .sector = 11304, .size = 2388,    .name = "MAP/MAP000.GNS"},
+//     ...
+//   }
+const fft_io_desc_t fft_io_file_list[F_FILE_COUNT] = {
+#define X(oname, osector, osize, opath) [oname] = { .sector = osector, .size = osize, .name = opath },
+    FFT_IO_INDEX
+#undef X
+};
+
+static void fft_io_init(fft_ctx_t* ctx, const char* filename) {
+    ctx->io.file = fopen(filename, "rb");
+    FFT_ASSERT(ctx->io.file != NULL, "Failed to open fft.bin");
+}
+
+static void fft_io_shutdown(fft_ctx_t* ctx) {
+    if (ctx->io.access_log != NULL) {
+        fclose(ctx->io.access_log);
+        ctx->io.access_log = NULL;
+    }
+    fclose(ctx->io.file);
+    ctx->io.file = NULL;
+}
+
+// Non empty files ordered by first sector, shared by every context.
+static uint16_t fft_io_sector_index[F_FILE_COUNT];
+static uint16_t fft_io_sector_index_count;
+static pthread_once_t fft_io_sector_index_once = PTHREAD_ONCE_INIT;
+
+static void fft_io_sector_index_build(void) {
+    // Insertion sort, the list is nearly in disc order already.
+    uint16_t* index = fft_io_sector_index;
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < F_FILE_COUNT; i++) {
+        if (fft_io_file_list[i].size == 0) {
+            continue;
+        }
+        uint16_t j = count++;
+        while (j > 0 && fft_io_file_list[index[j - 1]].sector > fft_io_file_list[i].sector) {
+            index[j] = index[j - 1];
+            j--;
+        }
+        index[j] = i;
+    }
+    fft_io_sector_index_count = count;
+}
+
+// Returns the file whose sectors contain sector, or F_FILE_COUNT if none do.
+// Files don't overlap on the disc, so only the last one starting at or before
+// sector can contain it.
+static fft_io_entry_e fft_io_entry_for_sector(uint32_t sector) {
+    pthread_once(&fft_io_sector_index_once, fft_io_sector_index_build);
+    const uint16_t* index = fft_io_sector_index;
+    uint32_t low = 0;
+    uint32_t high = fft_io_sector_index_count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (fft_io_file_list[index[mid]].sector <= sector) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return F_FILE_COUNT;
+    }
+    const fft_io_desc_t* desc = &fft_io_file_list[index[low - 1]];
+    uint32_t sectors = (desc->size + FFT_IO_SECTOR_SIZE - 1) / FFT_IO_SECTOR_SIZE;
+    return sector - desc->sector < sectors ? (fft_io_entry_e)index[low - 1] : F_FILE_COUNT;
+}
+
+// Adds delta to the total and the entry's counters. Call with the IO lock held.
+static void fft_io_stats_add(fft_ctx_t* ctx, fft_io_entry_e entry, fft_io_counters_t delta) {
+    fft_io_counters_t* counters[2] = { &ctx->io.stats.total, &ctx->io.stats.files[entry] };
+    for (size_t i = 0; i < 2; i++) {
+        counters[i]->opens += delta.opens;
+        counters[i]->reads += delta.reads;
+        counters[i]->sectors += delta.sectors;
+        counters[i]->bytes += delta.bytes;
+        counters[i]->seeks += delta.seeks;
+        counters[i]->syscalls += delta.syscalls;
+        counters[i]->time_ns += delta.time_ns;
+    }
+}
+
+void fft_io_stats_snapshot(fft_io_stats_t* out_stats) {
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    *out_stats = ctx->io.stats;
+    pthread_mutex_unlock(&ctx->io.lock);
+}
+
+void fft_io_stats_reset(void) {
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    memset(&ctx->io.stats, 0, sizeof(ctx->io.stats));
+    pthread_mutex_unlock(&ctx->io.lock);
+}
+
+static void fft_io_stats_count_cache(bool hit) {
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    if (hit) {
+        ctx->io.stats.cache_hits++;
+    } else {
+        ctx->io.stats.cache_misses++;
+    }
+    pthread_mutex_unlock(&ctx->io.lock);
+}
+
+static fft_io_desc_t fft_io_get_file_desc(uint32_t sector_start) {
+    for (size_t i = 0; i < F_FILE_COUNT; i++) {
+        if (fft_io_file_list[i].sector == sector_start) {
+            return fft_io_file_list[i];
+        }
+    }
+    return (fft_io_desc_t) { .sector = 0, .size = 0, .name = NULL };
+}
+
+// Reads size bytes starting offset bytes into sector_start into out_bytes. The
+// offset may be larger than a sector.
+static void fft_io_read_into(uint32_t sector_start, uint32_t offset, uint32_t size, uint8_t* out_bytes) {
+    FFT_TRACE_BEGIN("fft_io_read");
+    sector_start += offset / FFT_IO_SECTOR_SIZE;
+    offset %= FFT_IO_SECTOR_SIZE;
+    uint32_t occupied_sectors = (uint32_t)ceil((offset + size) / (double)FFT_IO_SECTOR_SIZE);
+
+    fft_io_entry_e entry = fft_io_entry_for_sector(sector_start);
+
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    uint64_t start_ns = fft_time_now_ns();
+    size_t written = 0;
+    for (uint32_t i = 0; i < occupied_sectors; i++) {
+        int32_t seek_to = (int32_t)((sector_start + i) * FFT_IO_SECTOR_SIZE_RAW) + FFT_IO_SECTOR_HEADER_SIZE;
+        int32_t sn = fseek(ctx->io.file, seek_to, SEEK_SET);
+        FFT_ASSERT(sn == 0, "Failed to seek to sector");
+
+        uint8_t sector[FFT_IO_SECTOR_SIZE];
+        size_t rn = fread(sector, sizeof(uint8_t), FFT_IO_SECTOR_SIZE, ctx->io.file);
+        FFT_ASSERT(rn == FFT_IO_SECTOR_SIZE, "Failed to read correct number of bytes from sector");
+
+        size_t skip = (i == 0) ? offset : 0;
+        size_t remaining_size = size - written;
+        size_t available = FFT_IO_SECTOR_SIZE - skip;
+        size_t bytes_to_copy = (remaining_size < available) ? remaining_size : available;
+
+        memcpy(out_bytes + written, sector + skip, bytes_to_copy);
+        written += bytes_to_copy;
+    }
+    fft_io_stats_add(ctx, entry,
+        (fft_io_counters_t) {
+            .reads = 1,
+            .sectors = occupied_sectors,
+            .bytes = size,
+            .seeks = occupied_sectors,
+            .syscalls = (uint64_t)occupied_sectors * 2,
+            .time_ns = fft_time_now_ns() - start_ns,
+        });
+    pthread_mutex_unlock(&ctx->io.lock);
+    FFT_TRACE_END("fft_io_read");
+}
+
+// Same as fft_io_read_into() but allocates the buffer.
+static fft_span_t fft_io_read_at(uint32_t sector_start, uint32_t offset, uint32_t size) {
+    // Try to get the file descriptor to tag the allocation with a filename.
+    fft_io_desc_t desc = fft_io_get_file_desc(sector_start);
+    uint8_t* bytes = NULL;
+    if (desc.sector == 0 && desc.size == 0 && desc.name == NULL) {
+        bytes = FFT_MEM_ALLOC(size);
+    } else {
+        bytes = FFT_MEM_ALLOC_TAG(size, desc.name);
+    }
+
+    fft_io_read_into(sector_start, offset, size, bytes);
+
+    return (fft_span_t) {
+        .data = bytes,
+        .size = size,
+    };
+}
+
+static fft_span_t fft_io_read(uint32_t sector_start, uint32_t size) {
+    return fft_io_read_at(sector_start, 0, size);
+}
+
+// fft_io_request_t is one read in a batch. The result is written to out.
+typedef struct {
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t size;
+    fft_span_t* out;
+} fft_io_request_t;
+
+static int io_request_compare(const void* a, const void* b) {
+    const fft_io_request_t* ra = (const fft_io_request_t*)a;
+    const fft_io_request_t* rb = (const fft_io_request_t*)b;
+    uint64_t pa = ((uint64_t)ra->sector * FFT_IO_SECTOR_SIZE) + ra->offset;
+    uint64_t pb = ((uint64_t)rb->sector * FFT_IO_SECTOR_SIZE) + rb->offset;
+    return (pa > pb) - (pa < pb);
+}
+
+// Reads a batch of requests in disc order, so the file is walked front to back
+// once instead of seeking back and forth. The requests are reordered.
+static void fft_io_read_batch(fft_io_request_t* requests, uint32_t count) {
+    qsort(requests, count, sizeof(fft_io_request_t), io_request_compare);
+    for (uint32_t i = 0; i < count; i++) {
+        *requests[i].out = fft_io_read_at(requests[i].sector, requests[i].offset, requests[i].size);
+    }
+}
+
+static fft_span_t fft_io_open(fft_io_entry_e file) {
+    fft_io_desc_t desc = fft_io_file_list[file];
+
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    fft_io_stats_add(ctx, file, (fft_io_counters_t) { .opens = 1 });
+    pthread_mutex_unlock(&ctx->io.lock);
+
+    return fft_io_read(desc.sector, desc.size);
+}
+
+static void fft_io_close(fft_span_t span) {
+    FFT_MEM_FREE((void*)span.data);
+    return;
+}
+
+/*
+================================================================================
+Access Log Implementation
+================================================================================
+*/
+
+static const char FFT_ACCESS_LOG_MAGIC[4] = { 'F', 'F', 'T', 'L' };
+
+enum {
+    FFT_ACCESS_LOG_VERSION = 1,
+};
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} fft_access_log_header_t;
+
+// Calls the library makes for itself aren't recorded. This is raised around
+// them, and for the whole life of the prefetch thread.
+static _Thread_local uint32_t _fft_access_log_muted = 0;
+
+static void fft_access_log_record(fft_access_kind_e kind, uint32_t id) {
+    if (_fft_access_log_muted > 0) {
+        return;
+    }
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    if (ctx->io.access_log != NULL) {
+        fft_access_record_t record = {
+            .time_ns = fft_time_now_ns() - ctx->io.access_log_start_ns,
+            .id = id,
+            .kind = (uint16_t)kind,
+        };
+        fwrite(&record, sizeof(record), 1, ctx->io.access_log);
+    }
+    pthread_mutex_unlock(&ctx->io.lock);
+}
+
+bool fft_access_log_start(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    fft_access_log_header_t header = { .version = FFT_ACCESS_LOG_VERSION };
+    memcpy(header.magic, FFT_ACCESS_LOG_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, file);
+
+    fft_access_log_stop();
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    ctx->io.access_log = file;
+    ctx->io.access_log_start_ns = fft_time_now_ns();
+    pthread_mutex_unlock(&ctx->io.lock);
+    return true;
+}
+
+void fft_access_log_stop(void) {
+    fft_ctx_t* ctx = fft_ctx();
+    pthread_mutex_lock(&ctx->io.lock);
+    FILE* file = ctx->io.access_log;
+    ctx->io.access_log = NULL;
+    pthread_mutex_unlock(&ctx->io.lock);
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+fft_access_log_t fft_access_log_read(const char* path) {
+    fft_access_log_t log = { 0 };
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return log;
+    }
+
+    fft_access_log_header_t header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, FFT_ACCESS_LOG_MAGIC, sizeof(header.magic)) == 0
+        && header.version == FFT_ACCESS_LOG_VERSION;
+    long records_start = ftell(file);
+    valid = valid && fseek(file, 0, SEEK_END) == 0;
+    long records_end = ftell(file);
+    if (!valid || records_start < 0 || records_end < records_start) {
+        fclose(file);
+        return log;
+    }
+
+    uint32_t count = (uint32_t)((size_t)(records_end - records_start) / sizeof(fft_access_record_t));
+    if (count > 0) {
+        log.records = FFT_MEM_ALLOC_TAG(count * sizeof(fft_access_record_t), "access log");
+        fseek(file, records_start, SEEK_SET);
+        log.count = (uint32_t)fread(log.records, sizeof(fft_access_record_t), count, file);
+    }
+    fclose(file);
+    return log;
+}
+
+void fft_access_log_destroy(fft_access_log_t* log) {
+    if (log->records != NULL) {
+        FFT_MEM_FREE(log->records);
+    }
+    *log = (fft_access_log_t) { 0 };
+}
+
+const char* fft_access_kind_str(fft_access_kind_e value) {
+    switch (value) {
+    case FFT_ACCESS_MAP_READ:
+        return "MapRead";
+    case FFT_ACCESS_MAP_READ_ALL:
+        return "MapReadAll";
+    case FFT_ACCESS_MAP_TEXTURES:
+        return "MapTextures";
+    case FFT_ACCESS_MAP_LOADER:
+        return "MapLoader";
+    case FFT_ACCESS_SCENARIO:
+        return "Scenario";
+    case FFT_ACCESS_EVENT:
+        return "Event";
+    case FFT_ACCESS_EVENT_EACH:
+        return "EventEach";
+    case FFT_ACCESS_ENTD:
+        return "Entd";
+    case FFT_ACCESS_BUNDLE:
+        return "Bundle";
+    case FFT_ACCESS_PREFETCH_HINT:
+        return "PrefetchHint";
+    case FFT_ACCESS_PREFETCH_TAKE:
+        return "PrefetchTake";
+    default:
+        return "Unknown";
+    }
+}
+
+/*
+================================================================================
+IO Pipeline Implementation
+================================================================================
+
+The IO pipeline overlaps reading with decoding for bulk jobs. A reader thread
+reads requests in order into a small ring of staging buffers while the calling
+thread decodes the previous ones. The reader stays at most
+FFT_IO_PIPELINE_DEPTH requests ahead, so memory use is bounded by the largest
+request, not the whole job.
+
+The span passed to the decode callback is only valid during the callback.
+
+================================================================================
+*/
+
+enum {
+    FFT_IO_PIPELINE_DEPTH = 4,
+};
+
+typedef void (*fft_io_pipeline_fn)(void* arg, uint32_t index, fft_span_t* span);
+
+typedef struct {
+    const fft_io_request_t* requests;
+    uint32_t count;
+    uint8_t* buffers[FFT_IO_PIPELINE_DEPTH];
+    fft_ctx_t* ctx;
+
+    uint32_t read_count;   // Requests sitting in buffers or decoded
+    uint32_t decode_count; // Requests decoded, their buffers can be reused
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} fft_io_pipeline_t;
+
+static void* fft_io_pipeline_reader(void* arg) {
+    fft_io_pipeline_t* pipeline = (fft_io_pipeline_t*)arg;
+    fft_ctx_make_current(pipeline->ctx);
+
+    for (uint32_t i = 0; i < pipeline->count; i++) {
+        pthread_mutex_lock(&pipeline->lock);
+        while (i - pipeline->decode_count >= FFT_IO_PIPELINE_DEPTH) {
+            pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        const fft_io_request_t* request = &pipeline->requests[i];
+        fft_io_read_into(request->sector, request->offset, request->size, pipeline->buffers[i % FFT_IO_PIPELINE_DEPTH]);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->read_count = i + 1;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+    return NULL;
+}
+
+// Reads requests in the given order and calls decode for each one, in order,
+// on the calling thread.
+static void fft_io_pipeline_run(const fft_io_request_t* requests, uint32_t count, fft_io_pipeline_fn decode, void* arg) {
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t buffer_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        buffer_size = FFT_MAX(buffer_size, requests[i].size);
+    }
+
+    fft_io_pipeline_t pipeline = { .requests = requests, .count = count, .ctx = fft_ctx() };
+    for (uint32_t i = 0; i < FFT_IO_PIPELINE_DEPTH; i++) {
+        pipeline.buffers[i] = FFT_MEM_ALLOC_TAG(FFT_MAX(buffer_size, 1u), "io_pipeline_buffer");
+    }
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.cond, NULL);
+
+    pthread_t reader;
+    int result = pthread_create(&reader, NULL, fft_io_pipeline_reader, &pipeline);
+    FFT_ASSERT(result == 0, "Failed to start IO pipeline reader");
+
+    for (uint32_t i = 0; i < count; i++) {
+        pthread_mutex_lock(&pipeline.lock);
+        while (pipeline.read_count <= i) {
+            pthread_cond_wait(&pipeline.cond, &pipeline.lock);
+        }
+        pthread_mutex_unlock(&pipeline.lock);
+
+        fft_span_t span = { .data = pipeline.buffers[i % FFT_IO_PIPELINE_DEPTH], .size = requests[i].size };
+        decode(arg, i, &span);
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.decode_count = i + 1;
+        pthread_cond_broadcast(&pipeline.cond);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    pthread_join(reader, NULL);
+    pthread_cond_destroy(&pipeline.cond);
+    pthread_mutex_destroy(&pipeline.lock);
+    for (uint32_t i = 0; i < FFT_IO_PIPELINE_DEPTH; i++) {
+        FFT_MEM_FREE(pipeline.buffers[i]);
+    }
+}
+
+/*
+================================================================================
+Thread Pool Implementation
+================================================================================
+*/
+
+enum {
+    FFT_POOL_WORKER_MAX = 64,
+    FFT_POOL_DEQUE_SIZE = 1024, // Tasks per worker, must be a power of two
+
+    // Meshes are decoded in place, the largest thing left on a worker's stack
+    // is an fft_event_t (~120 KB).
+    FFT_THREAD_STACK_SIZE = 1024 * 1024,
+};
+
+typedef struct {
+    fft_task_fn fn;
+    void* arg;
+    fft_ctx_t* ctx;
+    atomic_uint* group; // Decremented when the task finishes.
+} fft_pool_task_t;
+
+// The owner pushes and pops at the bottom, thieves take from the top. A mutex
+// per deque keeps it simple; contention is low because workers mostly touch
+// their own deque.
+typedef struct {
+    pthread_mutex_t lock;
+    fft_pool_task_t tasks[FFT_POOL_DEQUE_SIZE];
+    uint32_t top;
+    uint32_t bottom;
+} fft_pool_deque_t;
+
+typedef struct {
+    fft_pool_t* pool;
+    uint32_t index;
+} fft_pool_worker_t;
+
+struct fft_pool_t {
+    pthread_t threads[FFT_POOL_WORKER_MAX];
+    fft_pool_worker_t workers[FFT_POOL_WORKER_MAX];
+    fft_pool_deque_t deques[FFT_POOL_WORKER_MAX];
+    uint32_t worker_count;
+
+    atomic_uint queued;      // Tasks sitting in deques
+    atomic_uint outstanding; // Tasks submitted with fft_pool_submit, not yet finished
+    atomic_uint next_deque;  // Round robin for tasks submitted from outside
+    bool stopping;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond; // Signaled when tasks are queued
+    pthread_cond_t done_cond; // Signaled when a task group finishes
+};
+
+// Index of the pool worker running on this thread, if any.
+static _Thread_local fft_pool_t* _fft_pool_self = NULL;
+static _Thread_local uint32_t _fft_pool_self_index = 0;
+
+static bool fft_pool_deque_push(fft_pool_deque_t* deque, fft_pool_task_t task) {
+    pthread_mutex_lock(&deque->lock);
+    bool pushed = deque->bottom - deque->top < FFT_POOL_DEQUE_SIZE;
+    if (pushed) {
+        deque->tasks[deque->bottom % FFT_POOL_DEQUE_SIZE] = task;
+        deque->bottom++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return pushed;
+}
+
+static bool fft_pool_deque_pop(fft_pool_deque_t* deque, fft_pool_task_t* out_task) {
+    pthread_mutex_lock(&deque->lock);
+    bool popped = deque->bottom != deque->top;
+    if (popped) {
+        deque->bottom--;
+        *out_task = deque->tasks[deque->bottom % FFT_POOL_DEQUE_SIZE];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return popped;
+}
+
+static bool fft_pool_deque_steal(fft_pool_deque_t* deque, fft_pool_task_t* out_task) {
+    pthread_mutex_lock(&deque->lock);
+    bool stolen = deque->bottom != deque->top;
+    if (stolen) {
+        *out_task = deque->tasks[deque->top % FFT_POOL_DEQUE_SIZE];
+        deque->top++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return stolen;
+}
+
+static void fft_pool_run_task(fft_pool_t* pool, fft_pool_task_t task) {
+    fft_ctx_t* previous = _fft_ctx_current;
+    fft_ctx_make_current(task.ctx);
+    task.fn(task.arg);
+    fft_ctx_make_current(previous);
+
+    if (atomic_fetch_sub(task.group, 1) == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Runs one task from this thread's own deque, or stolen from another worker.
+// Returns false if there was nothing to run.
+static bool fft_pool_run_one(fft_pool_t* pool) {
+    fft_pool_task_t task;
+    bool is_worker = _fft_pool_self == pool;
+    uint32_t start = is_worker ? _fft_pool_self_index : 0;
+
+    bool found = is_worker && fft_pool_deque_pop(&pool->deques[start], &task);
+    for (uint32_t i = 0; !found && i < pool->worker_count; i++) {
+        found = fft_pool_deque_steal(&pool->deques[(start + i) % pool->worker_count], &task);
+    }
+    if (!found) {
+        return false;
+    }
+
+    atomic_fetch_sub(&pool->queued, 1);
+    fft_pool_run_task(pool, task);
+    return true;
+}
+
+static void fft_pool_push(fft_pool_t* pool, fft_pool_task_t task) {
+    // Workers push to their own deque so related work stays on one thread.
+    uint32_t index = (_fft_pool_self == pool) ? _fft_pool_self_index : atomic_fetch_add(&pool->next_deque, 1) % pool->worker_count;
+
+    atomic_fetch_add(&pool->queued, 1);
+    if (!fft_pool_deque_push(&pool->deques[index], task)) {
+        // Deque is full, run it here instead.
+        atomic_fetch_sub(&pool->queued, 1);
+        fft_pool_run_task(pool, task);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Helps run tasks until the group reaches zero.
+static void fft_pool_wait_group(fft_pool_t* pool, atomic_uint* group) {
+    while (atomic_load(group) != 0) {
+        if (fft_pool_run_one(pool)) {
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        if (atomic_load(group) != 0 && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void* fft_pool_worker_main(void* arg) {
+    fft_pool_worker_t* worker = (fft_pool_worker_t*)arg;
+    fft_pool_t* pool = worker->pool;
+    _fft_pool_self = pool;
+    _fft_pool_self_index = worker->index;
+
+    for (;;) {
+        if (fft_pool_run_one(pool)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        bool stopping = pool->stopping && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+fft_pool_t* fft_pool_create(uint32_t worker_count) {
+    if (worker_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    worker_count = FFT_MIN(worker_count, (uint32_t)FFT_POOL_WORKER_MAX);
+
+    fft_pool_t* pool = FFT_MEM_ALLOC_TAG(sizeof(fft_pool_t), "pool");
+    pool->worker_count = worker_count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, FFT_THREAD_STACK_SIZE);
+    for (uint32_t i = 0; i < worker_count; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->workers[i] = (fft_pool_worker_t) { .pool = pool, .index = i };
+    }
+    for (uint32_t i = 0; i < worker_count; i++) {
+        int result = pthread_create(&pool->threads[i], &attr, fft_pool_worker_main, &pool->workers[i]);
+        FFT_ASSERT(result == 0, "Failed to start pool worker");
+    }
+    pthread_attr_destroy(&attr);
+
+    return pool;
+}
+
+void fft_pool_destroy(fft_pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+    fft_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Join everyone first, workers steal from each other's deques until they exit.
+    for (uint32_t i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (uint32_t i = 0; i < pool->worker_count; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    FFT_MEM_FREE(pool);
+}
+
+uint32_t fft_pool_worker_count(const fft_pool_t* pool) {
+    return pool->worker_count;
+}
+
+void fft_pool_submit(fft_pool_t* pool, fft_task_fn fn, void* arg) {
+    atomic_fetch_add(&pool->outstanding, 1);
+    fft_pool_push(pool, (fft_pool_task_t) { .fn = fn, .arg = arg, .ctx = fft_ctx(), .group = &pool->outstanding });
+}
+
+void fft_pool_wait(fft_pool_t* pool) {
+    fft_pool_wait_group(pool, &pool->outstanding);
+}
+
+typedef struct {
+    fft_range_fn fn;
+    void* arg;
+    uint32_t begin;
+    uint32_t end;
+} fft_pool_range_t;
+
+static void fft_pool_range_task(void* arg) {
+    fft_pool_range_t* range = (fft_pool_range_t*)arg;
+    range->fn(range->arg, range->begin, range->end);
+}
+
+void fft_pool_parallel_for(fft_pool_t* pool, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg) {
+    if (count == 0) {
+        return;
+    }
+    grain = FFT_MAX(grain, 1u);
+    uint32_t chunk_count = (count + grain - 1) / grain;
+    if (chunk_count == 1) {
+        fn(arg, 0, count);
+        return;
+    }
+
+    fft_pool_range_t* ranges = FFT_MEM_ALLOC_TAG(chunk_count * sizeof(fft_pool_range_t), "pool_ranges");
+    atomic_uint group;
+    atomic_init(&group, chunk_count);
+
+    fft_ctx_t* ctx = fft_ctx();
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        uint32_t begin = i * grain;
+        ranges[i] = (fft_pool_range_t) { .fn = fn, .arg = arg, .begin = begin, .end = FFT_MIN(begin + grain, count) };
+        fft_pool_push(pool, (fft_pool_task_t) { .fn = fft_pool_range_task, .arg = &ranges[i], .ctx = ctx, .group = &group });
+    }
+    fft_pool_wait_group(pool, &group);
+
+    FFT_MEM_FREE(ranges);
+}
+
+static void fft_pool_executor_parallel_for(void* userdata, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg) {
+    fft_pool_parallel_for((fft_pool_t*)userdata, count, grain, fn, arg);
+}
+
+fft_executor_t fft_pool_executor(fft_pool_t* pool) {
+    return (fft_executor_t) { .parallel_for = fft_pool_executor_parallel_for, .userdata = pool };
+}
+
+void fft_executor_parallel_for(const fft_executor_t* executor, uint32_t count, uint32_t grain, fft_range_fn fn, void* arg) {
+    if (executor == NULL) {
+        if (count > 0) {
+            fn(arg, 0, count);
+        }
+        return;
+    }
+    executor->parallel_for(executor->userdata, count, grain, fn, arg);
+}
+
+/*
+================================================================================
+Map state Implementation
+================================================================================
+*/
+
+static fft_state_t fft_default_state = (fft_state_t) {
+    .time = FFT_TIME_DAY,
+    .weather = FFT_WEATHER_NONE,
+    .layout = FFT_LAYOUT_DEFAULT,
+};
+
+const char* fft_layout_str(fft_layout_e value) {
+    switch (value) {
+    case FFT_LAYOUT_DEFAULT:
+        return "Default";
+    case FFT_LAYOUT_ALTERNATE_A:
+        return "Alternate A";
+    case FFT_LAYOUT_ALTERNATE_B:
+        return "Alternate B";
+    case FFT_LAYOUT_ALTERNATE_C:
+        return "Alternate C";
+    case FFT_LAYOUT_ALTERNATE_D:
+        return "Alternate D";
+    case FFT_LAYOUT_ALTERNATE_E:
+        return "Alternate E";
+    default:
+        return "Unknown";
+    }
+}
+
+static void validate_layout(fft_layout_e value) {
+    switch (value) {
+    case FFT_LAYOUT_DEFAULT:
+    case FFT_LAYOUT_ALTERNATE_A:
+    case FFT_LAYOUT_ALTERNATE_B:
+    case FFT_LAYOUT_ALTERNATE_C:
+    case FFT_LAYOUT_ALTERNATE_D:
+    case FFT_LAYOUT_ALTERNATE_E:
+        return;
+    default:
+        FFT_ASSERT(false, "Invalid layout value: %d", value);
+    }
+}
+
+const char* fft_time_str(fft_time_e value) {
+    switch (value) {
+    case FFT_TIME_DAY:
+        return "Day";
+    case FFT_TIME_NIGHT:
+        return "Night";
+    default:
+        return "Unknown";
+    }
+}
+
+static void validate_time(fft_time_e value) {
+    switch (value) {
+    case FFT_TIME_DAY:
+    case FFT_TIME_NIGHT:
+        return;
+    default:
+        FFT_ASSERT(false, "Invalid time value: %d", value);
+    }
+}
+
+const char* fft_weather_str(fft_weather_e value) {
+    switch (value) {
+    case FFT_WEATHER_NONE:
+        return "None";
+    case FFT_WEATHER_NONE_ALT:
+        return "NoneAlt";
+    case FFT_WEATHER_NORMAL:
+        return "Normal";
+    case FFT_WEATHER_STRONG:
+        return "Strong";
+    case FFT_WEATHER_VERY_STRONG:
+        return "VeryStrong";
+    default:
+        return "Unknown";
+    }
+}
+
+static void validate_weather(fft_weather_e value) {
+    switch (value) {
+    case FFT_WEATHER_NONE:
+    case FFT_WEATHER_NONE_ALT:
+    case FFT_WEATHER_NORMAL:
+    case FFT_WEATHER_STRONG:
+    case FFT_WEATHER_VERY_STRONG:
+    case FFT_WEATHER_UNKNOWN_0x10: // Allow this until we understand it
+    case FFT_WEATHER_UNKNOWN_0x20: // Allow this until we understand it
+        return;
+    default:
+        FFT_ASSERT(false, "Invalid weather value: %d", value);
+    }
+}
+
+bool fft_state_is_equal(fft_state_t a, fft_state_t b) {
+    return a.time == b.time && a.weather == b.weather && a.layout == b.layout;
+}
+
+bool fft_state_is_default(fft_state_t map_state) {
+    return fft_state_is_equal(fft_default_state, map_state);
+}
+
+/*
+================================================================================
+GNS/Records Implementation
+================================================================================
+*/
+
+const char* fft_record_unknown_str(fft_record_unknown_e value) {
+    switch (value) {
+    case FFT_RECORD_UNKNOWN_0x22:
+        return "0x22";
+    case FFT_RECORD_UNKNOWN_0x30:
+        return "0x30";
+    case FFT_RECORD_UNKNOWN_0x70:
+        return "0x70";
+    default:
+        return "Unknown";
+    }
+}
+
+static void validate_gns_unknown(fft_record_unknown_e value) {
+    switch (value) {
+    case FFT_RECORD_UNKNOWN_0x22:
+    case FFT_RECORD_UNKNOWN_0x30:
+    case FFT_RECORD_UNKNOWN_0x70:
+        return;
+    default:
+        FFT_ASSERT(false, "Invalid Record unknown value: %d", value);
+    }
+}
+
+// Byte 3 holds both time and weather.
+// - time    = 0b10000000
+// - weather = 0b01110000
+#define FFT_RECORD_LAYOUT(F, B, A)                  \
+    F(gns_unknown_aa, fft_record_unknown_e, u16, 0) \
+    F(state.layout, fft_layout_e, u8, 2)            \
+    B(state.time, fft_time_e, u8, 3, 7, 1)          \
+    B(state.weather, fft_weather_e, u8, 3, 4, 3)    \
+    F(type, fft_recordtype_e, u16, 4)               \
+    F(unknown_ee, uint16_t, u16, 6)                 \
+    F(sector, uint32_t, u16, 8)                     \
+    F(unknown_gg, uint16_t, u16, 10)                \
+    F(length, uint32_t, u32, 12)                    \
+    F(unknown_ii, uint16_t, u16, 16)                \
+    F(unknown_jj, uint16_t, u16, 18)                \
+    A(raw, uint8_t, u8, 0, FFT_RECORD_SIZE) // Raw data for debugging
+
+FFT_FN_LAYOUT_DECODE(record_layout, fft_record_t, FFT_RECORD_SIZE, FFT_RECORD_LAYOUT)
+
+static fft_record_t fft_record_read(fft_span_t* span) {
+    fft_record_t record = { 0 };
+    fft_record_layout_read(span, &record);
+
+    validate_gns_unknown(record.gns_unknown_aa);
+    validate_layout(record.state.layout);
+    validate_time(record.state.time);
+    validate_weather(record.state.weather);
+
+    return record;
+}
+
+static uint8_t fft_record_read_all(fft_span_t* span, fft_record_t* out_records) {
+    uint8_t count = 0;
+    while (span->offset + FFT_RECORD_SIZE < span->size) {
+        fft_record_t record = fft_record_read(span);
+        if (record.type == FFT_RECORDTYPE_END) {
+            break;
+        }
+        if (count >= FFT_RECORD_MAX) {
+            break;
+        }
+        out_records[count++] = record;
+    }
+    return count;
+}
+
+const char* fft_recordtype_str(fft_recordtype_e value) {
+    switch (value) {
+    case FFT_RECORDTYPE_MESH_PRIMARY:
+        return "Primary";
+    case FFT_RECORDTYPE_MESH_ALT:
+        return "Alt";
+    case FFT_RECORDTYPE_MESH_OVERRIDE:
+        return "Override";
+    case FFT_RECORDTYPE_TEXTURE:
+        return "Texture";
+    case FFT_RECORDTYPE_END:
+        return "End";
+    default:
+        return "Unknown";
+    }
+}
+
+/*
+================================================================================
+Colors Implementation
+================================================================================
+*/
+
+uint8_t fft_color_4bpp_left(fft_color_4bpp_t raw) { return (raw & 0xF0) >> 4; }
+uint8_t fft_color_4bpp_right(fft_color_4bpp_t raw) { return raw & 0x0F; }
+
+uint8_t fft_color_5551_r8(fft_color_5551_t c) { return (uint8_t)(((c & 0x1F) << 3) | ((c & 0x1F) >> 2)); }
+uint8_t fft_color_5551_g8(fft_color_5551_t c) { return (uint8_t)((((c >> 5) & 0x1F) << 3) | (((c >> 5) & 0x1F) >> 2)); }
+uint8_t fft_color_5551_b8(fft_color_5551_t c) { return (uint8_t)((((c >> 10) & 0x1F) << 3) | (((c >> 10) & 0x1F) >> 2)); }
+uint8_t fft_color_5551_a8(fft_color_5551_t c) { return (uint8_t)(((c >> 15) & 0x01) ? 255 : 0); }
+
+fft_color_4bpp_t fft_color_4bpp_read(fft_span_t* span) {
+    uint8_t value = fft_span_read_u8(span);
+    return (fft_color_4bpp_t)value;
+}
+
+fft_color_5551_t fft_color_5551_read(fft_span_t* span) {
+    fft_color_5551_t color = 0;
+    uint16_t value = fft_span_read_u16(span);
+    color |= (value & 0x1F);               // Red
+    color |= ((value >> 5) & 0x1F) << 5;   // Green
+    color |= ((value >> 10) & 0x1F) << 10; // Blue
+    color |= ((value >> 15) & 0x01) << 15; // Alpha
+    return color;
+}
+
+fft_color_rgbfx16_t fft_color_rgbfx16_read(fft_span_t* span) {
+    fft_color_rgbfx16_t color = { 0 };
+    color.r = fft_span_read_i16(span); // 16 bits for red
+    color.g = fft_span_read_i16(span); // 16 bits for green
+    color.b = fft_span_read_i16(span); // 16 bits for blue
+    return color;
+}
+
+fft_color_rgb8_t fft_color_rgb8_read(fft_span_t* span) {
+    fft_color_rgb8_t color = { 0 };
+    color.r = fft_span_read_u8(span); // 8 bits for red
+    color.g = fft_span_read_u8(span); // 8 bits for green
+    color.b = fft_span_read_u8(span); // 8 bits for blue
+    return color;
+}
+
+fft_color_t fft_color_from_5551(fft_color_5551_t c) {
+    uint8_t r = (uint8_t)(((c) & 0x1F) << 3) | (((c) & 0x1F) >> 2);
+    uint8_t g = (uint8_t)(((c >> 5) & 0x1F) << 3) | (((c >> 5) & 0x1F) >> 2);
+    uint8_t b = (uint8_t)(((c >> 10) & 0x1F) << 3) | (((c >> 10) & 0x1F) >> 2);
+    uint8_t a = (c >> 15) ? 255 : 0;
+    return FFT_COLOR_RGBA(r, g, b, a);
+}
+
+// Convert RGB16 fixed-point to RGBA8888 (full 255 range)
+fft_color_t fft_color_from_rgbfx16(fft_color_rgbfx16_t c) {
+    float r32 = fft_fixed16_to_f32(c.r);
+    float g32 = fft_fixed16_to_f32(c.g);
+    float b32 = fft_fixed16_to_f32(c.b);
+
+    uint8_t r = (uint8_t)(r32 * 255.0f + 0.5f);
+    uint8_t g = (uint8_t)(g32 * 255.0f + 0.5f);
+    uint8_t b = (uint8_t)(b32 * 255.0f + 0.5f);
+    return FFT_COLOR_RGBA(r, g, b, 255);
+}
+
+// Convert RGB8 to RGBA8888
+fft_color_t fft_color_from_rgb8(fft_color_rgb8_t c) {
+    return FFT_COLOR_RGBA(c.r, c.g, c.b, 255);
+}
+
+/*
+================================================================================
+CLUT Implementation
+================================================================================
+*/
+
+// fft_color_5551_read() keeps all 16 bits as they are, so rows can be copied
+// straight from the span.
+fft_clut_row_t fft_clut_row_read(fft_span_t* span) {
+    fft_clut_row_t row = { 0 };
+    fft_span_read_u16_array(span, FFT_CLUT_ROW_WIDTH, row.colors);
+    return row;
+}
+
+fft_clut_t fft_clut_read(fft_span_t* span) {
+    // One read per row, since a pointer to the first row's colors may not be
+    // used past that row.
+    fft_clut_t clut = { 0 };
+    for (uint32_t i = 0; i < FFT_CLUT_ROW_COUNT; i++) {
+        fft_span_read_u16_array(span, FFT_CLUT_ROW_WIDTH, clut.rows[i].colors);
+    }
+    return clut;
+}
+
+/*
+================================================================================
+Images Implementation
+================================================================================
+*/
+
+enum {
+    FFT_IMAGE_PAL_COL_COUNT = 16,                         // Each palette entry is 16 bytes (RGBA)
+    FFT_IMAGE_PAL_ROW_SIZE = FFT_IMAGE_PAL_COL_COUNT * 4, // 4 bytes per color
+};
+
+// The image kernels below each come in two versions. The _ref version is the
+// plain scalar code and defines the correct output. The other version is the
+// one the library uses and must produce the same bytes. test.c checks this with
+// exhaustive and random inputs, and fft_bench checks it before timing them.
+
+// Unpacks 4bpp pixels to one grayscale RGBA pixel each. The low nibble is the
+// first pixel.
+static void fft_image_unpack_4bpp_ref(const uint8_t* src, size_t src_size, uint8_t* dst) {
+    size_t write_idx = 0;
+    for (size_t i = 0; i < src_size; i++) {
+        uint8_t right = fft_color_4bpp_right(src[i]);
+        uint8_t left = fft_color_4bpp_left(src[i]);
+
+        // Repeat each pixel 4 times to convert from 4bpp to 32bpp.
+        for (uint32_t j = 0; j < 4; j++) {
+            dst[write_idx++] = right;
+        }
+
+        for (uint32_t j = 0; j < 4; j++) {
+            dst[write_idx++] = left;
+        }
+    }
+}
+
+static void fft_image_unpack_4bpp(const uint8_t* src, size_t src_size, uint8_t* dst) {
+    // Multiplying by 0x01010101 repeats a byte into all four bytes of a word,
+    // which gives the same bytes in memory on any byte order.
+    for (size_t i = 0; i < src_size; i++) {
+        uint32_t right = (uint32_t)(src[i] & 0x0F) * 0x01010101u;
+        uint32_t left = (uint32_t)(src[i] >> 4) * 0x01010101u;
+        memcpy(&dst[i * 8], &right, 4);
+        memcpy(&dst[i * 8 + 4], &left, 4);
+    }
+}
+
+// Converts 16bpp BGR555 pixels to RGBA. Only black (0x0000) is transparent.
+static void fft_image_convert_5551_ref(const uint8_t* src, size_t pixel_count, uint8_t* dst) {
+    fft_span_t span = { .data = src, .size = pixel_count * 2 };
+    size_t write_idx = 0;
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint16_t val = fft_span_read_u16(&span);
+
+        dst[write_idx++] = (uint8_t)((val & 0x001F) << 3);      // R
+        dst[write_idx++] = (uint8_t)((val & 0x03E0) >> 2);      // G
+        dst[write_idx++] = (uint8_t)((val & 0x7C00) >> 7);      // B
+        dst[write_idx++] = (uint8_t)((val == 0) ? 0x00 : 0xFF); // A
+    }
+}
+
+static void fft_image_convert_5551(const uint8_t* src, size_t pixel_count, uint8_t* dst) {
+    // Same math, without the per pixel bounds checks of the span reads.
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint16_t val = (uint16_t)(src[i * 2] | (src[i * 2 + 1] << 8));
+        uint8_t* out = &dst[i * 4];
+        out[0] = (uint8_t)((val & 0x001F) << 3);
+        out[1] = (uint8_t)((val & 0x03E0) >> 2);
+        out[2] = (uint8_t)((val & 0x7C00) >> 7);
+        out[3] = (uint8_t)(val == 0 ? 0x00 : 0xFF);
+    }
+}
+
+// Replaces each grayscale pixel with its color from a 16 color RGBA palette.
+static void fft_image_palettize_pixels_ref(uint8_t* pixels, size_t pixel_count, const uint8_t* palette) {
+    for (size_t i = 0; i < pixel_count * 4; i = i + 4) {
+        uint8_t pixel = pixels[i];
+
+        // Ensure pixel value is within palette range
+        FFT_ASSERT(pixel < FFT_IMAGE_PAL_COL_COUNT, "Pixel value %d exceeds palette size", pixel);
+
+        memcpy(&pixels[i], &palette[pixel * 4], 4);
+    }
+}
+
+static void fft_image_palettize_pixels(uint8_t* pixels, size_t pixel_count, const uint8_t* palette) {
+    uint32_t colors[FFT_IMAGE_PAL_COL_COUNT];
+    memcpy(colors, palette, sizeof(colors));
+
+    // Check the range once at the end instead of for every pixel. Out of range
+    // values are masked so they can't read past the palette in the meantime.
+    uint8_t seen = 0;
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint8_t pixel = pixels[i * 4];
+        seen |= pixel;
+        memcpy(&pixels[i * 4], &colors[pixel & 0x0F], 4);
+    }
+    FFT_ASSERT(seen < FFT_IMAGE_PAL_COL_COUNT, "Pixel value exceeds palette size");
+}
+
+// This function reads the 4bpp data from the span and converts it to a 32bpp image.
+//
+// The resulting image will be grayscale, with each pixel represented by four bytes (RGBA).
+// The pixel values will be used in a to look up the actual color in a palette (CLUT).
+static fft_image_t fft_image_read_4bpp(fft_span_t* span, uint32_t width, uint32_t height) {
+    const uint32_t dims = (width * height);
+    const uint32_t size = dims * 4;
+    const uint32_t size_on_disk = dims / 2; // two pixels per byte
+    FFT_ASSERT(span->offset + size_on_disk <= span->size, "Out of bounds read.");
+
+    uint8_t* data = FFT_MEM_ALLOC(size);
+    fft_image_unpack_4bpp(&span->data[span->offset], size_on_disk, data);
+    span->offset += size_on_disk;
+
+    fft_image_t image = { 0 };
+    image.width = width;
+    image.height = height;
+    image.data = data;
+    image.size = size;
+    image.valid = true;
+
+    return image;
+}
+
+static fft_image_t fft_image_read_16bpp(fft_span_t* span, uint32_t width, uint32_t height) {
+    const uint32_t dims = width * height;
+    const uint32_t size = dims * 4;
+    FFT_ASSERT(span->offset + (dims * 2) <= span->size, "Out of bounds read.");
+
+    uint8_t* data = FFT_MEM_ALLOC(size);
+    fft_image_convert_5551(&span->data[span->offset], dims, data);
+    span->offset += dims * 2;
+
+    fft_image_t image = { 0 };
+    image.width = width;
+    image.height = height;
+    image.data = data;
+    image.size = size;
+    image.valid = true;
+
+    return image;
+}
+
+// Take a 4bpp image and a 16bpp palette (CLUT) and convert the image to a
+// palettized format.
+static void fft_image_palettize(fft_image_t* image, const fft_image_t* clut, uint8_t pal_index) {
+    FFT_ASSERT(image && image->data && image->valid, "Invalid image parameter");
+    FFT_ASSERT(clut && clut->data && clut->valid, "Invalid clut parameter");
+
+    const uint32_t pixel_count = image->width * image->height;
+    const uint32_t pal_offset = (FFT_IMAGE_PAL_ROW_SIZE * pal_index);
+
+    // Ensure palette index and offset are valid
+    FFT_ASSERT(pal_offset + (FFT_IMAGE_PAL_COL_COUNT * 4) <= clut->size, "Palette index out of bounds");
+
+    fft_image_palettize_pixels(image->data, pixel_count, &clut->data[pal_offset]);
+}
+
+static size_t fft_image_measure(fft_image_desc_t desc) {
+    return (size_t)desc.width * desc.height * 4;
+}
+
+static size_t fft_image_palette_measure(fft_image_desc_t desc) {
+    return (size_t)desc.pal_count * FFT_IMAGE_PAL_ROW_SIZE;
+}
+
+static void fft_image_read_4bpp_palettized_into(fft_span_t* span, fft_image_desc_t desc, uint8_t pal_index, uint8_t* out_pixels) {
+    // Read the 4bpp image data.
+    const size_t dims = (size_t)desc.width * desc.height;
+    const size_t size_on_disk = dims / 2; // two pixels per byte
+    FFT_ASSERT(span->offset + size_on_disk <= span->size, "Out of bounds read.");
+    fft_image_unpack_4bpp(&span->data[span->offset], size_on_disk, out_pixels);
+    span->offset += size_on_disk;
+
+    // Only the selected palette of the clut is converted. The span still ends
+    // up after the whole clut.
+    const size_t pal_size_on_disk = FFT_IMAGE_PAL_COL_COUNT * 2;
+    FFT_ASSERT(pal_index < desc.pal_count, "Palette index out of bounds");
+    fft_span_set_offset(span, desc.pal_offset + (desc.pal_count * pal_size_on_disk));
+    uint8_t palette[FFT_IMAGE_PAL_ROW_SIZE];
+    fft_image_convert_5551(&span->data[desc.pal_offset + (pal_index * pal_size_on_disk)], FFT_IMAGE_PAL_COL_COUNT, palette);
+
+    fft_image_palettize_pixels(out_pixels, dims, palette);
+}
+
+static fft_image_t fft_image_read_4bpp_palettized(fft_span_t* span, fft_image_desc_t desc, uint8_t pal_index) {
+    fft_image_t image = { 0 };
+    image.width = desc.width;
+    image.height = desc.height;
+    image.size = fft_image_measure(desc);
+    image.data = FFT_MEM_ALLOC(image.size);
+    image.valid = true;
+
+    fft_image_read_4bpp_palettized_into(span, desc, pal_index, image.data);
+    return image;
+}
+
+static fft_image_desc_t image_get_desc(fft_io_entry_e entry) {
+    fft_image_desc_t found = { 0 };
+    for (uint32_t i = 0; i < FFT_IMAGE_DESC_COUNT; i++) {
+        if (image_desc_list[i].entry == entry) {
+            // FIXME: This is just a development saftey measure. Might be better
+            // to find by name since there can be multiple desc per file.
+            FFT_ASSERT(found.entry == 0, "Duplicate image descriptor for entry %d", entry);
+            found = image_desc_list[i];
+        }
+    }
+    FFT_ASSERT(found.entry != 0, "Image descriptor not found for entry %d", entry);
+    return found;
+}
+
+// This will scale the image data from 4bpp to 32bpp by multiplying each pixel
+// value by 16. This is useful for debugging since the max value of 4bpp is 15,
+// and we want to scale it to 255 (15*17 = 255).
+static void fft_image_scale_paletted(fft_image_t* image) {
+    FFT_ASSERT(image && image->valid && image->data, "Invalid image parameter");
+
+    const uint32_t pixel_count = image->width * image->height;
+
+    for (uint32_t i = 0; i < pixel_count; i++) {
+        uint8_t* px = &image->data[i * 4];
+
+        // Scale each RGB channel from [0..15] → [0..255]
+        px[0] = px[0] * 17; // R
+        px[1] = px[1] * 17; // G
+        px[2] = px[2] * 17; // B
+        px[3] = 0xFF;       // A
+    }
+}
+
+static void fft_image_destroy(fft_image_t* image) {
+    if (image && image->data) {
+        FFT_MEM_FREE(image->data);
+        image->data = NULL;
+        image->valid = false;
+    }
+}
+
+static bool fft_image_write_ppm(const fft_image_t* image, const char* path) {
+    if (!image || !image->valid || !image->data) {
+        return false;
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    // Write PPM header (P6 = binary RGB)
+    // Max color value is 255
+    fprintf(f, "P6\n%d %d\n255\n", image->width, image->height);
+
+    // Write RGB data (ignore alpha)
+    for (uint32_t y = 0; y < image->height; y++) {
+        for (uint32_t x = 0; x < image->width; x++) {
+            uint8_t* px = &image->data[(y * image->width + x) * 4];
+            fwrite(px, 1, 3, f); // only write R,G,B
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+/*
+================================================================================
+Mesh Header Implementation
+================================================================================
+*/
+
+#define FFT_MESH_HEADER_LAYOUT(F, B, A)                                        \
+    A(unknown_00_to_40, uint32_t, u32, 0x00, 16)                               \
+    F(geometry, uint32_t, u32, FFT_MESH_PTR_GEOMETRY)                          \
+    F(clut_color, uint32_t, u32, FFT_MESH_PTR_CLUT_COLOR)                      \
+    F(unknown_48, uint32_t, u32, 0x48)                                         \
+    F(unknown_4c, uint32_t, u32, 0x4C)                                         \
+    A(unknown_50_to_64, uint32_t, u32, 0x50, 5)                                \
+    F(lights_and_background, uint32_t, u32, FFT_MESH_PTR_LIGHT_AND_BACKGROUND) \
+    F(terrain, uint32_t, u32, FFT_MESH_PTR_TERRAIN)                            \
+    F(texture_anim_inst, uint32_t, u32, FFT_MESH_PTR_TEXTURE_ANIM_INST)        \
+    F(palette_anim_inst, uint32_t, u32, FFT_MESH_PTR_PALETTE_ANIM_INST)        \
+    A(unknown_74_to_7c, uint32_t, u32, 0x74, 2)                                \
+    F(clut_gray, uint32_t, u32, FFT_MESH_PTR_CLUT_GRAY)                        \
+    A(unknown_80_to_8c, uint32_t, u32, 0x80, 3)                                \
+    F(mesh_anim_inst, uint32_t, u32, FFT_MESH_PTR_MESH_ANIM_INST)              \
+    F(anim_mesh_1, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_1)                    \
+    F(anim_mesh_2, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_2)                    \
+    F(anim_mesh_3, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_3)                    \
+    F(anim_mesh_4, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_4)                    \
+    F(anim_mesh_5, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_5)                    \
+    F(anim_mesh_6, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_6)                    \
+    F(anim_mesh_7, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_7)                    \
+    F(anim_mesh_8, uint32_t, u32, FFT_MESH_PTR_ANIM_MESH_8)                    \
+    F(poly_render_props, uint32_t, u32, FFT_MESH_PTR_POLY_RENDER_PROPS)        \
+    A(unknown_b4_to_c4, uint32_t, u32, 0xB4, 4)
+
+FFT_FN_LAYOUT_DECODE(mesh_header_layout, fft_mesh_header_t, FFT_MESH_HEADER_SIZE, FFT_MESH_HEADER_LAYOUT)
+
+fft_mesh_header_t fft_mesh_header_read(fft_span_t* span) {
+    fft_mesh_header_t header = { 0 };
+    fft_mesh_header_layout_read(span, &header);
+    return header;
+}
+
+/*
+================================================================================
+Geometry Implementation
+================================================================================
+*/
+
+static fft_position_t fft_geometry_read_position(fft_span_t* span) {
+    int16_t x = fft_span_read_i16(span);
+    int16_t y = fft_span_read_i16(span);
+    int16_t z = fft_span_read_i16(span);
+    return (fft_position_t) { x, y, z };
+}
+
+enum {
+    // Each block of polygon data is read in one go into a buffer this large.
+    FFT_GEOMETRY_BLOCK_MAX = FFT_MESH_MAX_TEX_QUADS * 4 * 3, // Quad positions, the largest block
+};
+
+static uint32_t fft_geometry_vertex_count(fft_polytype_e type) {
+    return type == FFT_POLYTYPE_TRIANGLE ? 3 : 4;
+}
+
+static uint32_t read_polygons(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, bool is_textured, uint32_t poly_offset, uint32_t count) {
+    const uint32_t vertex_count = fft_geometry_vertex_count(type);
+    FFT_ASSERT(count * vertex_count * 3 <= FFT_GEOMETRY_BLOCK_MAX, "Too many polygons in block");
+
+    // Read all vertex positions for this block at once
+    int16_t coords[FFT_GEOMETRY_BLOCK_MAX];
+    fft_span_read_i16_array(span, count * vertex_count * 3, coords);
+
+    const int16_t* c = coords;
+    for (uint32_t i = 0; i < count; i++) {
+        fft_polygon_t* poly = &g->polygons[poly_offset + i];
+        poly->tex.is_textured = is_textured;
+        poly->type = type;
+
+        for (uint32_t j = 0; j < vertex_count; j++, c += 3) {
+            poly->vertices[j].position = (fft_position_t) { c[0], c[1], c[2] };
+        }
+    }
+
+    return poly_offset + count;
+}
+
+static uint32_t read_normals(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, uint32_t poly_offset, uint32_t count) {
+    const uint32_t vertex_count = fft_geometry_vertex_count(type);
+    FFT_ASSERT(count * vertex_count * 3 <= FFT_GEOMETRY_BLOCK_MAX, "Too many polygons in block");
+
+    // Read all vertex normals for this block at once
+    fft_fixed16_t coords[FFT_GEOMETRY_BLOCK_MAX];
+    fft_span_read_i16_array(span, count * vertex_count * 3, coords);
+
+    const fft_fixed16_t* c = coords;
+    for (uint32_t i = 0; i < count; i++) {
+        fft_polygon_t* poly = &g->polygons[poly_offset + i];
+
+        for (uint32_t j = 0; j < vertex_count; j++, c += 3) {
+            poly->vertices[j].normal = (fft_normal_t) { c[0], c[1], c[2] };
+        }
+    }
+
+    return poly_offset + count;
+}
+
+// Byte 6 holds the page, image and an unknown value.
+#define FFT_TEXINFO_TRI_LAYOUT(F, B, A)                                \
+    F(texcoords[0].u, uint8_t, u8, 0)                                  \
+    F(texcoords[0].v, uint8_t, u8, 1)                                  \
+    F(clut, uint8_t, u8, 2)                                            \
+    F(unknown_a, uint8_t, u8, 3)                                       \
+    F(texcoords[1].u, uint8_t, u8, 4)                                  \
+    F(texcoords[1].v, uint8_t, u8, 5)                                  \
+    B(page, uint8_t, u8, 6, 0, 2)         /* bits 0–1  (0b00000011) */ \
+    B(image_to_use, uint8_t, u8, 6, 2, 2) /* bits 2–3  (0b00001100) */ \
+    B(unknown_b, uint8_t, u8, 6, 4, 4)    /* bits 4–7  (0b11110000) */ \
+    F(unknown_c, uint8_t, u8, 7)                                       \
+    F(texcoords[2].u, uint8_t, u8, 8)                                  \
+    F(texcoords[2].v, uint8_t, u8, 9)
+
+// Quads have 2 more bytes for the 4th texcoord.
+#define FFT_TEXINFO_QUAD_LAYOUT(F, B, A) \
+    FFT_TEXINFO_TRI_LAYOUT(F, B, A)      \
+    F(texcoords[3].u, uint8_t, u8, 10)   \
+    F(texcoords[3].v, uint8_t, u8, 11)
+
+enum {
+    FFT_TEXINFO_TRI_SIZE = 10,
+    FFT_TEXINFO_QUAD_SIZE = 12,
+};
+
+FFT_FN_LAYOUT_DECODE(texinfo_tri_layout, fft_texinfo_t, FFT_TEXINFO_TRI_SIZE, FFT_TEXINFO_TRI_LAYOUT)
+FFT_FN_LAYOUT_DECODE(texinfo_quad_layout, fft_texinfo_t, FFT_TEXINFO_QUAD_SIZE, FFT_TEXINFO_QUAD_LAYOUT)
+
+static uint32_t read_texinfo(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, uint32_t poly_offset, uint32_t count) {
+    const uint32_t stride = type == FFT_POLYTYPE_QUAD ? FFT_TEXINFO_QUAD_SIZE : FFT_TEXINFO_TRI_SIZE;
+    FFT_ASSERT(count <= (span->size - span->offset) / stride, "Out of bounds read.");
+    const uint8_t* bytes = &span->data[span->offset];
+    span->offset += count * stride;
+
+    for (uint32_t i = 0; i < count; i++) {
+        fft_texinfo_t* tex = &g->polygons[poly_offset + i].tex;
+        if (type == FFT_POLYTYPE_QUAD) {
+            fft_texinfo_quad_layout_decode(&bytes[i * stride], tex);
+        } else {
+            fft_texinfo_tri_layout_decode(&bytes[i * stride], tex);
+        }
+    }
+
+    return poly_offset + count;
+}
+
+static uint32_t read_untexinfo(fft_span_t* span, fft_geometry_t* g, uint32_t poly_offset, uint32_t count) {
+    FFT_ASSERT(count * 4 <= FFT_GEOMETRY_BLOCK_MAX, "Too many polygons in block");
+
+    uint8_t bytes[FFT_GEOMETRY_BLOCK_MAX];
+    fft_span_read_u8_array(span, count * 4, bytes);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* b = &bytes[i * 4];
+
+        // Populate the polygon's untextured info.
+        fft_polygon_t* poly = &g->polygons[poly_offset + i];
+        poly->untex.unknown_a = b[0];
+        poly->untex.unknown_b = b[1];
+        poly->untex.unknown_c = b[2];
+        poly->untex.unknown_d = b[3];
+    }
+
+    return poly_offset + count;
+}
+
+static uint32_t read_tile_locations(fft_span_t* span, fft_geometry_t* g, uint32_t poly_offset, uint32_t count) {
+    FFT_ASSERT(count * 2 <= FFT_GEOMETRY_BLOCK_MAX, "Too many polygons in block");
+
+    uint8_t bytes[FFT_GEOMETRY_BLOCK_MAX];
+    fft_span_read_u8_array(span, count * 2, bytes);
+
+    for (uint32_t i = 0; i < count; i++) {
+        // Read all data
+        uint8_t z_and_y = bytes[(i * 2) + 0]; // y is elevation 0 or 1
+        uint8_t x = bytes[(i * 2) + 1];
+
+        // Split single byte values
+        uint8_t y = (z_and_y >> 0) & 0x01; // 0b00000001
+        uint8_t z = (z_and_y >> 1) & 0x7F; // 0b11111110
+
+        // Populate the polygon's tile info.
+        fft_polygon_t* poly = &g->polygons[poly_offset + i];
+        poly->tiles.x = x;
+        poly->tiles.z = z;
+        poly->tiles.elevation = y;
+    }
+
+    return poly_offset + count;
+}
+
+static void fft_geometry_read_into(fft_span_t* span, fft_geometry_t* out) {
+    FFT_TRACE_BEGIN("fft_geometry_read");
+    memset(out, 0, sizeof(*out));
+
+    // The number of each type of polygon.
+    uint16_t N = fft_span_read_u16(span); // Textured triangles
+    uint16_t P = fft_span_read_u16(span); // Textured quads
+    uint16_t Q = fft_span_read_u16(span); // Untextured triangles
+    uint16_t R = fft_span_read_u16(span); // Untextured quads
+
+    // Validate maximum values
+    FFT_ASSERT(N < FFT_MESH_MAX_TEX_TRIS, "Mesh textured triangle count exceeded");
+    FFT_ASSERT(P < FFT_MESH_MAX_TEX_QUADS, "Mesh textured quad count exceeded");
+    FFT_ASSERT(Q < FFT_MESH_MAX_UNTEX_TRIS, "Mesh untextured triangle count exceeded");
+    FFT_ASSERT(R < FFT_MESH_MAX_UNTEX_QUADS, "Mesh untextured quad count exceeded");
+
+    // index is used to track the current position in the polygons array. It
+    // gets reset to 0 most of the time because most of this data is for the
+    // textured polygons, which come first.
+    uint32_t index = 0;
+
+    // Polygons
+    index = read_polygons(span, out, FFT_POLYTYPE_TRIANGLE, false, index, N);
+    index = read_polygons(span, out, FFT_POLYTYPE_QUAD, false, index, P);
+    index = read_polygons(span, out, FFT_POLYTYPE_TRIANGLE, false, index, Q);
+    index = read_polygons(span, out, FFT_POLYTYPE_QUAD, false, index, R);
+
+    // Normals
+    index = 0; // Reset for textured polygons
+    index = read_normals(span, out, FFT_POLYTYPE_TRIANGLE, index, N);
+    index = read_normals(span, out, FFT_POLYTYPE_QUAD, index, P);
+
+    // Texture Coordinates
+    index = 0; // Reset for textured polygons
+    index = read_texinfo(span, out, FFT_POLYTYPE_TRIANGLE, index, N);
+    index = read_texinfo(span, out, FFT_POLYTYPE_QUAD, index, P);
+
+    // Unknown Untextured Polygon Data
+    index = N + P; // Reset for untextured polygons
+    index = read_untexinfo(span, out, index, Q);
+    index = read_untexinfo(span, out, index, R);
+
+    // Tile Locations
+    index = 0; // Reset for textured polygons
+    index = read_tile_locations(span, out, index, N);
+    index = read_tile_locations(span, out, index, P);
+
+    FFT_TRACE_END("fft_geometry_read");
+}
+
+static fft_geometry_t fft_geometry_read(fft_span_t* span) {
+    fft_geometry_t geometry;
+    fft_geometry_read_into(span, &geometry);
+    return geometry;
+}
+
+/*
+================================================================================
+Lights and Background Implementation
+================================================================================
+*/
+
+static bool fft_light_is_valid(fft_light_t light) {
+    return light.color.r + light.color.g + light.color.b > 0.0f;
+}
+
+fft_lighting_t fft_lighting_read(fft_span_t* span) {
+    fft_lighting_t l = { 0 };
+
+    // Light colors are oddly stored all 3xR then 3xG then 3xB.
+    l.lights[0].color.r = fft_span_read_i16(span);
+    l.lights[1].color.r = fft_span_read_i16(span);
+    l.lights[2].color.r = fft_span_read_i16(span);
+    l.lights[0].color.g = fft_span_read_i16(span);
+    l.lights[1].color.g = fft_span_read_i16(span);
+    l.lights[2].color.g = fft_span_read_i16(span);
+    l.lights[0].color.b = fft_span_read_i16(span);
+    l.lights[1].color.b = fft_span_read_i16(span);
+    l.lights[2].color.b = fft_span_read_i16(span);
+
+    // Positions are stored as expected.
+    l.lights[0].position = fft_geometry_read_position(span);
+    l.lights[1].position = fft_geometry_read_position(span);
+    l.lights[2].position = fft_geometry_read_position(span);
+
+    l.ambient_color = fft_color_rgb8_read(span);
+
+    l.background_top = fft_color_rgb8_read(span);
+    l.background_bottom = fft_color_rgb8_read(span);
+
+    l.unknown_a = fft_span_read_u8(span);
+    l.unknown_b = fft_span_read_u8(span);
+    l.unknown_c = fft_span_read_u8(span);
+
+    return l;
+}
+
+/*
+================================================================================
+Terrain Implementation
+================================================================================
+*/
+
+// FIXME: This layout needs to be validated that it is reading everything correctly.
+// Bytes 1 and 5 are padding. Bits 3, 4, 5 of byte 6 are unused.
+#define FFT_TERRAIN_TILE_LAYOUT(F, B, A)                            \
+    B(surface, fft_terrain_surface_e, u8, 0, 0, 6) /* 0b00111111 */ \
+    F(sloped_height_bottom, uint8_t, u8, 2)                         \
+    B(sloped_height_top, uint8_t, u8, 3, 0, 5) /* 0b00011111 */     \
+    B(depth, uint8_t, u8, 3, 5, 3)             /* 0b11100000 */     \
+    F(slope, fft_terrain_slope_e, u8, 4)                            \
+    B(pass_through_only, bool, u8, 6, 0, 1)    /* bit 0 */          \
+    B(shading, uint8_t, u8, 6, 2, 2)           /* bit 1 & 2 */      \
+    B(cant_walk, bool, u8, 6, 6, 1)            /* bit 6 */          \
+    B(cant_select, bool, u8, 6, 7, 1)          /* bit 7 */          \
+    F(auto_cam_dir, uint8_t, u8, 7)
+
+FFT_FN_LAYOUT_DECODE(terrain_tile_layout, fft_terrain_tile_t, FFT_TERRAIN_TILE_SIZE, FFT_TERRAIN_TILE_LAYOUT)
+
+static void fft_terrain_read_into(fft_span_t* span, fft_terrain_t* out) {
+    FFT_TRACE_BEGIN("fft_terrain_read");
+    memset(out, 0, sizeof(*out));
+
+    uint8_t x_count = fft_span_read_u8(span);
+    uint8_t z_count = fft_span_read_u8(span);
+    FFT_ASSERT(x_count <= FFT_TERRAIN_MAX_X, "Terrain X count exceeded");
+    FFT_ASSERT(z_count <= FFT_TERRAIN_MAX_Z, "Terrain Z count exceeded");
+
+    // Each level is x_count * z_count tiles, stored in the same order as
+    // terrain.tiles, so a level decodes in one pass.
+    const size_t tile_count = (size_t)x_count * z_count;
+    FFT_ASSERT(tile_count <= FFT_TERRAIN_MAX_TILES, "Terrain tile count exceeded");
+    for (uint8_t level = 0; level < 2; level++) {
+        FFT_ASSERT(tile_count <= (span->size - span->offset) / FFT_TERRAIN_TILE_SIZE, "Out of bounds read.");
+        fft_terrain_tile_layout_decode_array(&span->data[span->offset], tile_count, out->tiles[level]);
+        span->offset += tile_count * FFT_TERRAIN_TILE_SIZE;
+
+        for (size_t i = 0; i < tile_count; i++) {
+            const fft_terrain_tile_t* tile = &out->tiles[level][i];
+            if (tile->slope == FFT_SLOPE_FLAT) {
+                // Sloped height top should be 0 for flat tiles but some
+                // maps tiles set to 1. This should be researched further.
+                FFT_ASSERT(tile->sloped_height_top == 0 || tile->sloped_height_top == 1, "Flat tile has > 1 sloped height top");
+            }
+        }
+    }
+
+    out->x_count = x_count;
+    out->z_count = z_count;
+    out->valid = true;
+    FFT_TRACE_END("fft_terrain_read");
+}
+
+static fft_terrain_t fft_terrain_read(fft_span_t* span) {
+    fft_terrain_t terrain;
+    fft_terrain_read_into(span, &terrain);
+    return terrain;
+}
+
+static const char* fft_terrain_surface_str(fft_terrain_surface_e value) {
+    switch (value) {
+#define X(oname, ovalue, ostring) \
+case oname:                       \
+    return ostring;
+        FFT_TERRAIN_SURFACE_INDEX
+#undef X
+    default:;
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "Unknown 0x%02X", value);
+        return buf;
+    }
+}
+
+static const char* fft_terrain_slope_str(fft_terrain_slope_e value) {
+    switch (value) {
+#define X(oname, ovalue, ostring) \
+case oname:                       \
+    return ostring;
+        FFT_TERRAIN_SLOPE_INDEX
+#undef X
+    default:;
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "Unknown 0x%02X", value);
+        return buf;
+    }
+}
+
+static const char* fft_terrain_shading_str(uint8_t value) {
+    switch (value) {
+    case 0:
+        return "Normal";
+    case 1:
+        return "Dark";
+    case 2:
+        return "Darker";
+    case 3:
+        return "Darkest";
+    default:
+        return "Unknown";
+    }
+}
+
+static void fft_terrain_camdir_str(uint8_t cam_dir, char out_str[static FFT_TERRAIN_STR_SIZE]) {
+    out_str[0] = '\0';
+
+    static const char* labels[8] = {
+        "NWT", "SWT",
+        "SET", "NET",
+        "NWB", "SWB",
+        "SEB", "NEB"
+    };
+
+    uint32_t offset = 0;
+    uint32_t written = 0;
+    bool first = true;
+
+    for (uint32_t i = 0; i < 8; i++) {
+        if (cam_dir & (1u << i)) {
+            if (!first) {
+                written = (uint32_t)snprintf(out_str + offset, FFT_TERRAIN_STR_SIZE - offset, ", ");
+                offset += (written > 0) ? written : 0;
+            }
+
+            written = (uint32_t)snprintf(out_str + offset, FFT_TERRAIN_STR_SIZE - offset, "%s", labels[i]);
+            offset += (written > 0) ? written : 0;
+
+            first = false;
+        }
+    }
+
+    if (offset == 0) {
+        snprintf(out_str, FFT_TERRAIN_STR_SIZE, "(None)");
+    }
+}
+
+/*
+================================================================================
+Mesh Implementation
+================================================================================
+*/
+
+// Reads the meta for the chunks present in the header. Only the polygon counts
+// and the lights are read.
+static fft_record_meta_t fft_mesh_meta_read(fft_span_t* span, const fft_mesh_header_t* header) {
+    fft_record_meta_t meta = { 0 };
+
+    if (header->geometry != 0) {
+        fft_span_set_offset(span, header->geometry);
+        meta.tex_tri_count = fft_span_read_u16(span);
+        meta.tex_quad_count = fft_span_read_u16(span);
+        meta.untex_tri_count = fft_span_read_u16(span);
+        meta.untex_quad_count = fft_span_read_u16(span);
+        meta.polygon_count = (uint16_t)(meta.tex_tri_count + meta.tex_quad_count + meta.untex_tri_count + meta.untex_quad_count);
+        meta.has_geometry = true;
+    }
+
+    meta.has_clut = header->clut_color != 0;
+
+    if (header->lights_and_background != 0) {
+        fft_span_set_offset(span, header->lights_and_background);
+        fft_lighting_t lighting = fft_lighting_read(span);
+        meta.has_lighting = true;
+
+        for (uint32_t i = 0; i < FFT_LIGHTING_MAX_LIGHTS; i++) {
+            if (fft_light_is_valid(lighting.lights[i])) {
+                meta.light_count++;
+            }
+        }
+    }
+
+    meta.has_terrain = header->terrain != 0;
+    return meta;
+}
+
+void fft_mesh_read_into(fft_span_t* span, fft_mesh_t* out) {
+    FFT_TRACE_BEGIN("fft_mesh_read");
+    FFT_ASSERT(span->data != NULL && span->offset == 0, "Invalid span for mesh read");
+
+    memset(out, 0, sizeof(*out));
+
+    out->header = fft_mesh_header_read(span);
+    out->meta = fft_mesh_meta_read(span, &out->header);
+
+    if (out->meta.has_geometry) {
+        fft_span_set_offset(span, out->header.geometry);
+        fft_geometry_read_into(span, &out->geometry);
+    }
+
+    if (out->meta.has_clut) {
+        fft_span_set_offset(span, out->header.clut_color);
+        out->clut = fft_clut_read(span);
+    }
+
+    if (out->meta.has_lighting) {
+        fft_span_set_offset(span, out->header.lights_and_background);
+        out->lighting = fft_lighting_read(span);
+    }
+
+    if (out->meta.has_terrain) {
+        fft_span_set_offset(span, out->header.terrain);
+        fft_terrain_read_into(span, &out->terrain);
+    }
+
+    FFT_TRACE_END("fft_mesh_read");
+}
+
+fft_record_meta_t fft_mesh_measure(const fft_span_t* span) {
+    FFT_ASSERT(span->data != NULL && span->offset == 0, "Invalid span for mesh measure");
+    fft_span_t copy = *span;
+    fft_mesh_header_t header = fft_mesh_header_read(&copy);
+    return fft_mesh_meta_read(&copy, &header);
+}
+
+fft_mesh_t fft_mesh_read(fft_span_t* span) {
+    fft_mesh_t mesh;
+    fft_mesh_read_into(span, &mesh);
+    return mesh;
+}
+
+/*
+================================================================================
+Texture Implementation
+================================================================================
+*/
+
+static void fft_texture_destroy(fft_texture_t texture) {
+    fft_image_destroy(&texture.image);
+}
+
+static fft_texture_t fft_texture_read(fft_span_t* span, fft_state_t state) {
+    FFT_TRACE_BEGIN("fft_texture_read");
+    fft_image_t image = fft_image_read_4bpp(span, FFT_TEXTURE_WIDTH, FFT_TEXTURE_HEIGHT);
+    FFT_TRACE_END("fft_texture_read");
+    return (fft_texture_t) {
+        .state = state,
+        .image = image,
+    };
+}
+
+/*
+================================================================================
+Map Data Implementation
+================================================================================
+*/
+
+// Decodes a record's resource into the map data.
+static void fft_map_data_decode_record(fft_map_data_t* map_data, fft_record_t* record, fft_span_t* file) {
+    switch (record->type) {
+    case FFT_RECORDTYPE_TEXTURE: {
+        fft_texture_t texture = fft_texture_read(file, record->state);
+        map_data->textures[map_data->texture_count++] = texture;
+        break;
+    }
+    case FFT_RECORDTYPE_MESH_PRIMARY: {
+        // There always only one primary mesh file and it uses default state.
+        FFT_ASSERT(fft_state_is_default(record->state), "Primary mesh file has non-default state");
+        fft_mesh_read_into(file, &map_data->primary_mesh);
+        record->meta = map_data->primary_mesh.meta;
+        break;
+    }
+    case FFT_RECORDTYPE_MESH_ALT: {
+        fft_mesh_t* alt_mesh = &map_data->alt_meshes[map_data->alt_mesh_count++];
+        fft_mesh_read_into(file, alt_mesh);
+        alt_mesh->state = record->state;
+        record->meta = map_data->primary_mesh.meta;
+        break;
+    }
+    case FFT_RECORDTYPE_MESH_OVERRIDE: {
+        // If there is an override file, there is only one and it uses default state.
+        FFT_ASSERT(fft_state_is_default(record->state), "Override must be default map state");
+        fft_mesh_read_into(file, &map_data->override_mesh);
+        record->meta = map_data->primary_mesh.meta;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static bool fft_map_data_record_has_resource(const fft_record_t* record) {
+    switch (record->type) {
+    case FFT_RECORDTYPE_TEXTURE:
+    case FFT_RECORDTYPE_MESH_PRIMARY:
+    case FFT_RECORDTYPE_MESH_ALT:
+    case FFT_RECORDTYPE_MESH_OVERRIDE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+fft_map_data_t* fft_map_data_read(int map_id) {
+    fft_access_log_record(FFT_ACCESS_MAP_READ, (uint32_t)map_id);
+    fft_map_data_t* map_data = FFT_MEM_ALLOC(sizeof(fft_map_data_t));
+
+    const fft_io_entry_e map_file = fft_map_list[map_id].entry;
+
+    fft_span_t gns = fft_io_open(map_file);
+    {
+        map_data->record_count = fft_record_read_all(&gns, map_data->records);
+    }
+    fft_io_close(gns);
+
+    for (uint32_t i = 0; i < map_data->record_count; i++) {
+        fft_record_t* record = &map_data->records[i];
+        if (!fft_map_data_record_has_resource(record)) {
+            continue;
+        }
+
+        // Fetch the resource file
+        fft_span_t file = fft_io_read(record->sector, record->length);
+        fft_map_data_decode_record(map_data, record, &file);
+        fft_io_close(file);
+    }
+
+    return map_data;
+}
+
+static const fft_record_t* fft_map_find_record(const fft_record_t* records, uint32_t record_count, fft_recordtype_e type, fft_state_t state) {
+    for (uint32_t i = 0; i < record_count; i++) {
+        const fft_record_t* record = &records[i];
+        if (record->type == type && fft_state_is_equal(record->state, state)) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+// The records one map state uses. The alt mesh is only used by non-default
+// states, and states without their own texture use the default one.
+typedef struct {
+    const fft_record_t* primary;
+    const fft_record_t* alt;
+    const fft_record_t* texture;
+} fft_map_state_records_t;
+
+static fft_map_state_records_t fft_map_state_records(const fft_record_t* records, uint32_t record_count, fft_state_t state) {
+    fft_map_state_records_t out = { 0 };
+    out.primary = fft_map_find_record(records, record_count, FFT_RECORDTYPE_MESH_PRIMARY, fft_default_state);
+    if (!fft_state_is_default(state)) {
+        out.alt = fft_map_find_record(records, record_count, FFT_RECORDTYPE_MESH_ALT, state);
+    }
+    out.texture = fft_map_find_record(records, record_count, FFT_RECORDTYPE_TEXTURE, state);
+    if (out.texture == NULL) {
+        out.texture = fft_map_find_record(records, record_count, FFT_RECORDTYPE_TEXTURE, fft_default_state);
+    }
+    return out;
+}
+
+uint32_t fft_map_state_disc_size(int map_id, fft_state_t state) {
+    FFT_ASSERT(map_id >= 0 && map_id < FFT_MAP_DESC_LIST_COUNT && fft_map_list[map_id].valid, "Invalid map %d", map_id);
+
+    fft_record_t records[FFT_RECORD_MAX];
+    fft_span_t gns = fft_io_open(fft_map_list[map_id].entry);
+    uint8_t record_count = fft_record_read_all(&gns, records);
+    fft_io_close(gns);
+
+    fft_map_state_records_t state_records = fft_map_state_records(records, record_count, state);
+    uint32_t size = 0;
+    if (state_records.primary != NULL) {
+        size += state_records.primary->length;
+    }
+    if (state_records.alt != NULL) {
+        size += state_records.alt->length;
+    }
+    if (state_records.texture != NULL) {
+        size += state_records.texture->length;
+    }
+    return size;
+}
+
+static void fft_map_data_read_range(void* arg, uint32_t begin, uint32_t end) {
+    fft_map_data_t** out_maps = (fft_map_data_t**)arg;
+    _fft_access_log_muted++;
+    for (uint32_t i = begin; i < end; i++) {
+        out_maps[i] = fft_map_list[i].valid ? fft_map_data_read((int)fft_map_list[i].id) : NULL;
+    }
+    _fft_access_log_muted--;
+}
+
+enum {
+    FFT_MAP_RESOURCE_MAX = FFT_MAP_DESC_LIST_COUNT * FFT_RECORD_MAX,
+};
+
+// Resources of a bulk map job, in request order.
+typedef struct {
+    fft_io_request_t requests[FFT_MAP_RESOURCE_MAX];
+    uint8_t map_ids[FFT_MAP_RESOURCE_MAX];
+    uint8_t record_indexes[FFT_MAP_RESOURCE_MAX];
+    fft_state_t states[FFT_MAP_RESOURCE_MAX];
+    uint32_t count;
+
+    fft_map_data_t** maps;
+    fft_texture_visit_fn visit;
+    void* userdata;
+} fft_map_resource_list_t;
+
+static void fft_map_resource_list_add(fft_map_resource_list_t* list, uint8_t map_id, uint8_t record_index, const fft_record_t* record) {
+    FFT_ASSERT(list->count < FFT_MAP_RESOURCE_MAX, "Too many map resources");
+    list->requests[list->count] = (fft_io_request_t) { .sector = record->sector, .size = record->length };
+    list->map_ids[list->count] = map_id;
+    list->record_indexes[list->count] = record_index;
+    list->states[list->count] = record->state;
+    list->count++;
+}
+
+static void fft_map_data_decode_pipelined(void* arg, uint32_t index, fft_span_t* span) {
+    fft_map_resource_list_t* list = (fft_map_resource_list_t*)arg;
+    fft_map_data_t* map_data = list->maps[list->map_ids[index]];
+    fft_map_data_decode_record(map_data, &map_data->records[list->record_indexes[index]], span);
+}
+
+void fft_map_data_read_all(const fft_executor_t* executor, fft_map_data_t* out_maps[FFT_MAP_DESC_LIST_COUNT]) {
+    fft_access_log_record(FFT_ACCESS_MAP_READ_ALL, 0);
+    if (executor != NULL) {
+        fft_executor_parallel_for(executor, FFT_MAP_DESC_LIST_COUNT, 1, fft_map_data_read_range, out_maps);
+        return;
+    }
+
+    // Records are needed up front to know what to read. They are small.
+    fft_map_resource_list_t* list = FFT_MEM_ALLOC_TAG(sizeof(fft_map_resource_list_t), "map_resource_list");
+    list->maps = out_maps;
+    for (uint8_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        out_maps[i] = NULL;
+        if (!fft_map_list[i].valid) {
+            continue;
+        }
+
+        fft_map_data_t* map_data = FFT_MEM_ALLOC(sizeof(fft_map_data_t));
+        fft_span_t gns = fft_io_open(fft_map_list[i].entry);
+        map_data->record_count = fft_record_read_all(&gns, map_data->records);
+        fft_io_close(gns);
+        out_maps[i] = map_data;
+
+        for (uint8_t j = 0; j < map_data->record_count; j++) {
+            if (fft_map_data_record_has_resource(&map_data->records[j])) {
+                fft_map_resource_list_add(list, i, j, &map_data->records[j]);
+            }
+        }
+    }
+
+    fft_io_pipeline_run(list->requests, list->count, fft_map_data_decode_pipelined, list);
+    FFT_MEM_FREE(list);
+}
+
+static void fft_map_texture_decode_pipelined(void* arg, uint32_t index, fft_span_t* span) {
+    fft_map_resource_list_t* list = (fft_map_resource_list_t*)arg;
+    fft_texture_t texture = fft_texture_read(span, list->states[index]);
+    list->visit(list->userdata, list->map_ids[index], &texture);
+    fft_texture_destroy(texture);
+}
+
+void fft_map_texture_read_each(fft_texture_visit_fn visit, void* userdata) {
+    fft_access_log_record(FFT_ACCESS_MAP_TEXTURES, 0);
+    fft_map_resource_list_t* list = FFT_MEM_ALLOC_TAG(sizeof(fft_map_resource_list_t), "map_resource_list");
+    list->visit = visit;
+    list->userdata = userdata;
+
+    // The list keeps each texture's state, so the records are only needed
+    // while they are parsed and no map data is kept.
+    fft_record_t records[FFT_RECORD_MAX];
+    for (uint8_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (!fft_map_list[i].valid) {
+            continue;
+        }
+        fft_span_t gns = fft_io_open(fft_map_list[i].entry);
+        uint8_t record_count = fft_record_read_all(&gns, records);
+        fft_io_close(gns);
+
+        for (uint8_t j = 0; j < record_count; j++) {
+            if (records[j].type == FFT_RECORDTYPE_TEXTURE) {
+                fft_map_resource_list_add(list, i, j, &records[j]);
+            }
+        }
+    }
+
+    fft_io_pipeline_run(list->requests, list->count, fft_map_texture_decode_pipelined, list);
+    FFT_MEM_FREE(list);
+}
+
+void fft_map_data_destroy(fft_map_data_t* map) {
+    if (map == NULL) {
+        return;
+    }
+
+    // Textures
+    for (uint32_t i = 0; i < map->texture_count; i++) {
+        fft_texture_destroy(map->textures[i]);
+    }
+
+    FFT_MEM_FREE(map);
+}
+
+/*
+================================================================================
+Incremental Map Loading Implementation
+================================================================================
+*/
+
+void fft_map_loader_begin(fft_map_loader_t* loader, int map_id) {
+    fft_access_log_record(FFT_ACCESS_MAP_LOADER, (uint32_t)map_id);
+    FFT_ASSERT(map_id >= 0 && map_id < FFT_MAP_DESC_LIST_COUNT, "Map id %d out of bounds", map_id);
+    *loader = (fft_map_loader_t) { .map_id = map_id, .stage = FFT_MAP_LOADER_STAGE_GNS };
+}
+
+// Moves to the next record with a resource, or to done.
+static void fft_map_loader_next_record(fft_map_loader_t* loader) {
+    fft_map_data_t* map_data = loader->map_data;
+    while (loader->record_index < map_data->record_count && !fft_map_data_record_has_resource(&map_data->records[loader->record_index])) {
+        loader->record_index++;
+    }
+    loader->stage = loader->record_index < map_data->record_count ? FFT_MAP_LOADER_STAGE_READ : FFT_MAP_LOADER_STAGE_DONE;
+}
+
+bool fft_map_loader_step(fft_map_loader_t* loader) {
+    switch (loader->stage) {
+    case FFT_MAP_LOADER_STAGE_GNS: {
+        loader->map_data = FFT_MEM_ALLOC(sizeof(fft_map_data_t));
+        fft_span_t gns = fft_io_open(fft_map_list[loader->map_id].entry);
+        loader->map_data->record_count = fft_record_read_all(&gns, loader->map_data->records);
+        fft_io_close(gns);
+
+        loader->record_index = 0;
+        fft_map_loader_next_record(loader);
+        break;
+    }
+    case FFT_MAP_LOADER_STAGE_READ: {
+        const fft_record_t* record = &loader->map_data->records[loader->record_index];
+        loader->file = fft_io_read(record->sector, record->length);
+        loader->stage = FFT_MAP_LOADER_STAGE_DECODE;
+        break;
+    }
+    case FFT_MAP_LOADER_STAGE_DECODE: {
+        fft_record_t* record = &loader->map_data->records[loader->record_index];
+        fft_map_data_decode_record(loader->map_data, record, &loader->file);
+        fft_io_close(loader->file);
+        loader->file = (fft_span_t) { 0 };
+
+        loader->record_index++;
+        fft_map_loader_next_record(loader);
+        break;
+    }
+    case FFT_MAP_LOADER_STAGE_DONE:
+        break;
+    }
+    return loader->stage == FFT_MAP_LOADER_STAGE_DONE;
+}
+
+bool fft_map_loader_update(fft_map_loader_t* loader, uint32_t budget_us) {
+    uint64_t deadline = fft_time_now_ns() + ((uint64_t)budget_us * 1000u);
+    bool done = fft_map_loader_step(loader);
+    while (!done && fft_time_now_ns() < deadline) {
+        done = fft_map_loader_step(loader);
+    }
+    return done;
+}
+
+fft_map_data_t* fft_map_loader_finish(fft_map_loader_t* loader) {
+    FFT_ASSERT(loader->stage == FFT_MAP_LOADER_STAGE_DONE, "Map loader is not done");
+    fft_map_data_t* map_data = loader->map_data;
+    *loader = (fft_map_loader_t) { 0 };
+    return map_data;
+}
+
+void fft_map_loader_cancel(fft_map_loader_t* loader) {
+    if (loader->file.data != NULL) {
+        fft_io_close(loader->file);
+    }
+    fft_map_data_destroy(loader->map_data);
+    *loader = (fft_map_loader_t) { 0 };
+}
+
+/*
+================================================================================
+Scenario Implementation
+================================================================================
+*/
+
+static void validate_nextstep(fft_nextstep_e step) {
+    switch (step) {
+    case FFT_NEXTSTEP_NONE:
+    case FFT_NEXTSTEP_WORLD_MAP:
+    case FFT_NEXTSTEP_EVENT:
+    case FFT_NEXTSTEP_RESET:
+        return;
+    default:
+        FFT_ASSERT(false, "Invalid step value: %d", step);
+    }
+}
+
+#define FFT_SCENARIO_LAYOUT(F, B, A)     \
+    F(event_id, uint16_t, u16, 0)        \
+    F(map_id, uint8_t, u8, 2)            \
+    F(weather, fft_weather_e, u8, 3)     \
+    F(time, fft_time_e, u8, 4)           \
+    F(music_file_first, uint8_t, u8, 5)  \
+    F(music_file_second, uint8_t, u8, 6) \
+    F(entd_id, uint16_t, u16, 7)         \
+    F(grid_first, uint16_t, u16, 9)      \
+    F(grid_second, uint16_t, u16, 11)    \
+    F(unknown_jjjj, uint32_t, u32, 13)   \
+    F(ramza_required, uint8_t, u8, 17)   \
+    F(next_event_id, uint16_t, u16, 18)  \
+    F(next_step, fft_nextstep_e, u8, 20) \
+    F(unknown_n, uint8_t, u8, 21)        \
+    F(script_id, uint16_t, u16, 22)      \
+    A(data, uint8_t, u8, 0, FFT_SCENARIO_SIZE) // All 24 bytes
+
+FFT_FN_LAYOUT_DECODE(scenario_layout, fft_scenario_t, FFT_SCENARIO_SIZE, FFT_SCENARIO_LAYOUT)
+
+static fft_scenario_t fft_scenario_decode(const uint8_t* data) {
+    fft_scenario_t scenario = { 0 };
+    fft_scenario_layout_decode(data, &scenario);
+    return scenario;
+}
+
+static void fft_scenario_validate(const fft_scenario_t* scenario) {
+    validate_time(scenario->time);
+    validate_weather(scenario->weather);
+    validate_nextstep(scenario->next_step);
+
+    if (scenario->next_step == FFT_NEXTSTEP_EVENT) {
+        FFT_ASSERT(scenario->next_event_id != 0, "Scenario with next step EVENT must have a next event id");
+    }
+}
+
+fft_scenario_t fft_scenario_get_scenario(uint32_t id) {
+    fft_access_log_record(FFT_ACCESS_SCENARIO, id);
+    FFT_ASSERT(id < FFT_SCENARIO_COUNT, "Scenario id %d out of bounds", id);
+    fft_span_t attack_out_file = fft_io_open(F_EVENT__ATTACK_OUT);
+
+    fft_scenario_t scenario = fft_scenario_decode(attack_out_file.data + FFT_SCENARIO_OFFSET + (id * FFT_SCENARIO_SIZE));
+    fft_scenario_validate(&scenario);
+
+    fft_io_close(attack_out_file);
+
+    return scenario;
+}
+
+static uint16_t fft_scenario_key(const fft_scenario_t* scenario, fft_scenario_key_e key) {
+    switch (key) {
+    case FFT_SCENARIO_KEY_MAP_ID:
+        return scenario->map_id;
+    case FFT_SCENARIO_KEY_EVENT_ID:
+        return scenario->event_id;
+    case FFT_SCENARIO_KEY_ENTD_ID:
+        return scenario->entd_id;
+    case FFT_SCENARIO_KEY_NEXT_EVENT_ID:
+        return scenario->next_event_id;
+    default:
+        FFT_ASSERT(false, "Invalid scenario key: %d", key);
+        return 0;
+    }
+}
+
+// Index entries are packed as (key << 16 | id) so sorting them orders by key,
+// then by id.
+static int scenario_index_compare(const void* a, const void* b) {
+    uint32_t value_a = *(const uint32_t*)a;
+    uint32_t value_b = *(const uint32_t*)b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+fft_scenario_table_t fft_scenario_table_read(void) {
+    fft_scenario_table_t table = { 0 };
+
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        fft_event_desc_t desc = fft_event_desc_list[i];
+        if (desc.usable && desc.scenario_id < FFT_SCENARIO_COUNT) {
+            table.usable[desc.scenario_id] = true;
+        }
+    }
+
+    fft_span_t attack_out_file = fft_io_open(F_EVENT__ATTACK_OUT);
+    const uint8_t* rows = attack_out_file.data + FFT_SCENARIO_OFFSET;
+    for (uint32_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        table.scenarios[i] = fft_scenario_decode(rows + (i * FFT_SCENARIO_SIZE));
+        if (table.usable[i]) {
+            fft_scenario_validate(&table.scenarios[i]);
+            table.usable_count++;
+        }
+    }
+    fft_io_close(attack_out_file);
+
+    uint32_t entries[FFT_SCENARIO_COUNT];
+    for (uint32_t key = 0; key < FFT_SCENARIO_KEY_COUNT; key++) {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+            if (table.usable[i]) {
+                entries[count++] = ((uint32_t)fft_scenario_key(&table.scenarios[i], key) << 16) | i;
+            }
+        }
+
+        qsort(entries, count, sizeof(uint32_t), scenario_index_compare);
+
+        for (uint32_t i = 0; i < count; i++) {
+            table.index_keys[key][i] = (uint16_t)(entries[i] >> 16);
+            table.index_ids[key][i] = (uint16_t)(entries[i] & 0xFFFF);
+        }
+    }
+
+    return table;
+}
+
+uint16_t fft_scenario_table_find(const fft_scenario_table_t* table, fft_scenario_key_e key, uint16_t value, const uint16_t** out_ids) {
+    FFT_ASSERT(key < FFT_SCENARIO_KEY_COUNT, "Invalid scenario key: %d", key);
+    const uint16_t* keys = table->index_keys[key];
+
+    // Lower bound of value
+    uint32_t low = 0;
+    uint32_t high = table->usable_count;
+    while (low < high) {
+        uint32_t mid = low + ((high - low) / 2);
+        if (keys[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    uint32_t end = low;
+    while (end < table->usable_count && keys[end] == value) {
+        end++;
+    }
+
+    *out_ids = &table->index_ids[key][low];
+    return (uint16_t)(end - low);
+}
+
+/*
+================================================================================
+Story Graph Implementation
+================================================================================
+*/
+
+static void fft_story_graph_build_edges(fft_story_graph_t* graph, const fft_scenario_table_t* table) {
+    for (uint16_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        graph->edge_offsets[i] = graph->edge_count;
+
+        const fft_scenario_t* scenario = &table->scenarios[i];
+        if (!table->usable[i] || scenario->next_step != FFT_NEXTSTEP_EVENT) {
+            continue;
+        }
+
+        const uint16_t* ids = NULL;
+        uint16_t count = fft_scenario_table_find(table, FFT_SCENARIO_KEY_EVENT_ID, scenario->next_event_id, &ids);
+        FFT_ASSERT(graph->edge_count + count <= FFT_STORY_EDGE_MAX, "Too many story graph edges");
+        memcpy(&graph->edges[graph->edge_count], ids, count * sizeof(uint16_t));
+        graph->edge_count += count;
+    }
+    graph->edge_offsets[FFT_SCENARIO_COUNT] = graph->edge_count;
+}
+
+// Breadth first search from a scenario. Fills out_parent with the scenario
+// each node was first reached from, or FFT_STORY_DEPTH_NONE. from gets a parent
+// too when the search comes back to it, which means it is on a cycle.
+static void fft_story_graph_search(const fft_story_graph_t* graph, uint16_t from, uint16_t out_parent[FFT_SCENARIO_COUNT]) {
+    uint16_t queue[FFT_SCENARIO_COUNT];
+    uint16_t head = 0;
+    uint16_t tail = 0;
+
+    for (uint32_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        out_parent[i] = FFT_STORY_DEPTH_NONE;
+    }
+
+    queue[tail++] = from;
+    while (head < tail) {
+        uint16_t node = queue[head++];
+        for (uint16_t e = graph->edge_offsets[node]; e < graph->edge_offsets[node + 1]; e++) {
+            uint16_t next = graph->edges[e];
+            if (out_parent[next] != FFT_STORY_DEPTH_NONE) {
+                continue;
+            }
+            out_parent[next] = node;
+            if (next != from) {
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+static void fft_story_graph_build_reachable(fft_story_graph_t* graph) {
+    uint16_t parent[FFT_SCENARIO_COUNT];
+    for (uint16_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        if (graph->edge_offsets[i] == graph->edge_offsets[i + 1]) {
+            continue;
+        }
+        fft_story_graph_search(graph, i, parent);
+        for (uint16_t j = 0; j < FFT_SCENARIO_COUNT; j++) {
+            if (parent[j] != FFT_STORY_DEPTH_NONE) {
+                graph->reachable[i][j / 32] |= 1u << (j % 32);
+            }
+        }
+    }
+}
+
+// Kahn's algorithm. Depth is relaxed in topological order so it ends up as the
+// longest chain leading to each node.
+static void fft_story_graph_build_order(fft_story_graph_t* graph, const fft_scenario_table_t* table) {
+    uint16_t in_degree[FFT_SCENARIO_COUNT] = { 0 };
+    for (uint16_t e = 0; e < graph->edge_count; e++) {
+        in_degree[graph->edges[e]]++;
+    }
+
+    for (uint16_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        graph->depth[i] = FFT_STORY_DEPTH_NONE;
+        if (table->usable[i] && in_degree[i] == 0) {
+            graph->depth[i] = 0;
+            graph->topo_order[graph->topo_count++] = i;
+        }
+    }
+
+    for (uint16_t head = 0; head < graph->topo_count; head++) {
+        uint16_t node = graph->topo_order[head];
+        for (uint16_t e = graph->edge_offsets[node]; e < graph->edge_offsets[node + 1]; e++) {
+            uint16_t next = graph->edges[e];
+            uint16_t depth = graph->depth[node] + 1;
+            if (graph->depth[next] == FFT_STORY_DEPTH_NONE || graph->depth[next] < depth) {
+                graph->depth[next] = depth;
+            }
+            if (--in_degree[next] == 0) {
+                graph->topo_order[graph->topo_count++] = next;
+            }
+        }
+    }
+
+    // Nodes left with edges into them are part of, or follow, a cycle.
+    for (uint16_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        if (in_degree[i] != 0) {
+            graph->depth[i] = FFT_STORY_DEPTH_NONE;
+        }
+    }
+}
+
+fft_story_graph_t fft_story_graph_build(const fft_scenario_table_t* table) {
+    fft_story_graph_t graph = { 0 };
+    fft_story_graph_build_edges(&graph, table);
+    fft_story_graph_build_reachable(&graph);
+    fft_story_graph_build_order(&graph, table);
+    return graph;
+}
+
+uint16_t fft_story_graph_successors(const fft_story_graph_t* graph, uint16_t scenario_id, const uint16_t** out_ids) {
+    FFT_ASSERT(scenario_id < FFT_SCENARIO_COUNT, "Scenario id %d out of bounds", scenario_id);
+    uint16_t start = graph->edge_offsets[scenario_id];
+    *out_ids = &graph->edges[start];
+    return graph->edge_offsets[scenario_id + 1] - start;
+}
+
+bool fft_story_graph_is_reachable(const fft_story_graph_t* graph, uint16_t from, uint16_t to) {
+    FFT_ASSERT(from < FFT_SCENARIO_COUNT && to < FFT_SCENARIO_COUNT, "Scenario id out of bounds");
+    return (graph->reachable[from][to / 32] >> (to % 32)) & 1;
+}
+
+uint16_t fft_story_graph_shortest_path(const fft_story_graph_t* graph, uint16_t from, uint16_t to, uint16_t out_path[FFT_SCENARIO_COUNT]) {
+    FFT_ASSERT(from < FFT_SCENARIO_COUNT && to < FFT_SCENARIO_COUNT, "Scenario id out of bounds");
+    if (from == to) {
+        out_path[0] = from;
+        return 1;
+    }
+    if (!fft_story_graph_is_reachable(graph, from, to)) {
+        return 0;
+    }
+
+    uint16_t parent[FFT_SCENARIO_COUNT];
+    fft_story_graph_search(graph, from, parent);
+
+    // Walk back from the target, then reverse.
+    uint16_t length = 0;
+    for (uint16_t node = to; node != from; node = parent[node]) {
+        out_path[length++] = node;
+    }
+    out_path[length++] = from;
+
+    for (uint16_t i = 0; i < length / 2; i++) {
+        uint16_t tmp = out_path[i];
+        out_path[i] = out_path[length - 1 - i];
+        out_path[length - 1 - i] = tmp;
+    }
+    return length;
+}
+
+/*
+================================================================================
+ENTD Implementation
+================================================================================
+*/
+
+fft_io_entry_e fft_entd_file(uint16_t entd_id) {
+    FFT_ASSERT(entd_id < FFT_ENTD_COUNT, "ENTD id %d out of bounds", entd_id);
+    static const fft_io_entry_e files[FFT_ENTD_FILE_COUNT] = {
+        F_BATTLE__ENTD1_ENT,
+        F_BATTLE__ENTD2_ENT,
+        F_BATTLE__ENTD3_ENT,
+        F_BATTLE__ENTD4_ENT,
+    };
+    return files[entd_id / FFT_ENTD_PER_FILE];
+}
+
+static fft_entd_unit_t fft_entd_unit_decode(const uint8_t* data, uint8_t slot) {
+    fft_entd_unit_t unit = { 0 };
+    unit.sprite_set = data[0x00];
+    unit.flags = data[0x01];
+    unit.name = data[0x02];
+    unit.level = data[0x03];
+    unit.brave = data[0x06];
+    unit.faith = data[0x07];
+    unit.job = data[0x0A];
+    unit.secondary = data[0x0B];
+    unit.reaction = (uint16_t)(data[0x0C] | (data[0x0D] << 8));
+    unit.support = (uint16_t)(data[0x0E] | (data[0x0F] << 8));
+    unit.movement = (uint16_t)(data[0x10] | (data[0x11] << 8));
+    unit.head = data[0x12];
+    unit.body = data[0x13];
+    unit.accessory = data[0x14];
+    unit.right_hand = data[0x15];
+    unit.left_hand = data[0x16];
+    unit.palette = data[0x17];
+    unit.team = (data[0x18] >> 4) & 0x03;
+    unit.controllable = (data[0x18] & 0x08) != 0;
+    unit.x = data[0x19];
+    unit.y = data[0x1A];
+    unit.facing = data[0x1B] & 0x03;
+    unit.upper_level = (data[0x1B] & 0x80) != 0;
+    unit.slot = slot;
+    return unit;
+}
+
+uint8_t fft_entd_decode(const uint8_t* data, fft_entd_unit_t out_units[FFT_ENTD_UNIT_MAX]) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < FFT_ENTD_UNIT_MAX; i++) {
+        const uint8_t* unit_data = data + (i * FFT_ENTD_UNIT_SIZE);
+        if (unit_data[0x00] == 0) {
+            continue; // Empty slot
+        }
+        out_units[count++] = fft_entd_unit_decode(unit_data, i);
+    }
+    return count;
+}
+
+fft_entd_t fft_entd_get_entd(uint16_t entd_id) {
+    fft_access_log_record(FFT_ACCESS_ENTD, entd_id);
+    fft_span_t file = fft_io_open(fft_entd_file(entd_id));
+    fft_entd_t entd = { 0 };
+    entd.unit_count = fft_entd_decode(file.data + ((entd_id % FFT_ENTD_PER_FILE) * FFT_ENTD_SIZE), entd.units);
+    fft_io_close(file);
+    return entd;
+}
+
+fft_entd_table_t fft_entd_table_read(void) {
+    fft_entd_table_t table = { 0 };
+
+    // Decode straight into a worst case buffer, then shrink it to the units
+    // that are actually present.
+    fft_entd_unit_t* units = FFT_MEM_ALLOC_TAG(FFT_ENTD_COUNT * FFT_ENTD_UNIT_MAX * sizeof(fft_entd_unit_t), "entd_units_scratch");
+
+    for (uint32_t f = 0; f < FFT_ENTD_FILE_COUNT; f++) {
+        fft_span_t file = fft_io_open(fft_entd_file((uint16_t)(f * FFT_ENTD_PER_FILE)));
+        for (uint32_t i = 0; i < FFT_ENTD_PER_FILE; i++) {
+            uint32_t entd_id = (f * FFT_ENTD_PER_FILE) + i;
+            table.unit_offsets[entd_id] = (uint16_t)table.unit_count;
+            table.unit_count += fft_entd_decode(file.data + (i * FFT_ENTD_SIZE), &units[table.unit_count]);
+        }
+        fft_io_close(file);
+    }
+    table.unit_offsets[FFT_ENTD_COUNT] = (uint16_t)table.unit_count;
+
+    table.units = FFT_MEM_ALLOC_TAG(FFT_MAX(table.unit_count, 1) * sizeof(fft_entd_unit_t), "entd_units");
+    memcpy(table.units, units, table.unit_count * sizeof(fft_entd_unit_t));
+    FFT_MEM_FREE(units);
+
+    return table;
+}
+
+void fft_entd_table_destroy(fft_entd_table_t* table) {
+    FFT_MEM_FREE(table->units);
+    *table = (fft_entd_table_t) { 0 };
+}
+
+uint8_t fft_entd_table_units(const fft_entd_table_t* table, uint16_t entd_id, const fft_entd_unit_t** out_units) {
+    FFT_ASSERT(entd_id < FFT_ENTD_COUNT, "ENTD id %d out of bounds", entd_id);
+    uint16_t start = table->unit_offsets[entd_id];
+    *out_units = &table->units[start];
+    return (uint8_t)(table->unit_offsets[entd_id + 1] - start);
+}
+
+/*
+================================================================================
+Event Opcodes Implementation
+================================================================================
+*/
+
+const fft_opcode_desc_t opcode_desc_list[] = {
+#define X(code, value, name, params, param_count) [code] = { value, name, params, param_count },
+    FFT_OPCODE_LIST
+#undef X
+};
+
+/*
+================================================================================
+Event Instructions Implementation
+================================================================================
+*/
+
+uint16_t fft_instructions_read(fft_span_t* span, fft_instruction_t* out_instructions) {
+    FFT_TRACE_BEGIN("fft_instructions_read");
+    uint16_t count = 0;
+    while (span->offset < span->size) {
+        fft_opcode_e id = (fft_opcode_e)fft_span_read_u8(span);
+        fft_opcode_desc_t desc = opcode_desc_list[id];
+        fft_instruction_t instruction = {
+            .opcode = id
+        };
+
+        for (int i = 0; i < desc.param_count; i++) {
+            fft_param_t param = { 0 };
+            if (desc.param_sizes[i] == FFT_PARAM_TYPE_U16) {
+                param.type = FFT_PARAM_TYPE_U16;
+                param.value.u16 = fft_span_read_u16(span);
+            } else if (desc.param_sizes[i] == FFT_PARAM_TYPE_U8) {
+                param.type = FFT_PARAM_TYPE_U8;
+                param.value.u8 = fft_span_read_u8(span);
+            } else {
+                FFT_ASSERT(false, "Unknown param type %d %s", desc.param_sizes[i], desc.name);
+            }
+            instruction.params[i] = param;
+            instruction.param_count++;
+        }
+        out_instructions[count++] = instruction;
+        FFT_ASSERT(count < FFT_INSTRUCTION_MAX, "Instruction count exceeded");
+    }
+    FFT_TRACE_END("fft_instructions_read");
+    return count;
+}
+
+/*
+================================================================================
+Packed Event Instructions Implementation
+================================================================================
+*/
+
+const fft_param_layout_t fft_param_layout_list[FFT_PARAM_LAYOUT_COUNT] = {
+    [FFT_PARAM_LAYOUT_NONE] = { { 0 }, 0 },
+#define X(code, value, name, params, param_count) [FFT_PARAM_LAYOUT_##code] = { params, param_count },
+    FFT_OPCODE_LIST
+#undef X
+};
+
+// Maps an opcode byte to its layout. Unknown opcodes map to FFT_PARAM_LAYOUT_NONE.
+static const uint8_t fft_opcode_layout_list[256] = {
+#define X(code, value, name, params, param_count) [value] = FFT_PARAM_LAYOUT_##code,
+    FFT_OPCODE_LIST
+#undef X
+};
+
+static size_t fft_param_layout_size(const fft_param_layout_t* layout, uint8_t param_count) {
+    size_t size = 0;
+    for (uint8_t i = 0; i < param_count; i++) {
+        size += layout->param_sizes[i];
+    }
+    return size;
+}
+
+uint16_t fft_instructions_pack(fft_span_t* span, fft_packed_instruction_t* out_instructions) {
+    uint16_t count = 0;
+    while (span->offset < span->size) {
+        FFT_ASSERT(span->offset <= UINT16_MAX, "Code section too large to pack");
+        uint16_t offset = (uint16_t)span->offset;
+        uint8_t opcode = fft_span_read_u8(span);
+        uint8_t layout = fft_opcode_layout_list[opcode];
+
+        // Check the bounds once for all of the parameters.
+        const fft_param_layout_t* desc = &fft_param_layout_list[layout];
+        size_t params_size = fft_param_layout_size(desc, desc->param_count);
+        FFT_ASSERT(span->offset + params_size <= span->size, "Out of bounds read.");
+        span->offset += params_size;
+
+        out_instructions[count++] = (fft_packed_instruction_t) {
+            .offset = offset,
+            .opcode = opcode,
+            .layout = layout,
+        };
+        FFT_ASSERT(count < FFT_INSTRUCTION_MAX, "Instruction count exceeded");
+    }
+    return count;
+}
+
+uint16_t fft_instructions_measure(const fft_span_t* span) {
+    uint32_t count = 0;
+    size_t offset = span->offset;
+    while (offset < span->size) {
+        const fft_param_layout_t* desc = &fft_param_layout_list[fft_opcode_layout_list[span->data[offset]]];
+        offset += 1 + fft_param_layout_size(desc, desc->param_count);
+        count++;
+    }
+    FFT_ASSERT(offset == span->size, "Out of bounds read.");
+    FFT_ASSERT(count <= UINT16_MAX, "Instruction count exceeded");
+    return (uint16_t)count;
+}
+
+uint8_t fft_packed_param_count(fft_packed_instruction_t instruction) {
+    return fft_param_layout_list[instruction.layout].param_count;
+}
+
+uint16_t fft_packed_param(const uint8_t* code, fft_packed_instruction_t instruction, uint8_t index) {
+    const fft_param_layout_t* layout = &fft_param_layout_list[instruction.layout];
+    FFT_ASSERT(index < layout->param_count, "Param index %d out of bounds", index);
+
+    const uint8_t* param = code + instruction.offset + 1 + fft_param_layout_size(layout, index);
+    if (layout->param_sizes[index] == FFT_PARAM_TYPE_U16) {
+        uint16_t value;
+        memcpy(&value, param, sizeof(value));
+        return value;
+    }
+    return param[0];
+}
+
+fft_instruction_t fft_packed_unpack(const uint8_t* code, fft_packed_instruction_t instruction) {
+    const fft_param_layout_t* layout = &fft_param_layout_list[instruction.layout];
+    fft_instruction_t out = {
+        .opcode = (fft_opcode_e)instruction.opcode,
+        .param_count = layout->param_count,
+    };
+
+    for (uint8_t i = 0; i < layout->param_count; i++) {
+        uint16_t value = fft_packed_param(code, instruction, i);
+        if (layout->param_sizes[i] == FFT_PARAM_TYPE_U16) {
+            out.params[i].type = FFT_PARAM_TYPE_U16;
+            out.params[i].value.u16 = value;
+        } else {
+            out.params[i].type = FFT_PARAM_TYPE_U8;
+            out.params[i].value.u8 = (uint8_t)value;
+        }
+    }
+    return out;
+}
+
+/*
+================================================================================
+Font Implementation
+================================================================================
+*/
+
+enum {
+    FFT_FONT_BYTES_PER_CHAR = 35,
+    FFT_FONT_BYTES_PER_PIXEL = 4,
+    FFT_FONT_CHAR_WIDTH = 10,
+    FFT_FONT_CHAR_HEIGHT = 14,
+};
+
+static int font_compare(const void* a, const void* b) {
+    uint16_t id_a = ((const fft_font_char_t*)a)->id;
+    uint16_t id_b = ((const fft_font_char_t*)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+const char* fft_font_get_char(uint16_t id) {
+    fft_font_char_t key = { id, NULL };
+    const fft_font_char_t* result = bsearch(&key, fft_font_chars, FFT_FONT_CHAR_COUNT, sizeof(fft_font_char_t), font_compare);
+    if (result == NULL) {
+        return NULL;
+    }
+    return result->data;
+}
+
+/*
+================================================================================
+Event Text Implementation
+================================================================================
+*/
+
+enum {
+    FFT_TEXT_DELIM = 0xFE,
+};
+
+// Appends len bytes of str to out_text at length and returns the new length.
+// out_text is NULL when only measuring.
+static size_t fft_text_append(char* out_text, size_t length, const char* str, size_t len) {
+    if (out_text != NULL) {
+        memcpy(&out_text[length], str, len);
+    }
+    return length + len;
+}
+
+// Decodes the text section into out_text, or only counts the output length if
+// out_text is NULL. Does not write the terminator.
+static size_t fft_text_decode(fft_span_t* span, char* out_text) {
+    size_t length = 0;
+
+    while (span->offset < span->size) {
+        uint8_t byte = fft_span_read_u8(span);
+
+        // These are special characters. We need to handle them differently.
+        // https://ffhacktics.com/wiki/Text_Format#Special_Characters
+        switch (byte) {
+        case FFT_TEXT_DELIM:
+            // This is the message delimiter.
+            length = fft_text_append(out_text, length, "\xFE", 1);
+            break;
+        case 0xE0: {
+            // Character name stored somewhere else. Hard coding for now.
+            const char* name = "Ramza";
+            length = fft_text_append(out_text, length, name, strlen(name));
+            break;
+        }
+        case 0xE2: {
+            uint8_t delay = fft_span_read_u8(span);
+            char buffer[32];
+            size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Delay: %d}", (uint32_t)delay);
+            length = fft_text_append(out_text, length, buffer, len);
+            break;
+        }
+        case 0xE3: {
+            uint8_t color = fft_span_read_u8(span);
+            char buffer[32];
+            size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Color: %d}", (uint32_t)color);
+            length = fft_text_append(out_text, length, buffer, len);
+            break;
+        }
+        case 0xF0:
+        case 0xF1:
+        case 0xF2:
+        case 0xF3: {
+            // This is a jump to another point in the text section.
+            // The next 2 bytes are the jump location and how many bytes to read.
+            // https://gomtuu.org/fft/trans/compression/
+            uint8_t second_byte = fft_span_read_u8(span);
+            uint8_t third_byte = fft_span_read_u8(span);
+            (void)second_byte; // Unused
+            (void)third_byte;  // Unused
+            const char* text_jump = "{TextJump}";
+            length = fft_text_append(out_text, length, text_jump, strlen(text_jump));
+            break;
+        }
+        case 0xF8: {
+            // New line/Line break
+            const char* close_str = "{LB}";
+            length = fft_text_append(out_text, length, close_str, strlen(close_str));
+            break;
+        }
+        case 0xFA:
+            // This one is not in the list but it is very common between words.
+            // It works well as a space though.
+            length = fft_text_append(out_text, length, " ", 1);
+            break;
+        case 0xFF: {
+            const char* close_str = "{Close}";
+            length = fft_text_append(out_text, length, close_str, strlen(close_str));
+            break;
+        }
+        default: {
+            if (byte > 0xCF) {
+                /* Two-byte character */
+                uint8_t second_byte = fft_span_read_u8(span);
+                uint16_t combined = (uint16_t)(second_byte | ((uint16_t)byte << 8));
+                const char* font_str = fft_font_get_char(combined);
+                if (font_str != NULL) {
+                    length = fft_text_append(out_text, length, font_str, strlen(font_str));
+                } else {
+                    /* Unknown character */
+                    char buffer[64];
+                    size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Unknown: 0x%X & 0x%X}", byte, second_byte);
+                    length = fft_text_append(out_text, length, buffer, len);
+                }
+            } else {
+                /* Single-byte character */
+                const char* font_str = fft_font_get_char(byte);
+                if (font_str != NULL) {
+                    length = fft_text_append(out_text, length, font_str, strlen(font_str));
+                } else {
+                    /* Unknown character */
+                    length = fft_text_append(out_text, length, "^", 1);
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    return length;
+}
+
+size_t fft_text_read(fft_span_t* span, char* out_text) {
+    FFT_TRACE_BEGIN("fft_text_read");
+    size_t length = fft_text_decode(span, out_text);
+    out_text[length] = '\0';
+    FFT_TRACE_END("fft_text_read");
+    return length;
+}
+
+size_t fft_text_measure(const fft_span_t* span) {
+    fft_span_t copy = *span;
+    return fft_text_decode(&copy, NULL);
+}
+
+size_t fft_text_by_index(const char* string, int index, char* buffer) {
+    FFT_ASSERT(index > 0, "Index must be greater than 0");
+    FFT_ASSERT(buffer != NULL, "Buffer must not be NULL");
+
+    int current_index = 1; // 1-based indexing
+    const char* start = string;
+    const char* ptr = string;
+
+    while (*ptr != '\0') {
+        if ((unsigned char)*ptr == FFT_TEXT_DELIM) {
+            if (current_index == index) {
+                ptrdiff_t diff = ptr - start;
+                FFT_ASSERT(diff >= 0, "negative length?");
+                size_t length = (size_t)diff;
+                strlcpy(buffer, start, length + 1);
+                return 0;
+            }
+            // Move to the next substring
+            current_index++;
+            start = ptr + 1;
+        }
+        ptr++;
+    }
+
+    // Check if the last substring is the desired one
+    if (current_index == index) {
+        ptrdiff_t diff = ptr - start;
+        FFT_ASSERT(diff >= 0, "negative length?");
+        size_t length = (size_t)diff;
+        strlcpy(buffer, start, length + 1);
+        return 0;
+    }
+
+    FFT_ASSERT(false, "Index out of bounds");
+}
+
+size_t fft_text_count(const char* string) {
+    FFT_ASSERT(string != NULL, "String must not be NULL");
+    if (*string == '\0') {
+        return 0;
+    }
+
+    size_t count = 1;
+    const char* ptr = string;
+    for (; *ptr; ++ptr) {
+        if ((uint8_t)*ptr == FFT_TEXT_DELIM) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*
+================================================================================
+Events Implementation
+================================================================================
+*/
+
+// Returns the code section of the raw event data. Returns false for events
+// with the invalid event marker.
+static bool fft_event_code_span(const uint8_t* event_data, fft_span_t* out_code) {
+    uint32_t text_offset;
+    memcpy(&text_offset, event_data, sizeof(text_offset));
+    if (text_offset == 0xF2F2F2F2) { // Invalid event marker
+        return false;
+    }
+    FFT_ASSERT(text_offset >= 4 && text_offset <= FFT_EVENT_SIZE, "Invalid event text offset 0x%X", text_offset);
+
+    *out_code = (fft_span_t) { .data = event_data + 4, .size = text_offset - 4 };
+    return true;
+}
+
+static fft_event_t fft_event_read(fft_span_t* span) {
+    fft_event_t event = { .valid = false };
+
+    uint32_t text_offset = fft_span_read_u32(span);
+    if (text_offset == 0xF2F2F2F2) { // Invalid event marker
+        return event;
+    }
+
+    memcpy(event.data, span->data, FFT_EVENT_SIZE);
+
+    size_t text_size = FFT_EVENT_SIZE - text_offset;
+    fft_span_t text_span = { .data = event.data + text_offset, .size = text_size };
+    size_t messages_len = fft_text_read(&text_span, event.messages);
+    size_t msg_count = fft_text_count(event.messages);
+
+    size_t code_size = text_offset - 4;
+    fft_span_t code_span = { .data = event.data + 4, .size = code_size };
+    size_t instruction_count = fft_instructions_read(&code_span, event.instructions);
+
+    event.message_count = msg_count;
+    event.messages_len = messages_len;
+    event.instruction_count = instruction_count;
+    event.valid = true;
+    return event;
+}
+
+fft_event_measure_t fft_event_measure(const uint8_t* event_data) {
+    fft_event_measure_t measure = { .valid = false };
+
+    fft_span_t code_span;
+    if (!fft_event_code_span(event_data, &code_span)) {
+        return measure;
     }
+
+    size_t text_offset = code_span.size + 4;
+    fft_span_t text_span = { .data = event_data + text_offset, .size = FFT_EVENT_SIZE - text_offset };
+    measure.messages_len = fft_text_measure(&text_span);
+    measure.instruction_count = fft_instructions_measure(&code_span);
+    measure.valid = true;
+    return measure;
 }
 
-static fft_record_t fft_record_read(fft_span_t* span) {
-    uint16_t raw_gns_unknown = fft_span_read_u16(span);    // 0
-    uint8_t raw_layout = fft_span_read_u8(span);           // 1-2
-    uint8_t raw_time_and_weather = fft_span_read_u8(span); // 3
-    fft_recordtype_e type = fft_span_read_u16(span);       // 4-5
-    uint16_t unknown_ee = fft_span_read_u16(span);         // 6-7
-    uint32_t sector = fft_span_read_u16(span);             // 8-9
-    uint16_t unknown_gg = fft_span_read_u16(span);         // 10-11
-    uint32_t length = fft_span_read_u32(span);             // 12-15
-    uint16_t unknown_ii = fft_span_read_u16(span);         // 16-17
-    uint16_t unknown_jj = fft_span_read_u16(span);         // 18-19
-
-    fft_record_unknown_e gns_unknown_aa = (fft_record_unknown_e)raw_gns_unknown;
-    validate_gns_unknown(gns_unknown_aa);
-
-    fft_layout_e layout = (fft_layout_e)raw_layout;
-    validate_layout(layout);
-
-    // Split time and weather from single byte.
-    // - time    = 0b10000000
-    // - weather = 0b01110000
-    fft_time_e time = (fft_time_e)((raw_time_and_weather >> 7) & 0x1);
-    validate_time(time);
-    fft_weather_e weather = (fft_weather_e)((raw_time_and_weather >> 4) & 0x7);
-    validate_weather(weather);
-
-    fft_record_t record = {
-        .type = type,
-        .sector = sector,
-        .length = length,
-        .state = {
-            .time = time,
-            .weather = weather,
-            .layout = layout,
-        },
-        .gns_unknown_aa = gns_unknown_aa,
-        .unknown_ee = unknown_ee,
-        .unknown_gg = unknown_gg,
-        .unknown_ii = unknown_ii,
-        .unknown_jj = unknown_jj,
+fft_event_t fft_event_get_event(uint32_t id) {
+    fft_access_log_record(FFT_ACCESS_EVENT, id);
+    FFT_ASSERT(id < FFT_EVENT_COUNT, "Event id %d out of bounds", id);
+    fft_span_t file = fft_io_open(F_EVENT__TEST_EVT);
+    fft_span_t span = {
+        .data = file.data + (id * FFT_EVENT_SIZE),
+        .size = FFT_EVENT_SIZE,
     };
-
-    // Rollback to the start of the record for raw data.
-    span->offset -= FFT_RECORD_SIZE;
-    fft_span_read_bytes(span, FFT_RECORD_SIZE, record.raw);
-
-    return record;
+    fft_event_t event = fft_event_read(&span);
+    fft_io_close(file);
+    return event;
 }
 
-static uint8_t fft_record_read_all(fft_span_t* span, fft_record_t* out_records) {
-    uint8_t count = 0;
-    while (span->offset + FFT_RECORD_SIZE < span->size) {
-        fft_record_t record = fft_record_read(span);
-        if (record.type == FFT_RECORDTYPE_END) {
-            break;
-        }
-        if (count >= FFT_RECORD_MAX) {
-            break;
+enum {
+    FFT_EVENT_CHUNK_COUNT = 32, // Events per pipelined read
+    FFT_EVENT_CHUNK_MAX = (FFT_EVENT_COUNT + FFT_EVENT_CHUNK_COUNT - 1) / FFT_EVENT_CHUNK_COUNT,
+};
+
+typedef struct {
+    fft_event_visit_fn visit;
+    void* userdata;
+    fft_event_t* event;
+} fft_event_read_each_t;
+
+static void fft_event_decode_chunk(void* arg, uint32_t index, fft_span_t* span) {
+    fft_event_read_each_t* each = (fft_event_read_each_t*)arg;
+    uint32_t event_count = (uint32_t)(span->size / FFT_EVENT_SIZE);
+    for (uint32_t i = 0; i < event_count; i++) {
+        fft_span_t event_span = { .data = span->data + (i * FFT_EVENT_SIZE), .size = FFT_EVENT_SIZE };
+        *each->event = fft_event_read(&event_span);
+        if (each->event->valid) {
+            each->visit(each->userdata, (uint16_t)((index * FFT_EVENT_CHUNK_COUNT) + i), each->event);
         }
-        out_records[count++] = record;
     }
-    return count;
 }
 
-const char* fft_recordtype_str(fft_recordtype_e value) {
-    switch (value) {
-    case FFT_RECORDTYPE_MESH_PRIMARY:
-        return "Primary";
-    case FFT_RECORDTYPE_MESH_ALT:
-        return "Alt";
-    case FFT_RECORDTYPE_MESH_OVERRIDE:
-        return "Override";
-    case FFT_RECORDTYPE_TEXTURE:
-        return "Texture";
-    case FFT_RECORDTYPE_END:
-        return "End";
-    default:
-        return "Unknown";
+void fft_event_read_each(fft_event_visit_fn visit, void* userdata) {
+    fft_access_log_record(FFT_ACCESS_EVENT_EACH, 0);
+    fft_io_request_t requests[FFT_EVENT_CHUNK_MAX];
+    const uint32_t sector = fft_io_file_list[F_EVENT__TEST_EVT].sector;
+    for (uint32_t i = 0; i < FFT_EVENT_CHUNK_MAX; i++) {
+        uint32_t first = i * FFT_EVENT_CHUNK_COUNT;
+        uint32_t count = FFT_MIN((uint32_t)FFT_EVENT_CHUNK_COUNT, FFT_EVENT_COUNT - first);
+        requests[i] = (fft_io_request_t) { .sector = sector, .offset = first * FFT_EVENT_SIZE, .size = count * FFT_EVENT_SIZE };
     }
+
+    // fft_event_t is too big to keep on the stack.
+    fft_event_read_each_t each = { .visit = visit, .userdata = userdata };
+    each.event = FFT_MEM_ALLOC_TAG(sizeof(fft_event_t), "event_read_each");
+    fft_io_pipeline_run(requests, FFT_EVENT_CHUNK_MAX, fft_event_decode_chunk, &each);
+    FFT_MEM_FREE(each.event);
 }
 
 /*
 ================================================================================
-Colors Implementation
+Event Interpreter Implementation
 ================================================================================
 */
 
-uint8_t fft_color_4bpp_left(fft_color_4bpp_t raw) { return (raw & 0xF0) >> 4; }
-uint8_t fft_color_4bpp_right(fft_color_4bpp_t raw) { return raw & 0x0F; }
-
-uint8_t fft_color_5551_r8(fft_color_5551_t c) { return (uint8_t)(((c & 0x1F) << 3) | ((c & 0x1F) >> 2)); }
-uint8_t fft_color_5551_g8(fft_color_5551_t c) { return (uint8_t)((((c >> 5) & 0x1F) << 3) | (((c >> 5) & 0x1F) >> 2)); }
-uint8_t fft_color_5551_b8(fft_color_5551_t c) { return (uint8_t)((((c >> 10) & 0x1F) << 3) | (((c >> 10) & 0x1F) >> 2)); }
-uint8_t fft_color_5551_a8(fft_color_5551_t c) { return (uint8_t)(((c >> 15) & 0x01) ? 255 : 0); }
-
-fft_color_4bpp_t fft_color_4bpp_read(fft_span_t* span) {
-    uint8_t value = fft_span_read_u8(span);
-    return (fft_color_4bpp_t)value;
+uint16_t fft_vm_param(const fft_vm_t* vm, fft_packed_instruction_t instruction, uint8_t index) {
+    return fft_packed_param(vm->code, instruction, index);
 }
 
-fft_color_5551_t fft_color_5551_read(fft_span_t* span) {
-    fft_color_5551_t color = 0;
-    uint16_t value = fft_span_read_u16(span);
-    color |= (value & 0x1F);               // Red
-    color |= ((value >> 5) & 0x1F) << 5;   // Green
-    color |= ((value >> 10) & 0x1F) << 10; // Blue
-    color |= ((value >> 15) & 0x01) << 15; // Alpha
-    return color;
+static uint16_t fft_vm_variable_get(const fft_vm_t* vm, uint16_t id) {
+    return id < FFT_VM_VARIABLE_MAX ? vm->variables[id] : 0;
 }
 
-fft_color_rgbfx16_t fft_color_rgbfx16_read(fft_span_t* span) {
-    fft_color_rgbfx16_t color = { 0 };
-    color.r = fft_span_read_i16(span); // 16 bits for red
-    color.g = fft_span_read_i16(span); // 16 bits for green
-    color.b = fft_span_read_i16(span); // 16 bits for blue
-    return color;
+static void fft_vm_variable_set(fft_vm_t* vm, uint16_t id, uint16_t value) {
+    if (id < FFT_VM_VARIABLE_MAX) {
+        vm->variables[id] = value;
+    }
+    vm->results[0] = vm->results[1];
+    vm->results[1] = value;
 }
 
-fft_color_rgb8_t fft_color_rgb8_read(fft_span_t* span) {
-    fft_color_rgb8_t color = { 0 };
-    color.r = fft_span_read_u8(span); // 8 bits for red
-    color.g = fft_span_read_u8(span); // 8 bits for green
-    color.b = fft_span_read_u8(span); // 8 bits for blue
-    return color;
+static void fft_vm_op_nop(fft_vm_t* vm, fft_packed_instruction_t instruction) {
 }
 
-fft_color_t fft_color_from_5551(fft_color_5551_t c) {
-    uint8_t r = (uint8_t)(((c) & 0x1F) << 3) | (((c) & 0x1F) >> 2);
-    uint8_t g = (uint8_t)(((c >> 5) & 0x1F) << 3) | (((c >> 5) & 0x1F) >> 2);
-    uint8_t b = (uint8_t)(((c >> 10) & 0x1F) << 3) | (((c >> 10) & 0x1F) >> 2);
-    uint8_t a = (c >> 15) ? 255 : 0;
-    return FFT_COLOR_RGBA(r, g, b, a);
+static void fft_vm_op_event_end(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    vm->halted = true;
 }
 
-// Convert RGB16 fixed-point to RGBA8888 (full 255 range)
-fft_color_t fft_color_from_rgbfx16(fft_color_rgbfx16_t c) {
-    float r32 = fft_fixed16_to_f32(c.r);
-    float g32 = fft_fixed16_to_f32(c.g);
-    float b32 = fft_fixed16_to_f32(c.b);
+static void fft_vm_op_wait(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    vm->frame += fft_vm_param(vm, instruction, 0);
+}
 
-    uint8_t r = (uint8_t)(r32 * 255.0f + 0.5f);
-    uint8_t g = (uint8_t)(g32 * 255.0f + 0.5f);
-    uint8_t b = (uint8_t)(b32 * 255.0f + 0.5f);
-    return FFT_COLOR_RGBA(r, g, b, 255);
+// DisplayMessage(Type, ?, MessageID, UnitID, ...)
+static void fft_vm_op_display_message(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    if (vm->message_count >= FFT_VM_MESSAGE_MAX) {
+        return;
+    }
+    vm->messages[vm->message_count++] = (fft_vm_message_t) {
+        .message_id = fft_vm_param(vm, instruction, 2),
+        .unit_id = (uint8_t)fft_vm_param(vm, instruction, 3),
+        .frame = vm->frame,
+    };
 }
 
-// Convert RGB8 to RGBA8888
-fft_color_t fft_color_from_rgb8(fft_color_rgb8_t c) {
-    return FFT_COLOR_RGBA(c.r, c.g, c.b, 255);
+// Camera(X, Z, Y, Angle, MapRotation, CameraRotation, Zoom, Frames)
+//
+// The camera moves over Frames in parallel with the script, so it doesn't
+// advance the frame count.
+static void fft_vm_op_camera(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    vm->camera.x = (int16_t)fft_vm_param(vm, instruction, 0);
+    vm->camera.z = (int16_t)fft_vm_param(vm, instruction, 1);
+    vm->camera.y = (int16_t)fft_vm_param(vm, instruction, 2);
+    vm->camera.angle = fft_vm_param(vm, instruction, 3);
+    vm->camera.map_rotation = fft_vm_param(vm, instruction, 4);
+    vm->camera.camera_rotation = fft_vm_param(vm, instruction, 5);
+    vm->camera.zoom = fft_vm_param(vm, instruction, 6);
 }
 
-/*
-================================================================================
-CLUT Implementation
-================================================================================
-*/
+static fft_vm_unit_t* fft_vm_unit(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    return &vm->units[(uint8_t)fft_vm_param(vm, instruction, 0)];
+}
 
-fft_clut_row_t fft_clut_row_read(fft_span_t* span) {
-    fft_clut_row_t row = { 0 };
-    for (uint32_t i = 0; i < FFT_CLUT_ROW_WIDTH; i++) {
-        row.colors[i] = fft_color_5551_read(span);
-    }
+// WalkTo(UnitID, ?, X, Y, Elevation, ...)
+static void fft_vm_op_walk_to(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_unit_t* unit = fft_vm_unit(vm, instruction);
+    unit->x = (uint8_t)fft_vm_param(vm, instruction, 2);
+    unit->y = (uint8_t)fft_vm_param(vm, instruction, 3);
+    unit->elevation = (uint8_t)fft_vm_param(vm, instruction, 4);
+}
 
-    return row;
+// WarpUnit(UnitID, ?, X, Y, Elevation, Direction)
+static void fft_vm_op_warp_unit(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_op_walk_to(vm, instruction);
+    fft_vm_unit(vm, instruction)->facing = (uint8_t)fft_vm_param(vm, instruction, 5);
 }
 
-fft_clut_t fft_clut_read(fft_span_t* span) {
-    fft_clut_t clut = { 0 };
-    for (uint32_t i = 0; i < FFT_CLUT_ROW_COUNT; i++) {
-        clut.rows[i] = fft_clut_row_read(span);
-    }
-    return clut;
+// RotateUnit(UnitID, ?, Direction, ...)
+static void fft_vm_op_rotate_unit(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_unit(vm, instruction)->facing = (uint8_t)fft_vm_param(vm, instruction, 2);
 }
 
-/*
-================================================================================
-Images Implementation
-================================================================================
-*/
+static void fft_vm_op_show_unit(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_unit(vm, instruction)->visible = true;
+}
 
-enum {
-    FFT_IMAGE_PAL_COL_COUNT = 16,                         // Each palette entry is 16 bytes (RGBA)
-    FFT_IMAGE_PAL_ROW_SIZE = FFT_IMAGE_PAL_COL_COUNT * 4, // 4 bytes per color
-};
+static void fft_vm_op_hide_unit(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_unit(vm, instruction)->visible = false;
+}
 
-// This function reads the 4bpp data from the span and converts it to a 32bpp image.
-//
-// The resulting image will be grayscale, with each pixel represented by four bytes (RGBA).
-// The pixel values will be used in a to look up the actual color in a palette (CLUT).
-static fft_image_t fft_image_read_4bpp(fft_span_t* span, uint32_t width, uint32_t height) {
-    const uint32_t dims = (width * height);
-    const uint32_t size = dims * 4;
-    const uint32_t size_on_disk = dims / 2; // two pixels per byte
+// Arithmetic opcodes come in pairs. The first takes an immediate value and
+// the second (opcode + 1) takes a variable id.
+static void fft_vm_op_arithmetic(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    uint16_t id = fft_vm_param(vm, instruction, 0);
+    uint16_t rhs = fft_vm_param(vm, instruction, 1);
+    bool rhs_is_variable = (instruction.opcode - FFT_OPCODE_ADD) % 2 == 1;
+    if (rhs_is_variable) {
+        rhs = fft_vm_variable_get(vm, rhs);
+    }
 
-    uint8_t* data = FFT_MEM_ALLOC(size);
+    uint16_t lhs = fft_vm_variable_get(vm, id);
+    uint16_t result = 0;
+    switch (instruction.opcode & 0xFE) {
+    case FFT_OPCODE_ADD:
+        result = (uint16_t)(lhs + rhs);
+        break;
+    case FFT_OPCODE_SUB:
+        result = (uint16_t)(lhs - rhs);
+        break;
+    case FFT_OPCODE_MULT:
+        result = (uint16_t)(lhs * rhs);
+        break;
+    case FFT_OPCODE_DIV:
+        result = rhs != 0 ? (uint16_t)(lhs / rhs) : 0;
+        break;
+    case FFT_OPCODE_MOD:
+        result = rhs != 0 ? (uint16_t)(lhs % rhs) : 0;
+        break;
+    case FFT_OPCODE_AND:
+        result = lhs & rhs;
+        break;
+    case FFT_OPCODE_OR:
+        result = lhs | rhs;
+        break;
+    default:
+        FFT_ASSERT(false, "Invalid arithmetic opcode 0x%02X", instruction.opcode);
+    }
+    fft_vm_variable_set(vm, id, result);
+}
 
-    uint32_t write_idx = 0;
-    for (uint32_t i = 0; i < size_on_disk; i++) {
-        fft_color_4bpp_t raw_pixel = fft_color_4bpp_read(span);
-        uint8_t right = fft_color_4bpp_right(raw_pixel);
-        uint8_t left = fft_color_4bpp_left(raw_pixel);
+static void fft_vm_op_zero(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_variable_set(vm, fft_vm_param(vm, instruction, 0), 0);
+}
 
-        // Repeat each pixel 4 times to convert from 4bpp to 32bpp.
-        for (uint32_t j = 0; j < 4; j++) {
-            data[write_idx++] = right;
-        }
+static void fft_vm_op_compare(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    uint16_t a = vm->results[0];
+    uint16_t b = vm->results[1];
+    switch (instruction.opcode) {
+    case FFT_OPCODE_LTE:
+        vm->condition = a <= b;
+        break;
+    case FFT_OPCODE_GTE:
+        vm->condition = a >= b;
+        break;
+    case FFT_OPCODE_EQ:
+        vm->condition = a == b;
+        break;
+    case FFT_OPCODE_NEQ:
+        vm->condition = a != b;
+        break;
+    case FFT_OPCODE_LT:
+        vm->condition = a < b;
+        break;
+    case FFT_OPCODE_GT:
+        vm->condition = a > b;
+        break;
+    default:
+        FFT_ASSERT(false, "Invalid compare opcode 0x%02X", instruction.opcode);
+    }
+}
 
-        for (uint32_t j = 0; j < 4; j++) {
-            data[write_idx++] = left;
+// Jumps move to the matching target instruction with the same label. If there
+// is no target the event ends, the same as running off the end of the script.
+static void fft_vm_jump(fft_vm_t* vm, fft_opcode_e target, uint16_t label, bool forward) {
+    int32_t i = forward ? vm->pc : (int32_t)vm->pc - 2;
+    while (i >= 0 && i < vm->instruction_count) {
+        fft_packed_instruction_t candidate = vm->instructions[i];
+        if (candidate.opcode == target && fft_vm_param(vm, candidate, 0) == label) {
+            vm->pc = (uint16_t)i;
+            return;
         }
+        i += forward ? 1 : -1;
     }
-
-    fft_image_t image = { 0 };
-    image.width = width;
-    image.height = height;
-    image.data = data;
-    image.size = size;
-    image.valid = true;
-
-    return image;
+    vm->halted = true;
 }
 
-static fft_image_t fft_image_read_16bpp(fft_span_t* span, uint32_t width, uint32_t height) {
-    const uint32_t dims = width * height;
-    const uint32_t size = dims * 4;
+static void fft_vm_op_jump_forward(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_jump(vm, FFT_OPCODE_FORWARDTARGET, fft_vm_param(vm, instruction, 0), true);
+}
 
-    uint8_t* data = FFT_MEM_ALLOC(size);
+static void fft_vm_op_jump_forward_if_zero(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    if (!vm->condition) {
+        fft_vm_op_jump_forward(vm, instruction);
+    }
+}
 
-    uint32_t write_idx = 0;
-    for (uint32_t i = 0; i < dims; i++) {
-        uint16_t val = fft_span_read_u16(span);
+static void fft_vm_op_jump_back(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_jump(vm, FFT_OPCODE_BACKTARGET, fft_vm_param(vm, instruction, 0), false);
+}
 
-        data[write_idx++] = (uint8_t)((val & 0x001F) << 3);      // R
-        data[write_idx++] = (uint8_t)((val & 0x03E0) >> 2);      // G
-        data[write_idx++] = (uint8_t)((val & 0x7C00) >> 7);      // B
-        data[write_idx++] = (uint8_t)((val == 0) ? 0x00 : 0xFF); // A
+static fft_vm_handler_fn fft_vm_default_handler(uint8_t opcode) {
+    switch (opcode) {
+    case FFT_OPCODE_EVENTEND:
+    case FFT_OPCODE_EVENTEND2:
+        return fft_vm_op_event_end;
+    case FFT_OPCODE_WAIT:
+        return fft_vm_op_wait;
+    case FFT_OPCODE_DISPLAYMESSAGE:
+        return fft_vm_op_display_message;
+    case FFT_OPCODE_CAMERA:
+        return fft_vm_op_camera;
+    case FFT_OPCODE_WALKTO:
+        return fft_vm_op_walk_to;
+    case FFT_OPCODE_WARPUNIT:
+        return fft_vm_op_warp_unit;
+    case FFT_OPCODE_ROTATEUNIT:
+        return fft_vm_op_rotate_unit;
+    case FFT_OPCODE_ADDUNIT:
+    case FFT_OPCODE_ADDGHOSTUNIT:
+    case FFT_OPCODE_TELEPORTIN:
+        return fft_vm_op_show_unit;
+    case FFT_OPCODE_REMOVEUNIT:
+    case FFT_OPCODE_DISMISSUNIT:
+    case FFT_OPCODE_BLUEREMOVEUNIT:
+    case FFT_OPCODE_TELEPORTOUT:
+        return fft_vm_op_hide_unit;
+    case FFT_OPCODE_ADD:
+    case FFT_OPCODE_ADDVAR:
+    case FFT_OPCODE_SUB:
+    case FFT_OPCODE_SUBVAR:
+    case FFT_OPCODE_MULT:
+    case FFT_OPCODE_MULTVAR:
+    case FFT_OPCODE_DIV:
+    case FFT_OPCODE_DIVVAR:
+    case FFT_OPCODE_MOD:
+    case FFT_OPCODE_MODVAR:
+    case FFT_OPCODE_AND:
+    case FFT_OPCODE_ANDVAR:
+    case FFT_OPCODE_OR:
+    case FFT_OPCODE_ORVAR:
+        return fft_vm_op_arithmetic;
+    case FFT_OPCODE_ZERO:
+        return fft_vm_op_zero;
+    case FFT_OPCODE_LTE:
+    case FFT_OPCODE_GTE:
+    case FFT_OPCODE_EQ:
+    case FFT_OPCODE_NEQ:
+    case FFT_OPCODE_LT:
+    case FFT_OPCODE_GT:
+        return fft_vm_op_compare;
+    case FFT_OPCODE_JUMPFORWARD:
+        return fft_vm_op_jump_forward;
+    case FFT_OPCODE_JUMPFORWARDIFZERO:
+        return fft_vm_op_jump_forward_if_zero;
+    case FFT_OPCODE_JUMPBACK:
+        return fft_vm_op_jump_back;
+    default:
+        return fft_vm_op_nop;
     }
+}
 
-    fft_image_t image = { 0 };
-    image.width = width;
-    image.height = height;
-    image.data = data;
-    image.size = size;
-    image.valid = true;
+void fft_vm_init(fft_vm_t* vm, fft_span_t* code) {
+    memset(vm, 0, sizeof(*vm));
+    vm->code = code->data;
+    vm->instruction_count = fft_instructions_pack(code, vm->instructions);
 
-    return image;
+    for (uint32_t i = 0; i < FFT_VM_HANDLER_COUNT; i++) {
+        vm->handlers[i] = fft_vm_default_handler((uint8_t)i);
+    }
 }
 
-// Take a 4bpp image and a 16bpp palette (CLUT) and convert the image to a
-// palettized format.
-static void fft_image_palettize(fft_image_t* image, const fft_image_t* clut, uint8_t pal_index) {
-    FFT_ASSERT(image && image->data && image->valid, "Invalid image parameter");
-    FFT_ASSERT(clut && clut->data && clut->valid, "Invalid clut parameter");
+void fft_vm_init_event(fft_vm_t* vm, const fft_event_t* event) {
+    FFT_ASSERT(event->valid, "Cannot interpret an invalid event");
 
-    const uint32_t pixel_count = image->width * image->height;
-    const uint32_t pal_offset = (FFT_IMAGE_PAL_ROW_SIZE * pal_index);
+    fft_span_t code = { 0 };
+    fft_event_code_span(event->data, &code);
+    fft_vm_init(vm, &code);
+}
 
-    // Ensure palette index and offset are valid
-    FFT_ASSERT(pal_offset + (FFT_IMAGE_PAL_COL_COUNT * 4) <= clut->size, "Palette index out of bounds");
+void fft_vm_default(fft_vm_t* vm, fft_packed_instruction_t instruction) {
+    fft_vm_default_handler(instruction.opcode)(vm, instruction);
+}
 
-    for (uint32_t i = 0; i < pixel_count * 4; i = i + 4) {
-        uint8_t pixel = image->data[i];
+bool fft_vm_step(fft_vm_t* vm) {
+    if (vm->halted || vm->pc >= vm->instruction_count) {
+        vm->halted = true;
+        return false;
+    }
+    if (vm->steps >= FFT_VM_STEP_MAX) {
+        vm->halted = true;
+        vm->step_limit_reached = true;
+        return false;
+    }
 
-        // Ensure pixel value is within palette range
-        FFT_ASSERT(pixel < FFT_IMAGE_PAL_COL_COUNT, "Pixel value %d exceeds palette size", pixel);
+    fft_packed_instruction_t instruction = vm->instructions[vm->pc++];
+    vm->steps++;
+    vm->handlers[instruction.opcode](vm, instruction);
+    return !vm->halted;
+}
 
-        memcpy(&image->data[i], &clut->data[pal_offset + (pixel * 4)], 4);
-    }
+void fft_vm_run(fft_vm_t* vm) {
+    while (fft_vm_step(vm)) { }
 }
 
-static fft_image_t fft_image_read_4bpp_palettized(fft_span_t* span, fft_image_desc_t desc, uint8_t pal_index) {
-    // Read the 4bpp image data.
-    fft_image_t image = fft_image_read_4bpp(span, desc.width, desc.height);
+/*
+================================================================================
+Instruction Table Implementation
+================================================================================
+*/
 
-    // Read the clut data.
-    fft_span_set_offset(span, desc.pal_offset);
-    fft_image_t clut = fft_image_read_16bpp(span, FFT_IMAGE_PAL_COL_COUNT, desc.pal_count);
+// Decoding is split into independent per-event jobs. The first pass packs each
+// event and counts its rows, then the row offsets are known and the second pass
+// writes each event's rows into its own slice of the columns.
+typedef struct {
+    fft_span_t code;
+    fft_packed_instruction_t* packed;
+    uint16_t count;
+    uint32_t row_offset;
+} fft_instruction_table_job_t;
+
+static void fft_instruction_table_pack_job(fft_instruction_table_job_t* job) {
+    fft_span_t code = job->code;
+    job->count = fft_instructions_pack(&code, job->packed);
+}
 
-    fft_image_palettize(&image, &clut, pal_index);
+static void fft_instruction_table_fill_job(fft_instruction_table_t* table, const fft_instruction_table_job_t* job, uint16_t event_id) {
+    for (uint16_t i = 0; i < job->count; i++) {
+        uint32_t row = job->row_offset + i;
+        fft_packed_instruction_t instruction = job->packed[i];
 
-    FFT_MEM_FREE(clut.data);
+        table->event_id[row] = event_id;
+        table->index[row] = i;
+        table->opcode[row] = instruction.opcode;
 
-    return image;
+        // Every column is written so params past the instruction's count read
+        // as 0 without relying on the allocator to hand back zeroed memory.
+        uint8_t param_count = fft_packed_param_count(instruction);
+        for (uint8_t j = 0; j < FFT_OPCODE_PARAM_MAX; j++) {
+            table->params[j][row] = j < param_count ? fft_packed_param(job->code.data, instruction, j) : 0;
+        }
+    }
 }
 
-static fft_image_desc_t image_get_desc(fft_io_entry_e entry) {
-    fft_image_desc_t found = { 0 };
-    for (uint32_t i = 0; i < FFT_IMAGE_DESC_COUNT; i++) {
-        if (image_desc_list[i].entry == entry) {
-            // FIXME: This is just a development saftey measure. Might be better
-            // to find by name since there can be multiple desc per file.
-            FFT_ASSERT(found.entry == 0, "Duplicate image descriptor for entry %d", entry);
-            found = image_desc_list[i];
+typedef struct {
+    fft_instruction_table_t* table;
+    fft_instruction_table_job_t* jobs;
+} fft_instruction_table_batch_t;
+
+static void fft_instruction_table_pack_range(void* arg, uint32_t begin, uint32_t end) {
+    fft_instruction_table_batch_t* batch = (fft_instruction_table_batch_t*)arg;
+    for (uint32_t i = begin; i < end; i++) {
+        if (batch->jobs[i].code.data != NULL) {
+            fft_instruction_table_pack_job(&batch->jobs[i]);
         }
     }
-    FFT_ASSERT(found.entry != 0, "Image descriptor not found for entry %d", entry);
-    return found;
 }
 
-// This will scale the image data from 4bpp to 32bpp by multiplying each pixel
-// value by 16. This is useful for debugging since the max value of 4bpp is 15,
-// and we want to scale it to 255 (15*17 = 255).
-static void fft_image_scale_paletted(fft_image_t* image) {
-    FFT_ASSERT(image && image->valid && image->data, "Invalid image parameter");
+static void fft_instruction_table_fill_range(void* arg, uint32_t begin, uint32_t end) {
+    fft_instruction_table_batch_t* batch = (fft_instruction_table_batch_t*)arg;
+    for (uint32_t i = begin; i < end; i++) {
+        fft_instruction_table_fill_job(batch->table, &batch->jobs[i], (uint16_t)i);
+    }
+}
 
-    const uint32_t pixel_count = image->width * image->height;
+fft_instruction_table_t fft_instruction_table_read(const fft_executor_t* executor) {
+    fft_instruction_table_t table = { 0 };
 
-    for (uint32_t i = 0; i < pixel_count; i++) {
-        uint8_t* px = &image->data[i * 4];
+    fft_span_t file = fft_io_open(F_EVENT__TEST_EVT);
 
-        // Scale each RGB channel from [0..15] → [0..255]
-        px[0] = px[0] * 17; // R
-        px[1] = px[1] * 17; // G
-        px[2] = px[2] * 17; // B
-        px[3] = 0xFF;       // A
+    fft_instruction_table_job_t* jobs = FFT_MEM_ALLOC_TAG(FFT_EVENT_COUNT * sizeof(fft_instruction_table_job_t), "instruction_table_jobs");
+    fft_packed_instruction_t* packed = FFT_MEM_ALLOC_TAG(FFT_EVENT_COUNT * FFT_INSTRUCTION_MAX * sizeof(fft_packed_instruction_t), "instruction_table_packed");
+    fft_instruction_table_batch_t batch = { .table = &table, .jobs = jobs };
+
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        jobs[i].packed = &packed[i * FFT_INSTRUCTION_MAX];
+        fft_event_code_span(file.data + (i * FFT_EVENT_SIZE), &jobs[i].code);
     }
-}
+    fft_executor_parallel_for(executor, FFT_EVENT_COUNT, 16, fft_instruction_table_pack_range, &batch);
 
-static void fft_image_destroy(fft_image_t* image) {
-    if (image && image->data) {
-        FFT_MEM_FREE(image->data);
-        image->data = NULL;
-        image->valid = false;
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        jobs[i].row_offset = table.row_count;
+        table.row_count += jobs[i].count;
     }
-}
 
-static bool fft_image_write_ppm(const fft_image_t* image, const char* path) {
-    if (!image || !image->valid || !image->data) {
-        return false;
+    size_t rows = FFT_MAX(table.row_count, 1);
+    table.event_id = FFT_MEM_ALLOC_TAG(rows * sizeof(uint16_t), "instruction_table_event_id");
+    table.index = FFT_MEM_ALLOC_TAG(rows * sizeof(uint16_t), "instruction_table_index");
+    table.opcode = FFT_MEM_ALLOC_TAG(rows * sizeof(uint8_t), "instruction_table_opcode");
+    for (uint32_t i = 0; i < FFT_OPCODE_PARAM_MAX; i++) {
+        table.params[i] = FFT_MEM_ALLOC_TAG(rows * sizeof(uint16_t), "instruction_table_params");
     }
 
-    FILE* f = fopen(path, "wb");
-    if (!f) {
-        return false;
+    fft_executor_parallel_for(executor, FFT_EVENT_COUNT, 16, fft_instruction_table_fill_range, &batch);
+
+    FFT_MEM_FREE(packed);
+    FFT_MEM_FREE(jobs);
+    fft_io_close(file);
+
+    return table;
+}
+
+void fft_instruction_table_destroy(fft_instruction_table_t* table) {
+    FFT_MEM_FREE(table->event_id);
+    FFT_MEM_FREE(table->index);
+    FFT_MEM_FREE(table->opcode);
+    for (uint32_t i = 0; i < FFT_OPCODE_PARAM_MAX; i++) {
+        FFT_MEM_FREE(table->params[i]);
     }
+    *table = (fft_instruction_table_t) { 0 };
+}
 
-    // Write PPM header (P6 = binary RGB)
-    // Max color value is 255
-    fprintf(f, "P6\n%d %d\n255\n", image->width, image->height);
+void fft_instruction_table_histogram(const fft_instruction_table_t* table, uint32_t out_counts[256]) {
+    // Four sub-histograms so consecutive equal opcodes don't serialize on the
+    // same counter.
+    uint32_t counts[4][256] = { { 0 } };
+    const uint8_t* opcode = table->opcode;
+
+    uint32_t i = 0;
+    for (; i + 4 <= table->row_count; i += 4) {
+        counts[0][opcode[i + 0]]++;
+        counts[1][opcode[i + 1]]++;
+        counts[2][opcode[i + 2]]++;
+        counts[3][opcode[i + 3]]++;
+    }
+    for (; i < table->row_count; i++) {
+        counts[0][opcode[i]]++;
+    }
 
-    // Write RGB data (ignore alpha)
-    for (uint32_t y = 0; y < image->height; y++) {
-        for (uint32_t x = 0; x < image->width; x++) {
-            uint8_t* px = &image->data[(y * image->width + x) * 4];
-            fwrite(px, 1, 3, f); // only write R,G,B
-        }
+    for (uint32_t j = 0; j < 256; j++) {
+        out_counts[j] = counts[0][j] + counts[1][j] + counts[2][j] + counts[3][j];
     }
+}
 
-    fclose(f);
-    return true;
+uint32_t fft_instruction_table_filter(const fft_instruction_table_t* table, fft_opcode_e opcode, uint32_t* out_rows) {
+    // Branchless so the scan doesn't depend on how often the opcode matches.
+    // out_rows must have space for row_count entries.
+    uint32_t count = 0;
+    const uint8_t* column = table->opcode;
+    for (uint32_t i = 0; i < table->row_count; i++) {
+        out_rows[count] = i;
+        count += (column[i] == (uint8_t)opcode);
+    }
+    return count;
 }
 
 /*
 ================================================================================
-Mesh Header Implementation
+Scenario Bundle Implementation
 ================================================================================
 */
 
-fft_mesh_header_t fft_mesh_header_read(fft_span_t* span) {
-    fft_mesh_header_t header = { 0 };
+enum {
+    FFT_BUNDLE_REQUEST_MAX = 5,
+};
 
-    // 0x00-0x3F: unknown pointers (16 × 4 bytes)
-    fft_span_read_bytes(span, 64, (uint8_t*)header.unknown_00_to_40);
+fft_scenario_bundle_t* fft_scenario_bundle_load(uint16_t scenario_id) {
+    fft_access_log_record(FFT_ACCESS_BUNDLE, scenario_id);
+    FFT_ASSERT(scenario_id < FFT_SCENARIO_COUNT, "Scenario id %d out of bounds", scenario_id);
+    fft_scenario_bundle_t* bundle = FFT_MEM_ALLOC_TAG(sizeof(fft_scenario_bundle_t), "scenario_bundle");
+
+    // Scenario row
+    const fft_io_desc_t attack_out = fft_io_file_list[F_EVENT__ATTACK_OUT];
+    fft_span_t row = fft_io_read_at(attack_out.sector, FFT_SCENARIO_OFFSET + ((uint32_t)scenario_id * FFT_SCENARIO_SIZE), FFT_SCENARIO_SIZE);
+    bundle->scenario = fft_scenario_decode(row.data);
+    fft_scenario_validate(&bundle->scenario);
+    fft_io_close(row);
+
+    const fft_scenario_t* scenario = &bundle->scenario;
+    FFT_ASSERT(scenario->map_id < FFT_MAP_DESC_LIST_COUNT && fft_map_list[scenario->map_id].valid, "Scenario %d has invalid map %d", scenario_id, scenario->map_id);
+    FFT_ASSERT(scenario->event_id < FFT_EVENT_COUNT, "Scenario %d has invalid event %d", scenario_id, scenario->event_id);
+    FFT_ASSERT(scenario->entd_id < FFT_ENTD_COUNT, "Scenario %d has invalid entd %d", scenario_id, scenario->entd_id);
+
+    bundle->state = (fft_state_t) {
+        .time = scenario->time,
+        .weather = (fft_weather_e)(scenario->weather & 0x07),
+        .layout = FFT_LAYOUT_DEFAULT,
+    };
 
-    header.geometry = fft_span_read_u32(span);   // 0x40
-    header.clut_color = fft_span_read_u32(span); // 0x44
-    header.unknown_48 = fft_span_read_u32(span); // 0x48
-    header.unknown_4c = fft_span_read_u32(span); // 0x4C
+    // GNS records
+    fft_span_t gns = fft_io_open(fft_map_list[scenario->map_id].entry);
+    bundle->record_count = fft_record_read_all(&gns, bundle->records);
+    fft_io_close(gns);
 
-    // 0x50-0x63: unknown pointers (5 × 4 bytes)
-    fft_span_read_bytes(span, 20, (uint8_t*)header.unknown_50_to_64);
+    fft_map_state_records_t state_records = fft_map_state_records(bundle->records, bundle->record_count, bundle->state);
+    const fft_record_t* primary = state_records.primary;
+    const fft_record_t* alt = state_records.alt;
+    const fft_record_t* texture = state_records.texture;
+    FFT_ASSERT(primary != NULL && texture != NULL, "Map %d is missing a primary mesh or texture", scenario->map_id);
+
+    // Everything else in one pass
+    fft_span_t primary_file = { 0 };
+    fft_span_t alt_file = { 0 };
+    fft_span_t texture_file = { 0 };
+    fft_span_t event_file = { 0 };
+    fft_span_t entd_file = { 0 };
+
+    fft_io_request_t requests[FFT_BUNDLE_REQUEST_MAX];
+    uint32_t request_count = 0;
+    requests[request_count++] = (fft_io_request_t) { primary->sector, 0, primary->length, &primary_file };
+    requests[request_count++] = (fft_io_request_t) { texture->sector, 0, texture->length, &texture_file };
+    if (alt != NULL) {
+        requests[request_count++] = (fft_io_request_t) { alt->sector, 0, alt->length, &alt_file };
+    }
+    requests[request_count++] = (fft_io_request_t) {
+        fft_io_file_list[F_EVENT__TEST_EVT].sector,
+        scenario->event_id * FFT_EVENT_SIZE,
+        FFT_EVENT_SIZE,
+        &event_file,
+    };
+    requests[request_count++] = (fft_io_request_t) {
+        fft_io_file_list[fft_entd_file(scenario->entd_id)].sector,
+        (scenario->entd_id % FFT_ENTD_PER_FILE) * FFT_ENTD_SIZE,
+        FFT_ENTD_SIZE,
+        &entd_file,
+    };
+    fft_io_read_batch(requests, request_count);
 
-    header.lights_and_background = fft_span_read_u32(span); // 0x64
-    header.terrain = fft_span_read_u32(span);               // 0x68
-    header.texture_anim_inst = fft_span_read_u32(span);     // 0x6C
-    header.palette_anim_inst = fft_span_read_u32(span);     // 0x70
+    fft_mesh_read_into(&primary_file, &bundle->primary_mesh);
+    fft_io_close(primary_file);
 
-    // 0x74-0x7B: unknown pointers (2 × 4 bytes)
-    fft_span_read_bytes(span, 8, (uint8_t*)header.unknown_74_to_7c);
+    if (alt != NULL) {
+        fft_mesh_read_into(&alt_file, &bundle->state_mesh);
+        bundle->state_mesh.state = alt->state;
+        bundle->has_state_mesh = true;
+        fft_io_close(alt_file);
+    }
 
-    header.clut_gray = fft_span_read_u32(span); // 0x7C
+    bundle->texture = fft_texture_read(&texture_file, texture->state);
+    fft_io_close(texture_file);
 
-    // 0x80-0x8B: unknown pointers (3 × 4 bytes)
-    fft_span_read_bytes(span, 12, (uint8_t*)header.unknown_80_to_8c);
+    bundle->event = fft_event_read(&event_file);
+    fft_io_close(event_file);
 
-    header.mesh_anim_inst = fft_span_read_u32(span);    // 0x8C
-    header.anim_mesh_1 = fft_span_read_u32(span);       // 0x90
-    header.anim_mesh_2 = fft_span_read_u32(span);       // 0x94
-    header.anim_mesh_3 = fft_span_read_u32(span);       // 0x98
-    header.anim_mesh_4 = fft_span_read_u32(span);       // 0x9C
-    header.anim_mesh_5 = fft_span_read_u32(span);       // 0xA0
-    header.anim_mesh_6 = fft_span_read_u32(span);       // 0xA4
-    header.anim_mesh_7 = fft_span_read_u32(span);       // 0xA8
-    header.anim_mesh_8 = fft_span_read_u32(span);       // 0xAC
-    header.poly_render_props = fft_span_read_u32(span); // 0xB0
+    memcpy(bundle->entd, entd_file.data, FFT_ENTD_SIZE);
+    fft_io_close(entd_file);
 
-    // 0xB4-0xC3: unknown pointers (4 × 4 bytes)
-    fft_span_read_bytes(span, 16, (uint8_t*)header.unknown_b4_to_c4);
+    return bundle;
+}
 
-    return header;
+void fft_scenario_bundle_destroy(fft_scenario_bundle_t* bundle) {
+    if (bundle == NULL) {
+        return;
+    }
+    fft_texture_destroy(bundle->texture);
+    FFT_MEM_FREE(bundle);
 }
 
 /*
 ================================================================================
-Geometry Implementation
+Prefetcher Implementation
 ================================================================================
 */
 
-static fft_position_t fft_geometry_read_position(fft_span_t* span) {
-    int16_t x = fft_span_read_i16(span);
-    int16_t y = fft_span_read_i16(span);
-    int16_t z = fft_span_read_i16(span);
-    return (fft_position_t) { x, y, z };
+typedef enum {
+    FFT_PREFETCH_SLOT_EMPTY,
+    FFT_PREFETCH_SLOT_LOADING,
+    FFT_PREFETCH_SLOT_READY,
+} fft_prefetch_slot_e;
+
+typedef struct {
+    fft_prefetch_slot_e status;
+    uint16_t scenario_id;
+    uint32_t age;
+    fft_scenario_bundle_t* bundle;
+} fft_prefetch_slot_t;
+
+// Owned by the context that started the prefetcher.
+typedef struct fft_prefetch_t {
+    fft_ctx_t* ctx;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+
+    const fft_scenario_table_t* table;
+
+    uint16_t queue[FFT_PREFETCH_QUEUE_MAX];
+    uint32_t queue_count;
+
+    fft_prefetch_slot_t slots[FFT_PREFETCH_SLOT_MAX];
+    uint32_t slot_count;
+    uint32_t clock;
+} fft_prefetch_t;
+
+static fft_prefetch_slot_t* fft_prefetch_find_slot(fft_prefetch_t* prefetch, uint16_t scenario_id) {
+    for (uint32_t i = 0; i < prefetch->slot_count; i++) {
+        fft_prefetch_slot_t* slot = &prefetch->slots[i];
+        if (slot->status != FFT_PREFETCH_SLOT_EMPTY && slot->scenario_id == scenario_id) {
+            return slot;
+        }
+    }
+    return NULL;
 }
 
-static fft_normal_t fft_geometry_read_normal(fft_span_t* span) {
-    fft_fixed16_t x = fft_span_read_i16(span);
-    fft_fixed16_t y = fft_span_read_i16(span);
-    fft_fixed16_t z = fft_span_read_i16(span);
-    return (fft_normal_t) { x, y, z };
+// Empty slots first, then the least recently used ready slot. Slots that are
+// loading are never evicted.
+static fft_prefetch_slot_t* fft_prefetch_evict_slot(fft_prefetch_t* prefetch) {
+    fft_prefetch_slot_t* oldest = NULL;
+    for (uint32_t i = 0; i < prefetch->slot_count; i++) {
+        fft_prefetch_slot_t* slot = &prefetch->slots[i];
+        if (slot->status == FFT_PREFETCH_SLOT_EMPTY) {
+            return slot;
+        }
+        if (slot->status == FFT_PREFETCH_SLOT_READY && (oldest == NULL || slot->age < oldest->age)) {
+            oldest = slot;
+        }
+    }
+    if (oldest != NULL) {
+        fft_scenario_bundle_destroy(oldest->bundle);
+        *oldest = (fft_prefetch_slot_t) { 0 };
+    }
+    return oldest;
 }
 
-static uint32_t read_polygons(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, bool is_textured, uint32_t poly_offset, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        fft_polygon_t* poly = &g->polygons[poly_offset + i];
-        poly->tex.is_textured = is_textured;
-        poly->type = type;
+static void* fft_prefetch_worker(void* arg) {
+    fft_prefetch_t* prefetch = (fft_prefetch_t*)arg;
+    fft_ctx_make_current(prefetch->ctx);
+    _fft_access_log_muted++;
+
+    pthread_mutex_lock(&prefetch->lock);
+    while (prefetch->running) {
+        if (prefetch->queue_count == 0) {
+            pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+            continue;
+        }
 
-        // Read vertices
-        for (uint32_t j = 0; j < (type == FFT_POLYTYPE_TRIANGLE ? 3 : 4); j++) {
-            poly->vertices[j].position = fft_geometry_read_position(span);
+        uint16_t scenario_id = prefetch->queue[0];
+        prefetch->queue_count--;
+        memmove(&prefetch->queue[0], &prefetch->queue[1], prefetch->queue_count * sizeof(uint16_t));
+
+        if (fft_prefetch_find_slot(prefetch, scenario_id) != NULL) {
+            continue;
+        }
+        fft_prefetch_slot_t* slot = fft_prefetch_evict_slot(prefetch);
+        if (slot == NULL) {
+            continue;
         }
+        slot->status = FFT_PREFETCH_SLOT_LOADING;
+        slot->scenario_id = scenario_id;
+
+        pthread_mutex_unlock(&prefetch->lock);
+        fft_scenario_bundle_t* bundle = fft_scenario_bundle_load(scenario_id);
+        pthread_mutex_lock(&prefetch->lock);
+
+        slot->bundle = bundle;
+        slot->status = FFT_PREFETCH_SLOT_READY;
+        slot->age = ++prefetch->clock;
+        pthread_cond_broadcast(&prefetch->cond);
     }
+    pthread_mutex_unlock(&prefetch->lock);
+    return NULL;
+}
 
-    return poly_offset + count;
+void fft_prefetch_start(const fft_scenario_table_t* table) {
+    fft_prefetch_start_slots(table, FFT_PREFETCH_SLOT_DEFAULT);
 }
 
-static uint32_t read_normals(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, uint32_t poly_offset, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        fft_polygon_t* poly = &g->polygons[poly_offset + i];
+void fft_prefetch_start_slots(const fft_scenario_table_t* table, uint32_t slot_count) {
+    fft_ctx_t* ctx = fft_ctx();
+    FFT_ASSERT(ctx->prefetch == NULL, "Prefetcher already started");
+    FFT_ASSERT(slot_count > 0 && slot_count <= FFT_PREFETCH_SLOT_MAX, "Prefetch slot count %u out of bounds", slot_count);
+
+    fft_prefetch_t* prefetch = FFT_MEM_ALLOC_TAG(sizeof(fft_prefetch_t), "prefetch");
+    prefetch->ctx = ctx;
+    prefetch->table = table;
+    prefetch->slot_count = slot_count;
+    prefetch->running = true;
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_cond_init(&prefetch->cond, NULL);
+    ctx->prefetch = prefetch;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, FFT_THREAD_STACK_SIZE);
+    int result = pthread_create(&prefetch->thread, &attr, fft_prefetch_worker, prefetch);
+    pthread_attr_destroy(&attr);
+    FFT_ASSERT(result == 0, "Failed to start prefetch thread");
+}
 
-        // Read normals
-        for (uint32_t j = 0; j < (type == FFT_POLYTYPE_TRIANGLE ? 3 : 4); j++) {
-            poly->vertices[j].normal = fft_geometry_read_normal(span);
-        }
+void fft_prefetch_stop(void) {
+    fft_ctx_t* ctx = fft_ctx();
+    fft_prefetch_t* prefetch = ctx->prefetch;
+    if (prefetch == NULL) {
+        return;
     }
 
-    return poly_offset + count;
+    pthread_mutex_lock(&prefetch->lock);
+    prefetch->running = false;
+    pthread_cond_broadcast(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->lock);
+    pthread_join(prefetch->thread, NULL);
+
+    for (uint32_t i = 0; i < prefetch->slot_count; i++) {
+        fft_scenario_bundle_destroy(prefetch->slots[i].bundle);
+    }
+    pthread_cond_destroy(&prefetch->cond);
+    pthread_mutex_destroy(&prefetch->lock);
+    FFT_MEM_FREE(prefetch);
+    ctx->prefetch = NULL;
 }
 
-static uint32_t read_texinfo(fft_span_t* span, fft_geometry_t* g, fft_polytype_e type, uint32_t poly_offset, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        // Read all data
-        uint8_t au = fft_span_read_u8(span);                           // 0
-        uint8_t av = fft_span_read_u8(span);                           // 1
-        uint8_t clut = fft_span_read_u8(span);                         // 2
-        uint8_t unknown_a = fft_span_read_u8(span);                    // 3
-        uint8_t bu = fft_span_read_u8(span);                           // 4
-        uint8_t bv = fft_span_read_u8(span);                           // 5
-        uint8_t page_and_image_and_unknown_b = fft_span_read_u8(span); // 6
-        uint8_t unknown_c = fft_span_read_u8(span);                    // 7
-        uint8_t cu = fft_span_read_u8(span);                           // 8
-        uint8_t cv = fft_span_read_u8(span);                           // 9
+void fft_prefetch_hint(uint16_t scenario_id) {
+    fft_access_log_record(FFT_ACCESS_PREFETCH_HINT, scenario_id);
+    fft_prefetch_t* prefetch = fft_ctx()->prefetch;
+    FFT_ASSERT(prefetch != NULL, "Prefetcher not started");
+    FFT_ASSERT(scenario_id < FFT_SCENARIO_COUNT, "Scenario id %d out of bounds", scenario_id);
+    const fft_scenario_table_t* table = prefetch->table;
+    const fft_scenario_t* scenario = &table->scenarios[scenario_id];
+
+    pthread_mutex_lock(&prefetch->lock);
+
+    // Older hints are stale once the viewer moves on.
+    prefetch->queue_count = 0;
+
+    if (table->usable[scenario_id] && scenario->next_step == FFT_NEXTSTEP_EVENT) {
+        const uint16_t* ids = NULL;
+        uint16_t count = fft_scenario_table_find(table, FFT_SCENARIO_KEY_EVENT_ID, scenario->next_event_id, &ids);
+        for (uint16_t i = 0; i < count && prefetch->queue_count < FFT_PREFETCH_QUEUE_MAX; i++) {
+            const fft_scenario_t* next = &table->scenarios[ids[i]];
+            if (next->map_id >= FFT_MAP_DESC_LIST_COUNT || !fft_map_list[next->map_id].valid) {
+                continue;
+            }
 
-        // Split single byte values
-        uint8_t page = (page_and_image_and_unknown_b >> 0) & 0x03;      // bits 0–1  (0b00000011)
-        uint8_t image = (page_and_image_and_unknown_b >> 2) & 0x03;     // bits 2–3  (0b00001100)
-        uint8_t unknown_b = (page_and_image_and_unknown_b >> 4) & 0x0F; // bits 4–7  (0b11110000)
+            // Keep cached successors from being evicted first.
+            fft_prefetch_slot_t* slot = fft_prefetch_find_slot(prefetch, ids[i]);
+            if (slot != NULL) {
+                slot->age = ++prefetch->clock;
+                continue;
+            }
+            prefetch->queue[prefetch->queue_count++] = ids[i];
+        }
+    }
 
-        // Populate the polygon's texture info.
-        fft_polygon_t* poly = &g->polygons[poly_offset + i];
-        poly->tex.texcoords[0] = (fft_texcoord_t) { .u = au, .v = av };
-        poly->tex.texcoords[1] = (fft_texcoord_t) { .u = bu, .v = bv };
-        poly->tex.texcoords[2] = (fft_texcoord_t) { .u = cu, .v = cv };
-        poly->tex.clut = clut;
-        poly->tex.page = page;
-        poly->tex.image_to_use = image;
-        poly->tex.unknown_a = unknown_a;
-        poly->tex.unknown_b = unknown_b;
-        poly->tex.unknown_c = unknown_c;
+    pthread_cond_broadcast(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->lock);
+}
 
-        if (type == FFT_POLYTYPE_QUAD) {
-            uint8_t du = fft_span_read_u8(span);
-            uint8_t dv = fft_span_read_u8(span);
-            fft_texcoord_t d = { .u = du, .v = dv };
-            poly->tex.texcoords[3] = d;
+fft_scenario_bundle_t* fft_prefetch_take(uint16_t scenario_id) {
+    fft_access_log_record(FFT_ACCESS_PREFETCH_TAKE, scenario_id);
+    fft_prefetch_t* prefetch = fft_ctx()->prefetch;
+    if (prefetch == NULL) {
+        _fft_access_log_muted++;
+        fft_scenario_bundle_t* bundle = fft_scenario_bundle_load(scenario_id);
+        _fft_access_log_muted--;
+        return bundle;
+    }
+
+    pthread_mutex_lock(&prefetch->lock);
+    for (;;) {
+        fft_prefetch_slot_t* slot = fft_prefetch_find_slot(prefetch, scenario_id);
+        if (slot == NULL) {
+            break;
+        }
+        if (slot->status == FFT_PREFETCH_SLOT_LOADING) {
+            pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+            continue;
         }
+
+        fft_scenario_bundle_t* bundle = slot->bundle;
+        *slot = (fft_prefetch_slot_t) { 0 };
+        pthread_mutex_unlock(&prefetch->lock);
+        fft_io_stats_count_cache(true);
+        return bundle;
     }
+    pthread_mutex_unlock(&prefetch->lock);
 
-    return poly_offset + count;
+    fft_io_stats_count_cache(false);
+    _fft_access_log_muted++;
+    fft_scenario_bundle_t* bundle = fft_scenario_bundle_load(scenario_id);
+    _fft_access_log_muted--;
+    return bundle;
 }
 
-static uint32_t read_untexinfo(fft_span_t* span, fft_geometry_t* g, uint32_t poly_offset, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        // Read all data
-        uint8_t unknown_a = fft_span_read_u8(span); // 0
-        uint8_t unknown_b = fft_span_read_u8(span); // 1
-        uint8_t unknown_c = fft_span_read_u8(span); // 2
-        uint8_t unknown_d = fft_span_read_u8(span); // 3
+/*
+================================================================================
+Cooked Pack Implementation
+================================================================================
+*/
 
-        // Populate the polygon's untextured info.
-        fft_polygon_t* poly = &g->polygons[poly_offset + i];
-        poly->untex.unknown_a = unknown_a;
-        poly->untex.unknown_b = unknown_b;
-        poly->untex.unknown_c = unknown_c;
-        poly->untex.unknown_d = unknown_d;
-    }
+static const char FFT_PACK_MAGIC[4] = { 'F', 'F', 'T', 'P' };
 
-    return poly_offset + count;
+enum {
+    FFT_PACK_ARRAY_ALIGN = 16, // Alignment of the arrays inside an entry
+    FFT_PACK_ENTRY_CAPACITY_MIN = 256,
+    FFT_PACK_BUFFER_CAPACITY_MIN = 64 * 1024,
+};
+
+struct fft_pack_writer_t {
+    FILE* file;     // NULL when cooking into buffer
+    uint8_t* buffer;
+    uint64_t buffer_capacity;
+    fft_pack_entry_t* entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    uint64_t offset;
+    bool failed;
+};
+
+// Smallest valid size of each kind of entry.
+static const size_t fft_pack_kind_size_min[FFT_PACK_KIND_COUNT] = {
+    [FFT_PACK_SCENARIOS] = sizeof(fft_scenario_table_t),
+    [FFT_PACK_MAP] = sizeof(fft_pack_map_t),
+    [FFT_PACK_MESH] = sizeof(fft_pack_mesh_t),
+    [FFT_PACK_TEXTURE] = sizeof(fft_pack_texture_t),
+    [FFT_PACK_EVENT] = sizeof(fft_pack_event_t),
+    [FFT_PACK_IMAGE] = sizeof(fft_pack_image_t),
+};
+
+static uint64_t fft_pack_align_up(uint64_t value, uint64_t align) {
+    return (value + align - 1) & ~(align - 1);
 }
 
-static uint32_t read_tile_locations(fft_span_t* span, fft_geometry_t* g, uint32_t poly_offset, uint32_t count) {
-    for (uint32_t i = 0; i < count; i++) {
-        // Read all data
-        uint8_t z_and_y = fft_span_read_u8(span); // y is elevation 0 or 1
-        uint8_t x = fft_span_read_u8(span);
+static uint64_t fft_pack_entry_key(const fft_pack_entry_t* entry) {
+    return ((uint64_t)entry->kind << 32) | ((uint64_t)entry->id << 16) | entry->index;
+}
 
-        // Split single byte values
-        uint8_t y = (z_and_y >> 0) & 0x01; // 0b00000001
-        uint8_t z = (z_and_y >> 1) & 0x7F; // 0b11111110
+static int fft_pack_entry_compare(const void* a, const void* b) {
+    uint64_t key_a = fft_pack_entry_key((const fft_pack_entry_t*)a);
+    uint64_t key_b = fft_pack_entry_key((const fft_pack_entry_t*)b);
+    return (key_a > key_b) - (key_a < key_b);
+}
 
-        // Populate the polygon's tile info.
-        fft_polygon_t* poly = &g->polygons[poly_offset + i];
-        poly->tiles.x = x;
-        poly->tiles.z = z;
-        poly->tiles.elevation = y;
+// A pack can only be read by a build whose structs have the same sizes and
+// byte order as the build that cooked it. Field order is covered by
+// FFT_PACK_VERSION.
+static uint32_t fft_pack_layout(void) {
+    const uint32_t byte_order = 0x01020304;
+    uint8_t first_byte;
+    memcpy(&first_byte, &byte_order, 1);
+
+    const size_t sizes[] = {
+        first_byte,
+        sizeof(fft_pack_header_t),
+        sizeof(fft_pack_entry_t),
+        sizeof(fft_scenario_table_t),
+        sizeof(fft_pack_map_t),
+        sizeof(fft_pack_mesh_t),
+        sizeof(fft_polygon_t),
+        sizeof(fft_pack_texture_t),
+        sizeof(fft_pack_event_t),
+        sizeof(fft_packed_instruction_t),
+        sizeof(fft_pack_image_t),
+    };
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        hash = (hash ^ (uint32_t)sizes[i]) * 16777619u;
     }
+    return hash;
+}
 
-    return poly_offset + count;
+// True if count elements of element_size at offset lie after the entry's
+// struct and inside its size. Arrays are written aligned, so unaligned
+// offsets are rejected too.
+static bool fft_pack_array_fits(uint64_t entry_size, size_t struct_size, uint64_t offset, uint64_t count, size_t element_size) {
+    if (offset < struct_size || offset > entry_size || offset % FFT_PACK_ARRAY_ALIGN != 0) {
+        return false;
+    }
+    return count <= (entry_size - offset) / element_size;
 }
 
-static fft_geometry_t fft_geometry_read(fft_span_t* span) {
-    fft_geometry_t geometry = { 0 };
+// Checks the offsets and counts inside an entry against its size, so the
+// accessors never read past it.
+static bool fft_pack_validate_entry(const uint8_t* data, const fft_pack_entry_t* entry) {
+    switch ((fft_pack_kind_e)entry->kind) {
+    case FFT_PACK_SCENARIOS: {
+        const fft_scenario_table_t* table = (const fft_scenario_table_t*)data;
+        if (table->usable_count > FFT_SCENARIO_COUNT) {
+            return false;
+        }
+        for (uint32_t key = 0; key < FFT_SCENARIO_KEY_COUNT; key++) {
+            for (uint32_t i = 0; i < table->usable_count; i++) {
+                if (table->index_ids[key][i] >= FFT_SCENARIO_COUNT) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    case FFT_PACK_MAP: {
+        const fft_pack_map_t* map = (const fft_pack_map_t*)data;
+        return map->record_count <= FFT_RECORD_MAX;
+    }
+    case FFT_PACK_MESH: {
+        const fft_pack_mesh_t* mesh = (const fft_pack_mesh_t*)data;
+        return mesh->meta.polygon_count <= FFT_MESH_MAX_POLYGONS
+            && fft_pack_array_fits(entry->size, sizeof(*mesh), mesh->polygons_offset, mesh->meta.polygon_count, sizeof(fft_polygon_t));
+    }
+    case FFT_PACK_TEXTURE: {
+        const fft_pack_texture_t* texture = (const fft_pack_texture_t*)data;
+        return fft_pack_array_fits(entry->size, sizeof(*texture), texture->pixels_offset, FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT, 1);
+    }
+    case FFT_PACK_EVENT: {
+        const fft_pack_event_t* event = (const fft_pack_event_t*)data;
+        if (event->instruction_count > FFT_INSTRUCTION_MAX
+            || !fft_pack_array_fits(entry->size, sizeof(*event), event->messages_offset, (uint64_t)event->messages_len + 1, 1)
+            || data[event->messages_offset + event->messages_len] != '\0'
+            || !fft_pack_array_fits(entry->size, sizeof(*event), event->instructions_offset, event->instruction_count, sizeof(fft_packed_instruction_t))) {
+            return false;
+        }
 
-    // The number of each type of polygon.
-    uint16_t N = fft_span_read_u16(span); // Textured triangles
-    uint16_t P = fft_span_read_u16(span); // Textured quads
-    uint16_t Q = fft_span_read_u16(span); // Untextured triangles
-    uint16_t R = fft_span_read_u16(span); // Untextured quads
+        // Params are read from the code section of data.
+        const fft_packed_instruction_t* instructions = (const fft_packed_instruction_t*)(data + event->instructions_offset);
+        for (uint32_t i = 0; i < event->instruction_count; i++) {
+            if (instructions[i].layout >= FFT_PARAM_LAYOUT_COUNT) {
+                return false;
+            }
+            const fft_param_layout_t* layout = &fft_param_layout_list[instructions[i].layout];
+            if ((size_t)instructions[i].offset + 1 + fft_param_layout_size(layout, layout->param_count) > FFT_EVENT_SIZE - 4) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case FFT_PACK_IMAGE: {
+        const fft_pack_image_t* image = (const fft_pack_image_t*)data;
+        const uint64_t pixel_count = (uint64_t)image->width * image->height;
+        // Checked before multiplying by repeat, which could wrap.
+        return image->repeat > 0
+            && pixel_count <= entry->size / image->repeat
+            && fft_pack_array_fits(entry->size, sizeof(*image), image->pixels_offset, pixel_count * image->repeat, 1)
+            && fft_pack_array_fits(entry->size, sizeof(*image), image->palettes_offset, image->pal_count, FFT_IMAGE_PAL_ROW_SIZE);
+    }
+    default:
+        return false;
+    }
+}
 
-    // Validate maximum values
-    FFT_ASSERT(N < FFT_MESH_MAX_TEX_TRIS, "Mesh textured triangle count exceeded");
-    FFT_ASSERT(P < FFT_MESH_MAX_TEX_QUADS, "Mesh textured quad count exceeded");
-    FFT_ASSERT(Q < FFT_MESH_MAX_UNTEX_TRIS, "Mesh untextured triangle count exceeded");
-    FFT_ASSERT(R < FFT_MESH_MAX_UNTEX_QUADS, "Mesh untextured quad count exceeded");
+// The entry table and the entries are checked once here so lookups can trust
+// them.
+static bool fft_pack_validate(fft_pack_t* pack) {
+    fft_pack_header_t header;
+    memcpy(&header, pack->data, sizeof(header));
+    if (memcmp(header.magic, FFT_PACK_MAGIC, sizeof(header.magic)) != 0
+        || header.version != FFT_PACK_VERSION
+        || header.layout != fft_pack_layout()) {
+        return false;
+    }
+    if (header.entry_offset % FFT_PACK_ALIGN != 0
+        || header.entry_offset > pack->size
+        || header.entry_count > (pack->size - header.entry_offset) / sizeof(fft_pack_entry_t)) {
+        return false;
+    }
 
-    // index is used to track the current position in the polygons array. It
-    // gets reset to 0 most of the time because most of this data is for the
-    // textured polygons, which come first.
-    uint32_t index = 0;
+    const fft_pack_entry_t* entries = (const fft_pack_entry_t*)(pack->data + header.entry_offset);
+    for (uint32_t i = 0; i < header.entry_count; i++) {
+        const fft_pack_entry_t* entry = &entries[i];
+        if (entry->kind >= FFT_PACK_KIND_COUNT
+            || entry->offset % FFT_PACK_ALIGN != 0
+            || entry->offset < sizeof(fft_pack_header_t)
+            || entry->offset > header.entry_offset
+            || entry->size > header.entry_offset - entry->offset
+            || entry->size < fft_pack_kind_size_min[entry->kind]) {
+            return false;
+        }
+        if (i > 0 && fft_pack_entry_key(&entries[i - 1]) >= fft_pack_entry_key(entry)) {
+            return false;
+        }
+        if (!fft_pack_validate_entry(pack->data + entry->offset, entry)) {
+            return false;
+        }
+    }
 
-    // Polygons
-    index = read_polygons(span, &geometry, FFT_POLYTYPE_TRIANGLE, false, index, N);
-    index = read_polygons(span, &geometry, FFT_POLYTYPE_QUAD, false, index, P);
-    index = read_polygons(span, &geometry, FFT_POLYTYPE_TRIANGLE, false, index, Q);
-    index = read_polygons(span, &geometry, FFT_POLYTYPE_QUAD, false, index, R);
+    pack->entries = entries;
+    pack->entry_count = header.entry_count;
+    return true;
+}
 
-    // Normals
-    index = 0; // Reset for textured polygons
-    index = read_normals(span, &geometry, FFT_POLYTYPE_TRIANGLE, index, N);
-    index = read_normals(span, &geometry, FFT_POLYTYPE_QUAD, index, P);
+bool fft_pack_open(const char* path, fft_pack_t* out) {
+    *out = (fft_pack_t) { 0 };
 
-    // Texture Coordinates
-    index = 0; // Reset for textured polygons
-    index = read_texinfo(span, &geometry, FFT_POLYTYPE_TRIANGLE, index, N);
-    index = read_texinfo(span, &geometry, FFT_POLYTYPE_QUAD, index, P);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(fft_pack_header_t)) {
+        close(fd);
+        return false;
+    }
 
-    // Unknown Untextured Polygon Data
-    index = N + P; // Reset for untextured polygons
-    index = read_untexinfo(span, &geometry, index, Q);
-    index = read_untexinfo(span, &geometry, index, R);
+    // The mapping keeps its own reference to the file.
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
 
-    // Tile Locations
-    index = 0; // Reset for textured polygons
-    index = read_tile_locations(span, &geometry, index, N);
-    index = read_tile_locations(span, &geometry, index, P);
+    fft_pack_t pack = { .data = (const uint8_t*)data, .size = size };
+    if (!fft_pack_validate(&pack)) {
+        munmap(data, size);
+        return false;
+    }
+    *out = pack;
+    return true;
+}
 
-    return geometry;
+void fft_pack_close(fft_pack_t* pack) {
+    if (pack->data != NULL) {
+        munmap((void*)pack->data, pack->size);
+    }
+    *pack = (fft_pack_t) { 0 };
 }
 
-/*
-================================================================================
-Lights and Background Implementation
-================================================================================
-*/
+const void* fft_pack_find(const fft_pack_t* pack, fft_pack_kind_e kind, uint16_t id, uint16_t index, uint64_t* out_size) {
+    const fft_pack_entry_t wanted = { .kind = (uint16_t)kind, .id = id, .index = index };
+    const uint64_t key = fft_pack_entry_key(&wanted);
+
+    // Lower bound
+    uint32_t low = 0;
+    uint32_t high = pack->entry_count;
+    while (low < high) {
+        uint32_t mid = low + ((high - low) / 2);
+        if (fft_pack_entry_key(&pack->entries[mid]) < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == pack->entry_count || fft_pack_entry_key(&pack->entries[low]) != key) {
+        return NULL;
+    }
 
-static bool fft_light_is_valid(fft_light_t light) {
-    return light.color.r + light.color.g + light.color.b > 0.0f;
+    const fft_pack_entry_t* entry = &pack->entries[low];
+    if (out_size != NULL) {
+        *out_size = entry->size;
+    }
+    return pack->data + entry->offset;
 }
 
-fft_lighting_t fft_lighting_read(fft_span_t* span) {
-    fft_lighting_t l = { 0 };
+const fft_scenario_table_t* fft_pack_scenarios(const fft_pack_t* pack) {
+    return (const fft_scenario_table_t*)fft_pack_find(pack, FFT_PACK_SCENARIOS, 0, 0, NULL);
+}
 
-    // Light colors are oddly stored all 3xR then 3xG then 3xB.
-    l.lights[0].color.r = fft_span_read_i16(span);
-    l.lights[1].color.r = fft_span_read_i16(span);
-    l.lights[2].color.r = fft_span_read_i16(span);
-    l.lights[0].color.g = fft_span_read_i16(span);
-    l.lights[1].color.g = fft_span_read_i16(span);
-    l.lights[2].color.g = fft_span_read_i16(span);
-    l.lights[0].color.b = fft_span_read_i16(span);
-    l.lights[1].color.b = fft_span_read_i16(span);
-    l.lights[2].color.b = fft_span_read_i16(span);
+const fft_pack_map_t* fft_pack_map(const fft_pack_t* pack, uint8_t map_id) {
+    return (const fft_pack_map_t*)fft_pack_find(pack, FFT_PACK_MAP, map_id, 0, NULL);
+}
 
-    // Positions are stored as expected.
-    l.lights[0].position = fft_geometry_read_position(span);
-    l.lights[1].position = fft_geometry_read_position(span);
-    l.lights[2].position = fft_geometry_read_position(span);
+const fft_pack_mesh_t* fft_pack_mesh(const fft_pack_t* pack, uint8_t map_id, uint8_t index) {
+    return (const fft_pack_mesh_t*)fft_pack_find(pack, FFT_PACK_MESH, map_id, index, NULL);
+}
 
-    l.ambient_color = fft_color_rgb8_read(span);
+const fft_pack_texture_t* fft_pack_texture(const fft_pack_t* pack, uint8_t map_id, uint8_t index) {
+    return (const fft_pack_texture_t*)fft_pack_find(pack, FFT_PACK_TEXTURE, map_id, index, NULL);
+}
 
-    l.background_top = fft_color_rgb8_read(span);
-    l.background_bottom = fft_color_rgb8_read(span);
+const fft_pack_event_t* fft_pack_event(const fft_pack_t* pack, uint16_t event_id) {
+    return (const fft_pack_event_t*)fft_pack_find(pack, FFT_PACK_EVENT, event_id, 0, NULL);
+}
 
-    l.unknown_a = fft_span_read_u8(span);
-    l.unknown_b = fft_span_read_u8(span);
-    l.unknown_c = fft_span_read_u8(span);
+const fft_pack_image_t* fft_pack_image(const fft_pack_t* pack, uint32_t desc_index) {
+    FFT_ASSERT(desc_index < FFT_IMAGE_DESC_COUNT, "Image descriptor %u out of bounds", desc_index);
+    return (const fft_pack_image_t*)fft_pack_find(pack, FFT_PACK_IMAGE, (uint16_t)desc_index, 0, NULL);
+}
 
-    return l;
+const fft_polygon_t* fft_pack_mesh_polygons(const fft_pack_mesh_t* mesh) {
+    return (const fft_polygon_t*)((const uint8_t*)mesh + mesh->polygons_offset);
 }
 
-/*
-================================================================================
-Terrain Implementation
-================================================================================
-*/
+const uint8_t* fft_pack_texture_pixels(const fft_pack_texture_t* texture) {
+    return (const uint8_t*)texture + texture->pixels_offset;
+}
 
-static fft_terrain_t fft_terrain_read(fft_span_t* span) {
-    fft_terrain_t terrain = { 0 };
+const char* fft_pack_event_messages(const fft_pack_event_t* event) {
+    return (const char*)event + event->messages_offset;
+}
 
-    uint8_t x_count = fft_span_read_u8(span);
-    uint8_t z_count = fft_span_read_u8(span);
-    FFT_ASSERT(x_count <= FFT_TERRAIN_MAX_X, "Terrain X count exceeded");
-    FFT_ASSERT(z_count <= FFT_TERRAIN_MAX_Z, "Terrain Z count exceeded");
+const fft_packed_instruction_t* fft_pack_event_instructions(const fft_pack_event_t* event) {
+    return (const fft_packed_instruction_t*)((const uint8_t*)event + event->instructions_offset);
+}
 
-    for (uint8_t level = 0; level < 2; level++) {
-        for (uint8_t z = 0; z < z_count; z++) {
-            for (uint8_t x = 0; x < x_count; x++) {
-                // FIXME: This code needs to be validated that it is reading everything correctly.
-                fft_terrain_tile_t tile = { 0 };
-
-                uint8_t raw_surface = fft_span_read_u8(span);
-                tile.surface = (fft_terrain_surface_e)(raw_surface & 0x3F); // 0b00111111
-                fft_span_read_u8(span);
-                tile.sloped_height_bottom = fft_span_read_u8(span);
-                uint8_t slope_top_and_depth = fft_span_read_u8(span);
-                tile.depth = (slope_top_and_depth >> 5) & 0x07;      // 0b11100000 -> 0b00000111
-                tile.sloped_height_top = slope_top_and_depth & 0x1F; // 0b00011111
-                tile.slope = (fft_terrain_slope_e)fft_span_read_u8(span);
-                fft_span_read_u8(span); // Padding
-
-                if (tile.slope == FFT_SLOPE_FLAT) {
-                    // Sloped height top should be 0 for flat tiles but some
-                    // maps tiles set to 1. This should be researched further.
-                    FFT_ASSERT(tile.sloped_height_top == 0 || tile.sloped_height_top == 1, "Flat tile has > 1 sloped height top");
-                }
+const uint8_t* fft_pack_image_pixels(const fft_pack_image_t* image, uint32_t repeat_index) {
+    FFT_ASSERT(repeat_index < image->repeat, "Image repeat %u out of bounds", repeat_index);
+    return (const uint8_t*)image + image->pixels_offset + ((size_t)repeat_index * image->width * image->height);
+}
+
+const uint8_t* fft_pack_image_palette(const fft_pack_image_t* image, uint32_t pal_index) {
+    FFT_ASSERT(pal_index < image->pal_count, "Image palette %u out of bounds", pal_index);
+    return (const uint8_t*)image + image->palettes_offset + ((size_t)pal_index * FFT_IMAGE_PAL_ROW_SIZE);
+}
 
-                // bits 3, 4, 5, are unused
-                uint8_t misc = fft_span_read_u8(span);
-                tile.pass_through_only = misc & (1 << 0); // bit 0
-                tile.shading = (misc >> 2) & 0x3;         // bit 1 & 2
-                tile.cant_walk = misc & (1 << 6);         // bit 6
-                tile.cant_select = misc & (1 << 7);       // bit 7
-                tile.auto_cam_dir = fft_span_read_u8(span);
+void fft_pack_mesh_expand(const fft_pack_mesh_t* mesh, fft_mesh_t* out) {
+    memset(out, 0, sizeof(*out));
+    out->state = mesh->state;
+    out->header = mesh->header;
+    out->clut = mesh->clut;
+    out->lighting = mesh->lighting;
+    out->terrain = mesh->terrain;
+    out->meta = mesh->meta;
+    memcpy(out->geometry.polygons, fft_pack_mesh_polygons(mesh), mesh->meta.polygon_count * sizeof(fft_polygon_t));
+}
 
-                terrain.tiles[level][z * x_count + x] = tile;
+static void fft_pack_writer_write(fft_pack_writer_t* writer, const void* data, size_t size) {
+    if (writer->file == NULL) {
+        if (writer->offset + size > writer->buffer_capacity) {
+            uint64_t capacity = FFT_MAX(writer->buffer_capacity * 2, (uint64_t)FFT_PACK_BUFFER_CAPACITY_MIN);
+            while (capacity < writer->offset + size) {
+                capacity *= 2;
             }
+            uint8_t* buffer = FFT_MEM_ALLOC_TAG((size_t)capacity, "pack buffer");
+            if (writer->buffer != NULL) {
+                memcpy(buffer, writer->buffer, (size_t)writer->offset);
+                FFT_MEM_FREE(writer->buffer);
+            }
+            writer->buffer = buffer;
+            writer->buffer_capacity = capacity;
+        }
+        memcpy(writer->buffer + writer->offset, data, size);
+    } else if (size > 0 && fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = true;
+    }
+    writer->offset += size;
+}
+
+// Entries start aligned, so aligning the file offset also aligns the offset
+// inside the current entry.
+static void fft_pack_writer_pad(fft_pack_writer_t* writer, uint64_t align) {
+    static const uint8_t zeros[FFT_PACK_ALIGN] = { 0 };
+    uint64_t padding = fft_pack_align_up(writer->offset, align) - writer->offset;
+    fft_pack_writer_write(writer, zeros, (size_t)padding);
+}
+
+static void fft_pack_writer_open_entry(fft_pack_writer_t* writer, fft_pack_kind_e kind, uint16_t id, uint16_t index) {
+    fft_pack_writer_pad(writer, FFT_PACK_ALIGN);
+
+    if (writer->entry_count == writer->entry_capacity) {
+        uint32_t capacity = FFT_MAX(writer->entry_capacity * 2, (uint32_t)FFT_PACK_ENTRY_CAPACITY_MIN);
+        fft_pack_entry_t* entries = FFT_MEM_ALLOC_TAG(capacity * sizeof(fft_pack_entry_t), "pack entries");
+        if (writer->entries != NULL) {
+            memcpy(entries, writer->entries, writer->entry_count * sizeof(fft_pack_entry_t));
+            FFT_MEM_FREE(writer->entries);
         }
+        writer->entries = entries;
+        writer->entry_capacity = capacity;
     }
 
-    terrain.x_count = x_count;
-    terrain.z_count = z_count;
-    terrain.valid = true;
-    return terrain;
+    writer->entries[writer->entry_count++] = (fft_pack_entry_t) {
+        .kind = (uint16_t)kind,
+        .id = id,
+        .index = index,
+        .offset = writer->offset,
+    };
 }
 
-static const char* fft_terrain_surface_str(fft_terrain_surface_e value) {
-    switch (value) {
-#define X(oname, ovalue, ostring) \
-case oname:                       \
-    return ostring;
-        FFT_TERRAIN_SURFACE_INDEX
-#undef X
-    default:;
-        static char buf[32];
-        snprintf(buf, sizeof(buf), "Unknown 0x%02X", value);
-        return buf;
-    }
+static void fft_pack_writer_close_entry(fft_pack_writer_t* writer) {
+    fft_pack_entry_t* entry = &writer->entries[writer->entry_count - 1];
+    entry->size = writer->offset - entry->offset;
 }
 
-static const char* fft_terrain_slope_str(fft_terrain_slope_e value) {
-    switch (value) {
-#define X(oname, ovalue, ostring) \
-case oname:                       \
-    return ostring;
-        FFT_TERRAIN_SLOPE_INDEX
-#undef X
-    default:;
-        static char buf[32];
-        snprintf(buf, sizeof(buf), "Unknown 0x%02X", value);
-        return buf;
+fft_pack_writer_t* fft_pack_writer_begin(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return NULL;
     }
+    fft_pack_writer_t* writer = FFT_MEM_ALLOC_TAG(sizeof(fft_pack_writer_t), "pack writer");
+    writer->file = file;
+
+    // Written again by fft_pack_writer_end() once the entry table is known.
+    fft_pack_header_t header = { 0 };
+    fft_pack_writer_write(writer, &header, sizeof(header));
+    return writer;
 }
 
-static const char* fft_terrain_shading_str(uint8_t value) {
-    switch (value) {
-    case 0:
-        return "Normal";
-    case 1:
-        return "Dark";
-    case 2:
-        return "Darker";
-    case 3:
-        return "Darkest";
-    default:
-        return "Unknown";
+// Cooks into memory instead of a file, for the shared cache. There is no
+// header, so entry offsets are from the start of buffer.
+static fft_pack_writer_t* fft_pack_writer_begin_memory(void) {
+    fft_pack_writer_t* writer = FFT_MEM_ALLOC_TAG(sizeof(fft_pack_writer_t), "pack writer");
+    return writer;
+}
+
+static void fft_pack_writer_free(fft_pack_writer_t* writer) {
+    if (writer->buffer != NULL) {
+        FFT_MEM_FREE(writer->buffer);
+    }
+    if (writer->entries != NULL) {
+        FFT_MEM_FREE(writer->entries);
     }
+    FFT_MEM_FREE(writer);
 }
 
-static void fft_terrain_camdir_str(uint8_t cam_dir, char out_str[static FFT_TERRAIN_STR_SIZE]) {
-    out_str[0] = '\0';
+bool fft_pack_writer_end(fft_pack_writer_t* writer) {
+    qsort(writer->entries, writer->entry_count, sizeof(fft_pack_entry_t), fft_pack_entry_compare);
+    for (uint32_t i = 1; i < writer->entry_count; i++) {
+        const fft_pack_entry_t* entry = &writer->entries[i];
+        FFT_ASSERT(fft_pack_entry_key(&writer->entries[i - 1]) != fft_pack_entry_key(entry),
+            "Duplicate pack entry kind %u id %u index %u", entry->kind, entry->id, entry->index);
+    }
 
-    static const char* labels[8] = {
-        "NWT", "SWT",
-        "SET", "NET",
-        "NWB", "SWB",
-        "SEB", "NEB"
+    fft_pack_writer_pad(writer, FFT_PACK_ALIGN);
+    fft_pack_header_t header = {
+        .version = FFT_PACK_VERSION,
+        .layout = fft_pack_layout(),
+        .entry_count = writer->entry_count,
+        .entry_offset = writer->offset,
     };
+    memcpy(header.magic, FFT_PACK_MAGIC, sizeof(header.magic));
+    fft_pack_writer_write(writer, writer->entries, writer->entry_count * sizeof(fft_pack_entry_t));
 
-    uint32_t offset = 0;
-    uint32_t written = 0;
-    bool first = true;
+    if (fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        writer->failed = true;
+    }
+    if (fclose(writer->file) != 0) {
+        writer->failed = true;
+    }
 
-    for (uint32_t i = 0; i < 8; i++) {
-        if (cam_dir & (1u << i)) {
-            if (!first) {
-                written = (uint32_t)snprintf(out_str + offset, FFT_TERRAIN_STR_SIZE - offset, ", ");
-                offset += (written > 0) ? written : 0;
-            }
+    bool ok = !writer->failed;
+    fft_pack_writer_free(writer);
+    return ok;
+}
 
-            written = (uint32_t)snprintf(out_str + offset, FFT_TERRAIN_STR_SIZE - offset, "%s", labels[i]);
-            offset += (written > 0) ? written : 0;
+void fft_pack_writer_add(fft_pack_writer_t* writer, fft_pack_kind_e kind, uint16_t id, uint16_t index, const void* data, size_t size) {
+    fft_pack_writer_open_entry(writer, kind, id, index);
+    fft_pack_writer_write(writer, data, size);
+    fft_pack_writer_close_entry(writer);
+}
 
-            first = false;
-        }
-    }
+void fft_pack_writer_add_scenarios(fft_pack_writer_t* writer, const fft_scenario_table_t* table) {
+    fft_pack_writer_add(writer, FFT_PACK_SCENARIOS, 0, 0, table, sizeof(*table));
+}
 
-    if (offset == 0) {
-        snprintf(out_str, FFT_TERRAIN_STR_SIZE, "(None)");
-    }
+void fft_pack_writer_add_mesh(fft_pack_writer_t* writer, uint8_t map_id, uint8_t index, fft_recordtype_e type, const fft_mesh_t* mesh) {
+    FFT_ASSERT(mesh->meta.polygon_count <= FFT_MESH_MAX_POLYGONS, "Mesh polygon count exceeded");
+
+    // Zeroed so the padding in the file is deterministic.
+    fft_pack_mesh_t packed;
+    memset(&packed, 0, sizeof(packed));
+    packed.type = type;
+    packed.state = mesh->state;
+    packed.header = mesh->header;
+    packed.clut = mesh->clut;
+    packed.lighting = mesh->lighting;
+    packed.terrain = mesh->terrain;
+    packed.meta = mesh->meta;
+    packed.polygons_offset = (uint32_t)fft_pack_align_up(sizeof(packed), FFT_PACK_ARRAY_ALIGN);
+
+    fft_pack_writer_open_entry(writer, FFT_PACK_MESH, map_id, index);
+    fft_pack_writer_write(writer, &packed, sizeof(packed));
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
+    fft_pack_writer_write(writer, mesh->geometry.polygons, mesh->meta.polygon_count * sizeof(fft_polygon_t));
+    fft_pack_writer_close_entry(writer);
 }
 
-/*
-================================================================================
-Mesh Implementation
-================================================================================
-*/
+static void fft_pack_writer_add_texture(fft_pack_writer_t* writer, uint8_t map_id, uint8_t index, const fft_texture_t* texture) {
+    FFT_ASSERT(texture->image.valid && texture->image.size == FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT * 4, "Invalid map texture");
 
-fft_mesh_t fft_mesh_read(fft_span_t* span) {
-    FFT_ASSERT(span->data != NULL && span->offset == 0, "Invalid span for mesh read");
+    fft_pack_texture_t packed;
+    memset(&packed, 0, sizeof(packed));
+    packed.state = texture->state;
+    packed.pixels_offset = (uint32_t)fft_pack_align_up(sizeof(packed), FFT_PACK_ARRAY_ALIGN);
 
-    fft_mesh_t mesh = { 0 };
+    fft_pack_writer_open_entry(writer, FFT_PACK_TEXTURE, map_id, index);
+    fft_pack_writer_write(writer, &packed, sizeof(packed));
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
 
-    mesh.header = fft_mesh_header_read(span);
+    // The decoded texture has the palette index in every channel.
+    uint8_t row[FFT_TEXTURE_WIDTH];
+    for (uint32_t y = 0; y < FFT_TEXTURE_HEIGHT; y++) {
+        const uint8_t* src = &texture->image.data[(size_t)y * FFT_TEXTURE_WIDTH * 4];
+        for (uint32_t x = 0; x < FFT_TEXTURE_WIDTH; x++) {
+            row[x] = src[x * 4];
+        }
+        fft_pack_writer_write(writer, row, sizeof(row));
+    }
+    fft_pack_writer_close_entry(writer);
+}
 
-    if (mesh.header.geometry != 0) {
-        fft_span_set_offset(span, mesh.header.geometry);
-        mesh.geometry = fft_geometry_read(span);
+void fft_pack_writer_add_map(fft_pack_writer_t* writer, uint8_t map_id, const fft_map_data_t* map_data) {
+    fft_pack_map_t packed;
+    memset(&packed, 0, sizeof(packed));
+    memcpy(packed.records, map_data->records, sizeof(packed.records));
+    packed.record_count = map_data->record_count;
 
-        // Jump back so we can read the polygon counts.
-        fft_span_set_offset(span, mesh.header.geometry);
-        mesh.meta.tex_tri_count = fft_span_read_u16(span);
-        mesh.meta.tex_quad_count = fft_span_read_u16(span);
-        mesh.meta.untex_tri_count = fft_span_read_u16(span);
-        mesh.meta.untex_quad_count = fft_span_read_u16(span);
-        mesh.meta.polygon_count = mesh.meta.tex_tri_count + mesh.meta.tex_quad_count + mesh.meta.untex_tri_count + mesh.meta.untex_quad_count;
-        mesh.meta.has_geometry = true;
+    // Meshes are numbered in record order.
+    uint8_t alt_index = 0;
+    for (uint32_t i = 0; i < map_data->record_count; i++) {
+        fft_recordtype_e type = map_data->records[i].type;
+        switch (type) {
+        case FFT_RECORDTYPE_MESH_PRIMARY:
+            fft_pack_writer_add_mesh(writer, map_id, packed.mesh_count++, type, &map_data->primary_mesh);
+            break;
+        case FFT_RECORDTYPE_MESH_OVERRIDE:
+            fft_pack_writer_add_mesh(writer, map_id, packed.mesh_count++, type, &map_data->override_mesh);
+            break;
+        case FFT_RECORDTYPE_MESH_ALT:
+            fft_pack_writer_add_mesh(writer, map_id, packed.mesh_count++, type, &map_data->alt_meshes[alt_index++]);
+            break;
+        default:
+            break;
+        }
     }
 
-    if (mesh.header.clut_color != 0) {
-        fft_span_set_offset(span, mesh.header.clut_color);
-        mesh.clut = fft_clut_read(span);
-        mesh.meta.has_clut = true;
+    for (uint8_t i = 0; i < map_data->texture_count; i++) {
+        fft_pack_writer_add_texture(writer, map_id, i, &map_data->textures[i]);
     }
+    packed.texture_count = map_data->texture_count;
 
-    if (mesh.header.lights_and_background != 0) {
-        fft_span_set_offset(span, mesh.header.lights_and_background);
-        mesh.lighting = fft_lighting_read(span);
-        mesh.meta.has_lighting = true;
+    fft_pack_writer_add(writer, FFT_PACK_MAP, map_id, 0, &packed, sizeof(packed));
+}
 
-        for (uint32_t i = 0; i < FFT_LIGHTING_MAX_LIGHTS; i++) {
-            if (fft_light_is_valid(mesh.lighting.lights[i])) {
-                mesh.meta.light_count++;
-            }
+void fft_pack_writer_add_event(fft_pack_writer_t* writer, uint16_t event_id, const fft_event_t* event) {
+    FFT_ASSERT(event->valid, "Event %d is not valid", event_id);
+
+    fft_span_t code;
+    fft_event_code_span(event->data, &code);
+    fft_packed_instruction_t instructions[FFT_INSTRUCTION_MAX];
+    uint16_t instruction_count = fft_instructions_pack(&code, instructions);
+
+    fft_pack_event_t packed;
+    memset(&packed, 0, sizeof(packed));
+    memcpy(packed.data, event->data, FFT_EVENT_SIZE);
+    packed.messages_len = (uint32_t)event->messages_len;
+    packed.message_count = (uint32_t)event->message_count;
+    packed.instruction_count = instruction_count;
+    packed.messages_offset = (uint32_t)fft_pack_align_up(sizeof(packed), FFT_PACK_ARRAY_ALIGN);
+    packed.instructions_offset = (uint32_t)fft_pack_align_up(packed.messages_offset + packed.messages_len + 1, FFT_PACK_ARRAY_ALIGN);
+
+    fft_pack_writer_open_entry(writer, FFT_PACK_EVENT, event_id, 0);
+    fft_pack_writer_write(writer, &packed, sizeof(packed));
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
+    fft_pack_writer_write(writer, event->messages, event->messages_len + 1);
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
+    fft_pack_writer_write(writer, instructions, instruction_count * sizeof(fft_packed_instruction_t));
+    fft_pack_writer_close_entry(writer);
+}
+
+void fft_pack_writer_add_image(fft_pack_writer_t* writer, uint32_t desc_index) {
+    FFT_ASSERT(desc_index < FFT_IMAGE_DESC_COUNT, "Image descriptor %u out of bounds", desc_index);
+    const fft_image_desc_t desc = image_desc_list[desc_index];
+    const size_t pixel_count = (size_t)desc.width * desc.height;
+    const size_t pal_size_on_disk = FFT_IMAGE_PAL_COL_COUNT * 2;
+
+    fft_pack_image_t packed;
+    memset(&packed, 0, sizeof(packed));
+    packed.width = desc.width;
+    packed.height = desc.height;
+    packed.repeat = desc.repeat > 0 ? desc.repeat : 1;
+    packed.pal_count = desc.pal_count;
+    packed.pixels_offset = (uint32_t)fft_pack_align_up(sizeof(packed), FFT_PACK_ARRAY_ALIGN);
+    packed.palettes_offset = (uint32_t)fft_pack_align_up(packed.pixels_offset + (packed.repeat * pixel_count), FFT_PACK_ARRAY_ALIGN);
+
+    fft_span_t file = fft_io_open(desc.entry);
+    FFT_ASSERT(desc.pal_offset + (desc.pal_count * pal_size_on_disk) <= file.size, "Out of bounds read.");
+
+    fft_pack_writer_open_entry(writer, FFT_PACK_IMAGE, (uint16_t)desc_index, 0);
+    fft_pack_writer_write(writer, &packed, sizeof(packed));
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
+
+    // One palette index per pixel, low nibble first like fft_image_unpack_4bpp().
+    uint8_t* pixels = FFT_MEM_ALLOC_TAG(pixel_count, "pack image");
+    for (uint32_t r = 0; r < packed.repeat; r++) {
+        const size_t offset = desc.data_offset + ((size_t)desc.repeat_offset * r);
+        FFT_ASSERT(offset + (pixel_count / 2) <= file.size, "Out of bounds read.");
+        for (size_t i = 0; i < pixel_count / 2; i++) {
+            pixels[i * 2] = file.data[offset + i] & 0x0F;
+            pixels[(i * 2) + 1] = file.data[offset + i] >> 4;
         }
+        fft_pack_writer_write(writer, pixels, pixel_count);
     }
+    FFT_MEM_FREE(pixels);
+    fft_pack_writer_pad(writer, FFT_PACK_ARRAY_ALIGN);
 
-    if (mesh.header.terrain != 0) {
-        fft_span_set_offset(span, mesh.header.terrain);
-        mesh.terrain = fft_terrain_read(span);
-        mesh.meta.has_terrain = true;
+    uint8_t palette[FFT_IMAGE_PAL_ROW_SIZE];
+    for (uint32_t p = 0; p < desc.pal_count; p++) {
+        fft_image_convert_5551(&file.data[desc.pal_offset + (p * pal_size_on_disk)], FFT_IMAGE_PAL_COL_COUNT, palette);
+        fft_pack_writer_write(writer, palette, sizeof(palette));
     }
-
-    return mesh;
+    fft_pack_writer_close_entry(writer);
+    fft_io_close(file);
 }
 
 /*
 ================================================================================
-Texture Implementation
+Shared Cache Implementation
 ================================================================================
 */
 
-static void fft_texture_destroy(fft_texture_t texture) {
-    fft_image_destroy(&texture.image);
-}
+static const char FFT_SHARED_CACHE_MAGIC[4] = { 'F', 'F', 'T', 'S' };
 
-static fft_texture_t fft_texture_read(fft_span_t* span, fft_state_t state) {
-    fft_image_t image = fft_image_read_4bpp(span, FFT_TEXTURE_WIDTH, FFT_TEXTURE_HEIGHT);
-    return (fft_texture_t) {
-        .state = state,
-        .image = image,
-    };
-}
+enum {
+    FFT_SHARED_CACHE_PAGE_SIZE = 4096, // Entries start on a page after the index
+};
 
-/*
-================================================================================
-Map Data Implementation
-================================================================================
-*/
+typedef enum {
+    FFT_SHARED_SLOT_DECODING, // Claimed, being cooked by the process that claimed it
+    FFT_SHARED_SLOT_READY,
+    FFT_SHARED_SLOT_FULL, // Didn't fit, every caller gets NULL
+} fft_shared_slot_state_e;
 
-fft_map_data_t* fft_map_data_read(int map_id) {
-    fft_map_data_t* map_data = FFT_MEM_ALLOC(sizeof(fft_map_data_t));
+// offset and size are written before state is stored as ready, and read after
+// loading it, so they don't need to be atomic.
+typedef struct {
+    _Atomic uint64_t key;   // fft_pack_entry_key() + 1, 0 while the slot is empty
+    _Atomic uint32_t state; // fft_shared_slot_state_e
+    uint32_t reserved;
+    uint64_t offset; // From the start of the cache
+    uint64_t size;   // 0 if the cook function didn't add the entry
+} fft_shared_slot_t;
+
+// At the start of the shared object. The fields other than the atomics are
+// written once by the creator before it stores ready.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t layout;
+    _Atomic uint32_t ready;
+    uint64_t size; // Of the whole object
+    uint64_t data_offset;
+    _Atomic uint64_t used; // Bump allocator, from data_offset
+    fft_shared_slot_t slots[FFT_SHARED_CACHE_SLOT_COUNT];
+} fft_shared_header_t;
+
+struct fft_shared_cache_t {
+    uint8_t* base;       // Read-write, for the index and publishing
+    const uint8_t* view; // Read-only, entries are returned from here
+    size_t size;
+    fft_shared_header_t* header;
+};
 
-    const fft_io_entry_e map_file = fft_map_list[map_id].entry;
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Shared cache atomics must be lock-free to work across processes");
+static_assert((FFT_SHARED_CACHE_SLOT_COUNT & (FFT_SHARED_CACHE_SLOT_COUNT - 1)) == 0, "Slot count must be a power of two");
 
-    fft_span_t gns = fft_io_open(map_file);
-    {
-        map_data->record_count = fft_record_read_all(&gns, map_data->records);
-    }
-    fft_io_close(gns);
+static uint64_t fft_shared_cache_data_offset(void) {
+    return fft_pack_align_up(sizeof(fft_shared_header_t), FFT_SHARED_CACHE_PAGE_SIZE);
+}
 
-    for (uint32_t i = 0; i < map_data->record_count; i++) {
-        fft_record_t* record = &map_data->records[i];
+static uint32_t fft_shared_cache_layout(void) {
+    return (fft_pack_layout() ^ (uint32_t)sizeof(fft_shared_header_t)) * 16777619u;
+}
 
-        // Fetch the resource file
+// Strict C11 builds on glibc don't declare ftruncate() without a POSIX feature
+// macro. The prototype is the POSIX one, so repeating it is harmless elsewhere.
+int ftruncate(int fd, off_t length);
 
-        switch (record->type) {
-        case FFT_RECORDTYPE_TEXTURE: {
-            fft_span_t file = fft_io_read(record->sector, record->length);
-            fft_texture_t texture = fft_texture_read(&file, record->state);
-            fft_io_close(file);
+static uint64_t fft_shared_cache_deadline(void) {
+    return fft_time_now_ns() + ((uint64_t)FFT_SHARED_CACHE_WAIT_MS * 1000000u);
+}
 
-            map_data->textures[map_data->texture_count++] = texture;
-            break;
+// Yields while waiting on another process. Returns false once the deadline has
+// passed, in case that process died.
+static bool fft_shared_cache_yield(uint64_t deadline_ns) {
+    sched_yield();
+    return fft_time_now_ns() < deadline_ns;
+}
+
+fft_shared_cache_t* fft_shared_cache_open(const char* name, size_t capacity) {
+    const uint64_t data_offset = fft_shared_cache_data_offset();
+
+    // O_EXCL picks the one process that creates and sizes the object.
+    bool created = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+
+    uint64_t size = data_offset + fft_pack_align_up(capacity, FFT_PACK_ALIGN);
+    if (created) {
+        if (ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
         }
-        case FFT_RECORDTYPE_MESH_PRIMARY: {
-            fft_span_t file = fft_io_read(record->sector, record->length);
-            // There always only one primary mesh file and it uses default state.
-            FFT_ASSERT(fft_state_is_default(record->state), "Primary mesh file has non-default state");
-            map_data->primary_mesh = fft_mesh_read(&file);
-            fft_io_close(file);
-
-            record->meta = map_data->primary_mesh.meta;
-            break;
+    } else {
+        // The creator may not have sized it yet.
+        const uint64_t deadline = fft_shared_cache_deadline();
+        struct stat st;
+        for (;;) {
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return NULL;
+            }
+            if (st.st_size > 0) {
+                break;
+            }
+            if (!fft_shared_cache_yield(deadline)) {
+                close(fd);
+                return NULL;
+            }
         }
-        case FFT_RECORDTYPE_MESH_ALT: {
-            fft_span_t file = fft_io_read(record->sector, record->length);
-            fft_mesh_t alt_mesh = fft_mesh_read(&file);
-            fft_io_close(file);
-
-            alt_mesh.state = record->state;
-            map_data->alt_meshes[map_data->alt_mesh_count++] = alt_mesh;
-            record->meta = map_data->primary_mesh.meta;
-            break;
+        size = (uint64_t)st.st_size;
+        if (size < data_offset) {
+            close(fd);
+            return NULL;
         }
-        case FFT_RECORDTYPE_MESH_OVERRIDE: {
-            fft_span_t file = fft_io_read(record->sector, record->length);
-            // If there is an override file, there is only one and it uses default state.
-            FFT_ASSERT(fft_state_is_default(record->state), "Override must be default map state");
-            map_data->override_mesh = fft_mesh_read(&file);
-            fft_io_close(file);
-
-            record->meta = map_data->primary_mesh.meta;
-            break;
+    }
+
+    // The mappings keep their own reference to the object.
+    void* base = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* view = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || view == MAP_FAILED) {
+        if (base != MAP_FAILED) {
+            munmap(base, (size_t)size);
+        }
+        if (view != MAP_FAILED) {
+            munmap(view, (size_t)size);
         }
+        return NULL;
+    }
 
-        default:
-            continue;
+    fft_shared_header_t* header = (fft_shared_header_t*)base;
+    if (created) {
+        memcpy(header->magic, FFT_SHARED_CACHE_MAGIC, sizeof(header->magic));
+        header->version = FFT_SHARED_CACHE_VERSION;
+        header->layout = fft_shared_cache_layout();
+        header->size = size;
+        header->data_offset = data_offset;
+        atomic_store_explicit(&header->ready, 1, memory_order_release);
+    } else {
+        const uint64_t deadline = fft_shared_cache_deadline();
+        while (atomic_load_explicit(&header->ready, memory_order_acquire) == 0) {
+            if (!fft_shared_cache_yield(deadline)) {
+                munmap(base, (size_t)size);
+                munmap(view, (size_t)size);
+                return NULL;
+            }
         }
     }
 
-    return map_data;
+    if (memcmp(header->magic, FFT_SHARED_CACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != FFT_SHARED_CACHE_VERSION
+        || header->layout != fft_shared_cache_layout()
+        || header->size != size
+        || header->data_offset != data_offset) {
+        munmap(base, (size_t)size);
+        munmap(view, (size_t)size);
+        return NULL;
+    }
+
+    fft_shared_cache_t* cache = FFT_MEM_ALLOC_TAG(sizeof(fft_shared_cache_t), "shared cache");
+    cache->base = (uint8_t*)base;
+    cache->view = (const uint8_t*)view;
+    cache->size = (size_t)size;
+    cache->header = header;
+    return cache;
 }
 
-void fft_map_data_destroy(fft_map_data_t* map) {
-    if (map == NULL) {
-        return;
-    }
+void fft_shared_cache_close(fft_shared_cache_t* cache) {
+    munmap(cache->base, cache->size);
+    munmap((void*)cache->view, cache->size);
+    FFT_MEM_FREE(cache);
+}
 
-    // Textures
-    for (uint32_t i = 0; i < map->texture_count; i++) {
-        fft_texture_destroy(map->textures[i]);
-    }
+bool fft_shared_cache_unlink(const char* name) {
+    return shm_unlink(name) == 0;
+}
 
-    FFT_MEM_FREE(map);
+uint64_t fft_shared_cache_used(const fft_shared_cache_t* cache) {
+    const uint64_t capacity = cache->header->size - cache->header->data_offset;
+    return FFT_MIN(atomic_load_explicit(&cache->header->used, memory_order_relaxed), capacity);
 }
 
-/*
-================================================================================
-Scenario Implementation
-================================================================================
-*/
+// Returns the slot holding key. If no slot holds it and claim is set, an empty
+// one is claimed for it and out_claimed is set. Returns NULL if the key isn't
+// there and it wasn't claimed.
+static fft_shared_slot_t* fft_shared_cache_slot(fft_shared_cache_t* cache, uint64_t key, bool claim, bool* out_claimed) {
+    const uint64_t stored = key + 1;
+    const uint32_t mask = FFT_SHARED_CACHE_SLOT_COUNT - 1;
+    uint32_t start = (uint32_t)((stored * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+
+    *out_claimed = false;
+    for (uint32_t probe = 0; probe < FFT_SHARED_CACHE_SLOT_COUNT; probe++) {
+        fft_shared_slot_t* slot = &cache->header->slots[(start + probe) & mask];
+        uint64_t current = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (current == 0) {
+            if (!claim) {
+                return NULL;
+            }
+            if (atomic_compare_exchange_strong_explicit(&slot->key, &current, stored, memory_order_acq_rel, memory_order_acquire)) {
+                *out_claimed = true;
+                return slot;
+            }
+            // Lost the race, current is now the key that won it.
+        }
+        if (current == stored) {
+            return slot;
+        }
+    }
+    return NULL;
+}
 
-static void validate_nextstep(fft_nextstep_e step) {
-    switch (step) {
-    case FFT_NEXTSTEP_NONE:
-    case FFT_NEXTSTEP_WORLD_MAP:
-    case FFT_NEXTSTEP_EVENT:
-    case FFT_NEXTSTEP_RESET:
-        return;
-    default:
-        FFT_ASSERT(false, "Invalid step value: %d", step);
+static const void* fft_shared_cache_wait(const fft_shared_cache_t* cache, fft_shared_slot_t* slot, uint64_t* out_size) {
+    const uint64_t deadline = fft_shared_cache_deadline();
+    uint32_t state;
+    while ((state = atomic_load_explicit(&slot->state, memory_order_acquire)) == FFT_SHARED_SLOT_DECODING) {
+        if (!fft_shared_cache_yield(deadline)) {
+            return NULL;
+        }
+    }
+    if (state != FFT_SHARED_SLOT_READY || slot->size == 0) {
+        return NULL;
     }
+    if (out_size != NULL) {
+        *out_size = slot->size;
+    }
+    return cache->view + slot->offset;
 }
 
-fft_scenario_t fft_scenario_get_scenario(uint32_t id) {
-    FFT_ASSERT(id < FFT_SCENARIO_COUNT, "Scenario id %d out of bounds", id);
-    fft_span_t attack_out_file = fft_io_open(F_EVENT__ATTACK_OUT);
+// Cooks the claimed slot's entry and anything added with it, copies them into
+// the cache, and marks them ready. The claimed slot is marked last so a
+// process that sees it ready also finds the rest.
+static void fft_shared_cache_publish(fft_shared_cache_t* cache, fft_shared_slot_t* slot, uint64_t key, fft_shared_cache_cook_fn cook, void* userdata) {
+    fft_shared_header_t* header = cache->header;
+    fft_pack_writer_t* writer = fft_pack_writer_begin_memory();
+    cook(userdata, writer);
+
+    // used only moves when the entry fits, so a publish that doesn't fit
+    // leaves the space for smaller ones.
+    const uint64_t capacity = header->size - header->data_offset;
+    const uint64_t size = fft_pack_align_up(writer->offset, FFT_PACK_ALIGN);
+    uint64_t offset = atomic_load_explicit(&header->used, memory_order_relaxed);
+    do {
+        if (size > capacity - offset) {
+            fft_pack_writer_free(writer);
+            atomic_store_explicit(&slot->state, FFT_SHARED_SLOT_FULL, memory_order_release);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&header->used, &offset, offset + size, memory_order_relaxed, memory_order_relaxed));
 
-    // Create a separate span view for this scenario
-    fft_span_t span = { 0 };
-    span.data = attack_out_file.data + FFT_SCENARIO_OFFSET + (id * FFT_SCENARIO_SIZE);
-    span.size = FFT_SCENARIO_SIZE;
+    const uint64_t start = header->data_offset + offset;
+    if (writer->offset > 0) {
+        memcpy(cache->base + start, writer->buffer, (size_t)writer->offset);
+    }
 
-    fft_scenario_t scenario = { 0 };
-    scenario.event_id = fft_span_read_u16(&span);
-    scenario.map_id = fft_span_read_u8(&span);
-
-    scenario.weather = (fft_weather_e)fft_span_read_u8(&span);
-    scenario.time = (fft_time_e)fft_span_read_u8(&span);
-    scenario.music_file_first = fft_span_read_u8(&span);
-    scenario.music_file_second = fft_span_read_u8(&span);
-    scenario.entd_id = fft_span_read_u16(&span);
-    scenario.grid_first = fft_span_read_u16(&span);
-    scenario.grid_second = fft_span_read_u16(&span);
-    scenario.unknown_jjjj = fft_span_read_u32(&span);
-    scenario.ramza_required = fft_span_read_u8(&span);
-    scenario.next_event_id = fft_span_read_u16(&span);
-    scenario.next_step = (fft_nextstep_e)fft_span_read_u8(&span);
-    scenario.unknown_n = fft_span_read_u8(&span);
-    scenario.script_id = fft_span_read_u16(&span);
-    memcpy(&scenario.data, &span.data[0], FFT_SCENARIO_SIZE); // All 24 bytes
-
-    validate_time(scenario.time);
-    validate_weather(scenario.weather);
-    validate_nextstep(scenario.next_step);
-
-    if (scenario.next_step == FFT_NEXTSTEP_EVENT) {
-        FFT_ASSERT(scenario.next_event_id != 0, "Scenario with next step EVENT must have a next event id");
+    for (uint32_t i = 0; i < writer->entry_count; i++) {
+        const fft_pack_entry_t* entry = &writer->entries[i];
+        fft_shared_slot_t* entry_slot = slot;
+        if (fft_pack_entry_key(entry) != key) {
+            bool claimed;
+            entry_slot = fft_shared_cache_slot(cache, fft_pack_entry_key(entry), true, &claimed);
+            if (entry_slot == NULL || !claimed) {
+                continue;
+            }
+        }
+        entry_slot->offset = start + entry->offset;
+        entry_slot->size = entry->size;
+        if (entry_slot != slot) {
+            atomic_store_explicit(&entry_slot->state, FFT_SHARED_SLOT_READY, memory_order_release);
+        }
     }
+    fft_pack_writer_free(writer);
+    atomic_store_explicit(&slot->state, FFT_SHARED_SLOT_READY, memory_order_release);
+}
 
-    fft_io_close(attack_out_file);
+const void* fft_shared_cache_get(fft_shared_cache_t* cache, fft_pack_kind_e kind, uint16_t id, uint16_t index,
+    fft_shared_cache_cook_fn cook, void* userdata, uint64_t* out_size) {
+    const fft_pack_entry_t wanted = { .kind = (uint16_t)kind, .id = id, .index = index };
+    const uint64_t key = fft_pack_entry_key(&wanted);
 
-    return scenario;
+    bool claimed;
+    fft_shared_slot_t* slot = fft_shared_cache_slot(cache, key, cook != NULL, &claimed);
+    if (slot == NULL) {
+        return NULL;
+    }
+    if (claimed) {
+        fft_shared_cache_publish(cache, slot, key, cook, userdata);
+    }
+    return fft_shared_cache_wait(cache, slot, out_size);
 }
 
-/*
-================================================================================
-Event Opcodes Implementation
-================================================================================
-*/
-
-const fft_opcode_desc_t opcode_desc_list[] = {
-#define X(code, value, name, params, param_count) [code] = { value, name, params, param_count },
-    FFT_OPCODE_LIST
-#undef X
-};
+static void fft_shared_cache_cook_map(void* userdata, fft_pack_writer_t* writer) {
+    const uint8_t map_id = *(const uint8_t*)userdata;
+    fft_map_data_t* map_data = fft_map_data_read(map_id);
+    fft_pack_writer_add_map(writer, map_id, map_data);
+    fft_map_data_destroy(map_data);
+}
 
-/*
-================================================================================
-Event Instructions Implementation
-================================================================================
-*/
+static void fft_shared_cache_cook_event(void* userdata, fft_pack_writer_t* writer) {
+    const uint16_t event_id = *(const uint16_t*)userdata;
+    fft_event_t event = fft_event_get_event(event_id);
+    if (event.valid) {
+        fft_pack_writer_add_event(writer, event_id, &event);
+    }
+}
 
-uint16_t fft_instructions_read(fft_span_t* span, fft_instruction_t* out_instructions) {
-    uint16_t count = 0;
-    while (span->offset < span->size) {
-        fft_opcode_e id = (fft_opcode_e)fft_span_read_u8(span);
-        fft_opcode_desc_t desc = opcode_desc_list[id];
-        fft_instruction_t instruction = {
-            .opcode = id
-        };
+const fft_pack_map_t* fft_shared_cache_map(fft_shared_cache_t* cache, uint8_t map_id) {
+    FFT_ASSERT(map_id < FFT_MAP_DESC_LIST_COUNT && fft_map_list[map_id].valid, "Map %d is not valid", map_id);
+    return (const fft_pack_map_t*)fft_shared_cache_get(cache, FFT_PACK_MAP, map_id, 0, fft_shared_cache_cook_map, &map_id, NULL);
+}
 
-        for (int i = 0; i < desc.param_count; i++) {
-            fft_param_t param = { 0 };
-            if (desc.param_sizes[i] == FFT_PARAM_TYPE_U16) {
-                param.type = FFT_PARAM_TYPE_U16;
-                param.value.u16 = fft_span_read_u16(span);
-            } else if (desc.param_sizes[i] == FFT_PARAM_TYPE_U8) {
-                param.type = FFT_PARAM_TYPE_U8;
-                param.value.u8 = fft_span_read_u8(span);
-            } else {
-                FFT_ASSERT(false, "Unknown param type %d %s", desc.param_sizes[i], desc.name);
-            }
-            instruction.params[i] = param;
-            instruction.param_count++;
-        }
-        out_instructions[count++] = instruction;
-        FFT_ASSERT(count < FFT_INSTRUCTION_MAX, "Instruction count exceeded");
+// Meshes and textures are published with their map, so they are only looked up.
+const fft_pack_mesh_t* fft_shared_cache_mesh(fft_shared_cache_t* cache, uint8_t map_id, uint8_t index) {
+    if (fft_shared_cache_map(cache, map_id) == NULL) {
+        return NULL;
     }
-    return count;
+    return (const fft_pack_mesh_t*)fft_shared_cache_get(cache, FFT_PACK_MESH, map_id, index, NULL, NULL, NULL);
+}
+
+const fft_pack_texture_t* fft_shared_cache_texture(fft_shared_cache_t* cache, uint8_t map_id, uint8_t index) {
+    if (fft_shared_cache_map(cache, map_id) == NULL) {
+        return NULL;
+    }
+    return (const fft_pack_texture_t*)fft_shared_cache_get(cache, FFT_PACK_TEXTURE, map_id, index, NULL, NULL, NULL);
+}
+
+const fft_pack_event_t* fft_shared_cache_event(fft_shared_cache_t* cache, uint16_t event_id) {
+    FFT_ASSERT(event_id < FFT_EVENT_COUNT, "Event id %d out of bounds", event_id);
+    return (const fft_pack_event_t*)fft_shared_cache_get(cache, FFT_PACK_EVENT, event_id, 0, fft_shared_cache_cook_event, &event_id, NULL);
 }
 
 /*
 ================================================================================
-Font Implementation
+Resident Maps Implementation
 ================================================================================
 */
 
+// A compressed block is a series of sequences. Each one is a token byte, whose
+// high nibble is the literal count and low nibble the match length minus
+// FFT_LZ_MATCH_MIN, then the literals, a little endian u16 match offset, and the
+// match. A nibble of 15 is continued by bytes that are added to it until one
+// isn't 255. The last sequence ends after its literals.
 enum {
-    FFT_FONT_BYTES_PER_CHAR = 35,
-    FFT_FONT_BYTES_PER_PIXEL = 4,
-    FFT_FONT_CHAR_WIDTH = 10,
-    FFT_FONT_CHAR_HEIGHT = 14,
+    FFT_LZ_MATCH_MIN = 4,
+    FFT_LZ_NIBBLE_MAX = 15,
+    FFT_LZ_OFFSET_MAX = 65535,
+    FFT_LZ_HASH_BITS = 12,
+    FFT_LZ_END_LITERALS = 8, // Matches stop this far from the end
+    FFT_LZ_SKIP_SHIFT = 6,   // Steps grow every 64 bytes without a match
 };
 
-static int font_compare(const void* a, const void* b) {
-    uint16_t id_a = ((const fft_font_char_t*)a)->id;
-    uint16_t id_b = ((const fft_font_char_t*)b)->id;
-    return (id_a > id_b) - (id_a < id_b);
+static uint32_t fft_lz_read_u32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
 }
 
-const char* fft_font_get_char(uint16_t id) {
-    fft_font_char_t key = { id, NULL };
-    const fft_font_char_t* result = bsearch(&key, fft_font_chars, FFT_FONT_CHAR_COUNT, sizeof(fft_font_char_t), font_compare);
-    if (result == NULL) {
-        return NULL;
+static uint64_t fft_lz_read_u64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t fft_lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - FFT_LZ_HASH_BITS);
+}
+
+static uint8_t* fft_lz_write_length(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
     }
-    return result->data;
+    *out++ = (uint8_t)length;
+    return out;
 }
 
-/*
-================================================================================
-Event Text Implementation
-================================================================================
-*/
+// match_length is 0 for the last sequence.
+static uint8_t* fft_lz_write_sequence(uint8_t* out, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length) {
+    const size_t match_code = match_length > 0 ? match_length - FFT_LZ_MATCH_MIN : 0;
+    *out++ = (uint8_t)((FFT_MIN(literal_count, (size_t)FFT_LZ_NIBBLE_MAX) << 4) | FFT_MIN(match_code, (size_t)FFT_LZ_NIBBLE_MAX));
+    if (literal_count >= FFT_LZ_NIBBLE_MAX) {
+        out = fft_lz_write_length(out, literal_count - FFT_LZ_NIBBLE_MAX);
+    }
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+
+    if (match_length > 0) {
+        *out++ = (uint8_t)(offset & 0xFF);
+        *out++ = (uint8_t)(offset >> 8);
+        if (match_code >= FFT_LZ_NIBBLE_MAX) {
+            out = fft_lz_write_length(out, match_code - FFT_LZ_NIBBLE_MAX);
+        }
+    }
+    return out;
+}
 
-enum {
-    FFT_TEXT_DELIM = 0xFE,
-};
+static bool fft_lz_read_length(const uint8_t* src, size_t src_size, size_t* in, size_t* length) {
+    uint8_t byte;
+    do {
+        if (*in >= src_size) {
+            return false;
+        }
+        byte = src[(*in)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
 
-size_t fft_text_read(fft_span_t* span, char* out_text) {
-    size_t length = 0;
+size_t fft_lz_bound(size_t size) {
+    return size + (size / 255) + 16;
+}
 
-    while (span->offset < span->size) {
-        uint8_t byte = fft_span_read_u8(span);
+size_t fft_lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_capacity) {
+    FFT_ASSERT(dst_capacity >= fft_lz_bound(size), "LZ output too small: %zu for %zu bytes", dst_capacity, size);
+    FFT_ASSERT(size <= UINT32_MAX, "LZ input too large: %zu", size);
+
+    // Last position each hashed 4 bytes were seen at. Candidates are checked,
+    // so stale or zeroed entries only cost a miss.
+    uint32_t table[1 << FFT_LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const size_t match_end = size > FFT_LZ_END_LITERALS ? size - FFT_LZ_END_LITERALS : 0;
+    uint8_t* out = dst;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + FFT_LZ_MATCH_MIN <= match_end) {
+        const uint32_t sequence = fft_lz_read_u32(src + pos);
+        const uint32_t hash = fft_lz_hash(sequence);
+        const size_t candidate = table[hash];
+        table[hash] = (uint32_t)pos;
+
+        if (candidate >= pos || pos - candidate > FFT_LZ_OFFSET_MAX || fft_lz_read_u32(src + candidate) != sequence) {
+            pos += 1 + ((pos - anchor) >> FFT_LZ_SKIP_SHIFT);
+            continue;
+        }
 
-        // These are special characters. We need to handle them differently.
-        // https://ffhacktics.com/wiki/Text_Format#Special_Characters
-        switch (byte) {
-        case FFT_TEXT_DELIM:
-            // This is the message delimiter.
-            out_text[length++] = 0xFE;
-            break;
-        case 0xE0: {
-            // Character name stored somewhere else. Hard coding for now.
-            const char* name = "Ramza";
-            size_t len = strlen(name);
-            memcpy(&out_text[length], name, len);
-            length += len;
-            break;
+        size_t length = FFT_LZ_MATCH_MIN;
+        while (pos + length + 8 <= match_end && fft_lz_read_u64(src + candidate + length) == fft_lz_read_u64(src + pos + length)) {
+            length += 8;
         }
-        case 0xE2: {
-            uint8_t delay = fft_span_read_u8(span);
-            char buffer[32];
-            size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Delay: %d}", (uint32_t)delay);
-            memcpy(&out_text[length], buffer, len);
-            length += len;
-            break;
+        while (pos + length < match_end && src[candidate + length] == src[pos + length]) {
+            length++;
         }
-        case 0xE3: {
-            uint8_t color = fft_span_read_u8(span);
-            char buffer[32];
-            size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Color: %d}", (uint32_t)color);
-            memcpy(&out_text[length], buffer, len);
-            length += len;
-            break;
+
+        out = fft_lz_write_sequence(out, src + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    out = fft_lz_write_sequence(out, src + anchor, size - anchor, 0, 0);
+    return (size_t)(out - dst);
+}
+
+bool fft_lz_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < src_size) {
+        const uint8_t token = src[in++];
+
+        size_t literal_count = token >> 4;
+        if (literal_count == FFT_LZ_NIBBLE_MAX && !fft_lz_read_length(src, src_size, &in, &literal_count)) {
+            return false;
         }
-        case 0xF0:
-        case 0xF1:
-        case 0xF2:
-        case 0xF3: {
-            // This is a jump to another point in the text section.
-            // The next 2 bytes are the jump location and how many bytes to read.
-            // https://gomtuu.org/fft/trans/compression/
-            uint8_t second_byte = fft_span_read_u8(span);
-            uint8_t third_byte = fft_span_read_u8(span);
-            (void)second_byte; // Unused
-            (void)third_byte;  // Unused
-            const char* text_jump = "{TextJump}";
-            size_t len = strlen(text_jump);
-            memcpy(&out_text[length], text_jump, len);
-            length += len;
-            break;
+        if (literal_count > src_size - in || literal_count > dst_size - out) {
+            return false;
         }
-        case 0xF8: {
-            // New line/Line break
-            const char* close_str = "{LB}";
-            size_t len = strlen(close_str);
-            memcpy(&out_text[length], close_str, len);
-            length += len;
-            break;
+        if (literal_count <= 16 && src_size - in >= 16 && dst_size - out >= 16) {
+            // Fixed size copies are a couple of moves, and short runs are common.
+            memcpy(dst + out, src + in, 16);
+        } else {
+            memcpy(dst + out, src + in, literal_count);
         }
-        case 0xFA:
-            // This one is not in the list but it is very common between words.
-            // It works well as a space though.
-            out_text[length++] = ' ';
-            break;
-        case 0xFF: {
-            const char* close_str = "{Close}";
-            size_t len = strlen(close_str);
-            memcpy(&out_text[length], close_str, len);
-            length += len;
+        in += literal_count;
+        out += literal_count;
+        if (in == src_size) {
             break;
         }
-        default: {
-            if (byte > 0xCF) {
-                /* Two-byte character */
-                uint8_t second_byte = fft_span_read_u8(span);
-                uint16_t combined = (uint16_t)(second_byte | ((uint16_t)byte << 8));
-                const char* font_str = fft_font_get_char(combined);
-                if (font_str != NULL) {
-                    size_t len = strlen(font_str);
-                    memcpy(&out_text[length], font_str, len);
-                    length += len;
-                } else {
-                    /* Unknown character */
-                    char buffer[64];
-                    size_t len = (size_t)snprintf(buffer, sizeof(buffer), "{Unknown: 0x%X & 0x%X}", byte, second_byte);
-                    memcpy(&out_text[length], buffer, len);
-                    length += len;
-                }
-            } else {
-                /* Single-byte character */
-                const char* font_str = fft_font_get_char(byte);
-                if (font_str != NULL) {
-                    size_t len = strlen(font_str);
-                    memcpy(&out_text[length], font_str, len);
-                    length += len;
-                } else {
-                    /* Unknown character */
-                    out_text[length++] = '^';
-                }
+
+        if (src_size - in < 2) {
+            return false;
+        }
+        const size_t offset = (size_t)src[in] | ((size_t)src[in + 1] << 8);
+        in += 2;
+        size_t match_length = token & FFT_LZ_NIBBLE_MAX;
+        if (match_length == FFT_LZ_NIBBLE_MAX && !fft_lz_read_length(src, src_size, &in, &match_length)) {
+            return false;
+        }
+        match_length += FFT_LZ_MATCH_MIN;
+        if (offset == 0 || offset > out || match_length > dst_size - out) {
+            return false;
+        }
+
+        uint8_t* match = dst + out;
+        if (offset >= 8 && dst_size - out >= match_length + 8) {
+            // Copies 8 bytes at a time and may write up to 7 past the match,
+            // which the next sequence overwrites.
+            for (size_t i = 0; i < match_length; i += 8) {
+                memcpy(match + i, match + i - offset, 8);
             }
-            break;
+            out += match_length;
+            continue;
         }
+
+        // Overlapping matches repeat the last offset bytes. Copying from the
+        // same start with a doubling distance keeps each memcpy disjoint, so
+        // long runs of zeros take a few copies instead of one per byte.
+        size_t distance = offset;
+        size_t remaining = match_length;
+        while (remaining > 0) {
+            const size_t chunk = FFT_MIN(remaining, distance);
+            memcpy(match, match - distance, chunk);
+            match += chunk;
+            remaining -= chunk;
+            distance *= 2;
         }
+        out += match_length;
     }
+    return out == dst_size;
+}
 
-    out_text[length] = '\0';
-    return length;
+enum {
+    FFT_RESIDENT_ENTRY_CAPACITY_MIN = 256,
+};
+
+typedef struct {
+    uint64_t key; // fft_pack_entry_key()
+    uint8_t* data;
+    uint64_t raw_size;
+    uint64_t stored_size;
+    bool compressed;
+} fft_resident_entry_t;
+
+// Holds a decompressed entry.
+typedef struct {
+    const fft_resident_entry_t* entry; // NULL while unused
+    uint8_t* data;
+    uint64_t capacity;
+    uint64_t last_used;
+} fft_resident_hot_t;
+
+struct fft_resident_t {
+    fft_resident_policy_e policy;
+    fft_resident_entry_t* entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    bool sorted;
+    bool map_added[FFT_MAP_DESC_LIST_COUNT];
+
+    fft_resident_hot_t* hot;
+    uint32_t hot_count;
+    uint64_t tick;
+
+    fft_resident_stats_t stats;
+};
+
+static int fft_resident_entry_compare(const void* a, const void* b) {
+    uint64_t key_a = ((const fft_resident_entry_t*)a)->key;
+    uint64_t key_b = ((const fft_resident_entry_t*)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
 }
 
-size_t fft_text_by_index(const char* string, int index, char* buffer) {
-    FFT_ASSERT(index > 0, "Index must be greater than 0");
-    FFT_ASSERT(buffer != NULL, "Buffer must not be NULL");
+fft_resident_t* fft_resident_create(fft_resident_policy_e policy, uint32_t hot_count) {
+    FFT_ASSERT(hot_count > 0, "Resident store needs at least one hot buffer");
+    fft_resident_t* resident = FFT_MEM_ALLOC_TAG(sizeof(fft_resident_t), "resident");
+    resident->policy = policy;
+    resident->sorted = true;
+    resident->hot = FFT_MEM_ALLOC_TAG(hot_count * sizeof(fft_resident_hot_t), "resident hot");
+    resident->hot_count = hot_count;
+    return resident;
+}
 
-    int current_index = 1; // 1-based indexing
-    const char* start = string;
-    const char* ptr = string;
+void fft_resident_destroy(fft_resident_t* resident) {
+    for (uint32_t i = 0; i < resident->entry_count; i++) {
+        FFT_MEM_FREE(resident->entries[i].data);
+    }
+    if (resident->entries != NULL) {
+        FFT_MEM_FREE(resident->entries);
+    }
+    for (uint32_t i = 0; i < resident->hot_count; i++) {
+        if (resident->hot[i].data != NULL) {
+            FFT_MEM_FREE(resident->hot[i].data);
+        }
+    }
+    FFT_MEM_FREE(resident->hot);
+    FFT_MEM_FREE(resident);
+}
 
-    while (*ptr != '\0') {
-        if ((unsigned char)*ptr == FFT_TEXT_DELIM) {
-            if (current_index == index) {
-                ptrdiff_t diff = ptr - start;
-                FFT_ASSERT(diff >= 0, "negative length?");
-                size_t length = (size_t)diff;
-                strlcpy(buffer, start, length + 1);
-                return 0;
-            }
-            // Move to the next substring
-            current_index++;
-            start = ptr + 1;
+static bool fft_resident_is_cold(const fft_resident_t* resident, const fft_pack_entry_t* entry, const uint8_t* data) {
+    if (entry->kind == FFT_PACK_MESH) {
+        const fft_pack_mesh_t* mesh = (const fft_pack_mesh_t*)data;
+        return resident->policy == FFT_RESIDENT_COMPRESS_ALL || !fft_state_is_default(mesh->state);
+    }
+    if (entry->kind == FFT_PACK_TEXTURE) {
+        const fft_pack_texture_t* texture = (const fft_pack_texture_t*)data;
+        return resident->policy == FFT_RESIDENT_COMPRESS_ALL || !fft_state_is_default(texture->state);
+    }
+    return false;
+}
+
+static void fft_resident_add_entry(fft_resident_t* resident, const fft_pack_entry_t* entry, const uint8_t* data) {
+    if (resident->entry_count == resident->entry_capacity) {
+        uint32_t capacity = FFT_MAX(resident->entry_capacity * 2, (uint32_t)FFT_RESIDENT_ENTRY_CAPACITY_MIN);
+        fft_resident_entry_t* entries = FFT_MEM_ALLOC_TAG(capacity * sizeof(fft_resident_entry_t), "resident entries");
+        if (resident->entries != NULL) {
+            memcpy(entries, resident->entries, resident->entry_count * sizeof(fft_resident_entry_t));
+            FFT_MEM_FREE(resident->entries);
         }
-        ptr++;
+        resident->entries = entries;
+        resident->entry_capacity = capacity;
     }
 
-    // Check if the last substring is the desired one
-    if (current_index == index) {
-        ptrdiff_t diff = ptr - start;
-        FFT_ASSERT(diff >= 0, "negative length?");
-        size_t length = (size_t)diff;
-        strlcpy(buffer, start, length + 1);
-        return 0;
+    fft_resident_entry_t stored = { .key = fft_pack_entry_key(entry), .raw_size = entry->size, .stored_size = entry->size };
+    if (fft_resident_is_cold(resident, entry, data)) {
+        const size_t bound = fft_lz_bound((size_t)entry->size);
+        uint8_t* scratch = FFT_MEM_ALLOC_TAG(bound, "resident scratch");
+        const size_t compressed_size = fft_lz_compress(data, (size_t)entry->size, scratch, bound);
+        if (compressed_size < entry->size) {
+            stored.data = FFT_MEM_ALLOC_TAG(compressed_size, "resident entry");
+            memcpy(stored.data, scratch, compressed_size);
+            stored.stored_size = compressed_size;
+            stored.compressed = true;
+            resident->stats.compressed_count++;
+        }
+        FFT_MEM_FREE(scratch);
+    }
+    if (!stored.compressed) {
+        stored.data = FFT_MEM_ALLOC_TAG((size_t)entry->size, "resident entry");
+        memcpy(stored.data, data, (size_t)entry->size);
     }
 
-    FFT_ASSERT(false, "Index out of bounds");
+    resident->entries[resident->entry_count++] = stored;
+    resident->sorted = false;
+    resident->stats.raw_bytes += stored.raw_size;
+    resident->stats.stored_bytes += stored.stored_size;
+    resident->stats.entry_count++;
 }
 
-size_t fft_text_count(const char* string) {
-    FFT_ASSERT(string != NULL, "String must not be NULL");
-    if (*string == '\0') {
-        return 0;
+void fft_resident_add_map(fft_resident_t* resident, uint8_t map_id, const fft_map_data_t* map_data) {
+    // Checked without a lookup, which would sort the entries on every add.
+    FFT_ASSERT(map_id < FFT_MAP_DESC_LIST_COUNT, "Map id %d out of range", map_id);
+    FFT_ASSERT(!resident->map_added[map_id], "Map %d is already resident", map_id);
+    resident->map_added[map_id] = true;
+
+    fft_pack_writer_t* writer = fft_pack_writer_begin_memory();
+    fft_pack_writer_add_map(writer, map_id, map_data);
+    for (uint32_t i = 0; i < writer->entry_count; i++) {
+        const fft_pack_entry_t* entry = &writer->entries[i];
+        fft_resident_add_entry(resident, entry, writer->buffer + entry->offset);
     }
+    fft_pack_writer_free(writer);
+}
 
-    size_t count = 1;
-    const char* ptr = string;
-    for (; *ptr; ++ptr) {
-        if ((uint8_t)*ptr == FFT_TEXT_DELIM) {
-            count++;
+void fft_resident_add_all_maps(fft_resident_t* resident) {
+    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (!fft_map_list[i].valid) {
+            continue;
         }
+        fft_map_data_t* map_data = fft_map_data_read((int)i);
+        fft_resident_add_map(resident, (uint8_t)i, map_data);
+        fft_map_data_destroy(map_data);
     }
+}
 
-    return count;
+// Entries are sorted on the first read after an add.
+static const fft_resident_entry_t* fft_resident_find(fft_resident_t* resident, uint64_t key) {
+    if (!resident->sorted) {
+        qsort(resident->entries, resident->entry_count, sizeof(fft_resident_entry_t), fft_resident_entry_compare);
+        resident->sorted = true;
+        // Hot buffers point at entries by address, which sorting moved.
+        for (uint32_t i = 0; i < resident->hot_count; i++) {
+            resident->hot[i].entry = NULL;
+        }
+    }
+
+    uint32_t low = 0;
+    uint32_t high = resident->entry_count;
+    while (low < high) {
+        uint32_t mid = low + ((high - low) / 2);
+        if (resident->entries[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == resident->entry_count || resident->entries[low].key != key) {
+        return NULL;
+    }
+    return &resident->entries[low];
 }
 
-/*
-================================================================================
-Events Implementation
-================================================================================
-*/
+static const uint8_t* fft_resident_decompress(fft_resident_t* resident, const fft_resident_entry_t* entry) {
+    resident->tick++;
 
-static fft_event_t fft_event_read(fft_span_t* span) {
-    fft_event_t event = { .valid = false };
+    fft_resident_hot_t* victim = &resident->hot[0];
+    for (uint32_t i = 0; i < resident->hot_count; i++) {
+        fft_resident_hot_t* hot = &resident->hot[i];
+        if (hot->entry == entry) {
+            hot->last_used = resident->tick;
+            resident->stats.hot_hits++;
+            return hot->data;
+        }
+        if (hot->last_used < victim->last_used) {
+            victim = hot;
+        }
+    }
 
-    uint32_t text_offset = fft_span_read_u32(span);
-    if (text_offset == 0xF2F2F2F2) { // Invalid event marker
-        return event;
+    if (victim->capacity < entry->raw_size) {
+        if (victim->data != NULL) {
+            FFT_MEM_FREE(victim->data);
+        }
+        victim->data = FFT_MEM_ALLOC_TAG((size_t)entry->raw_size, "resident hot buffer");
+        victim->capacity = entry->raw_size;
     }
+    bool ok = fft_lz_decompress(entry->data, (size_t)entry->stored_size, victim->data, (size_t)entry->raw_size);
+    FFT_ASSERT(ok, "Resident entry failed to decompress");
 
-    memcpy(event.data, span->data, FFT_EVENT_SIZE);
+    victim->entry = entry;
+    victim->last_used = resident->tick;
+    resident->stats.decompressions++;
+    return victim->data;
+}
 
-    size_t text_size = FFT_EVENT_SIZE - text_offset;
-    fft_span_t text_span = { .data = event.data + text_offset, .size = text_size };
-    size_t messages_len = fft_text_read(&text_span, event.messages);
-    size_t msg_count = fft_text_count(event.messages);
+const void* fft_resident_get(fft_resident_t* resident, fft_pack_kind_e kind, uint16_t id, uint16_t index, uint64_t* out_size) {
+    const fft_pack_entry_t wanted = { .kind = (uint16_t)kind, .id = id, .index = index };
+    const fft_resident_entry_t* entry = fft_resident_find(resident, fft_pack_entry_key(&wanted));
+    if (entry == NULL) {
+        return NULL;
+    }
+    if (out_size != NULL) {
+        *out_size = entry->raw_size;
+    }
+    return entry->compressed ? fft_resident_decompress(resident, entry) : entry->data;
+}
 
-    size_t code_size = text_offset - 4;
-    fft_span_t code_span = { .data = event.data + 4, .size = code_size };
-    size_t instruction_count = fft_instructions_read(&code_span, event.instructions);
+const fft_pack_map_t* fft_resident_map(fft_resident_t* resident, uint8_t map_id) {
+    return (const fft_pack_map_t*)fft_resident_get(resident, FFT_PACK_MAP, map_id, 0, NULL);
+}
 
-    event.message_count = msg_count;
-    event.messages_len = messages_len;
-    event.instruction_count = instruction_count;
-    event.valid = true;
-    return event;
+const fft_pack_mesh_t* fft_resident_mesh(fft_resident_t* resident, uint8_t map_id, uint8_t index) {
+    return (const fft_pack_mesh_t*)fft_resident_get(resident, FFT_PACK_MESH, map_id, index, NULL);
 }
 
-fft_event_t fft_event_get_event(uint32_t id) {
-    FFT_ASSERT(id < FFT_EVENT_COUNT, "Event id %d out of bounds", id);
-    fft_span_t file = fft_io_open(F_EVENT__TEST_EVT);
-    fft_span_t span = {
-        .data = file.data + (id * FFT_EVENT_SIZE),
-        .size = FFT_EVENT_SIZE,
-    };
-    fft_event_t event = fft_event_read(&span);
-    fft_io_close(file);
-    return event;
+const fft_pack_texture_t* fft_resident_texture(fft_resident_t* resident, uint8_t map_id, uint8_t index) {
+    return (const fft_pack_texture_t*)fft_resident_get(resident, FFT_PACK_TEXTURE, map_id, index, NULL);
+}
+
+fft_resident_stats_t fft_resident_stats(const fft_resident_t* resident) {
+    return resident->stats;
 }
 
 /*
@@ -3604,13 +8781,55 @@ Entrypoint Implementation
 */
 
 void fft_init(const char* filename) {
-    fft_mem_init();
-    fft_io_init(filename);
+    fft_mem_init(&_fft_ctx_default);
+    fft_io_init(&_fft_ctx_default, filename);
 }
 
 void fft_shutdown(void) {
-    fft_io_shutdown();
-    fft_mem_shutdown();
+    FFT_ASSERT(_fft_ctx_default.prefetch == NULL, "Stop the prefetcher before shutdown");
+    fft_io_shutdown(&_fft_ctx_default);
+    fft_mem_shutdown(&_fft_ctx_default);
+}
+
+fft_ctx_t* fft_ctx_create(const char* filename) {
+    // The context isn't tracked by its own allocator.
+    fft_ctx_t* ctx = calloc(1, sizeof(fft_ctx_t));
+    FFT_ASSERT(ctx != NULL, "Failed to allocate context");
+    pthread_mutex_init(&ctx->io.lock, NULL);
+    pthread_mutex_init(&ctx->mem.lock, NULL);
+
+    fft_mem_init(ctx);
+    fft_io_init(ctx, filename);
+    return ctx;
+}
+
+void fft_ctx_destroy(fft_ctx_t* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    FFT_ASSERT(ctx != &_fft_ctx_default, "Use fft_shutdown() for the default context");
+    FFT_ASSERT(ctx->prefetch == NULL, "Stop the prefetcher before destroying its context");
+    if (_fft_ctx_current == ctx) {
+        _fft_ctx_current = NULL;
+    }
+
+    fft_io_shutdown(ctx);
+    fft_mem_shutdown(ctx);
+
+    // Live allocations point back at the context, freeing them later would
+    // write to freed memory.
+    FFT_ASSERT(ctx->mem.allocations_current == 0, "Free every allocation before destroying its context");
+    pthread_mutex_destroy(&ctx->io.lock);
+    pthread_mutex_destroy(&ctx->mem.lock);
+    free(ctx);
+}
+
+void fft_ctx_make_current(fft_ctx_t* ctx) {
+    _fft_ctx_current = ctx;
+}
+
+fft_ctx_t* fft_ctx_get_current(void) {
+    return fft_ctx();
 }
 
 // clang-format off
@@ -4,6 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 
+// build.sh also builds this with FFT_TEST_NO_TRACE so the library is covered
+// with the trace zones compiled out.
+#ifndef FFT_TEST_NO_TRACE
+#    define FFT_TRACE
+#endif
 #define FFT_IMPLEMENTATION
 #include "fft.h"
 
@@ -152,73 +157,99 @@ static int test_span_read_bytes(void) {
     return 1;
 }
 
+static int test_span_read_arrays(void) {
+    fft_span_t span = { test_data, sizeof(test_data), 4 }; // Start at u16 data
+
+    uint16_t u16s[2];
+    fft_span_read_u16_array(&span, 2, u16s);
+    TEST_ASSERT(u16s[0] == 4660 && u16s[1] == 65535, "u16 array values");
+    TEST_ASSERT(span.offset == 8, "u16 array offset");
+
+    int16_t i16s[2];
+    fft_span_read_i16_array(&span, 2, i16s);
+    TEST_ASSERT(i16s[0] == -32768 && i16s[1] == 32767, "i16 array values");
+
+    uint32_t u32s[2];
+    fft_span_read_u32_array(&span, 2, u32s);
+    TEST_ASSERT(u32s[0] == 305419896 && u32s[1] == 4294967295, "u32 array values");
+    TEST_ASSERT(span.offset == 20, "u32 array offset");
+
+    // Empty reads are allowed at the end
+    uint8_t none[1];
+    span.offset = sizeof(test_data);
+    fft_span_read_u8_array(&span, 0, none);
+    TEST_ASSERT(span.offset == sizeof(test_data), "empty array read");
+
+    return 1;
+}
+
 static int test_mem_basic_alloc_free(void) {
     // Initialize memory system
-    fft_mem_init();
+    fft_mem_init(fft_ctx_get_current());
 
     // Test basic allocation
     void* ptr1 = FFT_MEM_ALLOC(100);
     TEST_ASSERT(ptr1 != NULL, "memory allocation succeeded");
-    TEST_ASSERT(_fft_state.mem.allocations_current == 1, "allocation count incremented");
-    TEST_ASSERT(_fft_state.mem.usage_current == 100, "usage tracking correct");
-    TEST_ASSERT(_fft_state.mem.usage_peak == 100, "peak usage tracked");
-    TEST_ASSERT(_fft_state.mem.usage_total == 100, "total usage tracked");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 1, "allocation count incremented");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 100, "usage tracking correct");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 100, "peak usage tracked");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 100, "total usage tracked");
 
     // Test second allocation
     void* ptr2 = FFT_MEM_ALLOC(50);
     TEST_ASSERT(ptr2 != NULL, "second allocation succeeded");
-    TEST_ASSERT(_fft_state.mem.allocations_current == 2, "allocation count is 2");
-    TEST_ASSERT(_fft_state.mem.usage_current == 150, "current usage is 150");
-    TEST_ASSERT(_fft_state.mem.usage_peak == 150, "peak usage updated to 150");
-    TEST_ASSERT(_fft_state.mem.usage_total == 150, "total usage is 150");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 2, "allocation count is 2");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 150, "current usage is 150");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 150, "peak usage updated to 150");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 150, "total usage is 150");
 
     // Test freeing first allocation
     fft_mem_free(ptr1);
-    TEST_ASSERT(_fft_state.mem.allocations_current == 1, "allocation count decremented");
-    TEST_ASSERT(_fft_state.mem.usage_current == 50, "current usage decreased");
-    TEST_ASSERT(_fft_state.mem.usage_peak == 150, "peak usage unchanged");
-    TEST_ASSERT(_fft_state.mem.usage_total == 150, "total usage unchanged");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 1, "allocation count decremented");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 50, "current usage decreased");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 150, "peak usage unchanged");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 150, "total usage unchanged");
 
     // Test freeing second allocation
     fft_mem_free(ptr2);
-    TEST_ASSERT(_fft_state.mem.allocations_current == 0, "all allocations freed");
-    TEST_ASSERT(_fft_state.mem.usage_current == 0, "no memory in use");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 0, "all allocations freed");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 0, "no memory in use");
 
     return 1;
 }
 
 static int test_mem_free_null(void) {
-    fft_mem_init();
+    fft_mem_init(fft_ctx_get_current());
 
     // Test that freeing NULL doesn't crash or affect stats
-    size_t initial_count = _fft_state.mem.allocations_current;
-    size_t initial_usage = _fft_state.mem.usage_current;
+    size_t initial_count = fft_ctx_get_current()->mem.allocations_current;
+    size_t initial_usage = fft_ctx_get_current()->mem.usage_current;
 
     fft_mem_free(NULL);
 
-    TEST_ASSERT(_fft_state.mem.allocations_current == initial_count, "NULL free doesn't change allocation count");
-    TEST_ASSERT(_fft_state.mem.usage_current == initial_usage, "NULL free doesn't change usage");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == initial_count, "NULL free doesn't change allocation count");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == initial_usage, "NULL free doesn't change usage");
 
     return 1;
 }
 
 static int test_mem_peak_tracking(void) {
-    fft_mem_init();
+    fft_mem_init(fft_ctx_get_current());
 
     // Allocate and free to test peak tracking
     void* ptr1 = FFT_MEM_ALLOC(100);
-    TEST_ASSERT(_fft_state.mem.usage_peak == 100, "peak starts at 100");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 100, "peak starts at 100");
 
     void* ptr2 = FFT_MEM_ALLOC(200);
-    TEST_ASSERT(_fft_state.mem.usage_peak == 300, "peak increases to 300");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 300, "peak increases to 300");
 
     fft_mem_free(ptr1);
-    TEST_ASSERT(_fft_state.mem.usage_peak == 300, "peak stays at 300 after free");
-    TEST_ASSERT(_fft_state.mem.usage_current == 200, "current drops to 200");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 300, "peak stays at 300 after free");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 200, "current drops to 200");
 
     void* ptr3 = FFT_MEM_ALLOC(50);
-    TEST_ASSERT(_fft_state.mem.usage_peak == 300, "peak unchanged at 300");
-    TEST_ASSERT(_fft_state.mem.usage_current == 250, "current is 250");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_peak == 300, "peak unchanged at 300");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 250, "current is 250");
 
     fft_mem_free(ptr2);
     fft_mem_free(ptr3);
@@ -227,24 +258,24 @@ static int test_mem_peak_tracking(void) {
 }
 
 static int test_mem_total_tracking(void) {
-    fft_mem_init();
+    fft_mem_init(fft_ctx_get_current());
 
     // Test that total keeps accumulating
     void* ptr1 = FFT_MEM_ALLOC(100);
-    TEST_ASSERT(_fft_state.mem.usage_total == 100, "total starts at 100");
-    TEST_ASSERT(_fft_state.mem.allocations_total == 1, "total allocations is 1");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 100, "total starts at 100");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_total == 1, "total allocations is 1");
 
     void* ptr2 = FFT_MEM_ALLOC(50);
-    TEST_ASSERT(_fft_state.mem.usage_total == 150, "total grows to 150");
-    TEST_ASSERT(_fft_state.mem.allocations_total == 2, "total allocations is 2");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 150, "total grows to 150");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_total == 2, "total allocations is 2");
 
     fft_mem_free(ptr1);
-    TEST_ASSERT(_fft_state.mem.usage_total == 150, "total unchanged after free");
-    TEST_ASSERT(_fft_state.mem.allocations_total == 2, "total allocations unchanged");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 150, "total unchanged after free");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_total == 2, "total allocations unchanged");
 
     void* ptr3 = FFT_MEM_ALLOC(25);
-    TEST_ASSERT(_fft_state.mem.usage_total == 175, "total grows to 175");
-    TEST_ASSERT(_fft_state.mem.allocations_total == 3, "total allocations is 3");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_total == 175, "total grows to 175");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_total == 3, "total allocations is 3");
 
     fft_mem_free(ptr2);
     fft_mem_free(ptr3);
@@ -357,23 +388,53 @@ static int test_record_parsing(void) {
     return 1;
 }
 
+static int test_record_layout_decode(void) {
+    uint8_t bytes[FFT_RECORD_SIZE * 2] = {
+        // clang-format off
+        0x22, 0x00, // gns unknown
+        0x01,       // layout
+        0x90,       // night, weather 1
+        0x01, 0x17, // texture
+        0x00, 0x00,
+        0x34, 0x12, // sector
+        0x00, 0x00,
+        0x00, 0x80, 0x00, 0x00, // length
+        0x00, 0x00, 0x00, 0x00,
+        // clang-format on
+    };
+    memcpy(&bytes[FFT_RECORD_SIZE], bytes, FFT_RECORD_SIZE);
+    bytes[FFT_RECORD_SIZE + 3] = 0x40; // Day, weather 4
+
+    fft_record_t records[2] = { 0 };
+    fft_record_layout_decode_array(bytes, 2, records);
+    TEST_ASSERT(records[0].gns_unknown_aa == FFT_RECORD_UNKNOWN_0x22, "layout gns unknown");
+    TEST_ASSERT(records[0].state.layout == FFT_LAYOUT_ALTERNATE_A, "layout layout");
+    TEST_ASSERT(records[0].state.time == FFT_TIME_NIGHT && records[0].state.weather == FFT_WEATHER_NONE_ALT, "layout time and weather bits");
+    TEST_ASSERT(records[0].type == FFT_RECORDTYPE_TEXTURE, "layout type");
+    TEST_ASSERT(records[0].sector == 0x1234 && records[0].length == 0x8000, "layout sector and length");
+    TEST_ASSERT(memcmp(records[0].raw, bytes, FFT_RECORD_SIZE) == 0, "layout raw bytes");
+    TEST_ASSERT(records[1].state.time == FFT_TIME_DAY && records[1].state.weather == FFT_WEATHER_VERY_STRONG, "layout second record");
+
+    return 1;
+}
+
 static int test_mem_alloc_with_tag(void) {
-    fft_mem_init();
+    fft_mem_init(fft_ctx_get_current());
 
     // Test allocation with tag
     void* ptr1 = FFT_MEM_ALLOC_TAG(100, "test_buffer");
     TEST_ASSERT(ptr1 != NULL, "tagged allocation succeeded");
-    TEST_ASSERT(_fft_state.mem.allocations_current == 1, "allocation count correct");
-    TEST_ASSERT(_fft_state.mem.usage_current == 100, "usage tracking correct");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 1, "allocation count correct");
+    TEST_ASSERT(fft_ctx_get_current()->mem.usage_current == 100, "usage tracking correct");
 
     // Test allocation without tag (should still work)
     void* ptr2 = FFT_MEM_ALLOC(50);
     TEST_ASSERT(ptr2 != NULL, "untagged allocation succeeded");
-    TEST_ASSERT(_fft_state.mem.allocations_current == 2, "allocation count is 2");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 2, "allocation count is 2");
 
     FFT_MEM_FREE(ptr1);
     FFT_MEM_FREE(ptr2);
-    TEST_ASSERT(_fft_state.mem.allocations_current == 0, "all allocations freed");
+    TEST_ASSERT(fft_ctx_get_current()->mem.allocations_current == 0, "all allocations freed");
 
     return 1;
 }
@@ -394,7 +455,1149 @@ static int test_io_file_desc_lookup(void) {
     return 1;
 }
 
-int main(void) {
+static int test_instructions_pack(void) {
+    // clang-format off
+    uint8_t code[] = {
+        0x13, 0x05, 0x06,             // ChangeMapBeta(5, 6)
+        0xF1, 0x34, 0x12,             // Wait(0x1234)
+        0x79, 0x01, 0x02, 0xCD, 0xAB, // WalkToAnim(1, 2, 0xABCD)
+        0xDB,                         // EventEnd
+    };
+    // clang-format on
+
+    fft_span_t span = { code, sizeof(code), 0 };
+    fft_packed_instruction_t packed[FFT_INSTRUCTION_MAX];
+    uint16_t count = fft_instructions_pack(&span, packed);
+    TEST_ASSERT(count == 4, "packed instruction count");
+    TEST_ASSERT(span.offset == sizeof(code), "pack consumed all bytes");
+
+    TEST_ASSERT(packed[0].opcode == FFT_OPCODE_CHANGEMAPBETA, "packed opcode");
+    TEST_ASSERT(packed[1].offset == 3, "packed offset");
+    TEST_ASSERT(fft_packed_param_count(packed[0]) == 2, "packed param count");
+    TEST_ASSERT(fft_packed_param(code, packed[0], 1) == 6, "packed u8 param");
+    TEST_ASSERT(fft_packed_param(code, packed[1], 0) == 0x1234, "packed u16 param");
+    TEST_ASSERT(fft_packed_param(code, packed[2], 2) == 0xABCD, "packed u16 param after u8 params");
+    TEST_ASSERT(fft_packed_param_count(packed[3]) == 0, "packed no params");
+
+    // Unpacking must match the expanded reader.
+    fft_span_t expanded_span = { code, sizeof(code), 0 };
+    fft_instruction_t expanded[FFT_INSTRUCTION_MAX];
+    uint16_t expanded_count = fft_instructions_read(&expanded_span, expanded);
+    TEST_ASSERT(expanded_count == count, "packed and expanded counts match");
+    for (uint16_t i = 0; i < count; i++) {
+        fft_instruction_t unpacked = fft_packed_unpack(code, packed[i]);
+        TEST_ASSERT(unpacked.opcode == expanded[i].opcode, "unpacked opcode matches");
+        TEST_ASSERT(unpacked.param_count == expanded[i].param_count, "unpacked param count matches");
+        for (uint8_t j = 0; j < unpacked.param_count; j++) {
+            TEST_ASSERT(unpacked.params[j].type == expanded[i].params[j].type, "unpacked param type matches");
+            TEST_ASSERT(unpacked.params[j].value.u16 == expanded[i].params[j].value.u16, "unpacked param value matches");
+        }
+    }
+
+    return 1;
+}
+
+static int test_event_measure(void) {
+    // clang-format off
+    uint8_t code[] = {
+        0x13, 0x05, 0x06, // ChangeMapBeta(5, 6)
+        0xF1, 0x34, 0x12, // Wait(0x1234)
+        0xDB,             // EventEnd
+    };
+    uint8_t text[] = {
+        0xE2, 0x10, 0xFA, 0xF8, 0xFE, // {Delay: 16}, space, {LB}, delimiter
+        0xD0, 0x01, 0xFF,             // Two-byte character, {Close}
+    };
+    // clang-format on
+
+    static uint8_t event[FFT_EVENT_SIZE];
+    uint32_t text_offset = 4 + sizeof(code);
+    memcpy(event, &text_offset, sizeof(text_offset));
+    memcpy(event + 4, code, sizeof(code));
+    memcpy(event + text_offset, text, sizeof(text));
+
+    fft_event_measure_t measure = fft_event_measure(event);
+    TEST_ASSERT(measure.valid, "measured event is valid");
+    TEST_ASSERT(measure.instruction_count == 3, "measured instruction count");
+
+    // The measured length must match what the reader writes.
+    static char messages[FFT_TEXT_MAX_LEN];
+    fft_span_t text_span = { event + text_offset, FFT_EVENT_SIZE - text_offset, 0 };
+    TEST_ASSERT(fft_text_measure(&text_span) == measure.messages_len, "text measure matches event measure");
+    TEST_ASSERT(text_span.offset == 0, "measure does not advance the span");
+    TEST_ASSERT(fft_text_read(&text_span, messages) == measure.messages_len, "measured text length");
+
+    uint32_t invalid = 0xF2F2F2F2;
+    memcpy(event, &invalid, sizeof(invalid));
+    TEST_ASSERT(!fft_event_measure(event).valid, "invalid event marker");
+
+    return 1;
+}
+
+static int test_vm_run(void) {
+    // clang-format off
+    uint8_t code[] = {
+        0x5F, 0x03, 0x00, 0x04, 0x05, 0x01, 0x02,       // WarpUnit(3, 0, 4, 5, 1, 2)
+        0xF1, 0x1E, 0x00,                               // Wait(30)
+        0x10, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00,       // DisplayMessage(1, 0, 2, 3, 0, ...
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ... 0, 0, 0, 0, 0)
+        0xD1, 0x07,                                     // JumpForward(7)
+        0xF1, 0x64, 0x00,                               // Wait(100), skipped
+        0xD2, 0x07,                                     // ForwardTarget(7)
+        0xDB,                                           // EventEnd
+    };
+    // clang-format on
+
+    fft_span_t span = { code, sizeof(code), 0 };
+    static fft_vm_t vm;
+    fft_vm_init(&vm, &span);
+    fft_vm_run(&vm);
+
+    TEST_ASSERT(vm.halted && !vm.step_limit_reached, "vm halted at event end");
+    TEST_ASSERT(vm.units[3].x == 4 && vm.units[3].y == 5, "vm unit position");
+    TEST_ASSERT(vm.units[3].elevation == 1 && vm.units[3].facing == 2, "vm unit elevation and facing");
+    TEST_ASSERT(vm.frame == 30, "vm skipped wait after jump");
+    TEST_ASSERT(vm.message_count == 1, "vm message count");
+    TEST_ASSERT(vm.messages[0].message_id == 2, "vm message id");
+    TEST_ASSERT(vm.messages[0].unit_id == 3, "vm message unit");
+    TEST_ASSERT(vm.messages[0].frame == 30, "vm message frame");
+
+    return 1;
+}
+
+static int test_instruction_table_scan(void) {
+    uint16_t event_id[] = { 1, 1, 1, 2, 2, 3 };
+    uint16_t index[] = { 0, 1, 2, 0, 1, 0 };
+    uint8_t opcode[] = { FFT_OPCODE_CHANGEMAPBETA, FFT_OPCODE_WAIT, FFT_OPCODE_EVENTEND, FFT_OPCODE_CHANGEMAPBETA, FFT_OPCODE_EVENTEND, FFT_OPCODE_EVENTEND };
+    uint16_t param0[] = { 5, 30, 0, 9, 0, 0 };
+
+    fft_instruction_table_t table = { .row_count = 6, .event_id = event_id, .index = index, .opcode = opcode };
+    table.params[0] = param0;
+
+    uint32_t counts[256];
+    fft_instruction_table_histogram(&table, counts);
+    TEST_ASSERT(counts[FFT_OPCODE_EVENTEND] == 3, "histogram event end count");
+    TEST_ASSERT(counts[FFT_OPCODE_CHANGEMAPBETA] == 2, "histogram change map count");
+    TEST_ASSERT(counts[FFT_OPCODE_WAITWALK] == 0, "histogram missing opcode");
+
+    uint32_t rows[6];
+    uint32_t count = fft_instruction_table_filter(&table, FFT_OPCODE_CHANGEMAPBETA, rows);
+    TEST_ASSERT(count == 2, "filter count");
+    TEST_ASSERT(rows[0] == 0 && rows[1] == 3, "filter rows");
+    TEST_ASSERT(table.event_id[rows[1]] == 2 && table.params[0][rows[1]] == 9, "filter row columns");
+
+    return 1;
+}
+
+static int test_scenario_table_find(void) {
+    static fft_scenario_table_t table;
+    uint16_t keys[] = { 3, 7, 7, 7, 9 };
+    uint16_t ids[] = { 40, 2, 15, 31, 8 };
+    table.usable_count = 5;
+    memcpy(table.index_keys[FFT_SCENARIO_KEY_MAP_ID], keys, sizeof(keys));
+    memcpy(table.index_ids[FFT_SCENARIO_KEY_MAP_ID], ids, sizeof(ids));
+
+    const uint16_t* found = NULL;
+    uint16_t count = fft_scenario_table_find(&table, FFT_SCENARIO_KEY_MAP_ID, 7, &found);
+    TEST_ASSERT(count == 3, "find count");
+    TEST_ASSERT(found[0] == 2 && found[2] == 31, "find ids");
+
+    count = fft_scenario_table_find(&table, FFT_SCENARIO_KEY_MAP_ID, 9, &found);
+    TEST_ASSERT(count == 1 && found[0] == 8, "find last key");
+
+    count = fft_scenario_table_find(&table, FFT_SCENARIO_KEY_MAP_ID, 5, &found);
+    TEST_ASSERT(count == 0, "find missing key");
+
+    return 1;
+}
+
+static int test_story_graph(void) {
+    // 0 -> (1, 3) -> 2
+    static fft_scenario_table_t table;
+    static fft_story_graph_t graph;
+    uint16_t event_ids[] = { 10, 11, 12, 11 };
+    uint16_t next_event_ids[] = { 11, 12, 0, 12 };
+    for (uint16_t i = 0; i < 4; i++) {
+        table.usable[i] = true;
+        table.scenarios[i].event_id = event_ids[i];
+        table.scenarios[i].next_event_id = next_event_ids[i];
+        table.scenarios[i].next_step = next_event_ids[i] ? FFT_NEXTSTEP_EVENT : FFT_NEXTSTEP_WORLD_MAP;
+    }
+    table.usable_count = 4;
+    uint16_t keys[] = { 10, 11, 11, 12 };
+    uint16_t ids[] = { 0, 1, 3, 2 };
+    memcpy(table.index_keys[FFT_SCENARIO_KEY_EVENT_ID], keys, sizeof(keys));
+    memcpy(table.index_ids[FFT_SCENARIO_KEY_EVENT_ID], ids, sizeof(ids));
+
+    graph = fft_story_graph_build(&table);
+
+    const uint16_t* successors = NULL;
+    TEST_ASSERT(fft_story_graph_successors(&graph, 0, &successors) == 2, "story successor count");
+    TEST_ASSERT(successors[0] == 1 && successors[1] == 3, "story successors");
+    TEST_ASSERT(fft_story_graph_is_reachable(&graph, 0, 2), "story reachable");
+    TEST_ASSERT(!fft_story_graph_is_reachable(&graph, 2, 0), "story not reachable");
+
+    TEST_ASSERT(graph.topo_count == 4 && graph.topo_order[0] == 0 && graph.topo_order[3] == 2, "story topo order");
+    TEST_ASSERT(graph.depth[0] == 0 && graph.depth[3] == 1 && graph.depth[2] == 2, "story depth");
+
+    uint16_t path[FFT_SCENARIO_COUNT];
+    TEST_ASSERT(fft_story_graph_shortest_path(&graph, 0, 2, path) == 3, "story path length");
+    TEST_ASSERT(path[0] == 0 && path[1] == 1 && path[2] == 2, "story path");
+    TEST_ASSERT(fft_story_graph_shortest_path(&graph, 2, 0, path) == 0, "story no path");
+
+    return 1;
+}
+
+static int test_story_graph_cycle(void) {
+    // 0 -> 1 <-> 2, and 1 -> 3
+    static fft_scenario_table_t table;
+    static fft_story_graph_t graph;
+    uint16_t event_ids[] = { 10, 11, 12, 12 };
+    uint16_t next_event_ids[] = { 11, 12, 11, 0 };
+    for (uint16_t i = 0; i < 4; i++) {
+        table.usable[i] = true;
+        table.scenarios[i].event_id = event_ids[i];
+        table.scenarios[i].next_event_id = next_event_ids[i];
+        table.scenarios[i].next_step = next_event_ids[i] ? FFT_NEXTSTEP_EVENT : FFT_NEXTSTEP_WORLD_MAP;
+    }
+    table.usable_count = 4;
+    uint16_t ids[] = { 0, 1, 2, 3 };
+    memcpy(table.index_keys[FFT_SCENARIO_KEY_EVENT_ID], event_ids, sizeof(event_ids));
+    memcpy(table.index_ids[FFT_SCENARIO_KEY_EVENT_ID], ids, sizeof(ids));
+
+    graph = fft_story_graph_build(&table);
+
+    TEST_ASSERT(fft_story_graph_is_reachable(&graph, 1, 1), "cycle reaches itself");
+    TEST_ASSERT(fft_story_graph_is_reachable(&graph, 2, 2), "cycle reaches itself both ways");
+    TEST_ASSERT(!fft_story_graph_is_reachable(&graph, 0, 0), "cycle entry does not reach itself");
+    TEST_ASSERT(fft_story_graph_is_reachable(&graph, 0, 2), "cycle reachable from entry");
+    TEST_ASSERT(graph.topo_count == 1 && graph.depth[1] == FFT_STORY_DEPTH_NONE, "cycle is not ordered");
+    TEST_ASSERT(graph.depth[3] == FFT_STORY_DEPTH_NONE, "node after a cycle is not ordered");
+    TEST_ASSERT(fft_story_graph_is_reachable(&graph, 2, 3) && !fft_story_graph_is_reachable(&graph, 3, 3), "node after a cycle does not reach itself");
+
+    uint16_t path[FFT_SCENARIO_COUNT];
+    TEST_ASSERT(fft_story_graph_shortest_path(&graph, 0, 2, path) == 3, "cycle path length");
+    TEST_ASSERT(fft_story_graph_shortest_path(&graph, 2, 1, path) == 2 && path[1] == 1, "cycle path back");
+
+    return 1;
+}
+
+static int test_entd_decode(void) {
+    uint8_t data[FFT_ENTD_SIZE] = { 0 };
+
+    // Slot 2 holds the only unit
+    uint8_t* unit = &data[2 * FFT_ENTD_UNIT_SIZE];
+    unit[0x00] = 0x80; // sprite set
+    unit[0x03] = 12;   // level
+    unit[0x0A] = 0x4A; // job
+    unit[0x0C] = 0x34; // reaction
+    unit[0x0D] = 0x01;
+    unit[0x18] = 0x28; // team 2, controllable
+    unit[0x19] = 5;    // x
+    unit[0x1A] = 9;    // y
+    unit[0x1B] = 0x83; // upper level, facing 3
+
+    fft_entd_unit_t units[FFT_ENTD_UNIT_MAX];
+    uint8_t count = fft_entd_decode(data, units);
+    TEST_ASSERT(count == 1, "entd skips empty slots");
+    TEST_ASSERT(units[0].slot == 2, "entd unit slot");
+    TEST_ASSERT(units[0].sprite_set == 0x80 && units[0].level == 12 && units[0].job == 0x4A, "entd unit fields");
+    TEST_ASSERT(units[0].reaction == 0x0134, "entd unit u16 field");
+    TEST_ASSERT(units[0].team == 2 && units[0].controllable, "entd unit team and control");
+    TEST_ASSERT(units[0].x == 5 && units[0].y == 9, "entd unit position");
+    TEST_ASSERT(units[0].facing == 3 && units[0].upper_level, "entd unit facing and level");
+
+    TEST_ASSERT(fft_entd_file(0x000) == F_BATTLE__ENTD1_ENT, "entd file first");
+    TEST_ASSERT(fft_entd_file(0x17F) == F_BATTLE__ENTD3_ENT, "entd file middle");
+    TEST_ASSERT(fft_entd_file(0x1FF) == F_BATTLE__ENTD4_ENT, "entd file last");
+
+    return 1;
+}
+
+// Writes sector_count raw sectors where each payload byte is
+// (sector * 16 + offset) & 0xFF, and makes it the current context's disc.
+static FILE* test_disc_create(uint32_t sector_count) {
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        return NULL;
+    }
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        uint8_t raw[FFT_IO_SECTOR_SIZE_RAW] = { 0 };
+        for (uint32_t i = 0; i < FFT_IO_SECTOR_SIZE; i++) {
+            raw[FFT_IO_SECTOR_HEADER_SIZE + i] = (uint8_t)((sector * 16) + i);
+        }
+        fwrite(raw, 1, sizeof(raw), file);
+    }
+    fft_ctx_get_current()->io.file = file;
+    return file;
+}
+
+static void test_disc_destroy(FILE* file) {
+    fclose(file);
+    fft_ctx_get_current()->io.file = NULL;
+}
+
+static int test_io_read_at(void) {
+    FILE* file = test_disc_create(3);
+    TEST_ASSERT(file != NULL, "create temp disc");
+
+    // Crosses from sector 1 into sector 2
+    fft_span_t span = fft_io_read_at(0, FFT_IO_SECTOR_SIZE + FFT_IO_SECTOR_SIZE - 2, 4);
+    TEST_ASSERT(span.size == 4, "read at size");
+    TEST_ASSERT(span.data[0] == (uint8_t)(16 + 2046) && span.data[1] == (uint8_t)(16 + 2047), "read at first sector bytes");
+    TEST_ASSERT(span.data[2] == 32 && span.data[3] == 33, "read at second sector bytes");
+    fft_io_close(span);
+
+    test_disc_destroy(file);
+    return 1;
+}
+
+static int test_io_stats(void) {
+    FILE* file = test_disc_create(3);
+    TEST_ASSERT(file != NULL, "create temp disc");
+
+    TEST_ASSERT(fft_io_entry_for_sector(24) == F_SCUS_942_21, "entry for first sector");
+    TEST_ASSERT(fft_io_entry_for_sector(197) == F_SCUS_942_21, "entry for last sector");
+    TEST_ASSERT(fft_io_entry_for_sector(198) == F_SCEAP_DAT, "entry for next file");
+    TEST_ASSERT(fft_io_entry_for_sector(0) == F_FILE_COUNT, "entry for unindexed sector");
+    for (uint16_t i = 0; i < F_FILE_COUNT; i++) {
+        const fft_io_desc_t* desc = &fft_io_file_list[i];
+        if (desc->size > 0) {
+            uint32_t last = desc->sector + ((desc->size - 1) / FFT_IO_SECTOR_SIZE);
+            TEST_ASSERT(fft_io_entry_for_sector(desc->sector) == i && fft_io_entry_for_sector(last) == i, "entry for every file");
+        }
+    }
+
+    fft_io_stats_reset();
+    fft_io_close(fft_io_read_at(0, FFT_IO_SECTOR_SIZE - 2, 4));
+    fft_io_close(fft_io_read_at(0, 0, 8));
+
+    fft_io_stats_t stats;
+    fft_io_stats_snapshot(&stats);
+    const fft_io_counters_t* other = &stats.files[F_FILE_COUNT];
+    TEST_ASSERT(stats.total.reads == 2 && other->reads == 2, "stats reads");
+    TEST_ASSERT(stats.total.sectors == 3 && other->sectors == 3, "stats sectors");
+    TEST_ASSERT(stats.total.bytes == 12 && other->bytes == 12, "stats bytes");
+    TEST_ASSERT(stats.total.seeks == 3 && stats.total.syscalls == 6, "stats seeks and syscalls");
+
+    fft_io_stats_reset();
+    fft_io_stats_snapshot(&stats);
+    TEST_ASSERT(stats.total.reads == 0 && stats.files[F_FILE_COUNT].bytes == 0, "stats reset");
+
+    test_disc_destroy(file);
+    return 1;
+}
+
+enum {
+    TEST_PACK_TEXTURE_PIXELS = 16, // Offset of the pixels, after fft_pack_texture_t
+    TEST_PACK_TEXTURE_SIZE = TEST_PACK_TEXTURE_PIXELS + (FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT),
+};
+
+static int test_pack_roundtrip(void) {
+    const char* path = "test_pack.fftpack";
+
+    static fft_mesh_t mesh;
+    mesh.meta.polygon_count = 2;
+    mesh.geometry.polygons[1].vertices[2].position.x = 1234;
+    mesh.terrain.x_count = 3;
+
+    uint32_t raw = 0xCAFEF00D;
+    fft_pack_writer_t* writer = fft_pack_writer_begin(path);
+    TEST_ASSERT(writer != NULL, "pack writer started");
+    fft_pack_writer_add(writer, FFT_PACK_EVENT, 9, 0, &raw, sizeof(raw));
+    fft_pack_writer_add_mesh(writer, 49, 0, FFT_RECORDTYPE_MESH_PRIMARY, &mesh);
+    TEST_ASSERT(fft_pack_writer_end(writer), "pack written");
+
+    fft_pack_t pack;
+    TEST_ASSERT(!fft_pack_open(path, &pack), "undersized event entry is rejected");
+
+    TEST_ASSERT(sizeof(fft_pack_texture_t) <= TEST_PACK_TEXTURE_PIXELS, "test texture layout");
+
+    // A texture whose pixels end past the entry.
+    static uint8_t texture[TEST_PACK_TEXTURE_SIZE];
+    fft_pack_texture_t* texture_header = (fft_pack_texture_t*)texture;
+    texture_header->pixels_offset = TEST_PACK_TEXTURE_PIXELS + 16;
+    writer = fft_pack_writer_begin(path);
+    fft_pack_writer_add(writer, FFT_PACK_TEXTURE, 9, 1, texture, sizeof(texture));
+    TEST_ASSERT(fft_pack_writer_end(writer), "pack written");
+    TEST_ASSERT(!fft_pack_open(path, &pack), "texture pixels out of bounds are rejected");
+
+    // A mesh entry cut short of its polygons.
+    static uint8_t short_mesh[sizeof(fft_pack_mesh_t) + 16];
+    fft_pack_mesh_t* short_mesh_header = (fft_pack_mesh_t*)short_mesh;
+    short_mesh_header->meta.polygon_count = 2;
+    short_mesh_header->polygons_offset = (uint32_t)(sizeof(short_mesh) - 16);
+    writer = fft_pack_writer_begin(path);
+    fft_pack_writer_add(writer, FFT_PACK_MESH, 49, 0, short_mesh, sizeof(short_mesh));
+    TEST_ASSERT(fft_pack_writer_end(writer), "pack written");
+    TEST_ASSERT(!fft_pack_open(path, &pack), "short mesh entry is rejected");
+
+    // An image whose pixel count wraps to 0 when multiplied by repeat.
+    static uint8_t image[32];
+    fft_pack_image_t* image_header = (fft_pack_image_t*)image;
+    image_header->width = 0x80000000u;
+    image_header->height = 0x80000000u;
+    image_header->repeat = 4;
+    image_header->pixels_offset = sizeof(image);
+    image_header->palettes_offset = sizeof(image);
+    writer = fft_pack_writer_begin(path);
+    fft_pack_writer_add(writer, FFT_PACK_IMAGE, 0, 0, image, sizeof(image));
+    TEST_ASSERT(fft_pack_writer_end(writer), "pack written");
+    TEST_ASSERT(!fft_pack_open(path, &pack), "image with an overflowing pixel count is rejected");
+
+    texture_header->pixels_offset = TEST_PACK_TEXTURE_PIXELS;
+    writer = fft_pack_writer_begin(path);
+    fft_pack_writer_add(writer, FFT_PACK_TEXTURE, 9, 1, texture, sizeof(texture));
+    fft_pack_writer_add_mesh(writer, 49, 0, FFT_RECORDTYPE_MESH_PRIMARY, &mesh);
+    TEST_ASSERT(fft_pack_writer_end(writer), "pack written");
+    TEST_ASSERT(fft_pack_open(path, &pack), "pack opened");
+    TEST_ASSERT(pack.entry_count == 2, "pack entry count");
+
+    uint64_t size = 0;
+    const fft_pack_mesh_t* packed = fft_pack_mesh(&pack, 49, 0);
+    TEST_ASSERT(packed != NULL && fft_pack_find(&pack, FFT_PACK_MESH, 49, 0, &size) == packed, "pack mesh found");
+    TEST_ASSERT((uintptr_t)packed % FFT_PACK_ALIGN == 0, "pack entry aligned");
+    TEST_ASSERT(size == packed->polygons_offset + (2 * sizeof(fft_polygon_t)), "pack mesh stores used polygons only");
+    TEST_ASSERT(fft_pack_texture(&pack, 9, 1) != NULL, "pack texture found");
+    TEST_ASSERT(fft_pack_mesh(&pack, 49, 1) == NULL && fft_pack_map(&pack, 49) == NULL, "missing entries not found");
+
+    static fft_mesh_t expanded;
+    fft_pack_mesh_expand(packed, &expanded);
+    TEST_ASSERT(expanded.geometry.polygons[1].vertices[2].position.x == 1234, "pack mesh polygons");
+    TEST_ASSERT(expanded.terrain.x_count == 3 && expanded.meta.polygon_count == 2, "pack mesh fields");
+    fft_pack_close(&pack);
+    remove(path);
+
+    TEST_ASSERT(!fft_pack_open(__FILE__, &pack), "non pack file is rejected");
+
+    return 1;
+}
+
+static void shared_cache_cook(void* userdata, fft_pack_writer_t* writer) {
+    uint32_t* cooks = (uint32_t*)userdata;
+    (*cooks)++;
+    fft_pack_texture_t texture = { .pixels_offset = 7 };
+    fft_pack_writer_add(writer, FFT_PACK_TEXTURE, 9, 1, &texture, sizeof(texture));
+    fft_pack_writer_add(writer, FFT_PACK_TEXTURE, 9, 2, &texture, sizeof(texture));
+}
+
+static void shared_cache_cook_other(void* userdata, fft_pack_writer_t* writer) {
+    (*(uint32_t*)userdata)++;
+    fft_pack_texture_t texture = { 0 };
+    fft_pack_writer_add(writer, FFT_PACK_TEXTURE, 10, 1, &texture, sizeof(texture));
+}
+
+static void shared_cache_cook_large(void* userdata, fft_pack_writer_t* writer) {
+    static uint8_t data[2 * 1024 * 1024];
+    fft_pack_writer_add(writer, FFT_PACK_MESH, 9, 3, data, sizeof(data));
+}
+
+static int test_shared_cache(void) {
+    const char* name = "/fft_test_shared_cache";
+    fft_shared_cache_unlink(name);
+
+    // Two handles stand in for two processes mapping the same cache.
+    fft_shared_cache_t* first = fft_shared_cache_open(name, 1024 * 1024);
+    fft_shared_cache_t* second = fft_shared_cache_open(name, 0);
+    TEST_ASSERT(first != NULL && second != NULL, "shared cache opened");
+
+    uint32_t cooks = 0;
+    uint64_t size = 0;
+    const fft_pack_texture_t* a = fft_shared_cache_get(first, FFT_PACK_TEXTURE, 9, 1, shared_cache_cook, &cooks, &size);
+    const fft_pack_texture_t* b = fft_shared_cache_get(second, FFT_PACK_TEXTURE, 9, 1, shared_cache_cook, &cooks, NULL);
+    TEST_ASSERT(cooks == 1, "shared cache entry cooked once");
+    TEST_ASSERT(a != NULL && b != NULL && a != b && a->pixels_offset == 7 && b->pixels_offset == 7, "shared cache entry seen by both handles");
+    TEST_ASSERT(size == sizeof(fft_pack_texture_t), "shared cache entry size");
+    TEST_ASSERT(fft_shared_cache_get(second, FFT_PACK_TEXTURE, 9, 2, NULL, NULL, NULL) != NULL, "entries cooked together are published together");
+    TEST_ASSERT(fft_shared_cache_get(second, FFT_PACK_MESH, 9, 0, shared_cache_cook, &cooks, NULL) == NULL, "entry the cook didn't add is NULL");
+    TEST_ASSERT(fft_shared_cache_used(first) == fft_shared_cache_used(second) && fft_shared_cache_used(first) > 0, "shared cache used");
+
+    const uint64_t used = fft_shared_cache_used(first);
+    TEST_ASSERT(fft_shared_cache_get(first, FFT_PACK_MESH, 9, 3, shared_cache_cook_large, NULL, NULL) == NULL, "entry larger than the cache is NULL");
+    TEST_ASSERT(fft_shared_cache_used(first) == used, "entry that didn't fit takes no space");
+    TEST_ASSERT(fft_shared_cache_get(second, FFT_PACK_TEXTURE, 10, 1, shared_cache_cook_other, &cooks, NULL) != NULL, "small entry fits after a large one failed");
+
+    fft_shared_cache_close(second);
+    fft_shared_cache_close(first);
+    TEST_ASSERT(fft_shared_cache_unlink(name), "shared cache unlinked");
+    return 1;
+}
+
+static int test_lz_roundtrip(void) {
+    static uint8_t src[20000];
+    static uint8_t packed[20000 + (20000 / 255) + 16];
+    static uint8_t out[20000];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        // Palette indices, a run of zeros, then bytes that don't repeat
+        src[i] = i < 8000 ? (uint8_t)((i / 3) % 16) : i < 16000 ? 0 : (uint8_t)((i * 2654435761u) >> 24);
+    }
+
+    size_t size = fft_lz_compress(src, sizeof(src), packed, sizeof(packed));
+    TEST_ASSERT(size < sizeof(src) / 2, "lz compresses repeated data");
+    TEST_ASSERT(fft_lz_decompress(packed, size, out, sizeof(out)) && memcmp(src, out, sizeof(src)) == 0, "lz roundtrip");
+    TEST_ASSERT(!fft_lz_decompress(packed, size, out, sizeof(out) - 1), "lz rejects the wrong size");
+    TEST_ASSERT(!fft_lz_decompress(packed, size - 1, out, sizeof(out)), "lz rejects truncated input");
+
+    size = fft_lz_compress(src, 0, packed, sizeof(packed));
+    TEST_ASSERT(fft_lz_decompress(packed, size, out, 0), "lz empty roundtrip");
+    return 1;
+}
+
+static int test_resident_map(void) {
+    static fft_map_data_t map_data;
+    map_data.record_count = 2;
+    map_data.records[0].type = FFT_RECORDTYPE_MESH_PRIMARY;
+    map_data.records[1].type = FFT_RECORDTYPE_MESH_ALT;
+    map_data.primary_mesh.meta.polygon_count = 4;
+    map_data.alt_meshes[0].state.time = FFT_TIME_NIGHT;
+    map_data.alt_meshes[0].meta.polygon_count = 300;
+    map_data.alt_meshes[0].geometry.polygons[299].vertices[0].position.x = 77;
+    map_data.alt_mesh_count = 1;
+
+    fft_resident_t* resident = fft_resident_create(FFT_RESIDENT_COMPRESS_COLD, 1);
+    fft_resident_add_map(resident, 49, &map_data);
+    fft_resident_stats_t stats = fft_resident_stats(resident);
+    TEST_ASSERT(stats.entry_count == 3 && stats.compressed_count == 1, "only the night mesh is compressed");
+    TEST_ASSERT(stats.stored_bytes < stats.raw_bytes, "resident store is smaller than raw");
+
+    const fft_pack_map_t* map = fft_resident_map(resident, 49);
+    TEST_ASSERT(map != NULL && map->mesh_count == 2, "resident map");
+    const fft_pack_mesh_t* night = fft_resident_mesh(resident, 49, 1);
+    TEST_ASSERT(night != NULL && night->meta.polygon_count == 300, "resident night mesh decompressed");
+    TEST_ASSERT(fft_pack_mesh_polygons(night)[299].vertices[0].position.x == 77, "resident night mesh polygons");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 1) == night, "resident hot entry reused");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 0)->meta.polygon_count == 4, "resident primary mesh");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 2) == NULL, "missing resident entry");
+
+    stats = fft_resident_stats(resident);
+    TEST_ASSERT(stats.decompressions == 1 && stats.hot_hits == 1, "resident hot set");
+    fft_resident_destroy(resident);
+    return 1;
+}
+
+static int test_resident_hot_lru(void) {
+    static fft_map_data_t map_data;
+    map_data.record_count = 3;
+    map_data.records[0].type = FFT_RECORDTYPE_MESH_PRIMARY;
+    map_data.records[1].type = FFT_RECORDTYPE_MESH_ALT;
+    map_data.records[2].type = FFT_RECORDTYPE_MESH_ALT;
+    map_data.primary_mesh.meta.polygon_count = 100;
+    map_data.alt_meshes[0].state.time = FFT_TIME_NIGHT;
+    map_data.alt_meshes[0].meta.polygon_count = 200;
+    map_data.alt_meshes[1].state.weather = FFT_WEATHER_STRONG;
+    map_data.alt_meshes[1].meta.polygon_count = 300;
+    map_data.alt_mesh_count = 2;
+
+    // Every mesh is compressed, including the default state one.
+    fft_resident_t* resident = fft_resident_create(FFT_RESIDENT_COMPRESS_ALL, 2);
+    fft_resident_add_map(resident, 49, &map_data);
+    fft_resident_stats_t stats = fft_resident_stats(resident);
+    TEST_ASSERT(stats.entry_count == 4 && stats.compressed_count == 3, "compress all compresses every mesh");
+
+    const fft_pack_mesh_t* primary = fft_resident_mesh(resident, 49, 0);
+    TEST_ASSERT(primary != NULL && primary->meta.polygon_count == 100, "compressed primary mesh");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 1)->meta.polygon_count == 200, "first alt mesh");
+
+    // Reading the primary again makes the first alt mesh the least recently
+    // used, so the second alt mesh replaces it and the primary stays hot.
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 0) == primary, "primary still hot");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 2)->meta.polygon_count == 300, "second alt mesh");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 0) == primary, "primary survives eviction");
+    stats = fft_resident_stats(resident);
+    TEST_ASSERT(stats.decompressions == 3 && stats.hot_hits == 2, "least recently used buffer evicted");
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 1)->meta.polygon_count == 200, "evicted mesh decompressed again");
+    TEST_ASSERT(fft_resident_stats(resident).decompressions == 4, "evicted mesh was not hot");
+
+    // Adding sorts the entries again on the next read, which moves them, so
+    // nothing read before the add is a hot hit.
+    fft_resident_add_map(resident, 50, &map_data);
+    TEST_ASSERT(fft_resident_mesh(resident, 49, 0)->meta.polygon_count == 100, "primary after add");
+    stats = fft_resident_stats(resident);
+    TEST_ASSERT(stats.decompressions == 5 && stats.hot_hits == 2, "hot buffers cleared by add");
+    TEST_ASSERT(fft_resident_mesh(resident, 50, 2)->meta.polygon_count == 300, "added map mesh");
+
+    fft_resident_destroy(resident);
+    return 1;
+}
+
+static void io_pipeline_check(void* arg, uint32_t index, fft_span_t* span) {
+    // Request i reads the first byte of sector i % 8
+    uint32_t* matches = (uint32_t*)arg;
+    if (span->size == 1 && span->data[0] == (uint8_t)((index % 8) * 16)) {
+        (*matches)++;
+    }
+}
+
+static int test_io_pipeline(void) {
+    FILE* file = test_disc_create(8);
+    TEST_ASSERT(file != NULL, "create temp disc");
+
+    // More requests than staging buffers so buffers are reused.
+    fft_io_request_t requests[32];
+    for (uint32_t i = 0; i < 32; i++) {
+        requests[i] = (fft_io_request_t) { .sector = i % 8, .size = 1 };
+    }
+    uint32_t matches = 0;
+    fft_io_pipeline_run(requests, 32, io_pipeline_check, &matches);
+    TEST_ASSERT(matches == 32, "pipeline decodes every request in order");
+
+    test_disc_destroy(file);
+    return 1;
+}
+
+static int test_ctx_isolation(void) {
+    fft_ctx_t* default_ctx = fft_ctx_get_current();
+    size_t default_count = default_ctx->mem.allocations_current;
+
+    // Any readable file works, nothing is read from it.
+    fft_ctx_t* ctx = fft_ctx_create(__FILE__);
+    fft_ctx_make_current(ctx);
+    TEST_ASSERT(fft_ctx_get_current() == ctx, "context made current");
+
+    void* ptr = FFT_MEM_ALLOC(64);
+    TEST_ASSERT(ctx->mem.allocations_current == 1, "allocation tracked in context");
+    TEST_ASSERT(default_ctx->mem.allocations_current == default_count, "default context untouched");
+
+    // Freed from another context, returned to its own.
+    fft_ctx_make_current(NULL);
+    TEST_ASSERT(fft_ctx_get_current() == default_ctx, "default context restored");
+    FFT_MEM_FREE(ptr);
+    TEST_ASSERT(ctx->mem.allocations_current == 0, "allocation returned to its context");
+    TEST_ASSERT(default_ctx->mem.allocations_current == default_count, "default context still untouched");
+
+    fft_ctx_destroy(ctx);
+    return 1;
+}
+
+static void pool_mark_range(void* arg, uint32_t begin, uint32_t end) {
+    uint8_t* marks = (uint8_t*)arg;
+    for (uint32_t i = begin; i < end; i++) {
+        marks[i]++;
+    }
+}
+
+static void pool_count_task(void* arg) {
+    atomic_fetch_add((atomic_uint*)arg, 1);
+}
+
+static int test_pool_parallel_for(void) {
+    static uint8_t marks[10000];
+    memset(marks, 0, sizeof(marks));
+
+    fft_pool_t* pool = fft_pool_create(4);
+    TEST_ASSERT(fft_pool_worker_count(pool) == 4, "pool worker count");
+
+    fft_executor_t executor = fft_pool_executor(pool);
+    fft_executor_parallel_for(&executor, 10000, 7, pool_mark_range, marks);
+    bool all_once = true;
+    for (uint32_t i = 0; i < 10000; i++) {
+        all_once = all_once && marks[i] == 1;
+    }
+    TEST_ASSERT(all_once, "parallel for visits each item once");
+
+    fft_executor_parallel_for(NULL, 10000, 7, pool_mark_range, marks);
+    TEST_ASSERT(marks[0] == 2 && marks[9999] == 2, "serial executor visits each item");
+
+    atomic_uint count;
+    atomic_init(&count, 0);
+    for (uint32_t i = 0; i < 100; i++) {
+        fft_pool_submit(pool, pool_count_task, &count);
+    }
+    fft_pool_wait(pool);
+    TEST_ASSERT(atomic_load(&count) == 100, "submitted tasks all ran");
+
+    fft_pool_destroy(pool);
+    return 1;
+}
+
+// Decoding into caller storage must match reading the 4bpp image and its clut
+// separately and palettizing.
+static int test_image_palettized_into(void) {
+    fft_image_desc_t desc = { .width = 8, .height = 4, .pal_offset = 16, .pal_count = 2 };
+    uint8_t data[16 + (2 * FFT_IMAGE_PAL_COL_COUNT * 2)];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+
+    static uint8_t pixels[8 * 4 * 4];
+    TEST_ASSERT(fft_image_measure(desc) == sizeof(pixels), "image measure");
+    TEST_ASSERT(fft_image_palette_measure(desc) == 2 * FFT_IMAGE_PAL_ROW_SIZE, "palette measure");
+    fft_span_t span = { .data = data, .size = sizeof(data) };
+    fft_image_read_4bpp_palettized_into(&span, desc, 1, pixels);
+    TEST_ASSERT(span.offset == sizeof(data), "palettized read ends after the clut");
+
+    span = (fft_span_t) { .data = data, .size = sizeof(data) };
+    fft_image_t image = fft_image_read_4bpp(&span, desc.width, desc.height);
+    fft_image_t clut = fft_image_read_16bpp(&span, FFT_IMAGE_PAL_COL_COUNT, desc.pal_count);
+    TEST_ASSERT(clut.size == fft_image_palette_measure(desc), "palette measure matches clut");
+    fft_image_palettize(&image, &clut, 1);
+    TEST_ASSERT(image.size == sizeof(pixels) && memcmp(image.data, pixels, sizeof(pixels)) == 0, "palettized into matches palettize");
+
+    fft_image_destroy(&clut);
+    fft_image_destroy(&image);
+    return 1;
+}
+
+// Fast kernels must match their _ref version byte for byte. Inputs are every
+// possible value where that's cheap, random otherwise.
+static int test_image_kernels_match(void) {
+    static uint8_t src[65536 * 2];
+    static uint8_t ref[65536 * 8];
+    static uint8_t fast[65536 * 8];
+
+    // Every 4bpp byte, then random bytes.
+    srand(1234);
+    for (uint32_t i = 0; i < 65536; i++) {
+        src[i] = (uint8_t)(i < 256 ? i : (uint32_t)rand());
+    }
+    fft_image_unpack_4bpp_ref(src, 65536, ref);
+    fft_image_unpack_4bpp(src, 65536, fast);
+    TEST_ASSERT(memcmp(ref, fast, 65536 * 8) == 0, "4bpp unpack matches reference");
+
+    // Every 16bpp value.
+    for (uint32_t i = 0; i < 65536; i++) {
+        src[i * 2] = (uint8_t)(i & 0xFF);
+        src[i * 2 + 1] = (uint8_t)(i >> 8);
+    }
+    fft_image_convert_5551_ref(src, 65536, ref);
+    fft_image_convert_5551(src, 65536, fast);
+    TEST_ASSERT(memcmp(ref, fast, 65536 * 4) == 0, "5551 conversion matches reference");
+
+    // Random pixels covering every palette index, random palette.
+    uint8_t palette[FFT_IMAGE_PAL_ROW_SIZE];
+    for (uint32_t i = 0; i < FFT_IMAGE_PAL_ROW_SIZE; i++) {
+        palette[i] = (uint8_t)rand();
+    }
+    for (uint32_t i = 0; i < 65536; i++) {
+        uint8_t pixel = (uint8_t)(i < 16 ? i : (uint32_t)rand() & 0x0F);
+        memset(&ref[i * 4], pixel, 4);
+    }
+    memcpy(fast, ref, 65536 * 4);
+    fft_image_palettize_pixels_ref(ref, 65536, palette);
+    fft_image_palettize_pixels(fast, 65536, palette);
+    TEST_ASSERT(memcmp(ref, fast, 65536 * 4) == 0, "palettize matches reference");
+
+    return 1;
+}
+
+static int test_fixed16_kernels_match(void) {
+    static fft_fixed16_t values[65536];
+    static float ref[65536];
+    static float fast[65536];
+
+    // Every fixed16 value.
+    for (uint32_t i = 0; i < 65536; i++) {
+        values[i] = (fft_fixed16_t)(int32_t)(i - 32768);
+    }
+    fft_fixed16_to_f32_array_ref(values, 65536, ref);
+    fft_fixed16_to_f32_array(values, 65536, fast);
+    TEST_ASSERT(memcmp(ref, fast, sizeof(ref)) == 0, "fixed16 conversion matches reference");
+    TEST_ASSERT(fast[32768 + 4096] == 1.0f && fast[0] == -8.0f, "fixed16 conversion values");
+
+    return 1;
+}
+
+static int test_trace_write(void) {
+#ifndef FFT_TRACE
+    TEST_ASSERT(!fft_trace_write("test_trace.json"), "trace disabled without FFT_TRACE");
+    return 1;
+#else
+    fft_trace_reset();
+
+    uint8_t text[] = { 0x0A, 0xFA, 0x0B, FFT_TEXT_DELIM };
+    char out[64];
+    fft_span_t span = { .data = text, .size = sizeof(text) };
+    fft_text_read(&span, out);
+
+    const char* path = "test_trace.json";
+    TEST_ASSERT(fft_trace_write(path), "trace written");
+
+    char json[1024] = { 0 };
+    FILE* file = fopen(path, "r");
+    TEST_ASSERT(file != NULL, "trace readable");
+    size_t size = fread(json, 1, sizeof(json) - 1, file);
+    fclose(file);
+    remove(path);
+
+    TEST_ASSERT(size > 0 && strstr(json, "\"traceEvents\"") != NULL, "trace has events array");
+    TEST_ASSERT(strstr(json, "\"name\":\"fft_text_read\",\"ph\":\"B\"") != NULL, "trace has zone begin");
+    TEST_ASSERT(strstr(json, "\"name\":\"fft_text_read\",\"ph\":\"E\"") != NULL, "trace has zone end");
+
+    return 1;
+#endif
+}
+
+/*
+================================================================================
+Disc tests
+
+These need a BIN, real or from tools/fft_gen_disc.c, and run in their own
+context when one is passed on the command line.
+================================================================================
+*/
+
+enum {
+    TEST_TEXTURE_WALK_PEAK_MAX = 16 * 1024 * 1024,
+};
+
+static void texture_walk_count(void* userdata, uint8_t map_id, const fft_texture_t* texture) {
+    (void)map_id;
+    (void)texture;
+    (*(uint32_t*)userdata)++;
+}
+
+static int test_map_texture_read_each(void) {
+    fft_ctx_t* ctx = fft_ctx_get_current();
+    const size_t baseline = ctx->mem.usage_current;
+    ctx->mem.usage_peak = baseline;
+
+    uint32_t count = 0;
+    fft_map_texture_read_each(texture_walk_count, &count);
+    TEST_ASSERT(count > 0, "texture walk visits textures");
+    TEST_ASSERT(ctx->mem.usage_peak - baseline < TEST_TEXTURE_WALK_PEAK_MAX, "texture walk keeps no map data");
+    TEST_ASSERT(ctx->mem.usage_current == baseline, "texture walk frees everything");
+    return 1;
+}
+
+static int test_disc_map_id(void) {
+    for (int i = 1; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (fft_map_list[i].valid) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static int test_map_loader_matches_read(void) {
+    const int map_id = test_disc_map_id();
+    fft_map_data_t* expected = fft_map_data_read(map_id);
+
+    fft_map_loader_t loader;
+    fft_map_loader_begin(&loader, map_id);
+    uint32_t steps = 1;
+    while (!fft_map_loader_step(&loader)) {
+        steps++;
+    }
+    TEST_ASSERT(loader.stage == FFT_MAP_LOADER_STAGE_DONE, "loader completes");
+    TEST_ASSERT(steps > 1, "loader takes several steps");
+    fft_map_data_t* actual = fft_map_loader_finish(&loader);
+
+    TEST_ASSERT(actual->record_count == expected->record_count, "loader record count");
+    TEST_ASSERT(actual->texture_count == expected->texture_count, "loader texture count");
+    TEST_ASSERT(actual->alt_mesh_count == expected->alt_mesh_count, "loader alt mesh count");
+    for (uint8_t i = 0; i < expected->record_count; i++) {
+        TEST_ASSERT(memcmp(actual->records[i].raw, expected->records[i].raw, FFT_RECORD_SIZE) == 0, "loader records");
+    }
+    TEST_ASSERT(memcmp(&actual->primary_mesh.header, &expected->primary_mesh.header, sizeof(fft_mesh_header_t)) == 0, "loader primary mesh");
+    for (uint8_t i = 0; i < expected->texture_count; i++) {
+        const fft_image_t* a = &actual->textures[i].image;
+        const fft_image_t* e = &expected->textures[i].image;
+        TEST_ASSERT(a->size == e->size && memcmp(a->data, e->data, e->size) == 0, "loader textures");
+    }
+
+    fft_map_data_destroy(actual);
+    fft_map_data_destroy(expected);
+    return 1;
+}
+
+static int test_map_loader_cancel(void) {
+    fft_ctx_t* ctx = fft_ctx_get_current();
+    const size_t usage = ctx->mem.usage_current;
+    const size_t allocations = ctx->mem.allocations_current;
+
+    fft_map_loader_t loader;
+    fft_map_loader_begin(&loader, test_disc_map_id());
+    while (loader.stage != FFT_MAP_LOADER_STAGE_DECODE || loader.record_index == 0) {
+        TEST_ASSERT(!fft_map_loader_step(&loader), "loader is midway");
+    }
+    TEST_ASSERT(ctx->mem.usage_current > usage, "loader holds memory midway");
+    fft_map_loader_cancel(&loader);
+
+    TEST_ASSERT(ctx->mem.usage_current == usage, "cancel frees memory");
+    TEST_ASSERT(ctx->mem.allocations_current == allocations, "cancel frees allocations");
+    return 1;
+}
+
+static int test_mesh_read_into(void) {
+    fft_record_t records[FFT_RECORD_MAX];
+    fft_span_t gns = fft_io_open(fft_map_list[test_disc_map_id()].entry);
+    uint8_t record_count = fft_record_read_all(&gns, records);
+    fft_io_close(gns);
+    const fft_record_t* primary = NULL;
+    for (uint8_t i = 0; i < record_count && primary == NULL; i++) {
+        if (records[i].type == FFT_RECORDTYPE_MESH_PRIMARY) {
+            primary = &records[i];
+        }
+    }
+    TEST_ASSERT(primary != NULL, "map has a primary mesh");
+
+    static fft_mesh_t expected;
+    fft_span_t file = fft_io_read(primary->sector, primary->length);
+    expected = fft_mesh_read(&file);
+    const size_t end = file.offset;
+
+    fft_mesh_t* actual = calloc(1, sizeof(fft_mesh_t));
+    file.offset = 0;
+    fft_mesh_read_into(&file, actual);
+    TEST_ASSERT(file.offset == end, "mesh read into consumes the same bytes");
+    fft_io_close(file);
+
+    // Fields are compared one by one since padding isn't copied reliably.
+    TEST_ASSERT(memcmp(&actual->header, &expected.header, sizeof(fft_mesh_header_t)) == 0, "mesh read into header");
+    TEST_ASSERT(actual->meta.polygon_count == expected.meta.polygon_count && actual->meta.polygon_count > 0, "mesh read into polygon count");
+    for (uint16_t i = 0; i < expected.meta.polygon_count; i++) {
+        const fft_polygon_t* a = &actual->geometry.polygons[i];
+        const fft_polygon_t* e = &expected.geometry.polygons[i];
+        TEST_ASSERT(a->type == e->type && memcmp(a->vertices, e->vertices, sizeof(a->vertices)) == 0, "mesh read into vertices");
+        TEST_ASSERT(a->tex.clut == e->tex.clut && a->tex.page == e->tex.page && memcmp(a->tex.texcoords, e->tex.texcoords, sizeof(a->tex.texcoords)) == 0, "mesh read into texinfo");
+        TEST_ASSERT(memcmp(&a->tiles, &e->tiles, sizeof(a->tiles)) == 0, "mesh read into tiles");
+    }
+    TEST_ASSERT(memcmp(&actual->clut, &expected.clut, sizeof(fft_clut_t)) == 0, "mesh read into clut");
+    TEST_ASSERT(memcmp(actual->terrain.tiles, expected.terrain.tiles, sizeof(expected.terrain.tiles)) == 0, "mesh read into terrain");
+    TEST_ASSERT(actual->terrain.x_count == expected.terrain.x_count && actual->terrain.z_count == expected.terrain.z_count, "mesh read into terrain size");
+
+    free(actual);
+    return 1;
+}
+
+static int test_map_measure(void) {
+    const int map_id = test_disc_map_id();
+    fft_map_data_t* map_data = fft_map_data_read(map_id);
+
+    uint32_t disc_size = 0;
+    const fft_record_t* primary = NULL;
+    for (uint8_t i = 0; i < map_data->record_count; i++) {
+        const fft_record_t* record = &map_data->records[i];
+        if (record->type == FFT_RECORDTYPE_MESH_PRIMARY && primary == NULL) {
+            primary = record;
+            disc_size += record->length;
+        }
+    }
+    TEST_ASSERT(primary != NULL, "map has a primary mesh");
+    for (uint8_t i = 0; i < map_data->record_count; i++) {
+        const fft_record_t* record = &map_data->records[i];
+        if (record->type == FFT_RECORDTYPE_TEXTURE && fft_state_is_default(record->state)) {
+            disc_size += record->length;
+            break;
+        }
+    }
+    TEST_ASSERT(fft_map_state_disc_size(map_id, fft_default_state) == disc_size, "map state disc size");
+
+    fft_span_t file = fft_io_read(primary->sector, primary->length);
+    fft_record_meta_t meta = fft_mesh_measure(&file);
+    TEST_ASSERT(file.offset == 0, "mesh measure does not advance the span");
+    const fft_record_meta_t* decoded = &map_data->primary_mesh.meta;
+    TEST_ASSERT(meta.polygon_count == decoded->polygon_count, "mesh measure polygon count");
+    TEST_ASSERT(meta.tex_tri_count == decoded->tex_tri_count && meta.tex_quad_count == decoded->tex_quad_count, "mesh measure textured counts");
+    TEST_ASSERT(meta.untex_tri_count == decoded->untex_tri_count && meta.untex_quad_count == decoded->untex_quad_count, "mesh measure untextured counts");
+    TEST_ASSERT(meta.light_count == decoded->light_count, "mesh measure light count");
+    fft_io_close(file);
+
+    fft_map_data_destroy(map_data);
+    return 1;
+}
+
+static int test_access_log_roundtrip(void) {
+    static fft_scenario_table_t table;
+    table = fft_scenario_table_read();
+    uint16_t scenario_id = 0;
+    while (!table.usable[scenario_id]) {
+        scenario_id++;
+    }
+    const int map_id = test_disc_map_id();
+
+    const char* path = "test_access.fftlog";
+    TEST_ASSERT(fft_access_log_start(path), "access log started");
+    fft_map_data_destroy(fft_map_data_read(map_id));
+    // Without a prefetcher the take loads the bundle itself, which is muted.
+    fft_scenario_bundle_destroy(fft_prefetch_take(scenario_id));
+    fft_access_log_stop();
+    fft_map_data_destroy(fft_map_data_read(map_id)); // Not recording
+
+    fft_access_log_t log = fft_access_log_read(path);
+    remove(path);
+    TEST_ASSERT(log.count == 2, "access log count");
+    TEST_ASSERT(log.records[0].kind == FFT_ACCESS_MAP_READ && log.records[0].id == (uint32_t)map_id, "access log map read");
+    TEST_ASSERT(log.records[1].kind == FFT_ACCESS_PREFETCH_TAKE && log.records[1].id == scenario_id, "access log take without its bundle load");
+    TEST_ASSERT(log.records[0].time_ns <= log.records[1].time_ns, "access log times ordered");
+    fft_access_log_destroy(&log);
+
+    log = fft_access_log_read(__FILE__);
+    TEST_ASSERT(log.count == 0 && log.records == NULL, "non log file is empty");
+
+    return 1;
+}
+
+static int test_instruction_table_read(void) {
+    fft_instruction_table_t table = fft_instruction_table_read(NULL);
+    TEST_ASSERT(table.row_count > 0, "instruction table has rows");
+
+    // Rows of one event are contiguous and in instruction order.
+    const uint16_t event_id = table.event_id[0];
+    static fft_event_t event;
+    event = fft_event_get_event(event_id);
+    TEST_ASSERT(event.valid, "first table event is valid");
+
+    uint32_t rows = 0;
+    while (rows < table.row_count && table.event_id[rows] == event_id) {
+        rows++;
+    }
+    TEST_ASSERT(rows == event.instruction_count, "table rows match event instructions");
+
+    for (uint32_t row = 0; row < rows; row++) {
+        const fft_instruction_t* instruction = &event.instructions[row];
+        TEST_ASSERT(table.index[row] == row, "table row index");
+        TEST_ASSERT(table.opcode[row] == instruction->opcode, "table row opcode");
+        for (uint8_t j = 0; j < FFT_OPCODE_PARAM_MAX; j++) {
+            uint16_t expected = 0; // Params past the instruction's count read as 0
+            if (j < instruction->param_count) {
+                const fft_param_t* param = &instruction->params[j];
+                expected = param->type == FFT_PARAM_TYPE_U16 ? param->value.u16 : param->value.u8;
+            }
+            TEST_ASSERT(table.params[j][row] == expected, "table row param");
+        }
+    }
+
+    fft_instruction_table_destroy(&table);
+    return 1;
+}
+
+// Scenarios fft_prefetch_hint() queues for scenario_id.
+static uint16_t test_prefetch_successors(const fft_scenario_table_t* table, uint16_t scenario_id, uint16_t out_ids[FFT_PREFETCH_QUEUE_MAX]) {
+    const fft_scenario_t* scenario = &table->scenarios[scenario_id];
+    if (!table->usable[scenario_id] || scenario->next_step != FFT_NEXTSTEP_EVENT) {
+        return 0;
+    }
+    const uint16_t* ids = NULL;
+    uint16_t found = fft_scenario_table_find(table, FFT_SCENARIO_KEY_EVENT_ID, scenario->next_event_id, &ids);
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < found && count < FFT_PREFETCH_QUEUE_MAX; i++) {
+        uint8_t map_id = table->scenarios[ids[i]].map_id;
+        if (map_id < FFT_MAP_DESC_LIST_COUNT && fft_map_list[map_id].valid) {
+            out_ids[count++] = ids[i];
+        }
+    }
+    return count;
+}
+
+// Waits until the prefetch worker has drained its queue and finished loading.
+static void test_prefetch_wait_idle(void) {
+    fft_prefetch_t* prefetch = fft_ctx_get_current()->prefetch;
+    for (;;) {
+        pthread_mutex_lock(&prefetch->lock);
+        bool idle = prefetch->queue_count == 0;
+        for (uint32_t i = 0; i < prefetch->slot_count; i++) {
+            idle = idle && prefetch->slots[i].status != FFT_PREFETCH_SLOT_LOADING;
+        }
+        pthread_mutex_unlock(&prefetch->lock);
+        if (idle) {
+            return;
+        }
+        sched_yield();
+    }
+}
+
+static uint16_t test_prefetch_hinted(const fft_scenario_table_t* table, uint16_t skip_id) {
+    uint16_t ids[FFT_PREFETCH_QUEUE_MAX];
+    for (uint16_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+        uint16_t count = test_prefetch_successors(table, i, ids);
+        for (uint16_t j = 0; j < count; j++) {
+            if (ids[j] != skip_id) {
+                return i;
+            }
+        }
+    }
+    return FFT_SCENARIO_COUNT;
+}
+
+static int test_prefetch_take_matches_load(void) {
+    static fft_scenario_table_t table;
+    table = fft_scenario_table_read();
+    const uint16_t hinted = test_prefetch_hinted(&table, FFT_SCENARIO_COUNT);
+    TEST_ASSERT(hinted < FFT_SCENARIO_COUNT, "prefetch has a scenario with successors");
+
+    fft_prefetch_start(&table);
+    fft_prefetch_hint(hinted);
+    test_prefetch_wait_idle();
+    const fft_prefetch_slot_t* slot = &fft_ctx_get_current()->prefetch->slots[0];
+    TEST_ASSERT(slot->status == FFT_PREFETCH_SLOT_READY, "prefetch loads a successor");
+    const uint16_t scenario_id = slot->scenario_id;
+
+    fft_io_stats_t before;
+    fft_io_stats_snapshot(&before);
+    fft_scenario_bundle_t* actual = fft_prefetch_take(scenario_id);
+    fft_io_stats_t after;
+    fft_io_stats_snapshot(&after);
+    TEST_ASSERT(after.cache_hits == before.cache_hits + 1, "prefetch take hits the cache");
+    fft_prefetch_stop();
+
+    fft_scenario_bundle_t* expected = fft_scenario_bundle_load(scenario_id);
+    TEST_ASSERT(actual->scenario.event_id == expected->scenario.event_id && actual->scenario.map_id == expected->scenario.map_id, "prefetch scenario");
+    TEST_ASSERT(actual->record_count == expected->record_count, "prefetch record count");
+    for (uint8_t i = 0; i < expected->record_count; i++) {
+        TEST_ASSERT(memcmp(actual->records[i].raw, expected->records[i].raw, FFT_RECORD_SIZE) == 0, "prefetch records");
+    }
+    TEST_ASSERT(memcmp(&actual->primary_mesh.header, &expected->primary_mesh.header, sizeof(fft_mesh_header_t)) == 0, "prefetch primary mesh");
+    const fft_image_t* a = &actual->texture.image;
+    const fft_image_t* e = &expected->texture.image;
+    TEST_ASSERT(a->size == e->size && memcmp(a->data, e->data, e->size) == 0, "prefetch texture");
+    TEST_ASSERT(memcmp(actual->event.data, expected->event.data, FFT_EVENT_SIZE) == 0, "prefetch event");
+    TEST_ASSERT(memcmp(actual->entd, expected->entd, FFT_ENTD_SIZE) == 0, "prefetch entd");
+
+    fft_scenario_bundle_destroy(actual);
+    fft_scenario_bundle_destroy(expected);
+    return 1;
+}
+
+static int test_prefetch_evicts(void) {
+    static fft_scenario_table_t table;
+    table = fft_scenario_table_read();
+    fft_ctx_t* ctx = fft_ctx_get_current();
+    const size_t usage = ctx->mem.usage_current;
+    const size_t allocations = ctx->mem.allocations_current;
+
+    fft_prefetch_start_slots(&table, 1);
+    fft_prefetch_hint(test_prefetch_hinted(&table, FFT_SCENARIO_COUNT));
+    test_prefetch_wait_idle();
+    const fft_prefetch_slot_t* slot = &ctx->prefetch->slots[0];
+    TEST_ASSERT(slot->status == FFT_PREFETCH_SLOT_READY, "prefetch fills the slot");
+    const uint16_t first_id = slot->scenario_id;
+
+    const uint16_t hinted = test_prefetch_hinted(&table, first_id);
+    TEST_ASSERT(hinted < FFT_SCENARIO_COUNT, "prefetch has another successor");
+    fft_prefetch_hint(hinted);
+    test_prefetch_wait_idle();
+    TEST_ASSERT(slot->status == FFT_PREFETCH_SLOT_READY && slot->scenario_id != first_id, "prefetch evicts the older bundle");
+    TEST_ASSERT(fft_prefetch_find_slot(ctx->prefetch, first_id) == NULL, "prefetch drops the evicted bundle");
+
+    fft_prefetch_stop();
+    TEST_ASSERT(ctx->mem.usage_current == usage, "prefetch stop frees memory");
+    TEST_ASSERT(ctx->mem.allocations_current == allocations, "prefetch stop frees allocations");
+    return 1;
+}
+
+static int run_disc_tests(const char* filename) {
+    fft_ctx_t* ctx = fft_ctx_create(filename);
+    fft_ctx_make_current(ctx);
+
+    RUN_TEST(test_map_texture_read_each);
+    RUN_TEST(test_map_loader_matches_read);
+    RUN_TEST(test_map_loader_cancel);
+    RUN_TEST(test_map_measure);
+    RUN_TEST(test_mesh_read_into);
+    RUN_TEST(test_access_log_roundtrip);
+    RUN_TEST(test_instruction_table_read);
+    RUN_TEST(test_prefetch_take_matches_load);
+    RUN_TEST(test_prefetch_evicts);
+
+    fft_ctx_make_current(NULL);
+    fft_ctx_destroy(ctx);
+    return 0;
+}
+
+int main(int argc, char** argv) {
     printf("Running tests...\n\n");
 
     // Span tests
@@ -405,6 +1608,7 @@ int main(void) {
     RUN_TEST(test_span_read_u32);
     RUN_TEST(test_span_read_i32);
     RUN_TEST(test_span_read_bytes);
+    RUN_TEST(test_span_read_arrays);
 
     // Memory tests
     RUN_TEST(test_mem_basic_alloc_free);
@@ -412,6 +1616,18 @@ int main(void) {
     RUN_TEST(test_mem_peak_tracking);
     RUN_TEST(test_mem_total_tracking);
     RUN_TEST(test_mem_alloc_with_tag);
+    RUN_TEST(test_ctx_isolation);
+
+    // Thread pool tests
+    RUN_TEST(test_pool_parallel_for);
+
+    // Kernel tests
+    RUN_TEST(test_image_kernels_match);
+    RUN_TEST(test_image_palettized_into);
+    RUN_TEST(test_fixed16_kernels_match);
+
+    // Tracing tests
+    RUN_TEST(test_trace_write);
 
     // String function tests
     RUN_TEST(test_time_str);
@@ -423,9 +1639,38 @@ int main(void) {
 
     // Record parsing tests
     RUN_TEST(test_record_parsing);
+    RUN_TEST(test_record_layout_decode);
 
     // IO function tests
     RUN_TEST(test_io_file_desc_lookup);
+    RUN_TEST(test_io_read_at);
+    RUN_TEST(test_io_stats);
+    RUN_TEST(test_pack_roundtrip);
+    RUN_TEST(test_shared_cache);
+    RUN_TEST(test_lz_roundtrip);
+    RUN_TEST(test_resident_map);
+    RUN_TEST(test_resident_hot_lru);
+    RUN_TEST(test_io_pipeline);
+
+    // Instruction tests
+    RUN_TEST(test_instructions_pack);
+    RUN_TEST(test_event_measure);
+    RUN_TEST(test_vm_run);
+    RUN_TEST(test_instruction_table_scan);
+
+    // Scenario tests
+    RUN_TEST(test_scenario_table_find);
+    RUN_TEST(test_story_graph);
+    RUN_TEST(test_story_graph_cycle);
+    RUN_TEST(test_entd_decode);
+
+    if (argc > 1) {
+        if (run_disc_tests(argv[1]) != 0) {
+            return 1;
+        }
+    } else {
+        printf("Skipping disc tests, no BIN given\n");
+    }
 
     printf("\nAll tests passed!\n");
     return 0;
@@ -0,0 +1,453 @@
+// Benchmarks for the hot decode paths. Results are printed as JSON.
+//
+// Usage: fft_bench [path/to/fft.bin]
+//
+// Benchmarks that only decode bytes run on synthetic data. Benchmarks that
+// need the disc are listed under "skipped" when the BIN can't be opened.
+#include <stdio.h>
+
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
+enum {
+    BENCH_MIN_TIME_NS = 200 * 1000 * 1000,
+    BENCH_MAX_ITERATIONS = 1 << 24,
+    BENCH_SPAN_SIZE = 64 * 1024,
+    BENCH_TEXT_SIZE = 4096,
+    BENCH_IO_SIZE = 64 * FFT_IO_SECTOR_SIZE,
+    BENCH_MAP_ID = 1,
+
+    // Synthetic mesh layout. The header is followed by geometry and terrain.
+    BENCH_MESH_GEOMETRY = 0x200,
+    BENCH_MESH_TEX_TRIS = 256,
+    BENCH_MESH_TEX_QUADS = 512,
+    BENCH_MESH_UNTEX_TRIS = 32,
+    BENCH_MESH_UNTEX_QUADS = 128,
+    BENCH_TERRAIN_X = 16,
+    BENCH_TERRAIN_Z = 16,
+    BENCH_TERRAIN_SIZE = 2 + (FFT_TERRAIN_MAX_Y * BENCH_TERRAIN_X * BENCH_TERRAIN_Z * 8),
+
+    // Pixels per kernel run, the size of a map texture.
+    BENCH_KERNEL_PIXELS = FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT,
+};
+
+typedef void (*bench_fn)(void);
+
+typedef struct {
+    const char* name;
+    bench_fn fn;
+    bool needs_disc;
+    size_t bytes_per_op;
+} bench_t;
+
+typedef struct {
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+} bench_result_t;
+
+// Written by every benchmark so the compiler can't drop the work.
+static volatile uint64_t bench_sink;
+
+static uint8_t span_data[BENCH_SPAN_SIZE];
+static uint8_t texture_data[(FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT / 2) + (FFT_IMAGE_PAL_COL_COUNT * FFT_IMAGE_PAL_COL_COUNT * 2)];
+static uint8_t text_data[BENCH_TEXT_SIZE];
+static uint8_t code_data[FFT_INSTRUCTION_MAX * 4];
+static size_t code_size;
+static size_t mesh_size;
+static uint8_t mesh_data[BENCH_MESH_GEOMETRY + (64 * 1024) + BENCH_TERRAIN_SIZE];
+
+static uint8_t kernel_out[BENCH_KERNEL_PIXELS * 4];
+static uint8_t lz_raw[BENCH_KERNEL_PIXELS];
+static uint8_t lz_packed[BENCH_KERNEL_PIXELS + (BENCH_KERNEL_PIXELS / 255) + 16];
+static uint8_t lz_out[BENCH_KERNEL_PIXELS];
+static size_t lz_packed_size;
+static uint8_t kernel_ref[BENCH_KERNEL_PIXELS * 4];
+static uint8_t kernel_palette[FFT_IMAGE_PAL_ROW_SIZE];
+static fft_fixed16_t fixed16_data[BENCH_SPAN_SIZE / 2];
+static float fixed16_out[BENCH_SPAN_SIZE / 2];
+
+static char text_out[BENCH_TEXT_SIZE * 32];
+static fft_instruction_t instructions[FFT_INSTRUCTION_MAX];
+static fft_packed_instruction_t packed[FFT_INSTRUCTION_MAX];
+static fft_mesh_t mesh;
+static fft_terrain_t terrain;
+
+/*
+================================================================================
+Synthetic Data
+================================================================================
+*/
+
+static void write_u16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void write_u32(uint8_t* out, uint32_t value) {
+    write_u16(out, (uint16_t)(value & 0xFFFF));
+    write_u16(out + 2, (uint16_t)(value >> 16));
+}
+
+static void setup_synthetic_data(void) {
+    // Arbitrary bytes. Every byte value is a valid 4bpp pixel pair.
+    for (size_t i = 0; i < sizeof(span_data); i++) {
+        span_data[i] = (uint8_t)((i * 31) ^ (i >> 8));
+    }
+    for (size_t i = 0; i < sizeof(texture_data); i++) {
+        texture_data[i] = (uint8_t)((i * 31) ^ (i >> 8));
+    }
+
+    // The first byte of each color is its own index, so palettizing the same
+    // pixels again gives the same result and the benchmark can run in place.
+    for (uint32_t i = 0; i < FFT_IMAGE_PAL_ROW_SIZE; i++) {
+        kernel_palette[i] = (uint8_t)((i % 4) == 0 ? i / 4 : i * 13);
+    }
+    memcpy(fixed16_data, span_data, sizeof(fixed16_data));
+
+    // Single byte characters with a space and delimiter mixed in.
+    for (size_t i = 0; i < sizeof(text_data); i++) {
+        uint8_t byte = (uint8_t)(i % 0xD0);
+        if (i % 7 == 6) {
+            byte = 0xFA;
+        } else if (i % 97 == 96) {
+            byte = FFT_TEXT_DELIM;
+        }
+        text_data[i] = byte;
+    }
+
+    // Every known opcode in order with zeroed parameters, repeated.
+    const size_t opcode_count = sizeof(opcode_desc_list) / sizeof(opcode_desc_list[0]);
+    uint32_t instruction_count = 0;
+    while (instruction_count < FFT_INSTRUCTION_MAX - 1) {
+        for (size_t i = 0; i < opcode_count && instruction_count < FFT_INSTRUCTION_MAX - 1; i++) {
+            fft_opcode_desc_t desc = opcode_desc_list[i];
+            if (desc.name == NULL) {
+                continue;
+            }
+            size_t size = 1 + fft_param_layout_size(&fft_param_layout_list[fft_opcode_layout_list[desc.opcode]], desc.param_count);
+            if (code_size + size > sizeof(code_data)) {
+                instruction_count = FFT_INSTRUCTION_MAX;
+                break;
+            }
+            code_data[code_size] = (uint8_t)desc.opcode;
+            code_size += size;
+            instruction_count++;
+        }
+    }
+
+    // Mesh header pointing at the geometry and terrain. Everything else is 0.
+    uint8_t* geometry = &mesh_data[BENCH_MESH_GEOMETRY];
+    write_u16(geometry + 0, BENCH_MESH_TEX_TRIS);
+    write_u16(geometry + 2, BENCH_MESH_TEX_QUADS);
+    write_u16(geometry + 4, BENCH_MESH_UNTEX_TRIS);
+    write_u16(geometry + 6, BENCH_MESH_UNTEX_QUADS);
+
+    const size_t tex_polys = BENCH_MESH_TEX_TRIS + BENCH_MESH_TEX_QUADS;
+    size_t geometry_size = 8;
+    geometry_size += (size_t)(BENCH_MESH_TEX_TRIS + BENCH_MESH_UNTEX_TRIS) * 3 * 6;   // Triangle positions
+    geometry_size += (size_t)(BENCH_MESH_TEX_QUADS + BENCH_MESH_UNTEX_QUADS) * 4 * 6; // Quad positions
+    geometry_size += (size_t)BENCH_MESH_TEX_TRIS * 3 * 6;                             // Triangle normals
+    geometry_size += (size_t)BENCH_MESH_TEX_QUADS * 4 * 6;                            // Quad normals
+    geometry_size += (size_t)BENCH_MESH_TEX_TRIS * 10;                                // Triangle texinfo
+    geometry_size += (size_t)BENCH_MESH_TEX_QUADS * 12;                               // Quad texinfo
+    geometry_size += (size_t)(BENCH_MESH_UNTEX_TRIS + BENCH_MESH_UNTEX_QUADS) * 4;    // Untextured info
+    geometry_size += tex_polys * 2;                                                   // Tile locations
+    for (size_t i = 8; i < geometry_size; i++) {
+        geometry[i] = (uint8_t)(i * 7);
+    }
+
+    const uint32_t terrain_offset = (uint32_t)(BENCH_MESH_GEOMETRY + geometry_size);
+    uint8_t* terrain_data = &mesh_data[terrain_offset];
+    terrain_data[0] = BENCH_TERRAIN_X;
+    terrain_data[1] = BENCH_TERRAIN_Z;
+
+    write_u32(&mesh_data[0x40], BENCH_MESH_GEOMETRY);
+    write_u32(&mesh_data[0x68], terrain_offset);
+    mesh_size = terrain_offset + BENCH_TERRAIN_SIZE;
+
+    // A texture cooked to one palette index per pixel, as resident maps store it.
+    for (size_t i = 0; i < BENCH_KERNEL_PIXELS / 2; i++) {
+        lz_raw[i * 2] = texture_data[i] & 0x0F;
+        lz_raw[(i * 2) + 1] = texture_data[i] >> 4;
+    }
+    lz_packed_size = fft_lz_compress(lz_raw, sizeof(lz_raw), lz_packed, sizeof(lz_packed));
+}
+
+/*
+================================================================================
+Benchmarks
+================================================================================
+*/
+
+static void bench_span_read_u16(void) {
+    fft_span_t span = { .data = span_data, .size = sizeof(span_data) };
+    uint64_t sum = 0;
+    while (span.offset < span.size) {
+        sum += fft_span_read_u16(&span);
+    }
+    bench_sink = sum;
+}
+
+static void bench_span_read_u32(void) {
+    fft_span_t span = { .data = span_data, .size = sizeof(span_data) };
+    uint64_t sum = 0;
+    while (span.offset < span.size) {
+        sum += fft_span_read_u32(&span);
+    }
+    bench_sink = sum;
+}
+
+static void bench_image_read_4bpp(void) {
+    fft_span_t span = { .data = texture_data, .size = sizeof(texture_data) };
+    fft_image_t image = fft_image_read_4bpp(&span, FFT_TEXTURE_WIDTH, FFT_TEXTURE_HEIGHT);
+    bench_sink = image.data[image.size - 1];
+    fft_image_destroy(&image);
+}
+
+static void bench_image_read_4bpp_palettized(void) {
+    fft_image_desc_t desc = {
+        .width = FFT_TEXTURE_WIDTH,
+        .height = FFT_TEXTURE_HEIGHT,
+        .pal_offset = FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT / 2,
+        .pal_count = FFT_IMAGE_PAL_COL_COUNT,
+    };
+    fft_span_t span = { .data = texture_data, .size = sizeof(texture_data) };
+    fft_image_t image = fft_image_read_4bpp_palettized(&span, desc, 3);
+    bench_sink = image.data[image.size - 1];
+    fft_image_destroy(&image);
+}
+
+static void bench_unpack_4bpp_ref(void) {
+    fft_image_unpack_4bpp_ref(texture_data, BENCH_KERNEL_PIXELS / 2, kernel_out);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_unpack_4bpp(void) {
+    fft_image_unpack_4bpp(texture_data, BENCH_KERNEL_PIXELS / 2, kernel_out);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_palettize_ref(void) {
+    fft_image_palettize_pixels_ref(kernel_out, BENCH_KERNEL_PIXELS, kernel_palette);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_palettize(void) {
+    fft_image_palettize_pixels(kernel_out, BENCH_KERNEL_PIXELS, kernel_palette);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_convert_5551_ref(void) {
+    fft_image_convert_5551_ref(texture_data, BENCH_KERNEL_PIXELS / 4, kernel_out);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_convert_5551(void) {
+    fft_image_convert_5551(texture_data, BENCH_KERNEL_PIXELS / 4, kernel_out);
+    bench_sink = kernel_out[0];
+}
+
+static void bench_fixed16_to_f32_ref(void) {
+    fft_fixed16_to_f32_array_ref(fixed16_data, BENCH_SPAN_SIZE / 2, fixed16_out);
+    bench_sink = (uint64_t)fixed16_out[1];
+}
+
+static void bench_fixed16_to_f32(void) {
+    fft_fixed16_to_f32_array(fixed16_data, BENCH_SPAN_SIZE / 2, fixed16_out);
+    bench_sink = (uint64_t)fixed16_out[1];
+}
+
+static void bench_mesh_read(void) {
+    fft_span_t span = { .data = mesh_data, .size = mesh_size };
+    fft_mesh_read_into(&span, &mesh);
+    bench_sink = mesh.meta.polygon_count;
+}
+
+static void bench_terrain_read(void) {
+    fft_span_t span = { .data = mesh_data, .size = mesh_size };
+    fft_span_set_offset(&span, mesh_size - BENCH_TERRAIN_SIZE);
+    fft_terrain_read_into(&span, &terrain);
+    bench_sink = terrain.x_count;
+}
+
+static void bench_text_read(void) {
+    fft_span_t span = { .data = text_data, .size = sizeof(text_data) };
+    bench_sink = fft_text_read(&span, text_out);
+}
+
+static void bench_instructions_read(void) {
+    fft_span_t span = { .data = code_data, .size = code_size };
+    bench_sink = fft_instructions_read(&span, instructions);
+}
+
+static void bench_instructions_pack(void) {
+    fft_span_t span = { .data = code_data, .size = code_size };
+    bench_sink = fft_instructions_pack(&span, packed);
+}
+
+static void bench_lz_compress(void) {
+    bench_sink = fft_lz_compress(lz_raw, sizeof(lz_raw), lz_packed, sizeof(lz_packed));
+}
+
+static void bench_lz_decompress(void) {
+    bench_sink = fft_lz_decompress(lz_packed, lz_packed_size, lz_out, sizeof(lz_out));
+}
+
+static void bench_io_read_at(void) {
+    const uint32_t sector = fft_io_file_list[F_EVENT__TEST_EVT].sector;
+    fft_span_t span = fft_io_read_at(sector, 0, BENCH_IO_SIZE);
+    bench_sink = span.data[span.size - 1];
+    fft_io_close(span);
+}
+
+static void bench_map_data_read(void) {
+    fft_map_data_t* map_data = fft_map_data_read(BENCH_MAP_ID);
+    bench_sink = map_data->record_count;
+    fft_map_data_destroy(map_data);
+}
+
+// Bytes read from the disc for one fft_map_data_read() call.
+static size_t map_data_resource_bytes(void) {
+    fft_map_data_t* map_data = fft_map_data_read(BENCH_MAP_ID);
+    size_t bytes = fft_io_file_list[fft_map_list[BENCH_MAP_ID].entry].size;
+    for (uint32_t i = 0; i < map_data->record_count; i++) {
+        if (fft_map_data_record_has_resource(&map_data->records[i])) {
+            bytes += map_data->records[i].length;
+        }
+    }
+    fft_map_data_destroy(map_data);
+    return bytes;
+}
+
+/*
+================================================================================
+Runner
+================================================================================
+*/
+
+// Fast kernels are only worth timing if they give the same bytes as the
+// reference versions on the benchmark data.
+static void check_kernels(void) {
+    fft_image_unpack_4bpp_ref(texture_data, BENCH_KERNEL_PIXELS / 2, kernel_ref);
+    fft_image_unpack_4bpp(texture_data, BENCH_KERNEL_PIXELS / 2, kernel_out);
+    FFT_ASSERT(memcmp(kernel_ref, kernel_out, sizeof(kernel_out)) == 0, "unpack_4bpp doesn't match reference");
+
+    fft_image_palettize_pixels_ref(kernel_ref, BENCH_KERNEL_PIXELS, kernel_palette);
+    fft_image_palettize_pixels(kernel_out, BENCH_KERNEL_PIXELS, kernel_palette);
+    FFT_ASSERT(memcmp(kernel_ref, kernel_out, sizeof(kernel_out)) == 0, "palettize doesn't match reference");
+
+    fft_image_convert_5551_ref(texture_data, BENCH_KERNEL_PIXELS / 4, kernel_ref);
+    fft_image_convert_5551(texture_data, BENCH_KERNEL_PIXELS / 4, kernel_out);
+    FFT_ASSERT(memcmp(kernel_ref, kernel_out, BENCH_KERNEL_PIXELS) == 0, "convert_5551 doesn't match reference");
+
+    static float fixed16_ref[BENCH_SPAN_SIZE / 2];
+    fft_fixed16_to_f32_array_ref(fixed16_data, BENCH_SPAN_SIZE / 2, fixed16_ref);
+    fft_fixed16_to_f32_array(fixed16_data, BENCH_SPAN_SIZE / 2, fixed16_out);
+    FFT_ASSERT(memcmp(fixed16_ref, fixed16_out, sizeof(fixed16_out)) == 0, "fixed16_to_f32 doesn't match reference");
+
+    bool lz_ok = fft_lz_decompress(lz_packed, lz_packed_size, lz_out, sizeof(lz_out));
+    FFT_ASSERT(lz_ok && memcmp(lz_raw, lz_out, sizeof(lz_out)) == 0, "lz doesn't roundtrip");
+
+    // Leave unpacked pixels for the palettize benchmarks.
+    fft_image_unpack_4bpp(texture_data, BENCH_KERNEL_PIXELS / 2, kernel_out);
+}
+
+// Doubles the iteration count until a run takes at least BENCH_MIN_TIME_NS.
+static bench_result_t bench_run(const bench_t* bench) {
+    fft_ctx_t* ctx = fft_ctx_get_current();
+    bench->fn(); // Warm up
+
+    bench_result_t result = { 0 };
+    for (uint64_t iterations = 1; iterations <= BENCH_MAX_ITERATIONS; iterations *= 2) {
+        size_t allocs_start = ctx->mem.allocations_total;
+        uint64_t start = fft_time_now_ns();
+        for (uint64_t i = 0; i < iterations; i++) {
+            bench->fn();
+        }
+        uint64_t elapsed = fft_time_now_ns() - start;
+        size_t allocs = ctx->mem.allocations_total - allocs_start;
+
+        result.iterations = iterations;
+        result.ns_per_op = (double)elapsed / (double)iterations;
+        result.allocs_per_op = (double)allocs / (double)iterations;
+        if (elapsed >= BENCH_MIN_TIME_NS) {
+            break;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : "../heretic/fft.bin";
+
+    // Probe first because fft_init() asserts when the BIN is missing.
+    FILE* probe = fopen(filename, "rb");
+    bool has_disc = probe != NULL;
+    if (has_disc) {
+        fclose(probe);
+        fft_init(filename);
+    } else {
+        fft_mem_init(fft_ctx_get_current());
+    }
+
+    setup_synthetic_data();
+    check_kernels();
+
+    bench_t benches[] = {
+        { "span_read_u16", bench_span_read_u16, false, sizeof(span_data) },
+        { "span_read_u32", bench_span_read_u32, false, sizeof(span_data) },
+        { "image_read_4bpp", bench_image_read_4bpp, false, FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT / 2 },
+        { "image_read_4bpp_palettized", bench_image_read_4bpp_palettized, false, sizeof(texture_data) },
+        { "unpack_4bpp_ref", bench_unpack_4bpp_ref, false, BENCH_KERNEL_PIXELS / 2 },
+        { "unpack_4bpp", bench_unpack_4bpp, false, BENCH_KERNEL_PIXELS / 2 },
+        { "palettize_ref", bench_palettize_ref, false, BENCH_KERNEL_PIXELS * 4 },
+        { "palettize", bench_palettize, false, BENCH_KERNEL_PIXELS * 4 },
+        { "convert_5551_ref", bench_convert_5551_ref, false, BENCH_KERNEL_PIXELS / 2 },
+        { "convert_5551", bench_convert_5551, false, BENCH_KERNEL_PIXELS / 2 },
+        { "fixed16_to_f32_ref", bench_fixed16_to_f32_ref, false, BENCH_SPAN_SIZE },
+        { "fixed16_to_f32", bench_fixed16_to_f32, false, BENCH_SPAN_SIZE },
+        { "mesh_read", bench_mesh_read, false, mesh_size },
+        { "terrain_read", bench_terrain_read, false, BENCH_TERRAIN_SIZE },
+        { "text_read", bench_text_read, false, sizeof(text_data) },
+        { "instructions_read", bench_instructions_read, false, code_size },
+        { "instructions_pack", bench_instructions_pack, false, code_size },
+        { "lz_compress", bench_lz_compress, false, sizeof(lz_raw) },
+        { "lz_decompress", bench_lz_decompress, false, sizeof(lz_raw) },
+        { "io_read_at", bench_io_read_at, true, BENCH_IO_SIZE },
+        { "map_data_read", bench_map_data_read, true, has_disc ? map_data_resource_bytes() : 0 },
+    };
+    const size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+
+    printf("{\n  \"benchmarks\": [");
+    bool first = true;
+    for (size_t i = 0; i < bench_count; i++) {
+        const bench_t* bench = &benches[i];
+        if (bench->needs_disc && !has_disc) {
+            continue;
+        }
+        fprintf(stderr, "Running %s...\n", bench->name);
+        bench_result_t result = bench_run(bench);
+        double mb_per_s = (double)bench->bytes_per_op / result.ns_per_op * 1e9 / (1024.0 * 1024.0);
+
+        printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"bytes_per_op\": %zu, \"mb_per_s\": %.2f, \"allocs_per_op\": %.2f}",
+            first ? "" : ",", bench->name, (unsigned long long)result.iterations, result.ns_per_op, bench->bytes_per_op, mb_per_s, result.allocs_per_op);
+        first = false;
+    }
+    printf("\n  ],\n  \"skipped\": [");
+    first = true;
+    for (size_t i = 0; i < bench_count; i++) {
+        if (benches[i].needs_disc && !has_disc) {
+            printf("%s\"%s\"", first ? "" : ", ", benches[i].name);
+            first = false;
+        }
+    }
+    printf("]\n}\n");
+
+    if (has_disc) {
+        fft_shutdown();
+    } else {
+        fft_mem_shutdown(fft_ctx_get_current());
+    }
+    return 0;
+}
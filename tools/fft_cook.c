@@ -0,0 +1,84 @@
+// Cooks a pack file from the disc: the scenario table, every valid map, every
+// valid event and every image descriptor, decoded once so they can be memory
+// mapped with fft_pack_open(). See "Cooked Pack" in fft.h.
+//
+// Usage: fft_cook [path/to/fft.bin] [path/to/out.pack]
+//
+// The pack is opened again before exiting to check it.
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
+typedef struct {
+    fft_pack_writer_t* writer;
+    uint32_t count;
+} cook_events_t;
+
+static void cook_event(void* userdata, uint16_t event_id, const fft_event_t* event) {
+    cook_events_t* events = (cook_events_t*)userdata;
+    fft_pack_writer_add_event(events->writer, event_id, event);
+    events->count++;
+}
+
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : "../heretic/fft.bin";
+    const char* pack_path = argc > 2 ? argv[2] : "fft.pack";
+
+    fft_init(filename);
+    uint64_t start = fft_time_now_ns();
+
+    fft_pack_writer_t* writer = fft_pack_writer_begin(pack_path);
+    if (writer == NULL) {
+        fprintf(stderr, "Failed to create %s\n", pack_path);
+        fft_shutdown();
+        return EXIT_FAILURE;
+    }
+
+    fft_scenario_table_t* table = malloc(sizeof(fft_scenario_table_t));
+    FFT_ASSERT(table != NULL, "Failed to allocate scenario table");
+    *table = fft_scenario_table_read();
+    fft_pack_writer_add_scenarios(writer, table);
+    free(table);
+
+    // One map at a time, since every map holds all of its meshes.
+    uint32_t map_count = 0;
+    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (!fft_map_list[i].valid) {
+            continue;
+        }
+        fft_map_data_t* map_data = fft_map_data_read((int)fft_map_list[i].id);
+        fft_pack_writer_add_map(writer, fft_map_list[i].id, map_data);
+        fft_map_data_destroy(map_data);
+        map_count++;
+    }
+
+    cook_events_t events = { .writer = writer };
+    fft_event_read_each(cook_event, &events);
+
+    for (uint32_t i = 0; i < FFT_IMAGE_DESC_COUNT; i++) {
+        fft_pack_writer_add_image(writer, i);
+    }
+
+    if (!fft_pack_writer_end(writer)) {
+        fprintf(stderr, "Failed to write %s\n", pack_path);
+        fft_shutdown();
+        return EXIT_FAILURE;
+    }
+    uint64_t elapsed_ns = fft_time_now_ns() - start;
+
+    fft_pack_t pack;
+    if (!fft_pack_open(pack_path, &pack)) {
+        fprintf(stderr, "Failed to open %s after writing it\n", pack_path);
+        fft_shutdown();
+        return EXIT_FAILURE;
+    }
+    printf("Cooked %u maps, %u events and %u images into %s: %u entries, %.2f MB in %.3fs\n",
+        map_count, events.count, (uint32_t)FFT_IMAGE_DESC_COUNT, pack_path, pack.entry_count,
+        FFT_BYTES_TO_MB(pack.size), (double)elapsed_ns / 1e9);
+    fft_pack_close(&pack);
+
+    fft_shutdown();
+    return EXIT_SUCCESS;
+}
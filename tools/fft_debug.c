@@ -7,6 +7,7 @@
 void read_scenarios(void);
 void read_map_data(void);
 void read_events(void);
+void read_entds(void);
 
 int main(void) {
     fft_init("../heretic/fft.bin");
@@ -14,20 +15,22 @@ int main(void) {
         read_scenarios();
         read_map_data();
         read_events();
+        read_entds();
     }
     fft_shutdown();
 }
 
 void read_map_data(void) {
-    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
-        fft_map_desc_t desc = fft_map_list[i];
-        if (desc.valid == false) {
-            continue;
-        }
+    fft_pool_t* pool = fft_pool_create(0);
+    fft_executor_t executor = fft_pool_executor(pool);
 
-        fft_map_data_t* data = fft_map_data_read(desc.id);
-        fft_map_data_destroy(data);
+    static fft_map_data_t* maps[FFT_MAP_DESC_LIST_COUNT];
+    fft_map_data_read_all(&executor, maps);
+    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        fft_map_data_destroy(maps[i]);
     }
+
+    fft_pool_destroy(pool);
 }
 
 void read_scenarios(void) {
@@ -51,3 +54,8 @@ void read_events(void) {
         FFT_ASSERT(event.valid, "Event %d (%s) is not valid", desc.event_id, desc.name);
     }
 }
+
+void read_entds(void) {
+    fft_entd_table_t table = fft_entd_table_read();
+    fft_entd_table_destroy(&table);
+}
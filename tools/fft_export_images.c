@@ -11,6 +11,7 @@
         mkdir(_p, mode);                            \
     } while (0)
 
+static void export_images(void* arg, uint32_t begin, uint32_t end);
 static void write_images_to_disk(fft_span_t* file, fft_image_desc_t desc);
 
 int main(void) {
@@ -18,24 +19,39 @@ int main(void) {
 
     fft_init("../heretic/fft.bin");
     {
-        for (uint32_t i = 0; i < FFT_IMAGE_DESC_COUNT; i++) {
-            fft_image_desc_t desc = image_desc_list[i];
-            fft_span_t file = fft_io_open(desc.entry);
-            write_images_to_disk(&file, desc);
-            fft_io_close(file);
-        }
+        fft_pool_t* pool = fft_pool_create(0);
+        fft_pool_parallel_for(pool, FFT_IMAGE_DESC_COUNT, 1, export_images, NULL);
+        fft_pool_destroy(pool);
     }
     fft_shutdown();
 }
 
+static void export_images(void* arg, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++) {
+        fft_image_desc_t desc = image_desc_list[i];
+        fft_span_t file = fft_io_open(desc.entry);
+        write_images_to_disk(&file, desc);
+        fft_io_close(file);
+    }
+}
+
 static void write_images_to_disk(fft_span_t* file, fft_image_desc_t desc) {
     uint32_t repeat = desc.repeat > 0 ? desc.repeat : 1;
 
+    // Every image of a descriptor has the same size, so one buffer is reused.
+    fft_image_t image = {
+        .width = desc.width,
+        .height = desc.height,
+        .size = fft_image_measure(desc),
+        .valid = true,
+    };
+    image.data = FFT_MEM_ALLOC(image.size);
+
     for (uint8_t i = 0; i < repeat; i++) {
         for (uint8_t j = 0; j < desc.pal_count; j++) {
 
             file->offset = desc.data_offset + (desc.repeat_offset * i);
-            fft_image_t image = fft_image_read_4bpp_palettized(file, desc, j);
+            fft_image_read_4bpp_palettized_into(file, desc, j, image.data);
 
             // Write the image to disk
             char path[64];
@@ -51,9 +67,9 @@ static void write_images_to_disk(fft_span_t* file, fft_image_desc_t desc) {
             }
 
             fft_image_write_ppm(&image, path);
-
-            FFT_MEM_FREE(image.data);
         }
     }
+    FFT_MEM_FREE(image.data);
+
     printf("Processed %s\n", desc.name);
 }
@@ -0,0 +1,636 @@
+// Writes a synthetic raw BIN that the library can read in place of the real
+// disc, so the benchmarks and IO tests can run without the game.
+//
+// Usage: fft_gen_disc [path/to/out.bin]
+//
+// Every file the library reads (map GNS files and their resources, TEST.EVT,
+// ATTACK.OUT and the ENTD files) is written at its FFT_IO_INDEX sector with
+// full Mode 2 Form 1 sector headers, EDC and ECC. The content is made up but
+// follows the real layouts. Sectors outside those files are left as holes, so
+// the output is a sparse file that reads back as zeros.
+//
+// The image is loaded back through the library before exiting.
+#include <stdio.h>
+
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
+enum {
+    GEN_SECTOR_MAX = 65536, // GNS records store the sector as a u16
+    GEN_MESH_HEADER_SIZE = 0xC4,
+    GEN_MESH_MAX_SIZE = 64 * 1024,
+    GEN_TEXTURE_SIZE = FFT_TEXTURE_WIDTH * FFT_TEXTURE_HEIGHT / 2,
+    GEN_TILE_SIZE = 28,
+    GEN_HEIGHT_SIZE = 12,
+    GEN_MESSAGE_COUNT = 8,
+};
+
+typedef struct {
+    uint32_t state;
+} gen_rng_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t offset;
+} gen_buffer_t;
+
+static FILE* out_file;
+static uint32_t last_sector;
+
+// Sectors used by indexed files or already handed out for map resources.
+static uint8_t sector_used[GEN_SECTOR_MAX];
+
+static uint8_t ecc_f_lut[256];
+static uint8_t ecc_b_lut[256];
+static uint32_t edc_lut[256];
+
+/*
+================================================================================
+Helpers
+================================================================================
+*/
+
+static uint32_t gen_rng_next(gen_rng_t* rng) {
+    // xorshift32
+    uint32_t x = rng->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng->state = x;
+    return x;
+}
+
+static uint32_t gen_rng_range(gen_rng_t* rng, uint32_t max) {
+    return gen_rng_next(rng) % max;
+}
+
+static void gen_u8(gen_buffer_t* buffer, uint8_t value) {
+    FFT_ASSERT(buffer->offset < buffer->size, "Generated buffer overflow");
+    buffer->data[buffer->offset++] = value;
+}
+
+static void gen_u16(gen_buffer_t* buffer, uint16_t value) {
+    gen_u8(buffer, (uint8_t)(value & 0xFF));
+    gen_u8(buffer, (uint8_t)(value >> 8));
+}
+
+static void gen_u32(gen_buffer_t* buffer, uint32_t value) {
+    gen_u16(buffer, (uint16_t)(value & 0xFFFF));
+    gen_u16(buffer, (uint16_t)(value >> 16));
+}
+
+static void gen_u32_at(gen_buffer_t* buffer, size_t offset, uint32_t value) {
+    size_t saved = buffer->offset;
+    buffer->offset = offset;
+    gen_u32(buffer, value);
+    buffer->offset = saved;
+}
+
+/*
+================================================================================
+Sectors
+================================================================================
+*/
+
+static void ecc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t j = (i << 1) ^ ((i & 0x80) ? 0x11D : 0);
+        ecc_f_lut[i] = (uint8_t)j;
+        ecc_b_lut[i ^ j] = (uint8_t)i;
+        uint32_t edc = i;
+        for (uint32_t k = 0; k < 8; k++) {
+            edc = (edc >> 1) ^ ((edc & 1) ? 0xD8018001 : 0);
+        }
+        edc_lut[i] = edc;
+    }
+}
+
+static uint32_t edc_compute(const uint8_t* data, size_t size) {
+    uint32_t edc = 0;
+    for (size_t i = 0; i < size; i++) {
+        edc = (edc >> 8) ^ edc_lut[(edc ^ data[i]) & 0xFF];
+    }
+    return edc;
+}
+
+// Reed-Solomon product code over the sector. P parity uses 86 columns of 24
+// bytes, Q parity 52 diagonals of 43 bytes.
+static void ecc_compute_block(const uint8_t* src, uint32_t major_count, uint32_t minor_count, uint32_t major_mult, uint32_t minor_inc, uint8_t* dest) {
+    uint32_t size = major_count * minor_count;
+    for (uint32_t major = 0; major < major_count; major++) {
+        uint32_t index = (major >> 1) * major_mult + (major & 1);
+        uint8_t ecc_a = 0;
+        uint8_t ecc_b = 0;
+        for (uint32_t minor = 0; minor < minor_count; minor++) {
+            uint8_t temp = src[index];
+            index += minor_inc;
+            if (index >= size) {
+                index -= size;
+            }
+            ecc_a ^= temp;
+            ecc_b ^= temp;
+            ecc_a = ecc_f_lut[ecc_a];
+        }
+        ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+        dest[major] = ecc_a;
+        dest[major + major_count] = ecc_a ^ ecc_b;
+    }
+}
+
+static uint8_t bcd(uint32_t value) {
+    return (uint8_t)(((value / 10) << 4) | (value % 10));
+}
+
+// Writes one raw Mode 2 Form 1 sector.
+static void write_sector(uint32_t sector, const uint8_t* data, size_t size, bool last) {
+    uint8_t raw[FFT_IO_SECTOR_SIZE_RAW] = { 0 };
+
+    // Sync pattern
+    memset(&raw[1], 0xFF, 10);
+
+    // Address as minutes, seconds and frames, offset by the 2 second pregap.
+    uint32_t lba = sector + 150;
+    raw[12] = bcd(lba / (60 * 75));
+    raw[13] = bcd((lba / 75) % 60);
+    raw[14] = bcd(lba % 75);
+    raw[15] = 2; // Mode 2
+
+    // Subheader, stored twice: file, channel, submode, coding. Submode is data,
+    // with end of record and end of file on the last sector.
+    uint8_t submode = last ? 0x89 : 0x08;
+    raw[18] = submode;
+    raw[22] = submode;
+
+    memcpy(&raw[FFT_IO_SECTOR_HEADER_SIZE], data, size);
+
+    uint32_t edc = edc_compute(&raw[16], 8 + FFT_IO_SECTOR_SIZE);
+    raw[0x818] = (uint8_t)(edc >> 0);
+    raw[0x819] = (uint8_t)(edc >> 8);
+    raw[0x81A] = (uint8_t)(edc >> 16);
+    raw[0x81B] = (uint8_t)(edc >> 24);
+
+    // Mode 2 ECC is computed with the address bytes zeroed.
+    uint8_t address[4];
+    memcpy(address, &raw[12], 4);
+    memset(&raw[12], 0, 4);
+    ecc_compute_block(&raw[12], 86, 24, 2, 86, &raw[0x81C]);
+    ecc_compute_block(&raw[12], 52, 43, 86, 88, &raw[0x8C8]);
+    memcpy(&raw[12], address, 4);
+
+    FFT_ASSERT(fseek(out_file, (long)sector * FFT_IO_SECTOR_SIZE_RAW, SEEK_SET) == 0, "Failed to seek to sector %u", sector);
+    FFT_ASSERT(fwrite(raw, 1, sizeof(raw), out_file) == sizeof(raw), "Failed to write sector %u", sector);
+    last_sector = FFT_MAX(last_sector, sector);
+}
+
+static uint32_t sector_count(size_t size) {
+    return (uint32_t)((size + FFT_IO_SECTOR_SIZE - 1) / FFT_IO_SECTOR_SIZE);
+}
+
+static void write_file(uint32_t sector, const uint8_t* data, size_t size) {
+    uint32_t count = sector_count(size);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t offset = (size_t)i * FFT_IO_SECTOR_SIZE;
+        write_sector(sector + i, data + offset, FFT_MIN(size - offset, (size_t)FFT_IO_SECTOR_SIZE), i == count - 1);
+    }
+}
+
+static void write_entry(fft_io_entry_e entry, const uint8_t* data) {
+    fft_io_desc_t desc = fft_io_file_list[entry];
+    write_file(desc.sector, data, desc.size);
+}
+
+// First fit search for free sectors, starting at hint.
+static uint32_t sector_alloc(uint32_t hint, uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t sector = hint; sector < GEN_SECTOR_MAX; sector++) {
+        run = sector_used[sector] ? 0 : run + 1;
+        if (run == count) {
+            uint32_t start = sector + 1 - count;
+            memset(&sector_used[start], 1, count);
+            return start;
+        }
+    }
+    FFT_ASSERT(false, "Out of free sectors below %d", GEN_SECTOR_MAX);
+    return 0;
+}
+
+/*
+================================================================================
+Maps
+================================================================================
+*/
+
+// Writes a flat-ish floor of textured quads, one per tile, and a terrain grid to
+// match. Night meshes only differ in their lighting.
+static size_t gen_mesh(uint8_t* out, gen_rng_t* rng, uint8_t x_count, uint8_t z_count, bool night) {
+    gen_buffer_t buffer = { .data = out, .size = GEN_MESH_MAX_SIZE, .offset = GEN_MESH_HEADER_SIZE };
+    uint8_t heights[FFT_TERRAIN_MAX_TILES];
+    const uint16_t quads = (uint16_t)(x_count * z_count);
+    for (uint32_t i = 0; i < quads; i++) {
+        heights[i] = (uint8_t)gen_rng_range(rng, 4);
+    }
+
+    // Geometry
+    gen_u32_at(&buffer, 0x40, (uint32_t)buffer.offset);
+    gen_u16(&buffer, 0);     // Textured triangles
+    gen_u16(&buffer, quads); // Textured quads
+    gen_u16(&buffer, 0);     // Untextured triangles
+    gen_u16(&buffer, 0);     // Untextured quads
+
+    static const uint8_t corners[4][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+    for (uint8_t z = 0; z < z_count; z++) {
+        for (uint8_t x = 0; x < x_count; x++) {
+            int16_t y = (int16_t)(-heights[z * x_count + x] * GEN_HEIGHT_SIZE);
+            for (uint32_t c = 0; c < 4; c++) {
+                gen_u16(&buffer, (uint16_t)((x + corners[c][0]) * GEN_TILE_SIZE));
+                gen_u16(&buffer, (uint16_t)y);
+                gen_u16(&buffer, (uint16_t)((z + corners[c][1]) * GEN_TILE_SIZE));
+            }
+        }
+    }
+    for (uint32_t i = 0; i < quads * 4u; i++) {
+        gen_u16(&buffer, 0);
+        gen_u16(&buffer, (uint16_t)-4096); // Facing up, 1.0 in fixed point
+        gen_u16(&buffer, 0);
+    }
+    for (uint32_t i = 0; i < quads; i++) {
+        uint8_t u = (uint8_t)(gen_rng_range(rng, 8) * 32);
+        uint8_t v = (uint8_t)(gen_rng_range(rng, 8) * 32);
+        uint8_t page = (uint8_t)gen_rng_range(rng, 4);
+        gen_u8(&buffer, u);
+        gen_u8(&buffer, v);
+        gen_u8(&buffer, (uint8_t)gen_rng_range(rng, FFT_CLUT_ROW_COUNT));
+        gen_u8(&buffer, 0x78);
+        gen_u8(&buffer, (uint8_t)(u + 31));
+        gen_u8(&buffer, v);
+        gen_u8(&buffer, page);
+        gen_u8(&buffer, 0);
+        gen_u8(&buffer, u);
+        gen_u8(&buffer, (uint8_t)(v + 31));
+        gen_u8(&buffer, (uint8_t)(u + 31));
+        gen_u8(&buffer, (uint8_t)(v + 31));
+    }
+    for (uint8_t z = 0; z < z_count; z++) {
+        for (uint8_t x = 0; x < x_count; x++) {
+            gen_u8(&buffer, (uint8_t)(z << 1));
+            gen_u8(&buffer, x);
+        }
+    }
+
+    // Palettes
+    gen_u32_at(&buffer, 0x44, (uint32_t)buffer.offset);
+    for (uint32_t row = 0; row < FFT_CLUT_ROW_COUNT; row++) {
+        for (uint32_t col = 0; col < FFT_CLUT_ROW_WIDTH; col++) {
+            uint16_t color = (uint16_t)(((col * 2) << 0) | (((row + col) & 0x1F) << 5) | (((row * 2) & 0x1F) << 10));
+            gen_u16(&buffer, col == 0 ? 0 : (uint16_t)(color | 0x8000));
+        }
+    }
+
+    // Lights and background
+    gen_u32_at(&buffer, 0x64, (uint32_t)buffer.offset);
+    const uint16_t brightness = night ? 1024 : 3072;
+    for (uint32_t i = 0; i < 9; i++) {
+        gen_u16(&buffer, (i % 3) == 0 ? brightness : 0);
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        gen_u16(&buffer, (uint16_t)(i * 1000));
+        gen_u16(&buffer, (uint16_t)-2000);
+        gen_u16(&buffer, 1000);
+    }
+    const uint8_t ambient = night ? 16 : 64;
+    for (uint32_t i = 0; i < 3; i++) {
+        gen_u8(&buffer, ambient);
+    }
+    gen_u8(&buffer, night ? 0 : 96); // Background top
+    gen_u8(&buffer, night ? 0 : 128);
+    gen_u8(&buffer, night ? 32 : 224);
+    gen_u8(&buffer, night ? 0 : 32); // Background bottom
+    gen_u8(&buffer, night ? 0 : 48);
+    gen_u8(&buffer, night ? 16 : 96);
+    gen_u8(&buffer, 1);
+    gen_u8(&buffer, 0);
+    gen_u8(&buffer, 0);
+
+    // Terrain. The upper level is left empty.
+    gen_u32_at(&buffer, 0x68, (uint32_t)buffer.offset);
+    gen_u8(&buffer, x_count);
+    gen_u8(&buffer, z_count);
+    for (uint32_t level = 0; level < FFT_TERRAIN_MAX_Y; level++) {
+        for (uint32_t i = 0; i < quads; i++) {
+            gen_u8(&buffer, level == 0 ? (uint8_t)gen_rng_range(rng, 0x30) : 0); // Surface
+            gen_u8(&buffer, 0);
+            gen_u8(&buffer, level == 0 ? heights[i] : 0); // Height
+            gen_u8(&buffer, 0);                           // Depth and slope height
+            gen_u8(&buffer, FFT_SLOPE_FLAT);
+            gen_u8(&buffer, 0);
+            gen_u8(&buffer, 0);
+            gen_u8(&buffer, 0xFF); // Auto camera directions
+        }
+    }
+
+    return buffer.offset;
+}
+
+static void gen_texture(uint8_t* out, gen_rng_t* rng, bool night) {
+    // Tiles of two alternating palette indices, darker at night.
+    const uint8_t base = night ? 1 : 8;
+    for (uint32_t y = 0; y < FFT_TEXTURE_HEIGHT; y++) {
+        for (uint32_t x = 0; x < FFT_TEXTURE_WIDTH; x += 2) {
+            uint8_t tile = (uint8_t)(((x / 32) + (y / 32)) & 1);
+            uint8_t noise = (uint8_t)gen_rng_range(rng, 4);
+            uint8_t pixel = (uint8_t)((base + tile * 3 + noise) & 0x0F);
+            out[(y * FFT_TEXTURE_WIDTH + x) / 2] = (uint8_t)(pixel | (pixel << 4));
+        }
+    }
+}
+
+static void gen_record(gen_buffer_t* gns, fft_recordtype_e type, fft_time_e time, uint32_t sector, uint32_t length) {
+    gen_u16(gns, FFT_RECORD_UNKNOWN_0x22);
+    gen_u8(gns, FFT_LAYOUT_DEFAULT);
+    gen_u8(gns, (uint8_t)(time << 7)); // No weather
+    gen_u16(gns, (uint16_t)type);
+    gen_u16(gns, 0);
+    gen_u16(gns, (uint16_t)sector);
+    gen_u16(gns, 0);
+    gen_u32(gns, length);
+    gen_u16(gns, 0);
+    gen_u16(gns, 0);
+}
+
+// Writes the GNS file of a map along with a day and night mesh and texture.
+static void gen_map(const fft_map_desc_t* map, uint8_t* mesh, uint8_t* texture) {
+    const fft_io_desc_t gns_desc = fft_io_file_list[map->entry];
+    FFT_ASSERT(gns_desc.size > 5 * FFT_RECORD_SIZE, "GNS file for map %d is too small", map->id);
+
+    uint8_t* gns_data = calloc(1, gns_desc.size);
+    FFT_ASSERT(gns_data != NULL, "Failed to allocate GNS file");
+    gen_buffer_t gns = { .data = gns_data, .size = gns_desc.size };
+
+    gen_rng_t rng = { .state = 0x9E3779B9u ^ map->id };
+    const uint8_t x_count = (uint8_t)(8 + gen_rng_range(&rng, 9));
+    const uint8_t z_count = (uint8_t)(8 + gen_rng_range(&rng, 8));
+
+    for (uint32_t t = 0; t < 2; t++) {
+        const bool night = t == 1;
+        const fft_time_e time = night ? FFT_TIME_NIGHT : FFT_TIME_DAY;
+
+        size_t mesh_size = gen_mesh(mesh, &rng, x_count, z_count, night);
+        uint32_t mesh_sector = sector_alloc(gns_desc.sector, sector_count(mesh_size));
+        write_file(mesh_sector, mesh, mesh_size);
+        gen_record(&gns, night ? FFT_RECORDTYPE_MESH_ALT : FFT_RECORDTYPE_MESH_PRIMARY, time, mesh_sector, (uint32_t)mesh_size);
+
+        gen_texture(texture, &rng, night);
+        uint32_t texture_sector = sector_alloc(gns_desc.sector, sector_count(GEN_TEXTURE_SIZE));
+        write_file(texture_sector, texture, GEN_TEXTURE_SIZE);
+        gen_record(&gns, FFT_RECORDTYPE_TEXTURE, time, texture_sector, GEN_TEXTURE_SIZE);
+    }
+    gen_record(&gns, FFT_RECORDTYPE_END, FFT_TIME_DAY, 0, 0);
+
+    write_entry(map->entry, gns_data);
+    free(gns_data);
+}
+
+/*
+================================================================================
+Events, Scenarios and ENTD
+================================================================================
+*/
+
+static void gen_instruction(gen_buffer_t* code, fft_opcode_e opcode, const uint16_t* params) {
+    fft_opcode_desc_t desc = opcode_desc_list[opcode];
+    gen_u8(code, (uint8_t)opcode);
+    for (uint8_t i = 0; i < desc.param_count; i++) {
+        if (desc.param_sizes[i] == FFT_PARAM_TYPE_U16) {
+            gen_u16(code, params[i]);
+        } else {
+            gen_u8(code, (uint8_t)params[i]);
+        }
+    }
+}
+
+// Writes an event that pans the camera, places a few units and shows a handful
+// of messages, followed by the message text.
+static void gen_event(uint8_t* out, uint16_t event_id) {
+    gen_rng_t rng = { .state = 0x85EBCA6Bu ^ event_id };
+    gen_buffer_t event = { .data = out, .size = FFT_EVENT_SIZE, .offset = 4 };
+
+    const uint16_t camera[8] = { 280, 280, (uint16_t)-200, 302, 1536, 2048, 4096, 60 };
+    gen_instruction(&event, FFT_OPCODE_CAMERA, camera);
+
+    const uint32_t unit_count = 2 + gen_rng_range(&rng, 4);
+    for (uint32_t i = 0; i < unit_count; i++) {
+        const uint16_t warp[6] = { (uint16_t)(i + 1), 0, (uint16_t)gen_rng_range(&rng, 8), (uint16_t)gen_rng_range(&rng, 8), 0, (uint16_t)gen_rng_range(&rng, 4) };
+        gen_instruction(&event, FFT_OPCODE_WARPUNIT, warp);
+    }
+
+    const uint32_t message_count = 1 + gen_rng_range(&rng, GEN_MESSAGE_COUNT);
+    for (uint32_t i = 0; i < message_count; i++) {
+        const uint16_t message[10] = { 0x10, 0, (uint16_t)(i + 1), (uint16_t)(1 + (i % unit_count)), 0, 0, 0, 0, 0, 0 };
+        const uint16_t wait[1] = { (uint16_t)(30 + gen_rng_range(&rng, 60)) };
+        const uint16_t rotate[6] = { (uint16_t)(1 + (i % unit_count)), 0, (uint16_t)gen_rng_range(&rng, 4), 0, 0, 0 };
+        gen_instruction(&event, FFT_OPCODE_DISPLAYMESSAGE, message);
+        gen_instruction(&event, FFT_OPCODE_WAIT, wait);
+        gen_instruction(&event, FFT_OPCODE_ROTATEUNIT, rotate);
+    }
+    gen_instruction(&event, FFT_OPCODE_EVENTEND, NULL);
+    gen_u32_at(&event, 0, (uint32_t)event.offset);
+
+    // Messages are runs of letters split into words by spaces. The rest of
+    // the event is padded with spaces.
+    for (uint32_t i = 0; i < message_count; i++) {
+        const uint32_t word_count = 3 + gen_rng_range(&rng, 8);
+        for (uint32_t w = 0; w < word_count; w++) {
+            const uint32_t length = 2 + gen_rng_range(&rng, 6);
+            for (uint32_t c = 0; c < length; c++) {
+                gen_u8(&event, (uint8_t)(0x24 + gen_rng_range(&rng, 26))); // a-z
+            }
+            gen_u8(&event, w == word_count - 1 ? FFT_TEXT_DELIM : 0xFA);
+        }
+    }
+    memset(&out[event.offset], 0xFA, FFT_EVENT_SIZE - event.offset);
+}
+
+static void gen_events(void) {
+    // The file is larger than the event slots, the rest stays zero.
+    const fft_io_desc_t file_desc = fft_io_file_list[F_EVENT__TEST_EVT];
+    FFT_ASSERT(file_desc.size >= FFT_EVENT_COUNT * FFT_EVENT_SIZE, "TEST.EVT is too small for every event");
+    uint8_t* data = calloc(1, file_desc.size);
+    FFT_ASSERT(data != NULL, "Failed to allocate TEST.EVT");
+
+    // Events are stored by event id, not by their place in the description list.
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        memset(&data[i * FFT_EVENT_SIZE], 0xF2, 4); // Invalid event marker
+    }
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        const fft_event_desc_t desc = fft_event_desc_list[i];
+        if (desc.usable && desc.event_id < FFT_EVENT_COUNT) {
+            gen_event(&data[desc.event_id * FFT_EVENT_SIZE], desc.event_id);
+        }
+    }
+
+    write_entry(F_EVENT__TEST_EVT, data);
+    free(data);
+}
+
+// Assigns each usable scenario a valid map and chains them into one story by
+// next_event_id.
+static void gen_scenarios(void) {
+    const fft_io_desc_t desc = fft_io_file_list[F_EVENT__ATTACK_OUT];
+    uint8_t* data = calloc(1, desc.size);
+    FFT_ASSERT(data != NULL, "Failed to allocate ATTACK.OUT");
+
+    uint8_t valid_maps[FFT_MAP_DESC_LIST_COUNT];
+    uint32_t valid_map_count = 0;
+    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (fft_map_list[i].valid) {
+            valid_maps[valid_map_count++] = (uint8_t)i;
+        }
+    }
+
+    int32_t previous = -1;
+    for (uint32_t i = 0; i < FFT_EVENT_COUNT; i++) {
+        const fft_event_desc_t event = fft_event_desc_list[i];
+        if (!event.usable || event.scenario_id >= FFT_SCENARIO_COUNT) {
+            continue;
+        }
+
+        gen_buffer_t row = {
+            .data = &data[FFT_SCENARIO_OFFSET + (event.scenario_id * FFT_SCENARIO_SIZE)],
+            .size = FFT_SCENARIO_SIZE,
+        };
+        gen_u16(&row, event.event_id);
+        gen_u8(&row, valid_maps[event.scenario_id % valid_map_count]);
+        gen_u8(&row, FFT_WEATHER_NONE);
+        gen_u8(&row, (event.scenario_id % 3) == 0 ? FFT_TIME_NIGHT : FFT_TIME_DAY);
+        gen_u8(&row, 0x17); // Music
+        gen_u8(&row, 0x18);
+        gen_u16(&row, (uint16_t)(event.scenario_id % FFT_ENTD_COUNT));
+
+        // Point the previous scenario at this one.
+        if (previous >= 0) {
+            gen_buffer_t previous_row = {
+                .data = &data[FFT_SCENARIO_OFFSET + ((uint32_t)previous * FFT_SCENARIO_SIZE)],
+                .size = FFT_SCENARIO_SIZE,
+                .offset = 18,
+            };
+            gen_u16(&previous_row, event.event_id);
+            gen_u8(&previous_row, FFT_NEXTSTEP_EVENT);
+        }
+        previous = event.scenario_id;
+    }
+
+    write_entry(F_EVENT__ATTACK_OUT, data);
+    free(data);
+}
+
+static void gen_entds(void) {
+    uint8_t* data = calloc(FFT_ENTD_PER_FILE, FFT_ENTD_SIZE);
+    FFT_ASSERT(data != NULL, "Failed to allocate ENTD file");
+
+    for (uint16_t f = 0; f < FFT_ENTD_FILE_COUNT; f++) {
+        memset(data, 0, FFT_ENTD_PER_FILE * FFT_ENTD_SIZE);
+        for (uint32_t i = 0; i < FFT_ENTD_PER_FILE; i++) {
+            gen_rng_t rng = { .state = 0xC2B2AE35u ^ (f * FFT_ENTD_PER_FILE + i) };
+            const uint32_t unit_count = 1 + gen_rng_range(&rng, FFT_ENTD_UNIT_MAX / 2);
+            for (uint32_t u = 0; u < unit_count; u++) {
+                uint8_t* unit = &data[(i * FFT_ENTD_SIZE) + (u * FFT_ENTD_UNIT_SIZE)];
+                const bool enemy = u >= unit_count / 2;
+                unit[0x00] = (uint8_t)(0x80 + gen_rng_range(&rng, 0x40)); // Sprite set
+                unit[0x03] = (uint8_t)(1 + gen_rng_range(&rng, 99));      // Level
+                unit[0x06] = (uint8_t)(40 + gen_rng_range(&rng, 40));     // Brave
+                unit[0x07] = (uint8_t)(40 + gen_rng_range(&rng, 40));     // Faith
+                unit[0x0A] = (uint8_t)(0x4A + gen_rng_range(&rng, 20));   // Job
+                unit[0x18] = (uint8_t)(enemy ? 0x10 : 0x08);              // Team and control
+                unit[0x19] = (uint8_t)gen_rng_range(&rng, 8);             // X
+                unit[0x1A] = (uint8_t)gen_rng_range(&rng, 8);             // Y
+                unit[0x1B] = (uint8_t)gen_rng_range(&rng, 4);             // Facing
+            }
+        }
+        write_entry(fft_entd_file((uint16_t)(f * FFT_ENTD_PER_FILE)), data);
+    }
+    free(data);
+}
+
+/*
+================================================================================
+Verification
+================================================================================
+*/
+
+// Loads everything that was generated. The library asserts on anything it
+// can't parse.
+static void verify(const char* filename) {
+    fft_init(filename);
+    {
+        for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+            if (fft_map_list[i].valid) {
+                fft_map_data_t* map_data = fft_map_data_read((int)i);
+                FFT_ASSERT(map_data->record_count == 4 && map_data->texture_count == 2, "Map %d did not load", i);
+                fft_map_data_destroy(map_data);
+            }
+        }
+
+        fft_scenario_table_t* table = FFT_MEM_ALLOC(sizeof(fft_scenario_table_t));
+        *table = fft_scenario_table_read();
+        for (uint32_t i = 0; i < FFT_SCENARIO_COUNT; i++) {
+            if (table->usable[i]) {
+                fft_scenario_bundle_t* bundle = fft_scenario_bundle_load((uint16_t)i);
+                FFT_ASSERT(bundle->event.valid, "Scenario %d has no event", i);
+                fft_scenario_bundle_destroy(bundle);
+            }
+        }
+        FFT_MEM_FREE(table);
+
+        fft_entd_table_t entds = fft_entd_table_read();
+        FFT_ASSERT(entds.unit_count > 0, "No ENTD units");
+        fft_entd_table_destroy(&entds);
+    }
+    fft_shutdown();
+}
+
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : "fft_synthetic.bin";
+
+    out_file = fopen(filename, "wb");
+    FFT_ASSERT(out_file != NULL, "Failed to open %s", filename);
+
+    ecc_init();
+    for (uint32_t i = 0; i < F_FILE_COUNT; i++) {
+        fft_io_desc_t desc = fft_io_file_list[i];
+        for (uint32_t s = desc.sector; s < desc.sector + sector_count(desc.size) && s < GEN_SECTOR_MAX; s++) {
+            sector_used[s] = 1;
+        }
+    }
+
+    uint8_t* mesh = calloc(1, GEN_MESH_MAX_SIZE);
+    uint8_t* texture = calloc(1, GEN_TEXTURE_SIZE);
+    FFT_ASSERT(mesh != NULL && texture != NULL, "Failed to allocate map buffers");
+    for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+        if (fft_map_list[i].valid) {
+            memset(mesh, 0, GEN_MESH_MAX_SIZE);
+            gen_map(&fft_map_list[i], mesh, texture);
+        }
+    }
+    free(mesh);
+    free(texture);
+
+    gen_events();
+    gen_scenarios();
+    gen_entds();
+
+    // Extend the image to the end of the last file on the disc.
+    uint32_t disc_sectors = 0;
+    for (uint32_t i = 0; i < F_FILE_COUNT; i++) {
+        disc_sectors = FFT_MAX(disc_sectors, fft_io_file_list[i].sector + sector_count(fft_io_file_list[i].size));
+    }
+    if (last_sector + 1 < disc_sectors) {
+        uint8_t empty[FFT_IO_SECTOR_SIZE] = { 0 };
+        write_sector(disc_sectors - 1, empty, sizeof(empty), true);
+    }
+    fclose(out_file);
+
+    verify(filename);
+    printf("Wrote %s (%u sectors)\n", filename, disc_sectors);
+    return 0;
+}
@@ -0,0 +1,301 @@
+// Replays an access log recorded with fft_access_log_start() and reports
+// latency per request kind along with IO and cache statistics.
+//
+// Usage: fft_replay <log> [path/to/fft.bin] [--slots N] [--threads N] [--realtime]
+//
+//   --slots N    Prefetch cache size. 0 disables the prefetcher, so hints are
+//                skipped and takes load directly. Default 4.
+//   --threads N  Threads replaying requests, also the worker count used for
+//                bulk requests. Requests are started in log order. Default 1.
+//                Each thread replays with its own context and prefetcher, so
+//                a hint only helps the takes replayed on the same thread.
+//   --realtime   Wait until each request's recorded time before starting it,
+//                so the prefetcher gets the same head start it had live.
+#define _POSIX_C_SOURCE 200809L // nanosleep()
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FFT_IMPLEMENTATION
+#include "fft.h"
+
+enum {
+    REPLAY_THREAD_MAX = 64,
+    REPLAY_LOADER_BUDGET_US = 2000,
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} replay_kind_stats_t;
+
+typedef struct {
+    const fft_access_log_t* log;
+    const fft_executor_t* executor;
+    const fft_scenario_table_t* table;
+    uint32_t slot_count; // 0 when not prefetching
+    bool realtime;
+    uint64_t start_ns;
+    atomic_uint next;
+} replay_t;
+
+typedef struct {
+    replay_t* replay;
+    pthread_t thread;
+    fft_ctx_t* ctx;
+    fft_io_stats_t* io;
+    replay_kind_stats_t stats[FFT_ACCESS_KIND_COUNT];
+} replay_worker_t;
+
+static void replay_count_event(void* userdata, uint16_t event_id, const fft_event_t* event) {
+    (void)event_id;
+    (void)event;
+    (*(uint32_t*)userdata)++;
+}
+
+static void replay_count_texture(void* userdata, uint8_t map_id, const fft_texture_t* texture) {
+    (void)map_id;
+    (void)texture;
+    (*(uint32_t*)userdata)++;
+}
+
+static void replay_request(const replay_t* replay, const fft_access_record_t* record) {
+    switch ((fft_access_kind_e)record->kind) {
+    case FFT_ACCESS_MAP_READ:
+        fft_map_data_destroy(fft_map_data_read((int)record->id));
+        break;
+    case FFT_ACCESS_MAP_READ_ALL: {
+        fft_map_data_t* maps[FFT_MAP_DESC_LIST_COUNT];
+        fft_map_data_read_all(replay->executor, maps);
+        for (uint32_t i = 0; i < FFT_MAP_DESC_LIST_COUNT; i++) {
+            fft_map_data_destroy(maps[i]);
+        }
+        break;
+    }
+    case FFT_ACCESS_MAP_TEXTURES: {
+        uint32_t count = 0;
+        fft_map_texture_read_each(replay_count_texture, &count);
+        break;
+    }
+    case FFT_ACCESS_MAP_LOADER: {
+        fft_map_loader_t loader;
+        fft_map_loader_begin(&loader, (int)record->id);
+        while (!fft_map_loader_update(&loader, REPLAY_LOADER_BUDGET_US)) { }
+        fft_map_data_destroy(fft_map_loader_finish(&loader));
+        break;
+    }
+    case FFT_ACCESS_SCENARIO:
+        (void)fft_scenario_get_scenario(record->id);
+        break;
+    case FFT_ACCESS_EVENT:
+        (void)fft_event_get_event(record->id);
+        break;
+    case FFT_ACCESS_EVENT_EACH: {
+        uint32_t count = 0;
+        fft_event_read_each(replay_count_event, &count);
+        break;
+    }
+    case FFT_ACCESS_ENTD:
+        (void)fft_entd_get_entd((uint16_t)record->id);
+        break;
+    case FFT_ACCESS_BUNDLE:
+        fft_scenario_bundle_destroy(fft_scenario_bundle_load((uint16_t)record->id));
+        break;
+    case FFT_ACCESS_PREFETCH_HINT:
+        if (replay->slot_count > 0) {
+            fft_prefetch_hint((uint16_t)record->id);
+        }
+        break;
+    case FFT_ACCESS_PREFETCH_TAKE:
+        fft_scenario_bundle_destroy(fft_prefetch_take((uint16_t)record->id));
+        break;
+    default:
+        fprintf(stderr, "Skipping unknown request kind %u\n", record->kind);
+        break;
+    }
+}
+
+static void replay_wait_until(uint64_t time_ns) {
+    for (;;) {
+        uint64_t now = fft_time_now_ns();
+        if (now >= time_ns) {
+            return;
+        }
+        uint64_t wait_ns = time_ns - now;
+        struct timespec ts = { .tv_sec = (time_t)(wait_ns / 1000000000u), .tv_nsec = (long)(wait_ns % 1000000000u) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* replay_worker(void* arg) {
+    replay_worker_t* worker = (replay_worker_t*)arg;
+    replay_t* replay = worker->replay;
+    fft_ctx_make_current(worker->ctx);
+    if (replay->slot_count > 0) {
+        fft_prefetch_start_slots(replay->table, replay->slot_count);
+    }
+
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&replay->next, 1);
+        if (index >= replay->log->count) {
+            break;
+        }
+        const fft_access_record_t* record = &replay->log->records[index];
+        if (replay->realtime) {
+            replay_wait_until(replay->start_ns + record->time_ns);
+        }
+
+        uint64_t start = fft_time_now_ns();
+        replay_request(replay, record);
+        uint64_t elapsed = fft_time_now_ns() - start;
+
+        if (record->kind < FFT_ACCESS_KIND_COUNT) {
+            replay_kind_stats_t* stats = &worker->stats[record->kind];
+            stats->count++;
+            stats->total_ns += elapsed;
+            stats->max_ns = FFT_MAX(stats->max_ns, elapsed);
+        }
+    }
+
+    fft_prefetch_stop();
+    fft_io_stats_snapshot(worker->io);
+    fft_ctx_make_current(NULL);
+    return NULL;
+}
+
+static bool replay_uses_prefetch(const fft_access_log_t* log) {
+    for (uint32_t i = 0; i < log->count; i++) {
+        uint16_t kind = log->records[i].kind;
+        if (kind == FFT_ACCESS_PREFETCH_HINT || kind == FFT_ACCESS_PREFETCH_TAKE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: fft_replay <log> [path/to/fft.bin] [--slots N] [--threads N] [--realtime]\n");
+}
+
+int main(int argc, char** argv) {
+    const char* log_path = NULL;
+    const char* filename = "../heretic/fft.bin";
+    uint32_t slot_count = FFT_PREFETCH_SLOT_DEFAULT;
+    uint32_t thread_count = 1;
+    bool realtime = false;
+
+    bool has_filename = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            slot_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = true;
+        } else if (log_path == NULL) {
+            log_path = argv[i];
+        } else if (!has_filename) {
+            filename = argv[i];
+            has_filename = true;
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (log_path == NULL || slot_count > FFT_PREFETCH_SLOT_MAX || thread_count == 0 || thread_count > REPLAY_THREAD_MAX) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    fft_init(filename);
+
+    fft_access_log_t log = fft_access_log_read(log_path);
+    if (log.count == 0) {
+        fprintf(stderr, "No requests in %s\n", log_path);
+        fft_access_log_destroy(&log);
+        fft_shutdown();
+        return EXIT_FAILURE;
+    }
+
+    static fft_scenario_table_t table;
+    bool prefetch = slot_count > 0 && replay_uses_prefetch(&log);
+    if (prefetch) {
+        table = fft_scenario_table_read();
+    }
+
+    fft_pool_t* pool = fft_pool_create(thread_count);
+    fft_executor_t executor = fft_pool_executor(pool);
+
+    replay_t replay = {
+        .log = &log,
+        .executor = &executor,
+        .table = &table,
+        .slot_count = prefetch ? slot_count : 0,
+        .realtime = realtime,
+    };
+    static replay_worker_t workers[REPLAY_THREAD_MAX];
+    for (uint32_t i = 0; i < thread_count; i++) {
+        workers[i].replay = &replay;
+        workers[i].ctx = fft_ctx_create(filename);
+        workers[i].io = malloc(sizeof(fft_io_stats_t));
+        FFT_ASSERT(workers[i].io != NULL, "Failed to allocate IO stats");
+    }
+
+    replay.start_ns = fft_time_now_ns();
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, FFT_THREAD_STACK_SIZE);
+        int result = pthread_create(&workers[i].thread, &attr, replay_worker, &workers[i]);
+        pthread_attr_destroy(&attr);
+        FFT_ASSERT(result == 0, "Failed to start replay thread");
+    }
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t elapsed_ns = fft_time_now_ns() - replay.start_ns;
+
+    // Each worker counted IO in its own context.
+    fft_io_counters_t io = { 0 };
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        const fft_io_stats_t* stats = workers[i].io;
+        io.reads += stats->total.reads;
+        io.sectors += stats->total.sectors;
+        io.bytes += stats->total.bytes;
+        io.time_ns += stats->total.time_ns;
+        cache_hits += stats->cache_hits;
+        cache_misses += stats->cache_misses;
+        free(workers[i].io);
+        fft_ctx_destroy(workers[i].ctx);
+    }
+
+    printf("Replayed %u requests in %.3fs (threads %u, slots %u%s)\n",
+        log.count, (double)elapsed_ns / 1e9, thread_count, prefetch ? slot_count : 0, realtime ? ", realtime" : "");
+    printf("%-14s %8s %10s %10s\n", "kind", "count", "mean_ms", "max_ms");
+    for (uint32_t kind = 0; kind < FFT_ACCESS_KIND_COUNT; kind++) {
+        replay_kind_stats_t total = { 0 };
+        for (uint32_t i = 0; i < thread_count; i++) {
+            total.count += workers[i].stats[kind].count;
+            total.total_ns += workers[i].stats[kind].total_ns;
+            total.max_ns = FFT_MAX(total.max_ns, workers[i].stats[kind].max_ns);
+        }
+        if (total.count == 0) {
+            continue;
+        }
+        printf("%-14s %8llu %10.3f %10.3f\n", fft_access_kind_str((fft_access_kind_e)kind), (unsigned long long)total.count,
+            (double)total.total_ns / (double)total.count / 1e6, (double)total.max_ns / 1e6);
+    }
+    printf("IO: %llu reads, %llu sectors, %.2f MB, %.3fs\n", (unsigned long long)io.reads,
+        (unsigned long long)io.sectors, FFT_BYTES_TO_MB(io.bytes), (double)io.time_ns / 1e9);
+    printf("Cache: %llu hits, %llu misses\n", (unsigned long long)cache_hits, (unsigned long long)cache_misses);
+
+    fft_pool_destroy(pool);
+    fft_access_log_destroy(&log);
+    fft_shutdown();
+    return EXIT_SUCCESS;
+}